@@ -13,7 +13,7 @@ static const float m_orig[3] = { 0.0f , 0.0f , 0.0f };
 class UnityNavMeshLoader
 {
 public:
-	UnityNavMeshLoader() : m_navMesh(dtAllocNavMesh()) {
+	UnityNavMeshLoader() : m_compactDetailVerts(false), m_navMesh(dtAllocNavMesh()) {
 	}
 
 	~UnityNavMeshLoader() {
@@ -25,6 +25,11 @@ public:
 	
 	bool load(std::string filepath);
 
+	// Stores the detail mesh vertices of the loaded tiles quantized to 16 bits.
+	void setCompactDetailVerts(bool compact) {
+		m_compactDetailVerts = compact;
+	}
+
 	float getCellSize() {
 		return m_cellSize;
 	}
@@ -64,6 +69,7 @@ private:
 	float m_walkableClimb;
 	float m_cellSize;
 	int m_maxTile;
+	bool m_compactDetailVerts;
 
 	dtNavMesh* m_navMesh;
 	//std::string m_meshData[];
@@ -127,6 +133,7 @@ struct dtParam {
 	dtPolyDetailIndex* detailTris;
 	dtBVNode* bvTree;
 	std::vector<OffMesh> *offmesh;
+	bool compactDetailVerts;
 };
 
 
@@ -65,6 +65,17 @@ NavStatus NavMeshQuery_findRandomPoint(NavMeshQuery q, NavPoint pos, dtPolyRef &
 ** [out]   pos    搜索结果
 */
 NavStatus NavMeshQuery_findNearestPointOnPoly(NavMeshQuery q, const NavPoint center, const NavPoint extent, NavPoint pos);
+
+/*
+** 搜索center点extent半径内，落在多边形上的点，优先从上次所在的多边形及其相邻多边形查找
+**
+** [in]    query  dtNavMeshQuery
+** [in]    center 搜索中心点. [(x, y, z)]
+** [in]    extent 搜索半径. [(x, y, z)]
+** [out]   pos    搜索结果
+** [in,out] poly  上次所在的多边形，返回结果所在的多边形
+*/
+NavStatus NavMeshQuery_findNearestPointOnPolyHinted(NavMeshQuery q, const NavPoint center, const NavPoint extent, NavPoint pos, dtPolyRef &poly);
 #ifdef __cplusplus
 }
 #endif
@@ -268,7 +268,8 @@ bool addTile(AssetMeshHeader *header, dtParam *param, dtNavMesh *mesh) {
 	const int polysSize = dtAlign4(sizeof(dtPoly) * totPolyCount);
 	const int linksSize = dtAlign4(sizeof(dtLink) * maxLinkCount);
 	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*header->detailMeshCount);
-	const int detailVertsSize = dtAlign4(sizeof(float) * 3 * header->detailVertCount);
+	const bool compactDetail = param->compactDetailVerts && header->detailVertCount > 0;
+	const int detailVertsSize = dtGetDetailVertsDataSize(header->detailVertCount, compactDetail);
 	const int detailTrisSize = dtAlign4(sizeof(unsigned char) * 4 * header->detailTriCount);
 	const int bvTreeSize = dtAlign4(sizeof(dtBVNode)*header->polyCount * 2);
 	const int offMeshConsSize = dtAlign4(sizeof(dtOffMeshConnection) * storedOffMeshConCount);
@@ -277,7 +278,7 @@ bool addTile(AssetMeshHeader *header, dtParam *param, dtNavMesh *mesh) {
 		detailMeshesSize + detailVertsSize + detailTrisSize +
 		bvTreeSize + offMeshConsSize;
 
-	unsigned char* data = (unsigned char*)dtAlloc(sizeof(unsigned char)*dataSize, DT_ALLOC_PERM);
+	unsigned char* data = (unsigned char*)dtAlloc(sizeof(unsigned char)*dataSize, DT_ALLOC_PERM_TILE_DATA);
 	if (!data)
 	{
 		return false;
@@ -291,7 +292,7 @@ bool addTile(AssetMeshHeader *header, dtParam *param, dtNavMesh *mesh) {
 	dtPoly* navPolys = dtGetThenAdvanceBufferPointer<dtPoly>(d, polysSize);
 	d += linksSize; // Ignore links; just leave enough space for them. They'll be created on load.
 	dtPolyDetail* navDMeshes = dtGetThenAdvanceBufferPointer<dtPolyDetail>(d, detailMeshesSize);
-	float* navDVerts = dtGetThenAdvanceBufferPointer<float>(d, detailVertsSize);
+	unsigned char* navDVerts = dtGetThenAdvanceBufferPointer<unsigned char>(d, detailVertsSize);
 	unsigned char* navDTris = dtGetThenAdvanceBufferPointer<unsigned char>(d, detailTrisSize);
 	dtBVNode* navBvtree = dtGetThenAdvanceBufferPointer<dtBVNode>(d, bvTreeSize);
 	dtOffMeshConnection* offMeshCons = dtGetThenAdvanceBufferPointer<dtOffMeshConnection>(d, offMeshConsSize);
@@ -300,6 +301,8 @@ bool addTile(AssetMeshHeader *header, dtParam *param, dtNavMesh *mesh) {
 	// Store header
 	hd->magic = DT_NAVMESH_MAGIC;
 	hd->version = DT_NAVMESH_VERSION;
+	if (compactDetail)
+		hd->version |= DT_NAVMESH_COMPACT_DETAIL;
 	hd->x = header->x;
 	hd->y = header->y;
 	hd->layer = 0;
@@ -385,7 +388,10 @@ bool addTile(AssetMeshHeader *header, dtParam *param, dtNavMesh *mesh) {
 		dtl.triBase = from->triBase;
 		dtl.triCount = (unsigned char)from->triCount;
 	}
-	memcpy(navDVerts, param->detailVerts, sizeof(float) * 3 * hd->detailVertCount);
+	if (compactDetail)
+		dtQuantizeDetailVerts(param->detailVerts, hd->detailVertCount, (float*)navDVerts, (unsigned short*)(navDVerts + sizeof(float) * 6));
+	else
+		memcpy(navDVerts, param->detailVerts, sizeof(float) * 3 * hd->detailVertCount);
 	for (int i = 0; i < 4 * hd->detailTriCount; ++i) {
 		navDTris[i] = (unsigned char)param->detailTris[i];
 	}
@@ -434,7 +440,7 @@ void update_ts(float sz) {
 	}
 }
 
-void parseTile(dtNavMesh *mesh, const char *buf, int len, std::vector<OffMesh> *offmesh = NULL) {
+void parseTile(dtNavMesh *mesh, const char *buf, int len, std::vector<OffMesh> *offmesh = NULL, bool compactDetailVerts = false) {
 	AssetMeshHeader *header = (AssetMeshHeader *)buf;
 
 	/*
@@ -490,6 +496,7 @@ void parseTile(dtNavMesh *mesh, const char *buf, int len, std::vector<OffMesh> *
 	param.detailTris = navDTris;
 	param.bvTree = navBvtree;
 	param.offmesh = offmesh;
+	param.compactDetailVerts = compactDetailVerts;
 
 	addTile(header, &param, mesh);	
 }
@@ -601,7 +608,7 @@ bool UnityNavMeshLoader::loadText(const char *content, int bufSize) {
 
 	for (int i = 0; i < m_maxTile; i++) {
 		int len = str2hex(m_MeshData[i], row);
-		parseTile(m_navMesh, row, len, &offmesh);
+		parseTile(m_navMesh, row, len, &offmesh, m_compactDetailVerts);
 	}
 	setTileSize(m_navMesh);
 	printf("tileSize = %f, tsc/tiles = %d/%d\n", ts, tsc, m_maxTile);
@@ -673,7 +680,7 @@ bool UnityNavMeshLoader::loadBinary(const char *content, int bufSize) {
 	m_navMesh->init(&params);
 
 	for (int i = 0; i < m_maxTile; i++) {
-		parseTile(m_navMesh, content+index[i], length[i], &offmesh);
+		parseTile(m_navMesh, content+index[i], length[i], &offmesh, m_compactDetailVerts);
 	}
 	//setTileSize(m_navMesh);
 	printf("tileSize = %f, tsc/tiles = %d/%d, offmesh = %lu\n", ts, tsc, m_maxTile, offmesh.size());
@@ -115,7 +115,7 @@ dtNavMesh* loadAll(const char* path)
 		if (!tileHeader.tileRef || !tileHeader.dataSize)
 			break;
 
-		unsigned char* data = (unsigned char*)dtAlloc(tileHeader.dataSize, DT_ALLOC_PERM);
+		unsigned char* data = (unsigned char*)dtAlloc(tileHeader.dataSize, DT_ALLOC_PERM_TILE_DATA);
 		if (!data) break;
 		memset(data, 0, tileHeader.dataSize);
 		readLen = fread(data, tileHeader.dataSize, 1, fp);
@@ -247,7 +247,7 @@ bool testOffMesh(const char *filepath) {
 
 int main(int argc, const char **argv) {
 	if (argc < 2) {
-		fprintf(stderr, "Usage: ./Convertor clientMesh serverMesh\n");
+		fprintf(stderr, "Usage: ./Convertor clientMesh serverMesh [--compact]\n");
 		return -1;
 	}
 
@@ -255,6 +255,8 @@ int main(int argc, const char **argv) {
 	const char *serverMesh = argv[2];
 	
 	UnityNavMeshLoader loader;
+	if (argc > 3 && strcmp(argv[3], "--compact") == 0)
+		loader.setCompactDetailVerts(true);
 	loader.load(clientMesh);
 	saveAll(serverMesh, loader.getNavMesh());
 	//testOffMesh(serverMesh);
@@ -8,6 +8,7 @@
 
 static const int NAVMESHSET_MAGIC = 'M' << 24 | 'S' << 16 | 'E' << 8 | 'T'; //'MSET';
 static const int NAVMESHSET_VERSION = 1;
+static const int MAX_STEER_POINTS = 16; // findFollowPath每次推进直线路径的路点数
 
 struct NavMeshQueryImpl {
     dtNavMeshQuery* navQuery;
@@ -100,7 +101,7 @@ NavStatus NavMesh_create(NavMesh* mesh, const void* buf, size_t sz)
             status = DT_FAILURE | DT_INVALID_PARAM;
             goto error;
         }
-        unsigned char* data = (unsigned char*)dtAlloc(tileHeader->dataSize, DT_ALLOC_PERM);
+        unsigned char* data = (unsigned char*)dtAlloc(tileHeader->dataSize, DT_ALLOC_PERM_TILE_DATA);
         if (!data) {
             status = DT_FAILURE;
             goto error;
@@ -298,9 +299,16 @@ NavStatus NavMeshQuery_findFollowPath(NavMeshQuery q, const NavPoint startPos, c
     if (q->polys[npolys - 1] != endRef)
         q->navQuery->closestPointOnPoly(q->polys[npolys - 1], endPos, epos, 0);
 
+    // 直线路径分段推进，只计算插点用到的部分
+    dtStraightPathState state;
+    status = q->navQuery->initStraightPath(startPos, epos, q->polys, npolys, &state, DT_STRAIGHTPATH_ALL_CROSSINGS);
+    if (dtStatusFailed(status)) {
+        return status;
+    }
+    const int maxSteerPath = dtMin(q->maxPoints, MAX_STEER_POINTS);
     int nsteerPath = 0;
-    status = q->navQuery->findStraightPath(startPos, epos, q->polys, npolys,
-        (float*)q->points2, NULL, q->polys2, &nsteerPath, q->maxPoints, DT_STRAIGHTPATH_ALL_CROSSINGS);
+    status = q->navQuery->updateStraightPath(&state, q->polys, npolys,
+        (float*)q->points2, NULL, q->polys2, &nsteerPath, maxSteerPath);
 
     // 根据step插点
     float iterPos[3];
@@ -309,7 +317,21 @@ NavStatus NavMeshQuery_findFollowPath(NavMeshQuery q, const NavPoint startPos, c
     *pathCount = 1;
 
     int ns = 1;
-    while (ns < nsteerPath && *pathCount < q->maxPoints) {
+    while (!dtStatusFailed(status) && *pathCount < q->maxPoints) {
+        if (ns >= nsteerPath) {
+            if (!dtStatusInProgress(status) || nsteerPath == 0) {
+                break;
+            }
+            // 保留最后一个路点，继续推进直线路径
+            dtVcopy(q->points2[0], q->points2[nsteerPath-1]);
+            q->polys2[0] = q->polys2[nsteerPath-1];
+            nsteerPath = 1;
+            ns = 1;
+            status = q->navQuery->updateStraightPath(&state, q->polys, npolys,
+                (float*)q->points2, NULL, q->polys2, &nsteerPath, maxSteerPath);
+            continue;
+        }
+
         float delta[3], len;
         dtVsub(delta, q->points2[ns], iterPos);
         len = dtMathSqrtf(dtVdot(delta, delta));
@@ -334,8 +356,8 @@ NavStatus NavMeshQuery_findFollowPath(NavMeshQuery q, const NavPoint startPos, c
         *pathCount = *pathCount + 1;
     }
 
-    if (ns < nsteerPath && *pathCount == q->maxPoints) {
-        status |= DT_BUFFER_TOO_SMALL;
+    if (dtStatusInProgress(status) || (ns < nsteerPath && *pathCount == q->maxPoints)) {
+        status = DT_SUCCESS | DT_BUFFER_TOO_SMALL | (status & DT_STATUS_DETAIL_MASK);
     }
     *path = q->points;
     return status;
@@ -383,3 +405,21 @@ NavStatus NavMeshQuery_findNearestPointOnPoly(NavMeshQuery q, const NavPoint cen
     return DT_SUCCESS;
 }
 
+/*
+** 搜索center点extent半径内，落在多边形上的点，优先从上次所在的多边形及其相邻多边形查找
+**
+** [in]    query  dtNavMeshQuery
+** [in]    center 搜索中心点. [(x, y, z)]
+** [in]    extent 搜索半径. [(x, y, z)]
+** [out]   pos    搜索结果
+** [in,out] poly  上次所在的多边形，返回结果所在的多边形
+*/
+NavStatus NavMeshQuery_findNearestPointOnPolyHinted(NavMeshQuery q, const NavPoint center, const NavPoint extent, NavPoint pos, dtPolyRef &poly) {
+    dtPolyRef ref = 0;
+    q->navQuery->findNearestPolyHinted(poly, center, extent, &q->filter, &ref, pos);
+    poly = ref;
+    if(!ref) {
+        return DT_FAILURE | DT_INVALID_PARAM; // 没有搜索到合适的点
+    }
+    return DT_SUCCESS;
+}
@@ -92,12 +92,13 @@ static void drawPolyBoundaries(duDebugDraw* dd, const dtMeshTile* tile,
 			{
 				const unsigned char* t = &tile->detailTris[(pd->triBase+k)*4];
 				const float* tv[3];
+				float dv[3][3];
 				for (int m = 0; m < 3; ++m)
 				{
 					if (t[m] < p->vertCount)
 						tv[m] = &tile->verts[p->verts[t[m]]*3];
 					else
-						tv[m] = &tile->detailVerts[(pd->vertBase+(t[m]-p->vertCount))*3];
+						tv[m] = dtGetDetailVert(tile, pd->vertBase+(t[m]-p->vertCount), dv[m]);
 				}
 				for (int m = 0, n = 2; m < 3; n=m++)
 				{
@@ -150,10 +151,11 @@ static void drawMeshTile(duDebugDraw* dd, const dtNavMesh& mesh, const dtNavMesh
 			const unsigned char* t = &tile->detailTris[(pd->triBase+j)*4];
 			for (int k = 0; k < 3; ++k)
 			{
+				float dv[3];
 				if (t[k] < p->vertCount)
 					dd->vertex(&tile->verts[p->verts[t[k]]*3], col);
 				else
-					dd->vertex(&tile->detailVerts[(pd->vertBase+t[k]-p->vertCount)*3], col);
+					dd->vertex(dtGetDetailVert(tile, pd->vertBase+t[k]-p->vertCount, dv), col);
 			}
 		}
 	}
@@ -470,10 +472,11 @@ void duDebugDrawNavMeshPoly(duDebugDraw* dd, const dtNavMesh& mesh, dtPolyRef re
 			const unsigned char* t = &tile->detailTris[(pd->triBase+i)*4];
 			for (int j = 0; j < 3; ++j)
 			{
+				float dv[3];
 				if (t[j] < poly->vertCount)
 					dd->vertex(&tile->verts[poly->verts[t[j]]*3], c);
 				else
-					dd->vertex(&tile->detailVerts[(pd->vertBase+t[j]-poly->vertCount)*3], c);
+					dd->vertex(dtGetDetailVert(tile, pd->vertBase+t[j]-poly->vertCount, dv), c);
 			}
 		}
 		dd->end();
@@ -23,10 +23,17 @@
 
 /// Provides hint values to the memory allocator on how long the
 /// memory is expected to be used.
+/// The persistent memory of the navigation mesh, the queries and the crowd is tagged
+/// with the category of its owner, so that a custom allocator can attribute it.
+/// All the hints other than #DT_ALLOC_TEMP are persistent.
 enum dtAllocHint
 {
-	DT_ALLOC_PERM,		///< Memory persist after a function call.
-	DT_ALLOC_TEMP		///< Memory used temporarily within a function.
+	DT_ALLOC_PERM,				///< Memory persist after a function call.
+	DT_ALLOC_TEMP,				///< Memory used temporarily within a function.
+	DT_ALLOC_PERM_NAVMESH,		///< Persistent memory of a navigation mesh, other than the tile data.
+	DT_ALLOC_PERM_TILE_DATA,	///< Persistent tile data, loaded or built.
+	DT_ALLOC_PERM_NAVQUERY,		///< Persistent memory of a navigation mesh query and its node pools.
+	DT_ALLOC_PERM_CROWD			///< Persistent memory of a crowd, its agents and their helpers.
 };
 
 /// A memory allocation function.
@@ -58,4 +65,79 @@ void* dtAlloc(size_t size, dtAllocHint hint);
 /// @see dtAlloc
 void dtFree(void* ptr);
 
+/// A linear allocator for temporary memory.
+/// The memory is taken from a single block, allocated once by #init. Blocks that
+/// are freed in the reverse order of allocation are returned to the arena immediately,
+/// the rest of the memory is released by #reset.
+/// The arena is not thread safe, use one arena per thread.
+/// @see dtAllocTemp, dtFreeTemp
+class dtArena
+{
+public:
+	dtArena();
+	~dtArena();
+
+	/// Allocates the memory block of the arena.
+	///  @param[in]		capacity	The size, in bytes, of the memory block.
+	/// @return True if the block was allocated.
+	bool init(size_t capacity);
+
+	/// Allocates memory from the arena.
+	///  @param[in]		size	The size, in bytes of memory, to allocate.
+	/// @return A pointer to the allocated memory, or null if the arena does not have room for it.
+	void* alloc(size_t size);
+
+	/// Returns memory to the arena if it is the most recent allocation.
+	/// Other allocations are released by #reset.
+	///  @param[in]		ptr		A pointer to a memory block previously allocated using #alloc.
+	void free(void* ptr);
+
+	/// Releases all the allocations of the arena.
+	void reset();
+
+	/// Returns true if the pointer belongs to the memory block of the arena.
+	///  @param[in]		ptr		The pointer to check.
+	inline bool owns(const void* ptr) const
+	{
+		return m_buffer && (const unsigned char*)ptr >= m_buffer && (const unsigned char*)ptr < m_buffer + m_capacity;
+	}
+
+	/// The size, in bytes, of the memory block.
+	inline size_t getCapacity() const { return m_capacity; }
+
+	/// The number of bytes currently in use.
+	inline size_t getUsed() const { return m_top; }
+
+	/// The largest number of bytes in use since the block was allocated.
+	inline size_t getHighWaterMark() const { return m_high; }
+
+	/// The number of allocations that did not fit in the arena.
+	inline int getOverflowCount() const { return m_overflowCount; }
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtArena(const dtArena&);
+	dtArena& operator=(const dtArena&);
+
+	unsigned char* m_buffer;
+	size_t m_capacity;
+	size_t m_top;
+	size_t m_last;
+	size_t m_high;
+	int m_overflowCount;
+};
+
+/// Allocates temporary memory from an arena, or using #dtAlloc if the arena is null or full.
+///  @param[in]		arena	The arena to allocate from. [opt]
+///  @param[in]		size	The size, in bytes of memory, to allocate.
+/// @return A pointer to the beginning of the allocated memory block, or null if the allocation failed.
+/// @see dtFreeTemp
+void* dtAllocTemp(dtArena* arena, size_t size);
+
+/// Deallocates a memory block allocated using #dtAllocTemp.
+///  @param[in]		arena	The arena that was passed to #dtAllocTemp. [opt]
+///  @param[in]		ptr		A pointer to a memory block previously allocated using #dtAllocTemp.
+/// @see dtAllocTemp
+void dtFreeTemp(dtArena* arena, void* ptr);
+
 #endif
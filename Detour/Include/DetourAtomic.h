@@ -0,0 +1,50 @@
+/**
+@defgroup detour Detour
+
+Members in this module are wrappers around the atomic operations of the compiler,
+used to publish data replaced while other threads keep reading it.
+*/
+
+#ifndef DETOURATOMIC_H
+#define DETOURATOMIC_H
+
+#if defined(_MSC_VER)
+
+#include <intrin.h>
+
+template<class T> inline T* dtAtomicLoadAcquire(T* const* p)
+{
+	return (T*)_InterlockedCompareExchangePointer((void* volatile*)p, 0, 0);
+}
+template<class T> inline void dtAtomicStoreRelease(T** p, T* v)
+{
+	_InterlockedExchangePointer((void* volatile*)p, (void*)v);
+}
+inline unsigned int dtAtomicLoadAcquire(const unsigned int* p)
+{
+	return (unsigned int)_InterlockedCompareExchange((volatile long*)p, 0, 0);
+}
+inline void dtAtomicStoreRelease(unsigned int* p, unsigned int v)
+{
+	_InterlockedExchange((volatile long*)p, (long)v);
+}
+
+#elif defined(__GNUC__) || defined(__clang__)
+
+template<class T> inline T* dtAtomicLoadAcquire(T* const* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+template<class T> inline void dtAtomicStoreRelease(T** p, T* v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+inline unsigned int dtAtomicLoadAcquire(const unsigned int* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+inline void dtAtomicStoreRelease(unsigned int* p, unsigned int v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+#else
+
+// No atomics known for this compiler. The accesses are plain, so data replaced by one
+// thread is only safe to read from another thread after the application's own synchronization.
+template<class T> inline T* dtAtomicLoadAcquire(T* const* p) { return *(T* const volatile*)p; }
+template<class T> inline void dtAtomicStoreRelease(T** p, T* v) { *(T* volatile*)p = v; }
+inline unsigned int dtAtomicLoadAcquire(const unsigned int* p) { return *(const volatile unsigned int*)p; }
+inline void dtAtomicStoreRelease(unsigned int* p, unsigned int v) { *(volatile unsigned int*)p = v; }
+
+#endif
+
+#endif // DETOURATOMIC_H
@@ -0,0 +1,246 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURFINDPATH_H
+#define DETOURFINDPATH_H
+
+#include "DetourNavMeshQuery.h"
+#include "DetourNode.h"
+#include "DetourCommon.h"
+#include "DetourAssert.h"
+
+#ifndef DT_VIRTUAL_QUERYFILTER
+inline bool dtQueryFilter::passFilter(const dtPolyRef /*ref*/,
+									  const dtMeshTile* /*tile*/,
+									  const dtPoly* poly) const
+{
+	return (poly->flags & m_includeFlags) != 0 && (poly->flags & m_excludeFlags) == 0;
+}
+
+inline float dtQueryFilter::getCost(const float* pa, const float* pb,
+									const dtPolyRef /*prevRef*/, const dtMeshTile* /*prevTile*/, const dtPoly* /*prevPoly*/,
+									const dtPolyRef /*curRef*/, const dtMeshTile* /*curTile*/, const dtPoly* curPoly,
+									const dtPolyRef /*nextRef*/, const dtMeshTile* /*nextTile*/, const dtPoly* /*nextPoly*/) const
+{
+	return dtVdist(pa, pb) * m_areaCost[curPoly->getArea()];
+}
+#endif
+
+/// @par
+///
+/// Works like #findPath, except that the filter is any type providing non-virtual
+/// @p passFilter and @p getCost members with the same signatures as in #dtQueryFilter.
+/// The search shares the node pool and open list with the other queries, so the
+/// same threading rules apply. #findPath runs this search with #dtQueryFilter.
+///
+/// @code
+/// struct MyFilter
+/// {
+/// 	bool passFilter(const dtPolyRef ref, const dtMeshTile* tile, const dtPoly* poly) const;
+/// 	float getCost(const float* pa, const float* pb,
+/// 				  const dtPolyRef prevRef, const dtMeshTile* prevTile, const dtPoly* prevPoly,
+/// 				  const dtPolyRef curRef, const dtMeshTile* curTile, const dtPoly* curPoly,
+/// 				  const dtPolyRef nextRef, const dtMeshTile* nextTile, const dtPoly* nextPoly) const;
+/// };
+///
+/// MyFilter filter;
+/// query->findPathT(startRef, endRef, startPos, endPos, &filter, path, &pathCount, maxPath);
+/// @endcode
+template<class TFilter>
+dtStatus dtNavMeshQuery::findPathT(dtPolyRef startRef, dtPolyRef endRef,
+								   const float* startPos, const float* endPos,
+								   const TFilter* filter,
+								   dtPolyRef* path, int* pathCount, const int maxPath) const
+{
+	static const float H_SCALE = 0.999f; // Search heuristic scale.
+
+	dtAssert(m_nav);
+	dtAssert(m_nodePool);
+	dtAssert(m_openList);
+	
+	if (pathCount)
+		*pathCount = 0;
+	
+	// Validate input
+	if (!startPos || !endPos || !filter || maxPath <= 0 || !path || !pathCount)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	dtStatus refStatus = m_nav->getPolyRefStatus(startRef);
+	if (dtStatusSucceed(refStatus))
+		refStatus = m_nav->getPolyRefStatus(endRef);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
+
+	if (startRef == endRef)
+	{
+		path[0] = startRef;
+		*pathCount = 1;
+		return DT_SUCCESS;
+	}
+	
+	m_nodePool->clear();
+	m_openList->clear();
+	
+	dtNode* startNode = m_nodePool->getNode(startRef);
+	dtVcopy(startNode->pos, startPos);
+	startNode->pidx = 0;
+	startNode->cost = 0;
+	startNode->total = dtVdist(startPos, endPos) * H_SCALE;
+	startNode->id = startRef;
+	startNode->flags = DT_NODE_OPEN;
+	m_openList->push(startNode);
+	
+	dtNode* lastBestNode = startNode;
+	float lastBestNodeCost = startNode->total;
+	
+	bool outOfNodes = false;
+	
+	while (!m_openList->empty())
+	{
+		// Remove node from open list and put it in closed list.
+		dtNode* bestNode = m_openList->pop();
+		bestNode->flags &= ~DT_NODE_OPEN;
+		bestNode->flags |= DT_NODE_CLOSED;
+		
+		// Reached the goal, stop searching.
+		if (bestNode->id == endRef)
+		{
+			lastBestNode = bestNode;
+			break;
+		}
+		
+		// Get current poly and tile.
+		const dtPolyRef bestRef = bestNode->id;
+		const dtMeshTile* bestTile = 0;
+		const dtPoly* bestPoly = 0;
+		m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
+		
+		// Get parent poly and tile.
+		dtPolyRef parentRef = 0;
+		const dtMeshTile* parentTile = 0;
+		const dtPoly* parentPoly = 0;
+		if (bestNode->pidx)
+			parentRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
+		if (parentRef)
+			m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
+		
+		const unsigned int bestIdx = (unsigned int)(bestPoly - bestTile->polys);
+		const dtTileAdjacency* bestAdj = dtGetTileAdjacency(bestTile);
+		for (unsigned int i = bestAdj->base[bestIdx]; i < bestAdj->base[bestIdx+1]; ++i)
+		{
+			const dtPolyAdjacency* nei = &bestAdj->entries[i];
+			dtPolyRef neighbourRef = nei->ref;
+			
+			// Skip invalid ids and do not expand back to where we came from.
+			if (!neighbourRef || neighbourRef == parentRef)
+				continue;
+			
+			// Get neighbour poly and tile.
+			const dtMeshTile* neighbourTile = 0;
+			const dtPoly* neighbourPoly = 0;
+			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
+			
+			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+				continue;
+
+			// deal explicitly with crossing tile boundaries
+			unsigned char crossSide = 0;
+			if (nei->side != 0xff)
+				crossSide = nei->side >> 1;
+
+			// get the node
+			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef, crossSide);
+			if (!neighbourNode)
+			{
+				outOfNodes = true;
+				continue;
+			}
+			
+			// If the node is visited the first time, calculate node position.
+			if (neighbourNode->flags == 0)
+				dtVcopy(neighbourNode->pos, nei->mid);
+
+			// Calculate cost and heuristic.
+			const float curCost = filter->getCost(bestNode->pos, neighbourNode->pos,
+												  parentRef, parentTile, parentPoly,
+												  bestRef, bestTile, bestPoly,
+												  neighbourRef, neighbourTile, neighbourPoly);
+			float cost = bestNode->cost + curCost;
+			float heuristic = 0;
+			
+			// Special case for last node.
+			if (neighbourRef == endRef)
+			{
+				cost += filter->getCost(neighbourNode->pos, endPos,
+										bestRef, bestTile, bestPoly,
+										neighbourRef, neighbourTile, neighbourPoly,
+										0, 0, 0);
+			}
+			else
+			{
+				heuristic = dtVdist(neighbourNode->pos, endPos)*H_SCALE;
+			}
+
+			const float total = cost + heuristic;
+			
+			// The node is already in open list and the new result is worse, skip.
+			if ((neighbourNode->flags & DT_NODE_OPEN) && total >= neighbourNode->total)
+				continue;
+			// The node is already visited and process, and the new result is worse, skip.
+			if ((neighbourNode->flags & DT_NODE_CLOSED) && total >= neighbourNode->total)
+				continue;
+			
+			// Add or update the node.
+			neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
+			neighbourNode->id = neighbourRef;
+			neighbourNode->flags = (neighbourNode->flags & ~DT_NODE_CLOSED);
+			neighbourNode->cost = cost;
+			neighbourNode->total = total;
+			
+			if (neighbourNode->flags & DT_NODE_OPEN)
+			{
+				// Already in open, update node location.
+				m_openList->modify(neighbourNode);
+			}
+			else
+			{
+				// Put the node in open list.
+				neighbourNode->flags |= DT_NODE_OPEN;
+				m_openList->push(neighbourNode);
+			}
+			
+			// Update nearest node to target so far.
+			if (heuristic < lastBestNodeCost)
+			{
+				lastBestNodeCost = heuristic;
+				lastBestNode = neighbourNode;
+			}
+		}
+	}
+
+	dtStatus status = getPathToNode(lastBestNode, path, pathCount, maxPath);
+
+	if (lastBestNode->id != endRef)
+		status |= DT_PARTIAL_RESULT;
+
+	if (outOfNodes)
+		status |= DT_OUT_OF_NODES;
+	
+	return status;
+}
+
+#endif // DETOURFINDPATH_H
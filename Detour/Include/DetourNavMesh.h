@@ -20,6 +20,7 @@
 #define DETOURNAVMESH_H
 
 #include "DetourAlloc.h"
+#include "DetourAtomic.h"
 #include "DetourStatus.h"
 
 // Undefine (or define in a build cofnig) the following line to use 64bit polyref.
@@ -72,6 +73,13 @@ static const int DT_NAVMESH_MAGIC = 'D'<<24 | 'N'<<16 | 'A'<<8 | 'V';
 /// A version number used to detect compatibility of navigation tile data.
 static const int DT_NAVMESH_VERSION = 7;
 
+/// The bits of dtMeshHeader::version holding the version number, the rest are format flags.
+static const int DT_NAVMESH_VERSION_MASK = 0xffff;
+
+/// A format flag set in dtMeshHeader::version of tiles which store the detail mesh
+/// vertices as 16 bit fixed point values. (See: dtNavMeshCreateParams::compactDetailVerts)
+static const int DT_NAVMESH_COMPACT_DETAIL = 0x10000;
+
 /// A magic number used to detect the compatibility of navigation tile states.
 static const int DT_NAVMESH_STATE_MAGIC = 'D'<<24 | 'N'<<16 | 'M'<<8 | 'S';
 
@@ -130,6 +138,15 @@ enum dtRaycastOptions
 	DT_RAYCAST_USE_COSTS = 0x01,		///< Raycast should calculate movement cost along the ray and fill RaycastHit::cost
 };
 
+/// Tells how dtNavMeshQuery::findNearestPolyHinted located the point.
+enum dtNearestPolyHintResult
+{
+	DT_NEAREST_NOT_FOUND = 0,		///< No polygon was found within the search box.
+	DT_NEAREST_HINT_POLY,			///< The point is still over the hint polygon.
+	DT_NEAREST_HINT_NEIGHBOUR,		///< The point is over a polygon linked to the hint polygon.
+	DT_NEAREST_SEARCH,				///< The polygon was found by searching the tiles.
+};
+
 
 /// Limit raycasting during any angle pahfinding
 /// The limit is given as a multiple of the character radius
@@ -160,13 +177,16 @@ struct dtPoly
 	unsigned short neis[DT_VERTS_PER_POLYGON];
 
 	/// The user defined polygon flags.
+	/// @note Once the tile has been added to a navigation mesh, change this value only through
+	/// dtNavMesh::setPolyFlags(), the search data of the tile is not updated otherwise.
 	unsigned short flags;
 
 	/// The number of vertices in the polygon.
 	unsigned char vertCount;
 
 	/// The bit packed area id and polygon type.
-	/// @note Use the structure's set and get methods to acess this value.
+	/// @note Use the structure's set and get methods to acess this value. Once the tile has been
+	/// added to a navigation mesh, change the area only through dtNavMesh::setPolyArea().
 	unsigned char areaAndtype;
 
 	/// Sets the user defined area id. [Limit: < #DT_MAX_AREAS]
@@ -182,6 +202,29 @@ struct dtPoly
 	inline unsigned char getType() const { return areaAndtype >> 6; }
 };
 
+/// Defines the polygon data used by the graph searches.
+/// A copy of the fields of dtPoly that the searches test for every visited polygon, kept
+/// in a dense array per tile so that a search does not need to fetch the whole polygon.
+/// The searches using a non-virtual #dtQueryFilter filter the polygons on these flags
+/// and price them by this area, so the copy must be kept in sync through
+/// dtNavMesh::setPolyFlags() and dtNavMesh::setPolyArea().
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile
+struct dtPolySearchData
+{
+	/// The user defined polygon flags. (Same as dtPoly::flags.)
+	unsigned short flags;
+
+	/// The bit packed area id and polygon type. (Same as dtPoly::areaAndtype.)
+	unsigned char areaAndtype;
+
+	/// Gets the user defined area id.
+	inline unsigned char getArea() const { return areaAndtype & 0x3f; }
+
+	/// Gets the polygon type. (See: #dtPolyTypes)
+	inline unsigned char getType() const { return areaAndtype >> 6; }
+};
+
 /// Defines the location of detail sub-mesh data within a dtMeshTile.
 struct dtPolyDetail
 {
@@ -204,6 +247,48 @@ struct dtLink
 	unsigned char bmax;				///< If a boundary link, defines the maximum sub-edge area.
 };
 
+/// Defines a neighbour of a polygon in the tile's compact adjacency.
+/// The adjacency is built from the links whenever they change, and stores the
+/// neighbours of each polygon next to each other so that searches do not need
+/// to walk the link list.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile
+struct dtPolyAdjacency
+{
+	dtPolyRef ref;					///< Neighbour reference. (The neighbor that is linked to.)
+	float mid[3];					///< The midpoint of the portal leading to the neighbour. [(x, y, z)]
+	unsigned char edge;				///< Index of the polygon edge that owns the link.
+	unsigned char side;				///< If a boundary link, defines on which side the link is.
+};
+
+/// Defines the end points of the portal leading to a neighbour in the tile's compact adjacency.
+/// The portals are stored in the same order as the adjacency entries.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtTileAdjacency
+struct dtPolyPortal
+{
+	float left[3];					///< The left end point of the portal. [(x, y, z)]
+	float right[3];					///< The right end point of the portal. [(x, y, z)]
+};
+
+/// Defines the compact polygon adjacency of a tile.
+/// The arrays are stored in the same allocation as the structure, so the navigation mesh
+/// replaces the whole adjacency of a tile with a single pointer store. (See: #dtGetTileAdjacency)
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile
+struct dtTileAdjacency
+{
+	/// The index of the first entry of each polygon. The entries of polygon i
+	/// are in the range [base[i], base[i+1]). [Size: dtMeshHeader::polyCount + 1]
+	unsigned int* base;
+
+	/// The neighbours of the polygons. [Size: dtMeshHeader::maxLinkCount]
+	dtPolyAdjacency* entries;
+
+	/// The portals leading to the neighbours. [Size: dtMeshHeader::maxLinkCount]
+	dtPolyPortal* portals;
+};
+
 /// Bounding volume node.
 /// @note This structure is rarely if ever used by the end user.
 /// @see dtMeshTile
@@ -214,6 +299,44 @@ struct dtBVNode
 	int i;							///< The node's index. (Negative for escape sequence.)
 };
 
+/// The number of children in a wide bounding volume node.
+static const int DT_WIDE_BVNODE_CHILDREN = 8;
+
+/// Wide bounding volume node.
+/// The wide tree is built from the tile's binary bounding volume tree when the tile is added,
+/// and stores the bounds of all the children of a node next to each other so that they can be
+/// tested against a query box at once.
+/// The bounds are quantized like in dtBVNode, but with the sign bit flipped so that they
+/// can be compared as signed values.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile
+struct dtWideBVNode
+{
+	short bmin[3][DT_WIDE_BVNODE_CHILDREN];	///< Minimum bounds of the children's AABB's. [(x, y, z)][child]
+	short bmax[3][DT_WIDE_BVNODE_CHILDREN];	///< Maximum bounds of the children's AABB's. [(x, y, z)][child]
+	
+	/// The index of the child node, or -(polygon index + 1) if the child is a leaf.
+	/// (Zero if the child is not in use.)
+	int child[DT_WIDE_BVNODE_CHILDREN];
+};
+
+/// The minimum number of detail triangles a polygon needs to get a detail triangle grid.
+static const int DT_DETAIL_GRID_MIN_TRIS = 16;
+
+/// A uniform grid over the xz-bounds of a polygon, listing the detail triangles overlapping
+/// each cell. The grid is built when the tile is added, so that the height of the detail mesh
+/// can be found without testing all the triangles of the polygon.
+/// @note This structure is rarely if ever used by the end user.
+/// @see dtMeshTile
+struct dtDetailTriGrid
+{
+	float bmin[2];					///< Minimum xz-bounds of the grid. [(x, z)]
+	float cellScale[2];				///< The inverse of the cell size. [(x, z)]
+	unsigned int cellBase;			///< The index of the first cell in dtMeshTile::detailCells.
+	unsigned char width;			///< The number of cells along the x-axis. (Zero if the polygon has no grid.)
+	unsigned char height;			///< The number of cells along the z-axis.
+};
+
 /// Defines an navigation mesh off-mesh connection within a dtMeshTile object.
 /// An off-mesh connection is a user defined traversable connection made up to two vertices.
 struct dtOffMeshConnection
@@ -285,8 +408,17 @@ struct dtMeshTile
 	dtPolyDetail* detailMeshes;			///< The tile's detail sub-meshes. [Size: dtMeshHeader::detailMeshCount]
 	
 	/// The detail mesh's unique vertices. [(x, y, z) * dtMeshHeader::detailVertCount]
+	/// (Will be null if the tile stores the vertices quantized.)
 	float* detailVerts;	
 
+	/// The origin and the cell size of the quantized detail mesh vertices. [(ox, oy, oz, sx, sy, sz)]
+	/// (Will be null unless the tile stores the vertices quantized.)
+	float* detailQuant;
+
+	/// The detail mesh's unique vertices quantized. [(x, y, z) * dtMeshHeader::detailVertCount]
+	/// (Will be null unless the tile stores the vertices quantized.)
+	unsigned short* detailQVerts;
+
 	/// The detail mesh's triangles. [(vertA, vertB, vertC) * dtMeshHeader::detailTriCount]
 	unsigned char* detailTris;	
 
@@ -295,6 +427,47 @@ struct dtMeshTile
 	dtBVNode* bvTree;
 
 	dtOffMeshConnection* offMeshCons;		///< The tile off-mesh connections. [Size: dtMeshHeader::offMeshConCount]
+
+	/// The search data of the polygons, kept in sync with the polygons by the navigation mesh.
+	/// Only the navigation mesh state functions (#dtNavMesh::setPolyFlags, #dtNavMesh::setPolyArea,
+	/// #dtNavMesh::restoreTileState and the change journal) update it, writing dtPoly::flags or
+	/// dtPoly::areaAndtype of an added tile directly leaves it stale. [Size: dtMeshHeader::polyCount]
+	dtPolySearchData* polySearch;
+
+	/// The compact polygon adjacency. Read it with #dtGetTileAdjacency while the tiles
+	/// may change on another thread. (See: #dtNavMesh::setDeferredReclaim)
+	dtTileAdjacency* adjacency;
+
+	/// The wide bounding volume nodes. [Size: bvWideNodeCount]
+	/// (Will be null if bounding volumes are disabled, or the tree could not be converted.)
+	dtWideBVNode* bvWideTree;
+	int bvWideNodeCount;				///< The number of wide bounding volume nodes.
+
+	/// The detail triangle grids of the polygons. [Size: dtMeshHeader::polyCount]
+	/// (Will be null if no polygon has #DT_DETAIL_GRID_MIN_TRIS detail triangles. Owns the cell arrays.)
+	dtDetailTriGrid* detailGrids;
+
+	/// The index of the first triangle of each grid cell in #detailCellTris, followed by
+	/// the end of the last cell of the grid.
+	unsigned int* detailCells;
+
+	/// The detail triangles of the grid cells, relative to dtPolyDetail::triBase.
+	unsigned char* detailCellTris;
+
+	/// The state version each polygon was last changed in by the state journal.
+	/// [Size: dtMeshHeader::polyCount] (Will be null if no polygon has been changed since the tile was added.)
+	unsigned int* polyStamps;
+
+	/// The state version the polygons or the links of the tile last changed in. (See: #dtNavMesh::getStateVersion)
+	unsigned int stateVersion;
+
+	/// The state version the tile was added in. The journal entries of older versions belong to
+	/// an earlier tile with the same reference.
+	unsigned int addVersion;
+
+	/// The salt of the tile evicted from this slot with #dtNavMesh::evictTile, or zero. References with
+	/// this salt report #DT_TILE_NOT_RESIDENT until a tile is added to the slot again.
+	unsigned int evictedSalt;
 		
 	unsigned char* data;					///< The tile data. (Not directly accessed under normal situations.)
 	int dataSize;							///< Size of the tile data.
@@ -305,6 +478,53 @@ private:
 	dtMeshTile& operator=(const dtMeshTile&);
 };
 
+/// Gets the size of the detail mesh vertex data of a tile.
+///  @param[in]	detailVertCount	The number of unique detail mesh vertices.
+///  @param[in]	compact			True if the vertices are stored quantized. (See: #DT_NAVMESH_COMPACT_DETAIL)
+/// @return The size of the vertex data in bytes.
+inline int dtGetDetailVertsDataSize(const int detailVertCount, const bool compact)
+{
+	const int size = compact ? (int)(sizeof(float)*6 + sizeof(unsigned short)*3*detailVertCount) :
+							   (int)(sizeof(float)*3*detailVertCount);
+	return (size+3) & ~3;
+}
+
+/// Gets a unique vertex of the detail mesh of a tile.
+///  @param[in]	tile	The tile.
+///  @param[in]	index	The index of the vertex in the detail mesh vertices.
+///  @param[in]	tmp		Storage for the vertex if the tile stores the vertices quantized. [(x, y, z)]
+/// @return The vertex. [(x, y, z)]
+inline const float* dtGetDetailVert(const dtMeshTile* tile, const unsigned int index, float* tmp)
+{
+	if (!tile->detailQVerts)
+		return &tile->detailVerts[index*3];
+	const unsigned short* q = &tile->detailQVerts[index*3];
+	const float* quant = tile->detailQuant;
+	tmp[0] = quant[0] + q[0]*quant[3];
+	tmp[1] = quant[1] + q[1]*quant[4];
+	tmp[2] = quant[2] + q[2]*quant[5];
+	return tmp;
+}
+
+/// Gets the compact polygon adjacency of a tile.
+/// The adjacency is loaded with acquire semantics, so all of it is visible when it was
+/// replaced by another thread after a tile change. Load it once per polygon expansion.
+///  @param[in]	tile	The tile.
+/// @return The adjacency of the tile.
+inline const dtTileAdjacency* dtGetTileAdjacency(const dtMeshTile* tile)
+{
+	return dtAtomicLoadAcquire(&tile->adjacency);
+}
+
+/// Gets the height of the detail mesh of a polygon at the specified location.
+///  @param[in]		tile	The tile of the polygon.
+///  @param[in]		poly	The polygon. (Not an off-mesh connection.)
+///  @param[in]		pos		The location. [(x, y, z)]
+///  @param[out]	height	The height of the detail mesh at the location.
+/// @return True if the location is over the detail mesh of the polygon.
+///  @ingroup detour
+bool dtGetPolyDetailHeight(const dtMeshTile* tile, const dtPoly* poly, const float* pos, float* height);
+
 /// Configuration parameters used to define multi-tile navigation meshes.
 /// The values are used to allocate space during the initialization of a navigation mesh.
 /// @see dtNavMesh::init()
@@ -318,6 +538,76 @@ struct dtNavMeshParams
 	int maxPolys;					///< The maximum number of polygons each tile can contain.
 };
 
+/// The flags and area of a polygon, as stored by dtNavMesh::storeStateChanges().
+/// @ingroup detour
+struct dtPolyStateChange
+{
+	dtPolyRef ref;					///< The polygon reference.
+	unsigned short flags;			///< The flags of the polygon. (See: #dtPolyFlags)
+	unsigned char area;				///< The area id of the polygon.
+};
+
+/// The bounds of a dense tile grid, used to look up tiles by their grid location directly.
+/// @see dtNavMesh::init()
+/// @ingroup detour
+struct dtNavMeshTileGrid
+{
+	int minX;						///< The smallest tile x-location in the grid.
+	int minY;						///< The smallest tile y-location in the grid.
+	int width;						///< The number of tiles along the x-axis. [Limit: > 0]
+	int height;						///< The number of tiles along the y-axis. [Limit: > 0]
+};
+
+/// The memory used by a tile of a navigation mesh, in bytes.
+/// @see dtNavMesh::getTileMemoryStats()
+/// @ingroup detour
+struct dtTileMemoryStats
+{
+	int dataSize;					///< The tile data, including the links stored in it.
+	int linkSize;					///< The links stored in the tile data. (Included in #dataSize.)
+	int searchSize;					///< The polygon search data, the compact adjacency and its portals.
+	int bvTreeSize;					///< The wide bounding volume tree.
+	int detailGridSize;				///< The detail triangle grids.
+	int stateSize;					///< The state versions of the changed polygons.
+	int totalSize;					///< The total memory used by the tile.
+};
+
+/// The memory used by a navigation mesh, in bytes.
+/// @see dtNavMesh::getMemoryStats()
+/// @ingroup detour
+struct dtNavMeshMemoryStats
+{
+	int tileCount;					///< The number of tiles in use.
+	size_t meshSize;				///< The navigation mesh object, the tile array and the tile lookup.
+	size_t tileDataSize;			///< The data of the tiles in use, including the links stored in it.
+	size_t linkSize;				///< The links stored in the tile data. (Included in #tileDataSize.)
+	size_t lookupSize;				///< The search data, adjacency, bounding volume trees and detail grids of the tiles.
+	size_t stateSize;				///< The state journal and the state versions of the changed polygons.
+	size_t retiredSize;				///< The removed tiles and allocations waiting to be reclaimed.
+	size_t totalSize;				///< The total memory used by the navigation mesh.
+};
+
+/// A task run for each index of a range by #dtParallelFor.
+///  @param[in]	userData	The user data passed to #dtParallelFor::run.
+///  @param[in]	index		The index of the task to run.
+typedef void (*dtParallelTaskFunc)(void* userData, int index);
+
+/// Provides the ability to run the independent parts of bulk operations in parallel.
+/// Used by dtNavMesh::addTiles.
+/// @ingroup detour
+class dtParallelFor
+{
+public:
+	virtual ~dtParallelFor() { }
+
+	/// Runs the task for every index in [0, count) and returns once all of them are done.
+	/// The tasks of a single call do not share any data they write, so they can run in any order.
+	///  @param[in]	func		The task to run.
+	///  @param[in]	userData	The user data to pass to the task.
+	///  @param[in]	count		The number of tasks.
+	virtual void run(dtParallelTaskFunc func, void* userData, int count) = 0;
+};
+
 /// A navigation mesh based on tiles of convex polygons.
 /// @ingroup detour
 class dtNavMesh
@@ -334,6 +624,12 @@ public:
 	/// @return The status flags for the operation.
 	dtStatus init(const dtNavMeshParams* params);
 
+	/// Initializes the navigation mesh for tiled use, with all the tiles inside a known grid.
+	///  @param[in]	params		Initialization parameters.
+	///  @param[in]	grid		The bounds of the tile grid. [opt]
+	/// @return The status flags for the operation.
+	dtStatus init(const dtNavMeshParams* params, const dtNavMeshTileGrid* grid);
+
 	/// Initializes the navigation mesh for single tile use.
 	///  @param[in]	data		Data of the new tile. (See: #dtCreateNavMeshData)
 	///  @param[in]	dataSize	The data size of the new tile.
@@ -345,6 +641,9 @@ public:
 	/// The navigation mesh initialization params.
 	const dtNavMeshParams* getParams() const;
 
+	/// The bounds of the tile grid, or null if the tiles are looked up by hash.
+	const dtNavMeshTileGrid* getTileGrid() const;
+
 	/// Adds a tile to the navigation mesh.
 	///  @param[in]		data		Data for the new tile mesh. (See: #dtCreateNavMeshData)
 	///  @param[in]		dataSize	Data size of the new tile mesh.
@@ -353,6 +652,17 @@ public:
 	///  @param[out]	result		The tile reference. (If the tile was succesfully added.) [opt]
 	/// @return The status flags for the operation.
 	dtStatus addTile(unsigned char* data, int dataSize, int flags, dtTileRef lastRef, dtTileRef* result);
+
+	/// Adds several tiles to the navigation mesh.
+	///  @param[in]		data		Data for the new tile meshes. [(data) * @p count]
+	///  @param[in]		dataSize	Data sizes of the new tile meshes. [(size) * @p count]
+	///  @param[in]		flags		Tile flags. (See: #dtTileFlags)
+	///  @param[in]		count		The number of tiles to add.
+	///  @param[out]	results		The tile references, or zero for the tiles that could not be added. [opt] [(ref) * @p count]
+	///  @param[in]		parallel	Runs the linking of the tiles in parallel. [opt]
+	/// @return The status flags for the operation.
+	dtStatus addTiles(unsigned char** data, const int* dataSize, int flags, const int count,
+					  dtTileRef* results, dtParallelFor* parallel);
 	
 	/// Removes the specified tile from the navigation mesh.
 	///  @param[in]		ref			The reference of the tile to remove.
@@ -361,6 +671,52 @@ public:
 	/// @return The status flags for the operation.
 	dtStatus removeTile(dtTileRef ref, unsigned char** data, int* dataSize);
 
+	/// Removes the specified tile from the navigation mesh, but keeps its reference known so that
+	/// the polygon references into it report #DT_TILE_NOT_RESIDENT until it is added back.
+	///  @param[in]		ref			The reference of the tile to evict.
+	///  @param[out]	data		Data associated with evicted tile.
+	///  @param[out]	dataSize	Size of the data associated with evicted tile.
+	/// @return The status flags for the operation.
+	dtStatus evictTile(dtTileRef ref, unsigned char** data, int* dataSize);
+
+	/// @}
+
+	/// @{
+	/// @name Deferred Reclamation
+
+	/// Enables or disables the deferred reclamation of removed tile data.
+	/// Disabling it frees all the retired data immediately.
+	///  @param[in]	enabled		True to keep removed data alive until #reclaim is called.
+	void setDeferredReclaim(bool enabled);
+
+	/// Returns true if removed tile data is kept alive until #reclaim is called.
+	inline bool getDeferredReclaim() const { return m_deferredReclaim; }
+
+	/// Returns the current epoch. The epoch advances after each tile change while
+	/// deferred reclamation is enabled. Can be called while a tile change is in progress.
+	inline unsigned int getEpoch() const { return dtAtomicLoadAcquire(&m_epoch); }
+
+	/// Frees the tiles and tile data that were retired before the specified epoch.
+	///  @param[in]	safeEpoch	The oldest epoch still observed by a reader.
+	void reclaim(unsigned int safeEpoch);
+
+	/// Returns the number of retired tiles and allocations waiting to be reclaimed.
+	int getRetiredCount() const;
+
+	/// @}
+
+	/// @{
+	/// @name Memory Statistics
+
+	/// Gets the memory used by the navigation mesh.
+	///  @param[out]	stats	The memory statistics.
+	void getMemoryStats(dtNavMeshMemoryStats* stats) const;
+
+	/// Gets the memory used by a tile.
+	///  @param[in]		tile	The tile.
+	///  @param[out]	stats	The memory statistics of the tile.
+	void getTileMemoryStats(const dtMeshTile* tile, dtTileMemoryStats* stats) const;
+
 	/// @}
 
 	/// @{
@@ -432,6 +788,12 @@ public:
 	///  @param[in]	ref		The polygon reference to check.
 	/// @return True if polygon reference is valid for the navigation mesh.
 	bool isValidPolyRef(dtPolyRef ref) const;
+
+	/// Gets the status of a polygon reference.
+	///  @param[in]	ref		The polygon reference to check.
+	/// @return #DT_SUCCESS if the reference is valid, otherwise #DT_FAILURE with #DT_TILE_NOT_RESIDENT
+	/// if the tile of the polygon has been evicted, or with #DT_INVALID_PARAM.
+	dtStatus getPolyRefStatus(dtPolyRef ref) const;
 	
 	/// Gets the polygon reference for the tile's base polygon.
 	///  @param[in]	tile		The tile.
@@ -458,6 +820,9 @@ public:
 	/// These functions do not effect #dtTileRef or #dtPolyRef's. 
 
 	/// Sets the user defined flags for the specified polygon.
+	/// The graph searches filter the polygons on a copy of the flags kept in the search data
+	/// of the tile. Change the flags of an added tile only through this function, a value
+	/// written to dtPoly::flags directly is not seen by the searches.
 	///  @param[in]	ref		The polygon reference.
 	///  @param[in]	flags	The new flags for the polygon.
 	/// @return The status flags for the operation.
@@ -470,6 +835,8 @@ public:
 	dtStatus getPolyFlags(dtPolyRef ref, unsigned short* resultFlags) const;
 
 	/// Sets the user defined area for the specified polygon.
+	/// Like the flags, the area is copied to the search data of the tile and read from there
+	/// by the graph searches. (See: #setPolyFlags)
 	///  @param[in]	ref		The polygon reference.
 	///  @param[in]	area	The new area id for the polygon. [Limit: < #DT_MAX_AREAS]
 	/// @return The status flags for the operation.
@@ -499,6 +866,43 @@ public:
 	///  @param[in]	maxDataSize		The size of the state within the data buffer.
 	/// @return The status flags for the operation.
 	dtStatus restoreTileState(dtMeshTile* tile, const unsigned char* data, const int maxDataSize);
+
+	/// Enables or disables the journal of the polygon flag and area changes.
+	/// Disabling it discards all the recorded changes.
+	///  @param[in]	enabled		True to record the changes.
+	void setStateJournal(bool enabled);
+
+	/// Returns true if the polygon flag and area changes are recorded.
+	inline bool getStateJournal() const { return m_journal.enabled; }
+
+	/// Returns the current state version. The version advances with each change of the
+	/// polygon flags or areas, and with each tile added or removed. The tiles record the
+	/// version they last changed in, see dtMeshTile::stateVersion.
+	inline unsigned int getStateVersion() const { return m_journal.version; }
+
+	/// Stores the current flags and areas of the polygons changed since the specified version.
+	///  @param[in]		sinceVersion	The state version the changes are relative to. (Obtained from #getStateVersion.)
+	///  @param[out]	changes			The changed polygons.
+	///  @param[out]	changeCount		The number of changed polygons.
+	///  @param[in]		maxChanges		The maximum number of changes the array can hold.
+	/// @return The status flags for the operation.
+	dtStatus storeStateChanges(unsigned int sinceVersion, dtPolyStateChange* changes, int* changeCount, const int maxChanges) const;
+
+	/// Applies polygon flags and areas in bulk. The polygons that are no longer valid are skipped.
+	///  @param[in]	changes			The new state of the polygons. (Obtained from #storeStateChanges.)
+	///  @param[in]	changeCount		The number of changes.
+	/// @return The status flags for the operation.
+	dtStatus restoreStateChanges(const dtPolyStateChange* changes, const int changeCount);
+
+	/// Reverts the polygon flags and areas to their state at the specified version.
+	///  @param[in]	version		The state version to revert to. (Obtained from #getStateVersion.)
+	/// @return The status flags for the operation.
+	dtStatus revertStateChanges(unsigned int version);
+
+	/// Discards the recorded changes up to and including the specified version.
+	/// Changes since an earlier version can no longer be stored or reverted.
+	///  @param[in]	version		The oldest state version still needed.
+	void discardStateChanges(unsigned int version);
 	
 	/// @}
 
@@ -626,6 +1030,45 @@ private:
 	
 	/// Removes external links at specified side.
 	void unconnectLinks(dtMeshTile* tile, dtMeshTile* target);
+
+	/// Returns the head of the lookup chain of tiles at the location, or null if the location is outside the tile grid.
+	dtMeshTile** getTileBucket(const int x, const int y) const;
+
+	/// Allocates a tile for the data and inserts it into the position lookup, without linking it.
+	dtStatus insertTile(unsigned char* data, int dataSize, int flags, dtTileRef lastRef, dtMeshTile** result);
+	/// Builds the search data and the links within a new tile.
+	void connectTile(dtMeshTile* tile);
+
+	/// Tasks run in parallel by #addTiles.
+	static void connectTileTask(void* userData, int index);
+	static void connectExtLinksTask(void* userData, int index);
+	static void connectExtOffMeshLinksTask(void* userData, int index);
+	static void buildAdjacencyTask(void* userData, int index);
+
+	/// Builds the wide bounding volume tree of a tile from its binary tree.
+	void buildWideBVTree(dtMeshTile* tile);
+
+	/// Builds the detail triangle grids of the polygons of a tile.
+	void buildDetailGrids(dtMeshTile* tile);
+
+	/// Builds the compact polygon adjacency of a tile from its links into the specified adjacency.
+	void buildAdjacency(const dtMeshTile* tile, dtTileAdjacency* adjacency) const;
+	/// Rebuilds the compact polygon adjacency of a tile that may be in use by readers.
+	void rebuildAdjacency(dtMeshTile* tile);
+	/// Rebuilds the compact polygon adjacency of the tiles around a tile.
+	void buildNeighbourAdjacency(dtMeshTile* tile);
+
+	/// Adds a removed tile and unused allocations of the specified total size to the retired list.
+	bool retire(dtMeshTile* tile, void* mem0, void* mem1, int memSize);
+	/// Releases the data of a removed tile and returns it to the freelist.
+	void releaseTile(dtMeshTile* tile);
+
+	/// Records the state of a polygon before it is changed in the specified version,
+	/// and marks the tile changed in the version.
+	bool journalPolyState(dtMeshTile* tile, unsigned int ip, unsigned int version);
+
+	/// Grows the journal to hold at least the specified number of entries.
+	bool reserveJournal(const int capacity);
 	
 
 	// TODO: These methods are duplicates from dtNavMeshQuery, but are needed for off-mesh connection finding.
@@ -645,10 +1088,41 @@ private:
 	int m_maxTiles;						///< Max number of tiles.
 	int m_tileLutSize;					///< Tile hash lookup size (must be pot).
 	int m_tileLutMask;					///< Tile hash lookup mask.
+	dtNavMeshTileGrid m_tileGrid;		///< Tile grid bounds, the lookup is indexed directly if the width is not zero.
 
-	dtMeshTile** m_posLookup;			///< Tile hash lookup.
+	dtMeshTile** m_posLookup;			///< Tile hash lookup, or the tile grid.
 	dtMeshTile* m_nextFree;				///< Freelist of tiles.
 	dtMeshTile* m_tiles;				///< List of tiles.
+
+	struct dtRetiredItem
+	{
+		dtRetiredItem* next;
+		dtMeshTile* tile;				///< Removed tile waiting to be released, or null.
+		void* mem[2];					///< Allocations waiting to be freed, or null.
+		int memSize;					///< The total size of the allocations.
+		unsigned int epoch;				///< The epoch the item was retired in.
+	};
+	dtRetiredItem* m_retired;			///< List of retired tiles and allocations, newest first.
+	unsigned int m_epoch;				///< Current reclamation epoch.
+	bool m_deferredReclaim;				///< True if removed data is kept until reclaimed.
+
+	struct dtStateJournalEntry
+	{
+		dtPolyRef ref;					///< The changed polygon.
+		unsigned int version;			///< The state version of the change.
+		unsigned short prevFlags;		///< The flags of the polygon before the change.
+		unsigned char prevArea;			///< The area of the polygon before the change.
+	};
+	struct dtStateJournal
+	{
+		dtStateJournalEntry* entries;	///< The recorded changes, oldest first.
+		int count;						///< The number of recorded changes.
+		int capacity;					///< The size of the entries array.
+		unsigned int version;			///< The current state version.
+		unsigned int base;				///< The changes after this version are all recorded.
+		bool enabled;					///< True if the changes are recorded.
+	};
+	dtStateJournal m_journal;			///< Journal of the polygon flag and area changes.
 		
 #ifndef DT_POLYREF64
 	unsigned int m_saltBits;			///< Number of salt bits in the tile ID.
@@ -667,6 +1141,18 @@ dtNavMesh* dtAllocNavMesh();
 ///  @ingroup detour
 void dtFreeNavMesh(dtNavMesh* navmesh);
 
+/// Tests the children of a wide bounding volume node against a quantized box.
+///  @param[in]		node	The wide bounding volume node.
+///  @param[in]		bmin	Minimum bounds of the box, quantized and sign flipped like the node bounds. [(x, y, z)]
+///  @param[in]		bmax	Maximum bounds of the box, quantized and sign flipped like the node bounds. [(x, y, z)]
+/// @return A mask with bit i set if the bounds of child i overlap the box.
+///  @ingroup detour
+unsigned int dtOverlapWideBVNode(const dtWideBVNode* node, const short* bmin, const short* bmax);
+
+/// The maximum traversal stack size needed by a wide bounding volume tree.
+/// Trees which would need a deeper stack are not converted.
+static const int DT_WIDE_BVTREE_STACK_SIZE = 256;
+
 #endif // DETOURNAVMESH_H
 
 ///////////////////////////////////////////////////////////////////////////
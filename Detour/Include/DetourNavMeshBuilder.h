@@ -101,6 +101,10 @@ struct dtNavMeshCreateParams
 	/// @note The BVTree is not normally needed for layered navigation meshes.
 	bool buildBvTree;
 
+	/// True if the detail mesh vertices should be stored as 16 bit fixed point values,
+	/// which halves their size at the cost of some height precision. (See: #DT_NAVMESH_COMPACT_DETAIL)
+	bool compactDetailVerts;
+
 	/// @}
 };
 
@@ -109,8 +113,17 @@ struct dtNavMeshCreateParams
 ///  @param[in]		params		Tile creation data.
 ///  @param[out]	outData		The resulting tile data.
 ///  @param[out]	outDataSize	The size of the tile data array.
+///  @param[in]		arena		The arena to use for the temporary memory of the build. [opt]
 /// @return True if the tile data was successfully created.
-bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData, int* outDataSize);
+bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData, int* outDataSize,
+						 dtArena* arena = 0);
+
+/// Quantizes detail mesh vertices to the layout used by tiles with #DT_NAVMESH_COMPACT_DETAIL set.
+///  @param[in]		verts		The detail mesh vertices. [(x, y, z) * @p nverts] [Unit: wu]
+///  @param[in]		nverts		The number of vertices.
+///  @param[out]	quant		The origin and the cell size of the quantized vertices. [(ox, oy, oz, sx, sy, sz)]
+///  @param[out]	qverts		The quantized vertices. [(x, y, z) * @p nverts]
+void dtQuantizeDetailVerts(const float* verts, const int nverts, float* quant, unsigned short* qverts);
 
 /// Swaps the endianess of the tile data's header (#dtMeshHeader).
 ///  @param[in,out]	data		The tile data array.
@@ -21,12 +21,15 @@
 
 #include "DetourNavMesh.h"
 #include "DetourStatus.h"
+#include "DetourTime.h"
 
 
 // Define DT_VIRTUAL_QUERYFILTER if you wish to derive a custom filter from dtQueryFilter.
 // On certain platforms indirect or virtual function call is expensive. The default
 // setting is to use non-virtual functions, the actual implementations of the functions
 // are declared as inline for maximum speed. 
+// The non-virtual functions are defined in DetourFindPath.h. A custom filter can also be
+// used without virtual calls through dtNavMeshQuery::findPathT, which is defined there too.
 
 //#define DT_VIRTUAL_QUERYFILTER 1
 
@@ -148,6 +151,57 @@ struct dtRaycastHit
 	float pathCost;
 };
 
+/// The funnel of a straight path query that is advanced in steps.
+/// Initialized by dtNavMeshQuery::initStraightPath and advanced by dtNavMeshQuery::updateStraightPath.
+/// @ingroup detour
+struct dtStraightPathState
+{
+	float endPos[3];				///< The requested end position. [(x, y, z)]
+	float closestEndPos[3];			///< The end position clamped to the last polygon. [(x, y, z)]
+	
+	float portalApex[3];			///< The apex of the funnel. [(x, y, z)]
+	float portalLeft[3];			///< The left side of the funnel. [(x, y, z)]
+	float portalRight[3];			///< The right side of the funnel. [(x, y, z)]
+	int apexIndex;					///< The path index of the apex.
+	int leftIndex;					///< The path index of the left side.
+	int rightIndex;					///< The path index of the right side.
+	dtPolyRef leftPolyRef;			///< The polygon entered at the left side.
+	dtPolyRef rightPolyRef;			///< The polygon entered at the right side.
+	unsigned char leftPolyType;		///< The type of the polygon entered at the left side.
+	unsigned char rightPolyType;	///< The type of the polygon entered at the right side.
+	int index;						///< The next path index to process.
+	
+	float lastPos[3];				///< The last vertex added to the straight path. [(x, y, z)]
+	float crossingStart[3];			///< The start of the segment with pending portal crossings. [(x, y, z)]
+	float crossingEnd[3];			///< The end of the segment with pending portal crossings. [(x, y, z)]
+	int crossingIndex;				///< The path index of the next pending portal crossing.
+	int crossingEndIndex;			///< The path index past the last pending portal crossing.
+	
+	float vertexPos[3];				///< The pending vertex. [(x, y, z)]
+	dtPolyRef vertexRef;			///< The polygon reference of the pending vertex.
+	unsigned char vertexFlags;		///< The flags of the pending vertex. (See: #dtStraightPathFlags)
+	bool hasVertex;					///< True if there is a pending vertex.
+	bool lastVertex;				///< True if the pending vertex ends the straight path.
+	bool endReached;				///< True if the funnel has processed the whole path.
+	bool partialEnd;				///< True if the end is clamped to an invalid portal.
+	
+	int options;					///< Query options. (see: #dtStraightPathOptions)
+	dtStatus status;				///< The status of the query.
+};
+
+/// The memory used by a navigation mesh query, in bytes.
+/// @see dtNavMeshQuery::getMemoryStats()
+/// @ingroup detour
+struct dtNavMeshQueryMemoryStats
+{
+	int querySize;					///< The query object.
+	int nodePoolSize;				///< The node pool of the graph searches.
+	int openListSize;				///< The open list of the graph searches.
+	int scratchSize;				///< The node scratch of the local searches, at its current size.
+	int raycastCacheSize;			///< The line of sight cache of the any-angle searches.
+	int totalSize;					///< The total memory used by the query.
+};
+
 /// Provides custom polygon query behavior.
 /// Used by dtNavMeshQuery::queryPolygons.
 /// @ingroup detour
@@ -194,6 +248,47 @@ public:
 					  const dtQueryFilter* filter,
 					  dtPolyRef* path, int* pathCount, const int maxPath) const;
 
+	/// Finds a path from the start polygon to the end polygon using a filter type known at compile time.
+	/// The filter calls are resolved statically and can be inlined into the search loop.
+	/// Include DetourFindPath.h to use it.
+	///  @param[in]		startRef	The refrence id of the start polygon.
+	///  @param[in]		endRef		The reference id of the end polygon.
+	///  @param[in]		startPos	A position within the start polygon. [(x, y, z)]
+	///  @param[in]		endPos		A position within the end polygon. [(x, y, z)]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[out]	path		An ordered list of polygon references representing the path. (Start to end.) 
+	///  							[(polyRef) * @p pathCount]
+	///  @param[out]	pathCount	The number of polygons returned in the @p path array.
+	///  @param[in]		maxPath		The maximum number of polygons the @p path array can hold. [Limit: >= 1]
+	template<class TFilter>
+	dtStatus findPathT(dtPolyRef startRef, dtPolyRef endRef,
+					   const float* startPos, const float* endPos,
+					   const TFilter* filter,
+					   dtPolyRef* path, int* pathCount, const int maxPath) const;
+
+	/// Finds the paths from the start polygon to several target polygons using a single search.
+	///  @param[in]		startRef		The refrence id of the start polygon.
+	///  @param[in]		startPos		A position within the start polygon. [(x, y, z)]
+	///  @param[in]		targetRefs		The reference ids of the target polygons. [(polyRef) * @p targetCount]
+	///  @param[in]		targetPos		A position within each target polygon. [(x, y, z) * @p targetCount]
+	///  @param[in]		targetCount		The number of targets.
+	///  @param[in]		maxSettled		The search stops once at least this many targets have been reached.
+	///  								[Limit: 0 = all targets]
+	///  @param[in]		filter			The polygon filter to apply to the query.
+	///  @param[out]	targetCosts		The cost of the path to each target, or FLT_MAX if the target
+	///  								was not reached. [(cost) * @p targetCount]
+	///  @param[out]	paths			An ordered list of polygon references per target. (Start to target.)
+	///  								The path to target i starts at <tt>paths[i * maxPath]</tt>.
+	///  								[(polyRef) * @p targetCount * @p maxPath]
+	///  @param[out]	pathCounts		The number of polygons in the path to each target, or zero if
+	///  								the target was not reached. [(count) * @p targetCount]
+	///  @param[in]		maxPath			The maximum number of polygons each path can hold. [Limit: >= 1]
+	/// @returns The status flags for the query.
+	dtStatus findPathsToMany(dtPolyRef startRef, const float* startPos,
+							 const dtPolyRef* targetRefs, const float* targetPos, const int targetCount,
+							 const int maxSettled, const dtQueryFilter* filter,
+							 float* targetCosts, dtPolyRef* paths, int* pathCounts, const int maxPath) const;
+
 	/// Finds the straight path from the start to the end position within the polygon corridor.
 	///  @param[in]		startPos			Path start position. [(x, y, z)]
 	///  @param[in]		endPos				Path end position. [(x, y, z)]
@@ -211,6 +306,33 @@ public:
 							  float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
 							  int* straightPathCount, const int maxStraightPath, const int options = 0) const;
 
+	/// Initializes a straight path query that returns the vertices of the straight path in steps.
+	///  @param[in]		startPos	Path start position. [(x, y, z)]
+	///  @param[in]		endPos		Path end position. [(x, y, z)]
+	///  @param[in]		path		An array of polygon references that represent the path corridor.
+	///  @param[in]		pathSize	The number of polygons in the @p path array.
+	///  @param[out]	state		The state of the query.
+	///  @param[in]		options		Query options. (see: #dtStraightPathOptions)
+	/// @returns The status flags for the query.
+	dtStatus initStraightPath(const float* startPos, const float* endPos,
+							  const dtPolyRef* path, const int pathSize,
+							  dtStraightPathState* state, const int options = 0) const;
+	
+	/// Appends the next vertices of a straight path query to the straight path arrays.
+	///  @param[in,out]	state				The state of the query. (See: #initStraightPath)
+	///  @param[in]		path				The polygon references passed to #initStraightPath.
+	///  @param[in]		pathSize			The number of polygons in the @p path array.
+	///  @param[out]	straightPath		Points describing the straight path. [(x, y, z) * @p straightPathCount].
+	///  @param[out]	straightPathFlags	Flags describing each point. (See: #dtStraightPathFlags) [opt]
+	///  @param[out]	straightPathRefs	The reference id of the polygon that is being entered at each point. [opt]
+	///  @param[in,out]	straightPathCount	The number of points in the straight path arrays. The new points 
+	///  									are appended after the points already in the arrays.
+	///  @param[in]		maxStraightPath		The maximum number of points the straight path arrays can hold.  [Limit: > 0]
+	/// @returns The status flags for the query. #DT_IN_PROGRESS if the arrays are full before the end of the path.
+	dtStatus updateStraightPath(dtStraightPathState* state, const dtPolyRef* path, const int pathSize,
+								float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
+								int* straightPathCount, const int maxStraightPath) const;
+
 	///@}
 	/// @name Sliced Pathfinding Functions
 	/// Common use case:
@@ -237,6 +359,14 @@ public:
 	/// @returns The status flags for the query.
 	dtStatus updateSlicedFindPath(const int maxIter, int* doneIters);
 
+	/// Updates an in-progress sliced path query until a time budget is used.
+	///  @param[in]		maxIter			The maximum number of iterations to perform.
+	///  @param[in]		maxTimeNs		The time budget in nanoseconds.
+	///  @param[out]	doneIters		The actual number of iterations completed. [opt]
+	///  @param[out]	itersPerUsec	The number of iterations completed per microsecond. [opt]
+	/// @returns The status flags for the query.
+	dtStatus updateSlicedFindPathTimed(const int maxIter, const uint64_t maxTimeNs, int* doneIters, float* itersPerUsec);
+
 	/// Finalizes and returns the results of a sliced path query.
 	///  @param[out]	path		An ordered list of polygon references representing the path. (Start to end.) 
 	///  							[(polyRef) * @p pathCount]
@@ -325,6 +455,33 @@ public:
 							 const dtQueryFilter* filter,
 							 dtPolyRef* nearestRef, float* nearestPt) const;
 	
+	/// Finds the polygon nearest to the specified center point, starting from the polygon it was last found in.
+	///  @param[in]		hintRef		The polygon the point was last found in. [opt]
+	///  @param[in]		center		The center of the search box. [(x, y, z)]
+	///  @param[in]		halfExtents	The search distance along each axis. [(x, y, z)]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[out]	nearestRef	The reference id of the nearest polygon.
+	///  @param[out]	nearestPt	The nearest point on the polygon. [opt] [(x, y, z)]
+	///  @param[out]	result		How the polygon was located. [opt]
+	/// @returns The status flags for the query.
+	dtStatus findNearestPolyHinted(dtPolyRef hintRef, const float* center, const float* halfExtents,
+								   const dtQueryFilter* filter,
+								   dtPolyRef* nearestRef, float* nearestPt,
+								   dtNearestPolyHintResult* result = 0) const;
+	
+	/// Finds the polygons nearest to a batch of points.
+	///  @param[in]		points		The centers of the search boxes. [(x, y, z) * @p count]
+	///  @param[in]		count		The number of points.
+	///  @param[in]		halfExtents	The search distance along each axis. [(x, y, z)]
+	///  @param[in]		filter		The polygon filter to apply to the query.
+	///  @param[out]	nearestRefs	The reference ids of the nearest polygons. [(polyRef) * @p count]
+	///  @param[out]	nearestPts	The nearest points on the polygons. [opt] [(x, y, z) * @p count]
+	///  @param[in]		hints		The polygons the points were last found in. [opt] [(polyRef) * @p count]
+	/// @returns The status flags for the query.
+	dtStatus findNearestPolyBatch(const float* points, const int count, const float* halfExtents,
+								  const dtQueryFilter* filter,
+								  dtPolyRef* nearestRefs, float* nearestPts, const dtPolyRef* hints = 0) const;
+	
 	/// Finds polygons that overlap the search box.
 	///  @param[in]		center		The center of the search box. [(x, y, z)]
 	///  @param[in]		halfExtents		The search distance along each axis. [(x, y, z)]
@@ -497,13 +654,39 @@ public:
 	/// @returns True if the polygon is in closed list.
 	bool isInClosedList(dtPolyRef ref) const;
 	
+	/// Gets the middle point of the portal between two adjacent polygons.
+	///  @param[in]		from		The reference id of the polygon the portal leaves.
+	///  @param[in]		to			The reference id of the polygon the portal enters.
+	///  @param[out]	mid			The middle point of the portal. [(x, y, z)]
+	/// @returns The status flags for the query.
+	dtStatus getEdgeMidPoint(dtPolyRef from, dtPolyRef to, float* mid) const;
+	
 	/// Gets the node pool.
 	/// @returns The node pool.
 	class dtNodePool* getNodePool() const { return m_nodePool; }
 	
+	/// Gets the node scratch used by #moveAlongSurface and #findLocalNeighbourhood.
+	/// The scratch grows when a search runs out of nodes, up to the node count given to #init,
+	/// and its high-water mark tells how large the searches have been.
+	/// @returns The node scratch.
+	class dtNodeScratch* getNodeScratch() const { return m_scratch; }
+	
 	/// Gets the navigation mesh the query object is using.
 	/// @return The navigation mesh the query object is using.
 	const dtNavMesh* getAttachedNavMesh() const { return m_nav; }
+	
+	/// Sets the arena used for the temporary memory of the queries.
+	/// The arena is not owned by the query, and must not be shared with another thread.
+	///  @param[in]		arena	The arena to use, or null to use the allocator. [opt]
+	void setTempArena(dtArena* arena) { m_tempArena = arena; }
+	
+	/// Gets the arena used for the temporary memory of the queries.
+	/// @return The arena, or null if the allocator is used.
+	dtArena* getTempArena() const { return m_tempArena; }
+	
+	/// Gets the memory used by the query object, excluding the navigation mesh.
+	///  @param[out]	stats	The memory statistics.
+	void getMemoryStats(dtNavMeshQueryMemoryStats* stats) const;
 
 	/// @}
 	
@@ -516,6 +699,10 @@ private:
 	void queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, const float* qmax,
 							 const dtQueryFilter* filter, dtPolyQuery* query) const;
 
+	/// Tests if a point is still over a hint polygon, and within the climb height from it.
+	bool isNearestPolyHint(dtPolyRef ref, const float* pos, const float* halfExtents,
+						   const dtQueryFilter* filter, float* nearestPt) const;
+
 	/// Returns portal points between two polygons.
 	dtStatus getPortalPoints(dtPolyRef from, dtPolyRef to, float* left, float* right,
 							 unsigned char& fromType, unsigned char& toType) const;
@@ -524,7 +711,6 @@ private:
 							 float* left, float* right) const;
 	
 	/// Returns edge mid point between two polygons.
-	dtStatus getEdgeMidPoint(dtPolyRef from, dtPolyRef to, float* mid) const;
 	dtStatus getEdgeMidPoint(dtPolyRef from, const dtPoly* fromPoly, const dtMeshTile* fromTile,
 							 dtPolyRef to, const dtPoly* toPoly, const dtMeshTile* toTile,
 							 float* mid) const;
@@ -534,10 +720,24 @@ private:
 						  float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
 						  int* straightPathCount, const int maxStraightPath) const;
 
-	// Appends intermediate portal points to a straight path.
-	dtStatus appendPortals(const int startIdx, const int endIdx, const float* endPos, const dtPolyRef* path,
+	// Appends the pending intermediate portal points of a straight path query to a straight path.
+	dtStatus appendPortals(dtStraightPathState* state, const dtPolyRef* path,
 						   float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
-						   int* straightPathCount, const int maxStraightPath, const int options) const;
+						   int* straightPathCount, const int maxStraightPath) const;
+
+	// Updates the sliced path query until the iterations are used or the clock reaches the deadline.
+	dtStatus updateSlicedFindPathUntil(const int maxIter, const uint64_t deadline, int* doneIters);
+
+	// Starts a raycast, and advances it past the current polygon.
+	dtStatus initRaycastRay(struct dtRaycastRay& ray, dtPolyRef startRef, const float* startPos, const float* endPos,
+							dtRaycastHit* hit, dtPolyRef prevRef) const;
+	bool advanceRaycastRay(struct dtRaycastRay& ray, const float* verts, const int nv,
+						   const bool intersects, const float tmax, const int segMax,
+						   const dtQueryFilter* filter, const unsigned int options) const;
+
+	// Tests the line of sight between the parent and a neighbour node of an any-angle search.
+	bool raycastShortcut(const struct dtNode* parentNode, dtPolyRef grandpaRef, const struct dtNode* neighbourNode,
+						 const float costTail, const float maxTotal, float* cost);
 
 	// Gets the path leading to the specified end node.
 	dtStatus getPathToNode(struct dtNode* endNode, dtPolyRef* path, int* pathCount, int maxPath) const;
@@ -557,9 +757,22 @@ private:
 	};
 	dtQueryData m_query;				///< Sliced query state.
 
-	class dtNodePool* m_tinyNodePool;	///< Pointer to small node pool.
+	/// A line of sight test cached by an any-angle search.
+	struct dtRaycastCacheEntry
+	{
+		dtPolyRef fromRef, toRef, prevRef;
+		float cost;
+		unsigned int stamp;
+		bool visible;
+	};
+	dtRaycastCacheEntry* m_raycastCache;	///< Line of sight tests of the current sliced query.
+	int m_raycastCacheMask;
+	unsigned int m_raycastCacheStamp;
+
+	class dtNodeScratch* m_scratch;		///< Pointer to growable node pool for small searches.
 	class dtNodePool* m_nodePool;		///< Pointer to node pool.
 	class dtNodeQueue* m_openList;		///< Pointer to open list queue.
+	dtArena* m_tempArena;				///< Arena for temporary memory, not owned.
 };
 
 /// Allocates a query object using the Detour allocator.
@@ -21,6 +21,11 @@
 
 #include "DetourNavMesh.h"
 
+// Define DT_NODE_QUEUE_4ARY if you wish the open list to use a 4-ary heap instead of a binary heap.
+// The wider heap is shallower, which makes push and modify cheaper and keeps the children
+// of a node next to each other in memory, at the cost of more comparisons per pop.
+//#define DT_NODE_QUEUE_4ARY 1
+
 enum dtNodeFlags
 {
 	DT_NODE_OPEN = 0x01,
@@ -42,10 +47,17 @@ struct dtNode
 	unsigned int state : DT_NODE_STATE_BITS;	///< extra state information. A polyRef can have multiple nodes with different extra info. see DT_MAX_STATES_PER_NODE
 	unsigned int flags : 3;						///< Node flags. A combination of dtNodeFlags.
 	dtPolyRef id;								///< Polygon ref the node corresponds to.
+	int heapIdx;								///< Index of the node in the open list heap, only valid while the node is open.
 };
 
 static const int DT_MAX_STATES_PER_NODE = 1 << DT_NODE_STATE_BITS;	// number of extra states per node. See dtNode::state
 
+#ifdef DT_NODE_QUEUE_4ARY
+static const int DT_NODE_QUEUE_ARITY = 4;
+#else
+static const int DT_NODE_QUEUE_ARITY = 2;
+#endif
+
 class dtNodePool
 {
 public:
@@ -129,16 +141,14 @@ public:
 		bubbleUp(m_size-1, node);
 	}
 	
+	/// Restores the heap order after the total cost of a node in the queue has decreased.
+	/// The node keeps track of its own heap position, so this is O(log n).
 	inline void modify(dtNode* node)
 	{
-		for (int i = 0; i < m_size; ++i)
-		{
-			if (m_heap[i] == node)
-			{
-				bubbleUp(i, node);
-				return;
-			}
-		}
+		const int i = node->heapIdx;
+		if (i < 0 || i >= m_size || m_heap[i] != node)
+			return;
+		bubbleUp(i, node);
 	}
 	
 	inline bool empty() const { return m_size == 0; }
@@ -164,5 +174,65 @@ private:
 	int m_size;
 };		
 
+/// A node pool and a first-in first-out queue of its nodes for the small breadth-first searches.
+/// The pool grows when a search runs out of nodes, and keeps its size between the searches.
+class dtNodeScratch
+{
+public:
+	dtNodeScratch();
+	~dtNodeScratch();
+	
+	/// Allocates the pool unless it already holds @p maxNodes, and sets the size the pool may grow to.
+	bool init(int maxNodes, int maxNodesLimit);
+	
+	/// Doubles the size of the pool, up to the limit. The nodes and the queue are cleared.
+	/// Returns false if the pool is at the limit, or could not be allocated.
+	bool grow();
+	
+	/// Clears the nodes and the queue for a new search.
+	void clear();
+	
+	inline dtNodePool* getNodePool() { return m_pool; }
+	
+	/// Adds a node at the back of the queue. Each node may be added once per search.
+	inline void push(dtNode* node)
+	{
+		m_queue[m_tail++] = (dtNodeIndex)(m_pool->getNodeIdx(node) - 1);
+	}
+	
+	/// Removes the node at the front of the queue.
+	inline dtNode* pop() { return m_pool->getNodeAtIdx(m_queue[m_head++] + 1); }
+	
+	inline bool empty() const { return m_head == m_tail; }
+	
+	/// The largest number of nodes used by a search.
+	inline int getHighWaterMark() const
+	{
+		const int used = m_pool ? m_pool->getNodeCount() : 0;
+		return used > m_highWaterMark ? used : m_highWaterMark;
+	}
+	
+	inline int getMaxNodes() const { return m_pool ? m_pool->getMaxNodes() : 0; }
+	
+	inline int getMemUsed() const
+	{
+		return sizeof(*this) +
+			(m_pool ? m_pool->getMemUsed() + sizeof(dtNodeIndex)*m_pool->getMaxNodes() : 0);
+	}
+	
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtNodeScratch(const dtNodeScratch&);
+	dtNodeScratch& operator=(const dtNodeScratch&);
+	
+	bool allocate(int maxNodes);
+	
+	dtNodePool* m_pool;
+	dtNodeIndex* m_queue;
+	int m_head, m_tail;
+	int m_maxNodesLimit;
+	int m_highWaterMark;
+};
+
 
 #endif // DETOURNODE_H
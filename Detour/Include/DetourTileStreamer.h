@@ -0,0 +1,223 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURTILESTREAMER_H
+#define DETOURTILESTREAMER_H
+
+#include "DetourNavMesh.h"
+
+/// A magic number used to detect the compatibility of tile stream files.
+static const int DT_TILESTREAM_MAGIC = 'D'<<24 | 'N'<<16 | 'T'<<8 | 'S';
+
+/// A version number used to detect the compatibility of tile stream files.
+static const int DT_TILESTREAM_VERSION = 2;
+
+/// The header of a tile stream file.
+/// The header is followed by the index entries of the tiles, and then by the tile data.
+/// @ingroup detour
+struct dtTileStreamHeader
+{
+	int magic;						///< Tile stream magic number. (Used to identify the data format.)
+	int version;					///< Tile stream format version number.
+	dtNavMeshParams params;			///< The parameters of the navigation mesh the tiles belong to.
+	int tileCount;					///< The number of index entries.
+};
+
+/// The index entry of a tile in a tile stream.
+/// @ingroup detour
+struct dtTileStreamEntry
+{
+	int x;							///< The x-location of the tile within the tile grid.
+	int y;							///< The y-location of the tile within the tile grid.
+	int layer;						///< The layer of the tile.
+	int dataSize;					///< The size of the tile data.
+	unsigned int offset;			///< The offset of the tile data from the start of the stream.
+	dtTileRef ref;					///< The reference of the tile, restored when the tile is loaded. (0 to load the tile to the index of the entry.)
+};
+
+/// Provides the tile data for a dtTileStreamer.
+/// @ingroup detour
+struct dtTileStreamLoader
+{
+	virtual ~dtTileStreamLoader() { }
+
+	/// Reads the data of a tile.
+	///  @param[in]		entry		The index entry of the tile.
+	///  @param[out]	data		The buffer to read the data to. [Size: dtTileStreamEntry::dataSize]
+	/// @return The status flags for the operation.
+	virtual dtStatus loadTile(const dtTileStreamEntry* entry, unsigned char* data) = 0;
+
+	/// Starts reading the data of a tile in the background.
+	/// The read is completed by calling dtTileStreamer::finishLoad from the thread which
+	/// owns the navigation mesh.
+	///  @param[in]		index		The index of the entry, to pass to dtTileStreamer::finishLoad.
+	///  @param[in]		entry		The index entry of the tile.
+	///  @param[out]	data		The buffer to read the data to. [Size: dtTileStreamEntry::dataSize]
+	/// @return True if the read was started, false if the tile should be read with #loadTile instead.
+	virtual bool requestTile(const int /*index*/, const dtTileStreamEntry* /*entry*/, unsigned char* /*data*/) { return false; }
+};
+
+/// Reads tiles from a tile stream file.
+/// @ingroup detour
+class dtTileStreamFileLoader : public dtTileStreamLoader
+{
+public:
+	dtTileStreamFileLoader();
+	virtual ~dtTileStreamFileLoader();
+
+	/// Opens a tile stream file and reads its index.
+	///  @param[in]		path		The path of the file.
+	/// @return The status flags for the operation.
+	dtStatus open(const char* path);
+
+	/// Closes the file.
+	void close();
+
+	/// The header of the opened file.
+	inline const dtTileStreamHeader* getHeader() const { return &m_header; }
+
+	/// The index entries of the opened file. [Size: dtTileStreamHeader::tileCount]
+	inline const dtTileStreamEntry* getEntries() const { return m_entries; }
+
+	virtual dtStatus loadTile(const dtTileStreamEntry* entry, unsigned char* data);
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtTileStreamFileLoader(const dtTileStreamFileLoader&);
+	dtTileStreamFileLoader& operator=(const dtTileStreamFileLoader&);
+
+	void* m_file;
+	dtTileStreamHeader m_header;
+	dtTileStreamEntry* m_entries;
+};
+
+/// Writes the tiles of a navigation mesh to a tile stream file.
+///  @param[in]		path		The path of the file.
+///  @param[in]		mesh		The navigation mesh.
+/// @return The status flags for the operation.
+/// @ingroup detour
+dtStatus dtSaveTileStream(const char* path, const dtNavMesh* mesh);
+
+/// Keeps the tiles around the areas in use resident in a navigation mesh, and evicts the least
+/// recently used tiles when the resident tiles exceed a memory budget.
+/// @ingroup detour
+class dtTileStreamer
+{
+public:
+	dtTileStreamer();
+	~dtTileStreamer();
+
+	/// Initializes the streamer.
+	///  @param[in]		nav			The navigation mesh the tiles are added to. [Limit: No tiles added]
+	///  @param[in]		entries		The index entries of the tiles. [Size: @p entryCount]
+	///  @param[in]		entryCount	The number of tiles. [Limit: <= dtNavMesh::getMaxTiles()]
+	///  @param[in]		loader		Provides the tile data.
+	///  @param[in]		memoryBudget	The maximum memory used by the resident tiles. (See: dtTileMemoryStats::totalSize) [Limit: 0 = unlimited]
+	/// @return The status flags for the operation.
+	dtStatus init(dtNavMesh* nav, const dtTileStreamEntry* entries, const int entryCount,
+				  dtTileStreamLoader* loader, const int memoryBudget);
+
+	/// Marks the tiles overlapping the box as used, and loads the ones which are not resident.
+	///  @param[in]		bmin		The minimum bounds of the box. [(x, y, z)]
+	///  @param[in]		bmax		The maximum bounds of the box. [(x, y, z)]
+	/// @return The status flags for the operation.
+	dtStatus touchArea(const float* bmin, const float* bmax);
+
+	/// Marks the tiles at the grid location as used, and loads the ones which are not resident.
+	///  @param[in]		x			The x-location of the tiles.
+	///  @param[in]		y			The y-location of the tiles.
+	/// @return The status flags for the operation.
+	dtStatus touchTile(const int x, const int y);
+
+	/// Marks the tile of the polygon as used, and loads it if it is not resident.
+	///  @param[in]		ref			The reference id of the polygon.
+	/// @return The status flags for the operation.
+	dtStatus touchPolyRef(dtPolyRef ref);
+
+	/// Gets the residency of the tile of the polygon.
+	///  @param[in]		ref			The reference id of the polygon.
+	/// @return #DT_SUCCESS if the tile is resident, otherwise the status has #DT_TILE_NOT_RESIDENT set.
+	dtStatus getPolyRefStatus(dtPolyRef ref) const;
+
+	/// Completes a background read started with dtTileStreamLoader::requestTile.
+	///  @param[in]		index		The index of the entry.
+	///  @param[in]		status		The status of the read.
+	/// @return The status flags for the operation.
+	dtStatus finishLoad(const int index, dtStatus status);
+
+	/// Evicts the least recently used tiles until the resident tiles are within the memory budget,
+	/// and starts a new round of use. Tiles used since the previous update are not evicted.
+	void update();
+
+	inline int getEntryCount() const { return m_entryCount; }
+	inline const dtTileStreamEntry* getEntry(const int i) const { return &m_entries[i]; }
+	inline bool isResident(const int i) const { return m_items[i].state == DT_TILESTREAM_RESIDENT; }
+	inline int getResidentCount() const { return m_residentCount; }
+	/// The memory used by the resident tiles, including the search data the navigation mesh builds for them.
+	inline int getResidentBytes() const { return m_residentBytes; }
+	inline int getMemoryBudget() const { return m_memoryBudget; }
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtTileStreamer(const dtTileStreamer&);
+	dtTileStreamer& operator=(const dtTileStreamer&);
+
+	enum dtTileStreamState
+	{
+		DT_TILESTREAM_EVICTED,
+		DT_TILESTREAM_LOADING,
+		DT_TILESTREAM_RESIDENT,
+	};
+
+	struct dtTileStreamItem
+	{
+		dtTileRef ref;					///< The reference of the tile, kept while evicted so that the tile returns with the same reference.
+		unsigned char* data;			///< The data being read in the background.
+		unsigned int lastUsed;			///< The round the tile was last used in.
+		int memSize;					///< The memory used by the tile while it is resident.
+		int prev, next;					///< The neighbours in the least recently used list.
+		int nextHash;					///< The next entry in the location lookup.
+		unsigned char state;			///< The residency of the tile. (See: dtTileStreamState)
+	};
+
+	void purge();
+	dtStatus touchEntry(const int index);
+	void unlink(const int index);
+	void linkFront(const int index);
+	dtStatus evict(const int index);
+
+	dtNavMesh* m_nav;
+	dtTileStreamLoader* m_loader;
+	dtTileStreamEntry* m_entries;
+	dtTileStreamItem* m_items;
+	int m_entryCount;
+
+	int* m_posLookup;
+	int m_lookupMask;
+	int* m_tileEntries;					///< The entry loaded to each tile index, or -1. [Size: dtNavMesh::getMaxTiles()]
+
+	int m_lruHead;						///< The most recently used resident tile.
+	int m_lruTail;						///< The least recently used resident tile.
+	unsigned int m_round;
+
+	int m_residentCount;
+	int m_residentBytes;
+	int m_memoryBudget;
+};
+
+#endif // DETOURTILESTREAMER_H
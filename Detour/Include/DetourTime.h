@@ -0,0 +1,37 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURTIME_H
+#define DETOURTIME_H
+
+#include <stdint.h>
+
+/// A monotonic clock function.
+///  @return The current time in nanoseconds, relative to an arbitrary starting point.
+///  @see dtTimeSetCustom
+typedef uint64_t (dtTimeFunc)();
+
+/// Sets the clock used by the time limited Detour functions.
+///  @param[in]		timeFunc	The clock function to be used by #dtGetTimeNs, or null to use the default clock.
+void dtTimeSetCustom(dtTimeFunc* timeFunc);
+
+/// Reads the monotonic clock.
+///  @return The current time in nanoseconds, relative to an arbitrary starting point.
+uint64_t dtGetTimeNs();
+
+#endif // DETOURTIME_H
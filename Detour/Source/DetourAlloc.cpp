@@ -48,3 +48,95 @@ void dtFree(void* ptr)
 	if (ptr)
 		sFreeFunc(ptr);
 }
+
+// Each arena allocation is preceded by the offset of the previous allocation, so that
+// the allocations can be popped in reverse order.
+static const size_t DT_ARENA_ALIGN = 16;
+static const size_t DT_ARENA_HEADER_SIZE = DT_ARENA_ALIGN;
+
+inline size_t dtArenaAlign(size_t x) { return (x + (DT_ARENA_ALIGN-1)) & ~(DT_ARENA_ALIGN-1); }
+
+dtArena::dtArena() :
+	m_buffer(0),
+	m_capacity(0),
+	m_top(0),
+	m_last(0),
+	m_high(0),
+	m_overflowCount(0)
+{
+}
+
+dtArena::~dtArena()
+{
+	dtFree(m_buffer);
+}
+
+/// @par
+///
+/// May be called more than once to resize the arena. All the allocations are released.
+bool dtArena::init(size_t capacity)
+{
+	dtFree(m_buffer);
+	m_buffer = 0;
+	m_capacity = 0;
+	m_top = 0;
+	m_last = 0;
+	m_high = 0;
+	m_overflowCount = 0;
+
+	capacity = dtArenaAlign(capacity);
+	m_buffer = (unsigned char*)dtAlloc(capacity, DT_ALLOC_PERM);
+	if (!m_buffer)
+		return false;
+	m_capacity = capacity;
+	return true;
+}
+
+void* dtArena::alloc(size_t size)
+{
+	const size_t offset = m_top + DT_ARENA_HEADER_SIZE;
+	if (!m_buffer || size > m_capacity || offset + size > m_capacity)
+	{
+		m_overflowCount++;
+		return 0;
+	}
+	*(size_t*)(m_buffer + m_top) = m_last;
+	m_last = offset;
+	m_top = dtArenaAlign(offset + size);
+	if (m_top > m_high)
+		m_high = m_top;
+	return m_buffer + offset;
+}
+
+void dtArena::free(void* ptr)
+{
+	if (!ptr || !owns(ptr))
+		return;
+	const size_t offset = (size_t)((unsigned char*)ptr - m_buffer);
+	if (offset != m_last)
+		return;
+	m_top = offset - DT_ARENA_HEADER_SIZE;
+	m_last = *(size_t*)(m_buffer + m_top);
+}
+
+void dtArena::reset()
+{
+	m_top = 0;
+	m_last = 0;
+}
+
+void* dtAllocTemp(dtArena* arena, size_t size)
+{
+	void* ptr = arena ? arena->alloc(size) : 0;
+	if (!ptr)
+		ptr = dtAlloc(size, DT_ALLOC_TEMP);
+	return ptr;
+}
+
+void dtFreeTemp(dtArena* arena, void* ptr)
+{
+	if (arena && arena->owns(ptr))
+		arena->free(ptr);
+	else
+		dtFree(ptr);
+}
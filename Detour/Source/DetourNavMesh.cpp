@@ -27,6 +27,11 @@
 #include "DetourAssert.h"
 #include <new>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DT_WIDE_BVNODE_SSE2 1
+#endif
+
 
 inline bool overlapSlabs(const float* amin, const float* amax,
 						 const float* bmin, const float* bmax,
@@ -139,7 +144,7 @@ inline void freeLink(dtMeshTile* tile, unsigned int link)
 
 dtNavMesh* dtAllocNavMesh()
 {
-	void* mem = dtAlloc(sizeof(dtNavMesh), DT_ALLOC_PERM);
+	void* mem = dtAlloc(sizeof(dtNavMesh), DT_ALLOC_PERM_NAVMESH);
 	if (!mem) return 0;
 	return new(mem) dtNavMesh;
 }
@@ -195,7 +200,10 @@ dtNavMesh::dtNavMesh() :
 	m_tileLutMask(0),
 	m_posLookup(0),
 	m_nextFree(0),
-	m_tiles(0)
+	m_tiles(0),
+	m_retired(0),
+	m_epoch(0),
+	m_deferredReclaim(false)
 {
 #ifndef DT_POLYREF64
 	m_saltBits = 0;
@@ -203,6 +211,8 @@ dtNavMesh::dtNavMesh() :
 	m_polyBits = 0;
 #endif
 	memset(&m_params, 0, sizeof(dtNavMeshParams));
+	memset(&m_tileGrid, 0, sizeof(dtNavMeshTileGrid));
+	memset(&m_journal, 0, sizeof(m_journal));
 	m_orig[0] = 0;
 	m_orig[1] = 0;
 	m_orig[2] = 0;
@@ -210,6 +220,16 @@ dtNavMesh::dtNavMesh() :
 
 dtNavMesh::~dtNavMesh()
 {
+	// Retired tiles still own their data and are freed with the other tiles below.
+	while (m_retired)
+	{
+		dtRetiredItem* item = m_retired;
+		m_retired = item->next;
+		dtFree(item->mem[0]);
+		dtFree(item->mem[1]);
+		dtFree(item);
+	}
+
 	for (int i = 0; i < m_maxTiles; ++i)
 	{
 		if (m_tiles[i].flags & DT_TILE_FREE_DATA)
@@ -218,13 +238,35 @@ dtNavMesh::~dtNavMesh()
 			m_tiles[i].data = 0;
 			m_tiles[i].dataSize = 0;
 		}
+		dtFree(m_tiles[i].polySearch);
+		dtFree(m_tiles[i].adjacency);
+		dtFree(m_tiles[i].bvWideTree);
+		dtFree(m_tiles[i].detailGrids);
+		dtFree(m_tiles[i].polyStamps);
 	}
 	dtFree(m_posLookup);
 	dtFree(m_tiles);
+	dtFree(m_journal.entries);
 }
 		
 dtStatus dtNavMesh::init(const dtNavMeshParams* params)
 {
+	return init(params, 0);
+}
+
+/// @par
+///
+/// When the grid is specified, the tiles are looked up from a table with one
+/// entry per grid location instead of a hash table, which avoids the hashing
+/// and the collisions between locations. Tiles outside the grid cannot be added.
+///
+/// The grid is not part of #dtNavMeshParams, so it needs to be stored separately
+/// along with the parameters when the navigation mesh is saved.
+dtStatus dtNavMesh::init(const dtNavMeshParams* params, const dtNavMeshTileGrid* grid)
+{
+	if (grid && (grid->width <= 0 || grid->height <= 0))
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
 	memcpy(&m_params, params, sizeof(dtNavMeshParams));
 	dtVcopy(m_orig, params->orig);
 	m_tileWidth = params->tileWidth;
@@ -232,14 +274,24 @@ dtStatus dtNavMesh::init(const dtNavMeshParams* params)
 	
 	// Init tiles
 	m_maxTiles = params->maxTiles;
-	m_tileLutSize = dtNextPow2(params->maxTiles/4);
-	if (!m_tileLutSize) m_tileLutSize = 1;
-	m_tileLutMask = m_tileLutSize-1;
+	if (grid)
+	{
+		memcpy(&m_tileGrid, grid, sizeof(dtNavMeshTileGrid));
+		m_tileLutSize = grid->width * grid->height;
+		m_tileLutMask = 0;
+	}
+	else
+	{
+		memset(&m_tileGrid, 0, sizeof(dtNavMeshTileGrid));
+		m_tileLutSize = dtNextPow2(params->maxTiles/4);
+		if (!m_tileLutSize) m_tileLutSize = 1;
+		m_tileLutMask = m_tileLutSize-1;
+	}
 	
-	m_tiles = (dtMeshTile*)dtAlloc(sizeof(dtMeshTile)*m_maxTiles, DT_ALLOC_PERM);
+	m_tiles = (dtMeshTile*)dtAlloc(sizeof(dtMeshTile)*m_maxTiles, DT_ALLOC_PERM_NAVMESH);
 	if (!m_tiles)
 		return DT_FAILURE | DT_OUT_OF_MEMORY;
-	m_posLookup = (dtMeshTile**)dtAlloc(sizeof(dtMeshTile*)*m_tileLutSize, DT_ALLOC_PERM);
+	m_posLookup = (dtMeshTile**)dtAlloc(sizeof(dtMeshTile*)*m_tileLutSize, DT_ALLOC_PERM_NAVMESH);
 	if (!m_posLookup)
 		return DT_FAILURE | DT_OUT_OF_MEMORY;
 	memset(m_tiles, 0, sizeof(dtMeshTile)*m_maxTiles);
@@ -272,7 +324,7 @@ dtStatus dtNavMesh::init(unsigned char* data, const int dataSize, const int flag
 	dtMeshHeader* header = (dtMeshHeader*)data;
 	if (header->magic != DT_NAVMESH_MAGIC)
 		return DT_FAILURE | DT_WRONG_MAGIC;
-	if (header->version != DT_NAVMESH_VERSION)
+	if ((header->version & DT_NAVMESH_VERSION_MASK) != DT_NAVMESH_VERSION)
 		return DT_FAILURE | DT_WRONG_VERSION;
 
 	dtNavMeshParams params;
@@ -298,6 +350,24 @@ const dtNavMeshParams* dtNavMesh::getParams() const
 	return &m_params;
 }
 
+const dtNavMeshTileGrid* dtNavMesh::getTileGrid() const
+{
+	return m_tileGrid.width ? &m_tileGrid : 0;
+}
+
+inline dtMeshTile** dtNavMesh::getTileBucket(const int x, const int y) const
+{
+	if (m_tileGrid.width)
+	{
+		const unsigned int gx = (unsigned int)(x - m_tileGrid.minX);
+		const unsigned int gy = (unsigned int)(y - m_tileGrid.minY);
+		if (gx >= (unsigned int)m_tileGrid.width || gy >= (unsigned int)m_tileGrid.height)
+			return 0;
+		return &m_posLookup[gy*(unsigned int)m_tileGrid.width + gx];
+	}
+	return &m_posLookup[computeTileHash(x, y, m_tileLutMask)];
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////
 // Search for neighbor polygons in the tile.
 int dtNavMesh::findConnectingPolys(const float* va, const float* vb,
@@ -621,6 +691,193 @@ void dtNavMesh::baseOffMeshLinks(dtMeshTile* tile)
 	}
 }
 
+inline void updatePolySearchData(dtMeshTile* tile, const unsigned int ip)
+{
+	const dtPoly* poly = &tile->polys[ip];
+	dtPolySearchData* sd = &tile->polySearch[ip];
+	sd->flags = poly->flags;
+	sd->areaAndtype = poly->areaAndtype;
+}
+
+/// Returns the size of the compact polygon adjacency of a tile, including its arrays.
+static int getAdjacencyMemUsed(const dtMeshHeader* header)
+{
+	const int n = dtMax(header->maxLinkCount, 1);
+	return (int)(dtAlign4(sizeof(dtTileAdjacency)) + (sizeof(dtPolyAdjacency) + sizeof(dtPolyPortal))*n +
+				 sizeof(unsigned int)*(header->polyCount+1));
+}
+
+/// Allocates the compact polygon adjacency of a tile and its arrays in a single block.
+static dtTileAdjacency* allocAdjacency(const dtMeshHeader* header)
+{
+	const int n = dtMax(header->maxLinkCount, 1);
+	unsigned char* mem = (unsigned char*)dtAlloc(getAdjacencyMemUsed(header), DT_ALLOC_PERM_NAVMESH);
+	if (!mem)
+		return 0;
+	dtTileAdjacency* adjacency = (dtTileAdjacency*)mem;
+	mem += dtAlign4(sizeof(dtTileAdjacency));
+	adjacency->entries = (dtPolyAdjacency*)mem;
+	mem += sizeof(dtPolyAdjacency)*n;
+	adjacency->portals = (dtPolyPortal*)mem;
+	mem += sizeof(dtPolyPortal)*n;
+	adjacency->base = (unsigned int*)mem;
+	return adjacency;
+}
+
+static void calcPortalPoints(const dtNavMesh* nav, const dtMeshTile* fromTile, const dtPoly* fromPoly,
+							 dtPolyRef to, float* left, float* right)
+{
+	// Find the link that points to the 'to' polygon.
+	const dtLink* link = 0;
+	for (unsigned int i = fromPoly->firstLink; i != DT_NULL_LINK; i = fromTile->links[i].next)
+	{
+		if (fromTile->links[i].ref == to)
+		{
+			link = &fromTile->links[i];
+			break;
+		}
+	}
+	
+	const dtMeshTile* toTile = 0;
+	const dtPoly* toPoly = 0;
+	if (to)
+		nav->getTileAndPolyByRefUnsafe(to, &toTile, &toPoly);
+	
+	dtVcopy(left, &fromTile->verts[fromPoly->verts[0]*3]);
+	dtVcopy(right, left);
+	
+	if (!link || !toPoly)
+	{
+		// Should not happen, keep the position on the polygon.
+	}
+	else if (fromPoly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+	{
+		dtVcopy(left, &fromTile->verts[fromPoly->verts[link->edge]*3]);
+		dtVcopy(right, left);
+	}
+	else if (toPoly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+	{
+		for (unsigned int i = toPoly->firstLink; i != DT_NULL_LINK; i = toTile->links[i].next)
+		{
+			if (toTile->links[i].ref == nav->getPolyRefBase(fromTile) + (dtPolyRef)(fromPoly - fromTile->polys))
+			{
+				const int v = toTile->links[i].edge;
+				dtVcopy(left, &toTile->verts[toPoly->verts[v]*3]);
+				dtVcopy(right, left);
+				break;
+			}
+		}
+	}
+	else
+	{
+		const int v0 = fromPoly->verts[link->edge];
+		const int v1 = fromPoly->verts[(link->edge+1) % (int)fromPoly->vertCount];
+		dtVcopy(left, &fromTile->verts[v0*3]);
+		dtVcopy(right, &fromTile->verts[v1*3]);
+		
+		// If the link is at tile boundary, clamp the vertices to the link width.
+		if (link->side != 0xff && (link->bmin != 0 || link->bmax != 255))
+		{
+			const float s = 1.0f/255.0f;
+			dtVlerp(left, &fromTile->verts[v0*3], &fromTile->verts[v1*3], link->bmin*s);
+			dtVlerp(right, &fromTile->verts[v0*3], &fromTile->verts[v1*3], link->bmax*s);
+		}
+	}
+}
+
+/// @par
+///
+/// The portals and their midpoints match the ones dtNavMeshQuery computes from the links,
+/// so searches walking the adjacency find the same paths as searches walking the links.
+void dtNavMesh::buildAdjacency(const dtMeshTile* tile, dtTileAdjacency* adjacency) const
+{
+	if (!tile || !tile->header || !adjacency)
+		return;
+	
+	unsigned int* adjBase = adjacency->base;
+	dtPolyAdjacency* adj = adjacency->entries;
+	dtPolyPortal* portals = adjacency->portals;
+	unsigned int n = 0;
+	for (int i = 0; i < tile->header->polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		adjBase[i] = n;
+		for (unsigned int j = poly->firstLink; j != DT_NULL_LINK; j = tile->links[j].next)
+		{
+			const dtLink* link = &tile->links[j];
+			dtPolyPortal* portal = &portals[n];
+			dtPolyAdjacency* nei = &adj[n++];
+			nei->ref = link->ref;
+			nei->edge = link->edge;
+			nei->side = link->side;
+			calcPortalPoints(this, tile, poly, link->ref, portal->left, portal->right);
+			nei->mid[0] = (portal->left[0]+portal->right[0])*0.5f;
+			nei->mid[1] = (portal->left[1]+portal->right[1])*0.5f;
+			nei->mid[2] = (portal->left[2]+portal->right[2])*0.5f;
+		}
+	}
+	adjBase[tile->header->polyCount] = n;
+}
+
+/// @par
+///
+/// With deferred reclamation enabled, the new adjacency is built into a new allocation
+/// which is then published with a single release store. A search loading the adjacency
+/// with #dtGetTileAdjacency sees either the old or the new adjacency, never a mix of both.
+/// The old adjacency is retired until the readers are done with it.
+void dtNavMesh::rebuildAdjacency(dtMeshTile* tile)
+{
+	if (!tile || !tile->header || !tile->adjacency)
+		return;
+	
+	// The links of the tile changed with the tile added or removed next to it.
+	tile->stateVersion = m_journal.version;
+	
+	if (!m_deferredReclaim)
+	{
+		buildAdjacency(tile, tile->adjacency);
+		return;
+	}
+	
+	const dtMeshHeader* header = tile->header;
+	dtTileAdjacency* adjacency = allocAdjacency(header);
+	if (!adjacency)
+	{
+		// Out of memory, update in place.
+		buildAdjacency(tile, tile->adjacency);
+		return;
+	}
+	buildAdjacency(tile, adjacency);
+	
+	dtTileAdjacency* oldAdjacency = tile->adjacency;
+	dtAtomicStoreRelease(&tile->adjacency, adjacency);
+	if (!retire(0, oldAdjacency, 0, getAdjacencyMemUsed(header)))
+		dtFree(oldAdjacency);
+}
+
+void dtNavMesh::buildNeighbourAdjacency(dtMeshTile* tile)
+{
+	static const int MAX_NEIS = 32;
+	dtMeshTile* neis[MAX_NEIS];
+	int nneis;
+	
+	// Other layers in the current tile.
+	nneis = getTilesAt(tile->header->x, tile->header->y, neis, MAX_NEIS);
+	for (int j = 0; j < nneis; ++j)
+	{
+		if (neis[j] != tile)
+			rebuildAdjacency(neis[j]);
+	}
+	
+	// Neighbour tiles.
+	for (int i = 0; i < 8; ++i)
+	{
+		nneis = getNeighbourTilesAt(tile->header->x, tile->header->y, i, neis, MAX_NEIS);
+		for (int j = 0; j < nneis; ++j)
+			rebuildAdjacency(neis[j]);
+	}
+}
+
 void dtNavMesh::closestPointOnPoly(dtPolyRef ref, const float* pos, float* closest, bool* posOverPoly) const
 {
 	const dtMeshTile* tile = 0;
@@ -641,9 +898,6 @@ void dtNavMesh::closestPointOnPoly(dtPolyRef ref, const float* pos, float* close
 		return;
 	}
 	
-	const unsigned int ip = (unsigned int)(poly - tile->polys);
-	const dtPolyDetail* pd = &tile->detailMeshes[ip];
-	
 	// Clamp point to be inside the polygon.
 	float verts[DT_VERTS_PER_POLYGON*3];	
 	float edged[DT_VERTS_PER_POLYGON];
@@ -680,24 +934,9 @@ void dtNavMesh::closestPointOnPoly(dtPolyRef ref, const float* pos, float* close
 	}
 	
 	// Find height at the location.
-	for (int j = 0; j < pd->triCount; ++j)
-	{
-		const unsigned char* t = &tile->detailTris[(pd->triBase+j)*4];
-		const float* v[3];
-		for (int k = 0; k < 3; ++k)
-		{
-			if (t[k] < poly->vertCount)
-				v[k] = &tile->verts[poly->verts[t[k]]*3];
-			else
-				v[k] = &tile->detailVerts[(pd->vertBase+(t[k]-poly->vertCount))*3];
-		}
-		float h;
-		if (dtClosestHeightPointTriangle(closest, v[0], v[1], v[2], h))
-		{
-			closest[1] = h;
-			break;
-		}
-	}
+	float h;
+	if (dtGetPolyDetailHeight(tile, poly, closest, &h))
+		closest[1] = h;
 }
 
 dtPolyRef dtNavMesh::findNearestPolyInTile(const dtMeshTile* tile,
@@ -748,125 +987,558 @@ dtPolyRef dtNavMesh::findNearestPolyInTile(const dtMeshTile* tile,
 	return nearest;
 }
 
-int dtNavMesh::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, const float* qmax,
-								   dtPolyRef* polys, const int maxPolys) const
+static int getBVSubtreeSize(const dtBVNode* node)
 {
-	if (tile->bvTree)
+	return node->i >= 0 ? 1 : -node->i;
+}
+
+// Collects the subtrees found in the node range [first, end).
+static int getBVChildren(const dtBVNode* nodes, const int first, const int end,
+						 int* children, const int maxChildren)
+{
+	int n = 0;
+	int i = first;
+	while (i < end)
 	{
-		const dtBVNode* node = &tile->bvTree[0];
-		const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
-		const float* tbmin = tile->header->bmin;
-		const float* tbmax = tile->header->bmax;
-		const float qfac = tile->header->bvQuantFactor;
-		
-		// Calculate quantized box
-		unsigned short bmin[3], bmax[3];
-		// dtClamp query box to world box.
-		float minx = dtClamp(qmin[0], tbmin[0], tbmax[0]) - tbmin[0];
-		float miny = dtClamp(qmin[1], tbmin[1], tbmax[1]) - tbmin[1];
-		float minz = dtClamp(qmin[2], tbmin[2], tbmax[2]) - tbmin[2];
-		float maxx = dtClamp(qmax[0], tbmin[0], tbmax[0]) - tbmin[0];
-		float maxy = dtClamp(qmax[1], tbmin[1], tbmax[1]) - tbmin[1];
-		float maxz = dtClamp(qmax[2], tbmin[2], tbmax[2]) - tbmin[2];
-		// Quantize
-		bmin[0] = (unsigned short)(qfac * minx) & 0xfffe;
-		bmin[1] = (unsigned short)(qfac * miny) & 0xfffe;
-		bmin[2] = (unsigned short)(qfac * minz) & 0xfffe;
-		bmax[0] = (unsigned short)(qfac * maxx + 1) | 1;
-		bmax[1] = (unsigned short)(qfac * maxy + 1) | 1;
-		bmax[2] = (unsigned short)(qfac * maxz + 1) | 1;
-		
-		// Traverse tree
-		dtPolyRef base = getPolyRefBase(tile);
-		int n = 0;
-		while (node < end)
+		const int size = getBVSubtreeSize(&nodes[i]);
+		if (size < 1 || i + size > end || n >= maxChildren)
+			return -1;
+		children[n++] = i;
+		i += size;
+	}
+	return n;
+}
+
+inline bool containsQuantBounds(const dtBVNode* parent, const dtBVNode* child)
+{
+	for (int k = 0; k < 3; ++k)
+	{
+		if (child->bmin[k] < parent->bmin[k] || child->bmax[k] > parent->bmax[k])
+			return false;
+	}
+	return true;
+}
+
+// Builds a wide node from the given binary subtrees, pulling up grandchildren until the node is full.
+// Returns the index of the node, or -1 if the tree cannot be converted.
+// When 'out' is null, only counts the nodes.
+static int buildWideBVNode(const dtBVNode* nodes, const int* roots, const int nroots,
+						   dtWideBVNode* out, int& nout, const int depth, int& maxDepth)
+{
+	static const int MAX_CHILDREN = DT_WIDE_BVNODE_CHILDREN;
+	int children[MAX_CHILDREN];
+	int nchildren = nroots;
+	if (nchildren > MAX_CHILDREN)
+		return -1;
+	memcpy(children, roots, sizeof(int)*nchildren);
+	
+	bool expanded = true;
+	while (expanded)
+	{
+		expanded = false;
+		for (int k = 0; k < nchildren; ++k)
 		{
-			const bool overlap = dtOverlapQuantBounds(bmin, bmax, node->bmin, node->bmax);
-			const bool isLeafNode = node->i >= 0;
-			
-			if (isLeafNode && overlap)
-			{
-				if (n < maxPolys)
-					polys[n++] = base | (dtPolyRef)node->i;
-			}
-			
-			if (overlap || isLeafNode)
-				node++;
-			else
-			{
-				const int escapeIndex = -node->i;
-				node += escapeIndex;
-			}
+			const int ci = children[k];
+			if (nodes[ci].i >= 0)
+				continue;
+			int sub[MAX_CHILDREN];
+			const int nsub = getBVChildren(nodes, ci+1, ci + getBVSubtreeSize(&nodes[ci]), sub, MAX_CHILDREN);
+			if (nsub < 1)
+				return -1;
+			if (nchildren-1 + nsub > MAX_CHILDREN)
+				continue;
+			// Replace the child with its children, keeping the tree order.
+			memmove(&children[k+nsub], &children[k+1], sizeof(int)*(nchildren-k-1));
+			memcpy(&children[k], sub, sizeof(int)*nsub);
+			nchildren += nsub-1;
+			expanded = true;
+			break;
 		}
-		
-		return n;
 	}
-	else
+	
+	const int idx = nout++;
+	maxDepth = dtMax(maxDepth, depth);
+	
+	if (out)
 	{
-		float bmin[3], bmax[3];
-		int n = 0;
-		dtPolyRef base = getPolyRefBase(tile);
-		for (int i = 0; i < tile->header->polyCount; ++i)
+		dtWideBVNode* node = &out[idx];
+		for (int k = 0; k < MAX_CHILDREN; ++k)
 		{
-			dtPoly* p = &tile->polys[i];
-			// Do not return off-mesh connection polygons.
-			if (p->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
-				continue;
-			// Calc polygon bounds.
-			const float* v = &tile->verts[p->verts[0]*3];
-			dtVcopy(bmin, v);
-			dtVcopy(bmax, v);
-			for (int j = 1; j < p->vertCount; ++j)
+			// Unused children never overlap.
+			for (int j = 0; j < 3; ++j)
 			{
-				v = &tile->verts[p->verts[j]*3];
-				dtVmin(bmin, v);
-				dtVmax(bmax, v);
+				node->bmin[j][k] = 0x7fff;
+				node->bmax[j][k] = -0x8000;
 			}
-			if (dtOverlapBounds(qmin,qmax, bmin,bmax))
+			node->child[k] = 0;
+		}
+	}
+	
+	for (int k = 0; k < nchildren; ++k)
+	{
+		const dtBVNode* c = &nodes[children[k]];
+		int child = 0;
+		if (c->i >= 0)
+		{
+			child = -(c->i+1);
+		}
+		else
+		{
+			int sub[MAX_CHILDREN];
+			const int nsub = getBVChildren(nodes, children[k]+1, children[k] + getBVSubtreeSize(c), sub, MAX_CHILDREN);
+			if (nsub < 1)
+				return -1;
+			child = buildWideBVNode(nodes, sub, nsub, out, nout, depth+1, maxDepth);
+			if (child < 0)
+				return -1;
+		}
+		if (out)
+		{
+			dtWideBVNode* node = &out[idx];
+			for (int j = 0; j < 3; ++j)
 			{
-				if (n < maxPolys)
-					polys[n++] = base | (dtPolyRef)i;
+				node->bmin[j][k] = (short)(c->bmin[j] ^ 0x8000);
+				node->bmax[j][k] = (short)(c->bmax[j] ^ 0x8000);
 			}
+			node->child[k] = child;
 		}
-		return n;
 	}
+	
+	return idx;
 }
 
 /// @par
 ///
-/// The add operation will fail if the data is in the wrong format, the allocated tile
-/// space is full, or there is a tile already at the specified reference.
-///
-/// The lastRef parameter is used to restore a tile with the same tile
-/// reference it had previously used.  In this case the #dtPolyRef's for the
-/// tile will be restored to the same values they were before the tile was 
-/// removed.
-///
-/// The nav mesh assumes exclusive access to the data passed and will make
-/// changes to the dynamic portion of the data. For that reason the data
-/// should not be reused in other nav meshes until the tile has been successfully
-/// removed from this nav mesh.
-///
-/// @see dtCreateNavMeshData, #removeTile
-dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
-							dtTileRef lastRef, dtTileRef* result)
+/// The wide tree returns the same polygons in the same order as the binary tree. This
+/// relies on the bounds of each node containing the bounds of its children, so trees
+/// which do not satisfy that (or are too deep to traverse with a fixed size stack) are
+/// left unconverted, and queries fall back to the binary tree.
+void dtNavMesh::buildWideBVTree(dtMeshTile* tile)
 {
-	// Make sure the data is in right format.
-	dtMeshHeader* header = (dtMeshHeader*)data;
-	if (header->magic != DT_NAVMESH_MAGIC)
-		return DT_FAILURE | DT_WRONG_MAGIC;
-	if (header->version != DT_NAVMESH_VERSION)
-		return DT_FAILURE | DT_WRONG_VERSION;
-		
-	// Make sure the location is free.
-	if (getTileAt(header->x, header->y, header->layer))
-		return DT_FAILURE | DT_ALREADY_OCCUPIED;
-		
-	// Allocate a tile.
-	dtMeshTile* tile = 0;
-	if (!lastRef)
+	tile->bvWideTree = 0;
+	tile->bvWideNodeCount = 0;
+	
+	if (!tile->bvTree || tile->header->bvNodeCount <= 0)
+		return;
+	
+	const dtBVNode* nodes = tile->bvTree;
+	const int nnodes = tile->header->bvNodeCount;
+	
+	// Make sure the bounds of the children are inside their parents.
+	for (int i = 0; i < nnodes; ++i)
 	{
-		if (m_nextFree)
+		if (nodes[i].i >= 0)
+			continue;
+		const int end = i + getBVSubtreeSize(&nodes[i]);
+		if (end > nnodes)
+			return;
+		for (int j = i+1; j < end; j += getBVSubtreeSize(&nodes[j]))
+		{
+			if (!containsQuantBounds(&nodes[i], &nodes[j]))
+				return;
+		}
+	}
+	
+	// The root of the wide tree holds the top level subtrees.
+	static const int MAX_ROOTS = DT_WIDE_BVNODE_CHILDREN;
+	int roots[MAX_ROOTS];
+	const int nroots = getBVChildren(nodes, 0, nnodes, roots, MAX_ROOTS);
+	if (nroots < 1)
+		return;
+	
+	// Count the nodes, and check that the traversal stack is large enough.
+	int count = 0;
+	int maxDepth = 0;
+	if (buildWideBVNode(nodes, roots, nroots, 0, count, 0, maxDepth) < 0)
+		return;
+	if ((maxDepth+1)*(DT_WIDE_BVNODE_CHILDREN-1)+1 > DT_WIDE_BVTREE_STACK_SIZE)
+		return;
+	
+	dtWideBVNode* wideNodes = (dtWideBVNode*)dtAlloc(sizeof(dtWideBVNode)*count, DT_ALLOC_PERM_NAVMESH);
+	if (!wideNodes)
+		return;
+	
+	count = 0;
+	buildWideBVNode(nodes, roots, nroots, wideNodes, count, 0, maxDepth);
+	
+	tile->bvWideTree = wideNodes;
+	tile->bvWideNodeCount = count;
+}
+
+inline void getDetailTriVerts(const dtMeshTile* tile, const dtPoly* poly, const dtPolyDetail* pd,
+							  const unsigned char* t, const float** v, float dv[3][3])
+{
+	for (int k = 0; k < 3; ++k)
+	{
+		if (t[k] < poly->vertCount)
+			v[k] = &tile->verts[poly->verts[t[k]]*3];
+		else
+			v[k] = dtGetDetailVert(tile, pd->vertBase+(t[k]-poly->vertCount), dv[k]);
+	}
+}
+
+inline int getDetailGridCell(const float pos, const float bmin, const float scale, const int size)
+{
+	const float c = (pos - bmin) * scale;
+	if (!(c >= 0.0f))
+		return 0;
+	if (c >= (float)size)
+		return size-1;
+	return (int)c;
+}
+
+static void getDetailTriCells(const dtMeshTile* tile, const dtPoly* poly, const dtPolyDetail* pd, const int j,
+							  const dtDetailTriGrid& grid, int& x0, int& x1, int& z0, int& z1)
+{
+	const float* v[3];
+	float dv[3][3];
+	getDetailTriVerts(tile, poly, pd, &tile->detailTris[(pd->triBase+j)*4], v, dv);
+	float tmin[2], tmax[2];
+	tmin[0] = dtMin(v[0][0], dtMin(v[1][0], v[2][0]));
+	tmin[1] = dtMin(v[0][2], dtMin(v[1][2], v[2][2]));
+	tmax[0] = dtMax(v[0][0], dtMax(v[1][0], v[2][0]));
+	tmax[1] = dtMax(v[0][2], dtMax(v[1][2], v[2][2]));
+	// Inflate the bounds to cover the epsilon of dtClosestHeightPointTriangle.
+	const float pad = dtMax(tmax[0] - tmin[0], tmax[1] - tmin[1]) * 0.01f + 0.0001f;
+	x0 = getDetailGridCell(tmin[0] - pad, grid.bmin[0], grid.cellScale[0], grid.width);
+	x1 = getDetailGridCell(tmax[0] + pad, grid.bmin[0], grid.cellScale[0], grid.width);
+	z0 = getDetailGridCell(tmin[1] - pad, grid.bmin[1], grid.cellScale[1], grid.height);
+	z1 = getDetailGridCell(tmax[1] + pad, grid.bmin[1], grid.cellScale[1], grid.height);
+}
+
+/// @par
+///
+/// The grid is sized so that a cell overlaps a couple of triangles. The triangles are listed
+/// in every cell their slightly inflated xz-bounds overlap, in the order of the detail mesh,
+/// so that the grid finds the same triangle as testing all the triangles in order would.
+void dtNavMesh::buildDetailGrids(dtMeshTile* tile)
+{
+	static const int MAX_GRID_SIZE = 16;
+	
+	tile->detailGrids = 0;
+	tile->detailCells = 0;
+	tile->detailCellTris = 0;
+	
+	const dtMeshHeader* header = tile->header;
+	if (!tile->detailMeshes || header->polyCount <= 0)
+		return;
+	
+	// Size the grids, and count the cells and the triangle entries.
+	dtDetailTriGrid* grids = 0;
+	int cellCount = 0;
+	int cellTriCount = 0;
+	for (int i = 0; i < header->polyCount; ++i)
+	{
+		const dtPoly* poly = &tile->polys[i];
+		if (poly->getType() != DT_POLYTYPE_GROUND)
+			continue;
+		const dtPolyDetail* pd = &tile->detailMeshes[i];
+		if (pd->triCount < DT_DETAIL_GRID_MIN_TRIS)
+			continue;
+		
+		if (!grids)
+		{
+			grids = (dtDetailTriGrid*)dtAlloc(sizeof(dtDetailTriGrid)*header->polyCount, DT_ALLOC_TEMP);
+			if (!grids)
+				return;
+			memset(grids, 0, sizeof(dtDetailTriGrid)*header->polyCount);
+		}
+		
+		float bmin[2] = { FLT_MAX, FLT_MAX };
+		float bmax[2] = { -FLT_MAX, -FLT_MAX };
+		for (int j = 0; j < pd->triCount; ++j)
+		{
+			const float* v[3];
+			float dv[3][3];
+			getDetailTriVerts(tile, poly, pd, &tile->detailTris[(pd->triBase+j)*4], v, dv);
+			for (int k = 0; k < 3; ++k)
+			{
+				bmin[0] = dtMin(bmin[0], v[k][0]);
+				bmin[1] = dtMin(bmin[1], v[k][2]);
+				bmax[0] = dtMax(bmax[0], v[k][0]);
+				bmax[1] = dtMax(bmax[1], v[k][2]);
+			}
+		}
+		
+		// Aim for about two triangles per cell, with square-ish cells.
+		const float sx = dtMax(bmax[0] - bmin[0], 0.001f);
+		const float sz = dtMax(bmax[1] - bmin[1], 0.001f);
+		const float target = pd->triCount * 0.5f;
+		const int w = dtClamp((int)dtMathCeilf(dtMathSqrtf(target * sx / sz)), 1, MAX_GRID_SIZE);
+		const int h = dtClamp((int)dtMathCeilf(target / w), 1, MAX_GRID_SIZE);
+		
+		dtDetailTriGrid& grid = grids[i];
+		grid.bmin[0] = bmin[0];
+		grid.bmin[1] = bmin[1];
+		grid.cellScale[0] = w / sx;
+		grid.cellScale[1] = h / sz;
+		grid.cellBase = (unsigned int)cellCount;
+		grid.width = (unsigned char)w;
+		grid.height = (unsigned char)h;
+		
+		for (int j = 0; j < pd->triCount; ++j)
+		{
+			int x0, x1, z0, z1;
+			getDetailTriCells(tile, poly, pd, j, grid, x0, x1, z0, z1);
+			cellTriCount += (x1 - x0 + 1) * (z1 - z0 + 1);
+		}
+		cellCount += w*h + 1;
+	}
+	
+	if (!grids)
+		return;
+	
+	// Store the grids and the cells in a single allocation.
+	const int gridsSize = dtAlign4(sizeof(dtDetailTriGrid)*header->polyCount);
+	const int cellsSize = dtAlign4(sizeof(unsigned int)*cellCount);
+	const int cellTrisSize = dtAlign4(sizeof(unsigned char)*cellTriCount);
+	unsigned char* data = (unsigned char*)dtAlloc(gridsSize + cellsSize + cellTrisSize, DT_ALLOC_PERM_NAVMESH);
+	if (!data)
+	{
+		dtFree(grids);
+		return;
+	}
+	memcpy(data, grids, sizeof(dtDetailTriGrid)*header->polyCount);
+	dtFree(grids);
+	grids = (dtDetailTriGrid*)data;
+	unsigned int* cells = (unsigned int*)(data + gridsSize);
+	unsigned char* cellTris = data + gridsSize + cellsSize;
+	
+	// Fill in the cells.
+	unsigned int first = 0;
+	for (int i = 0; i < header->polyCount; ++i)
+	{
+		const dtDetailTriGrid& grid = grids[i];
+		if (!grid.width)
+			continue;
+		const dtPoly* poly = &tile->polys[i];
+		const dtPolyDetail* pd = &tile->detailMeshes[i];
+		const int ncells = grid.width*grid.height;
+		unsigned int* gridCells = &cells[grid.cellBase];
+		
+		// Count the triangles of each cell, and turn the counts into start indices.
+		memset(gridCells, 0, sizeof(unsigned int)*(ncells+1));
+		for (int j = 0; j < pd->triCount; ++j)
+		{
+			int x0, x1, z0, z1;
+			getDetailTriCells(tile, poly, pd, j, grid, x0, x1, z0, z1);
+			for (int z = z0; z <= z1; ++z)
+				for (int x = x0; x <= x1; ++x)
+					gridCells[z*grid.width + x + 1]++;
+		}
+		gridCells[0] = first;
+		for (int j = 0; j < ncells; ++j)
+			gridCells[j+1] += gridCells[j];
+		first = gridCells[ncells];
+		
+		unsigned int next[MAX_GRID_SIZE*MAX_GRID_SIZE];
+		memcpy(next, gridCells, sizeof(unsigned int)*ncells);
+		for (int j = 0; j < pd->triCount; ++j)
+		{
+			int x0, x1, z0, z1;
+			getDetailTriCells(tile, poly, pd, j, grid, x0, x1, z0, z1);
+			for (int z = z0; z <= z1; ++z)
+				for (int x = x0; x <= x1; ++x)
+					cellTris[next[z*grid.width + x]++] = (unsigned char)j;
+		}
+	}
+	
+	tile->detailGrids = grids;
+	tile->detailCells = cells;
+	tile->detailCellTris = cellTris;
+}
+
+/// @par
+///
+/// Tests the detail triangles overlapping the location in the order of the detail mesh,
+/// using the detail triangle grid of the polygon when it has one.
+bool dtGetPolyDetailHeight(const dtMeshTile* tile, const dtPoly* poly, const float* pos, float* height)
+{
+	const unsigned int ip = (unsigned int)(poly - tile->polys);
+	const dtPolyDetail* pd = &tile->detailMeshes[ip];
+	
+	const float* v[3];
+	float dv[3][3];
+	float h;
+	
+	if (tile->detailGrids && tile->detailGrids[ip].width)
+	{
+		const dtDetailTriGrid* grid = &tile->detailGrids[ip];
+		const int x = getDetailGridCell(pos[0], grid->bmin[0], grid->cellScale[0], grid->width);
+		const int z = getDetailGridCell(pos[2], grid->bmin[1], grid->cellScale[1], grid->height);
+		const unsigned int* cell = &tile->detailCells[grid->cellBase + z*grid->width + x];
+		for (unsigned int i = cell[0]; i < cell[1]; ++i)
+		{
+			const int j = tile->detailCellTris[i];
+			getDetailTriVerts(tile, poly, pd, &tile->detailTris[(pd->triBase+j)*4], v, dv);
+			if (dtClosestHeightPointTriangle(pos, v[0], v[1], v[2], h))
+			{
+				*height = h;
+				return true;
+			}
+		}
+		return false;
+	}
+	
+	for (int j = 0; j < pd->triCount; ++j)
+	{
+		getDetailTriVerts(tile, poly, pd, &tile->detailTris[(pd->triBase+j)*4], v, dv);
+		if (dtClosestHeightPointTriangle(pos, v[0], v[1], v[2], h))
+		{
+			*height = h;
+			return true;
+		}
+	}
+	return false;
+}
+
+int dtNavMesh::queryPolygonsInTile(const dtMeshTile* tile, const float* qmin, const float* qmax,
+								   dtPolyRef* polys, const int maxPolys) const
+{
+	if (tile->bvTree)
+	{
+		const dtBVNode* node = &tile->bvTree[0];
+		const dtBVNode* end = &tile->bvTree[tile->header->bvNodeCount];
+		const float* tbmin = tile->header->bmin;
+		const float* tbmax = tile->header->bmax;
+		const float qfac = tile->header->bvQuantFactor;
+		
+		// Calculate quantized box
+		unsigned short bmin[3], bmax[3];
+		// dtClamp query box to world box.
+		float minx = dtClamp(qmin[0], tbmin[0], tbmax[0]) - tbmin[0];
+		float miny = dtClamp(qmin[1], tbmin[1], tbmax[1]) - tbmin[1];
+		float minz = dtClamp(qmin[2], tbmin[2], tbmax[2]) - tbmin[2];
+		float maxx = dtClamp(qmax[0], tbmin[0], tbmax[0]) - tbmin[0];
+		float maxy = dtClamp(qmax[1], tbmin[1], tbmax[1]) - tbmin[1];
+		float maxz = dtClamp(qmax[2], tbmin[2], tbmax[2]) - tbmin[2];
+		// Quantize
+		bmin[0] = (unsigned short)(qfac * minx) & 0xfffe;
+		bmin[1] = (unsigned short)(qfac * miny) & 0xfffe;
+		bmin[2] = (unsigned short)(qfac * minz) & 0xfffe;
+		bmax[0] = (unsigned short)(qfac * maxx + 1) | 1;
+		bmax[1] = (unsigned short)(qfac * maxy + 1) | 1;
+		bmax[2] = (unsigned short)(qfac * maxz + 1) | 1;
+		
+		dtPolyRef base = getPolyRefBase(tile);
+		int n = 0;
+
+		if (tile->bvWideTree)
+		{
+			const short wmin[3] = { (short)(bmin[0] ^ 0x8000), (short)(bmin[1] ^ 0x8000), (short)(bmin[2] ^ 0x8000) };
+			const short wmax[3] = { (short)(bmax[0] ^ 0x8000), (short)(bmax[1] ^ 0x8000), (short)(bmax[2] ^ 0x8000) };
+			
+			// Traverse the wide tree, visiting the overlapping children in tree order.
+			int stack[DT_WIDE_BVTREE_STACK_SIZE];
+			int nstack = 0;
+			stack[nstack++] = 0;
+			while (nstack > 0)
+			{
+				const int idx = stack[--nstack];
+				if (idx < 0)
+				{
+					if (n < maxPolys)
+						polys[n++] = base | (dtPolyRef)(-idx-1);
+					continue;
+				}
+				const dtWideBVNode* wideNode = &tile->bvWideTree[idx];
+				const unsigned int mask = dtOverlapWideBVNode(wideNode, wmin, wmax);
+				for (int k = DT_WIDE_BVNODE_CHILDREN-1; k >= 0; --k)
+				{
+					if ((mask & (1u << k)) && wideNode->child[k] != 0)
+						stack[nstack++] = wideNode->child[k];
+				}
+			}
+			
+			return n;
+		}
+		
+		// Traverse tree
+		while (node < end)
+		{
+			const bool overlap = dtOverlapQuantBounds(bmin, bmax, node->bmin, node->bmax);
+			const bool isLeafNode = node->i >= 0;
+			
+			if (isLeafNode && overlap)
+			{
+				if (n < maxPolys)
+					polys[n++] = base | (dtPolyRef)node->i;
+			}
+			
+			if (overlap || isLeafNode)
+				node++;
+			else
+			{
+				const int escapeIndex = -node->i;
+				node += escapeIndex;
+			}
+		}
+		
+		return n;
+	}
+	else
+	{
+		float bmin[3], bmax[3];
+		int n = 0;
+		dtPolyRef base = getPolyRefBase(tile);
+		for (int i = 0; i < tile->header->polyCount; ++i)
+		{
+			dtPoly* p = &tile->polys[i];
+			// Do not return off-mesh connection polygons.
+			if (p->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+				continue;
+			// Calc polygon bounds.
+			const float* v = &tile->verts[p->verts[0]*3];
+			dtVcopy(bmin, v);
+			dtVcopy(bmax, v);
+			for (int j = 1; j < p->vertCount; ++j)
+			{
+				v = &tile->verts[p->verts[j]*3];
+				dtVmin(bmin, v);
+				dtVmax(bmax, v);
+			}
+			if (dtOverlapBounds(qmin,qmax, bmin,bmax))
+			{
+				if (n < maxPolys)
+					polys[n++] = base | (dtPolyRef)i;
+			}
+		}
+		return n;
+	}
+}
+
+dtStatus dtNavMesh::insertTile(unsigned char* data, int dataSize, int flags,
+							   dtTileRef lastRef, dtMeshTile** result)
+{
+	// Make sure the data is in right format.
+	dtMeshHeader* header = (dtMeshHeader*)data;
+	if (header->magic != DT_NAVMESH_MAGIC)
+		return DT_FAILURE | DT_WRONG_MAGIC;
+	if ((header->version & DT_NAVMESH_VERSION_MASK) != DT_NAVMESH_VERSION)
+		return DT_FAILURE | DT_WRONG_VERSION;
+		
+	// Make sure the location is inside the tile grid, and free.
+	dtMeshTile** bucket = getTileBucket(header->x, header->y);
+	if (!bucket)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	if (getTileAt(header->x, header->y, header->layer))
+		return DT_FAILURE | DT_ALREADY_OCCUPIED;
+	
+	// Allocate the polygon search data and the compact polygon adjacency.
+	dtPolySearchData* polySearch = (dtPolySearchData*)dtAlloc(sizeof(dtPolySearchData)*dtMax(header->polyCount, 1), DT_ALLOC_PERM_NAVMESH);
+	dtTileAdjacency* adjacency = allocAdjacency(header);
+	if (!polySearch || !adjacency)
+	{
+		dtFree(polySearch);
+		dtFree(adjacency);
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+		
+	// Allocate a tile.
+	dtMeshTile* tile = 0;
+	if (!lastRef)
+	{
+		if (m_nextFree)
 		{
 			tile = m_nextFree;
 			m_nextFree = tile->next;
@@ -878,7 +1550,11 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 		// Try to relocate the tile to specific index with same salt.
 		int tileIndex = (int)decodePolyIdTile((dtPolyRef)lastRef);
 		if (tileIndex >= m_maxTiles)
+		{
+			dtFree(polySearch);
+			dtFree(adjacency);
 			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		}
 		// Try to find the specific tile id from the free list.
 		dtMeshTile* target = &m_tiles[tileIndex];
 		dtMeshTile* prev = 0;
@@ -890,7 +1566,17 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 		}
 		// Could not find the correct location.
 		if (tile != target)
+		{
+			dtFree(polySearch);
+			dtFree(adjacency);
+			// A removed tile keeps its slot until it is reclaimed.
+			for (const dtRetiredItem* item = m_retired; item; item = item->next)
+			{
+				if (item->tile == target)
+					return DT_FAILURE | DT_ALREADY_OCCUPIED;
+			}
 			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		}
 		// Remove from freelist
 		if (!prev)
 			m_nextFree = tile->next;
@@ -898,17 +1584,21 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 			prev->next = tile->next;
 
 		// Restore salt.
-		tile->salt = decodePolyIdSalt((dtPolyRef)lastRef);
+		dtAtomicStoreRelease(&tile->salt, decodePolyIdSalt((dtPolyRef)lastRef));
 	}
 
 	// Make sure we could allocate a tile.
 	if (!tile)
+	{
+		dtFree(polySearch);
+		dtFree(adjacency);
 		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+	dtAtomicStoreRelease(&tile->evictedSalt, 0u);
 	
 	// Insert tile into the position lut.
-	int h = computeTileHash(header->x, header->y, m_tileLutMask);
-	tile->next = m_posLookup[h];
-	m_posLookup[h] = tile;
+	tile->next = *bucket;
+	*bucket = tile;
 	
 	// Patch header pointers.
 	const int headerSize = dtAlign4(sizeof(dtMeshHeader));
@@ -916,7 +1606,8 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	const int polysSize = dtAlign4(sizeof(dtPoly)*header->polyCount);
 	const int linksSize = dtAlign4(sizeof(dtLink)*(header->maxLinkCount));
 	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*header->detailMeshCount);
-	const int detailVertsSize = dtAlign4(sizeof(float)*3*header->detailVertCount);
+	const bool compactDetail = (header->version & DT_NAVMESH_COMPACT_DETAIL) != 0;
+	const int detailVertsSize = dtGetDetailVertsDataSize(header->detailVertCount, compactDetail);
 	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*header->detailTriCount);
 	const int bvtreeSize = dtAlign4(sizeof(dtBVNode)*header->bvNodeCount);
 	const int offMeshLinksSize = dtAlign4(sizeof(dtOffMeshConnection)*header->offMeshConCount);
@@ -926,7 +1617,19 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	tile->polys = dtGetThenAdvanceBufferPointer<dtPoly>(d, polysSize);
 	tile->links = dtGetThenAdvanceBufferPointer<dtLink>(d, linksSize);
 	tile->detailMeshes = dtGetThenAdvanceBufferPointer<dtPolyDetail>(d, detailMeshesSize);
-	tile->detailVerts = dtGetThenAdvanceBufferPointer<float>(d, detailVertsSize);
+	if (compactDetail)
+	{
+		tile->detailVerts = 0;
+		tile->detailQuant = (float*)d;
+		tile->detailQVerts = (unsigned short*)(d + sizeof(float)*6);
+		d += detailVertsSize;
+	}
+	else
+	{
+		tile->detailVerts = dtGetThenAdvanceBufferPointer<float>(d, detailVertsSize);
+		tile->detailQuant = 0;
+		tile->detailQVerts = 0;
+	}
 	tile->detailTris = dtGetThenAdvanceBufferPointer<unsigned char>(d, detailTrisSize);
 	tile->bvTree = dtGetThenAdvanceBufferPointer<dtBVNode>(d, bvtreeSize);
 	tile->offMeshCons = dtGetThenAdvanceBufferPointer<dtOffMeshConnection>(d, offMeshLinksSize);
@@ -941,17 +1644,72 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	for (int i = 0; i < header->maxLinkCount-1; ++i)
 		tile->links[i].next = i+1;
 
-	// Init tile.
-	tile->header = header;
+	// Init tile, the header is published last as it marks the tile valid for the lookups.
 	tile->data = data;
 	tile->dataSize = dataSize;
 	tile->flags = flags;
+	tile->polySearch = polySearch;
+	tile->adjacency = adjacency;
+	dtAtomicStoreRelease(&tile->header, header);
+
+	*result = tile;
+	
+	return DT_SUCCESS;
+}
+
+void dtNavMesh::connectTile(dtMeshTile* tile)
+{
+	// Pack the search data of the polygons.
+	for (int i = 0; i < tile->header->polyCount; ++i)
+		updatePolySearchData(tile, i);
+
+	// Build the wide bounding volume tree used for spatial queries.
+	buildWideBVTree(tile);
+
+	// Build the detail triangle grids used for height queries.
+	buildDetailGrids(tile);
 
 	connectIntLinks(tile);
 
 	// Base off-mesh connections to their starting polygons and connect connections inside the tile.
 	baseOffMeshLinks(tile);
 	connectExtOffMeshLinks(tile, tile, -1);
+}
+
+/// @par
+///
+/// The add operation will fail if the data is in the wrong format, the allocated tile
+/// space is full, or there is a tile already at the specified reference.
+///
+/// The lastRef parameter is used to restore a tile with the same tile
+/// reference it had previously used.  In this case the #dtPolyRef's for the
+/// tile will be restored to the same values they were before the tile was 
+/// removed.
+///
+/// With deferred reclamation enabled, a removed tile keeps its slot until it has been
+/// reclaimed, and restoring a tile with its @p lastRef before that fails with
+/// #DT_ALREADY_OCCUPIED. Call #reclaim once the readers are done with the removed tile
+/// before restoring it. (See: #setDeferredReclaim)
+///
+/// The nav mesh assumes exclusive access to the data passed and will make
+/// changes to the dynamic portion of the data. For that reason the data
+/// should not be reused in other nav meshes until the tile has been successfully
+/// removed from this nav mesh.
+///
+/// @see dtCreateNavMeshData, #removeTile
+dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
+							dtTileRef lastRef, dtTileRef* result)
+{
+	dtMeshTile* tile = 0;
+	dtStatus status = insertTile(data, dataSize, flags, lastRef, &tile);
+	if (dtStatusFailed(status))
+		return status;
+	
+	const dtMeshHeader* header = tile->header;
+	tile->stateVersion = ++m_journal.version;
+	tile->addVersion = tile->stateVersion;
+	
+	connectTile(tile);
 
 	// Create connections with neighbour tiles.
 	static const int MAX_NEIS = 32;
@@ -962,39 +1720,258 @@ dtStatus dtNavMesh::addTile(unsigned char* data, int dataSize, int flags,
 	nneis = getTilesAt(header->x, header->y, neis, MAX_NEIS);
 	for (int j = 0; j < nneis; ++j)
 	{
-		if (neis[j] == tile)
-			continue;
-	
-		connectExtLinks(tile, neis[j], -1);
-		connectExtLinks(neis[j], tile, -1);
-		connectExtOffMeshLinks(tile, neis[j], -1);
-		connectExtOffMeshLinks(neis[j], tile, -1);
+		if (neis[j] == tile)
+			continue;
+	
+		connectExtLinks(tile, neis[j], -1);
+		connectExtLinks(neis[j], tile, -1);
+		connectExtOffMeshLinks(tile, neis[j], -1);
+		connectExtOffMeshLinks(neis[j], tile, -1);
+	}
+	
+	// Connect with neighbour tiles.
+	for (int i = 0; i < 8; ++i)
+	{
+		nneis = getNeighbourTilesAt(header->x, header->y, i, neis, MAX_NEIS);
+		for (int j = 0; j < nneis; ++j)
+		{
+			connectExtLinks(tile, neis[j], i);
+			connectExtLinks(neis[j], tile, dtOppositeTile(i));
+			connectExtOffMeshLinks(tile, neis[j], i);
+			connectExtOffMeshLinks(neis[j], tile, dtOppositeTile(i));
+		}
+	}
+
+	// Update the adjacency of the tile and of the neighbours that were linked to it.
+	buildAdjacency(tile, tile->adjacency);
+	buildNeighbourAdjacency(tile);
+	
+	if (m_deferredReclaim)
+		dtAtomicStoreRelease(&m_epoch, m_epoch+1);
+	
+	if (result)
+		*result = getTileRef(tile);
+	
+	return DT_SUCCESS;
+}
+
+enum dtAddTilesMark
+{
+	DT_ADDTILES_NEW = 1,		// The tile is added by the operation.
+	DT_ADDTILES_NEIGHBOUR = 2,	// The tile is already in the mesh and links to a new tile.
+};
+
+struct dtAddTilesContext
+{
+	dtNavMesh* nav;
+	dtMeshTile** tiles;			// The new tiles, followed by their neighbours already in the mesh.
+	const unsigned char* marks;	// Per tile index, see dtAddTilesMark.
+};
+
+static void runTasks(dtParallelFor* parallel, dtParallelTaskFunc func, void* userData, int count)
+{
+	if (parallel)
+	{
+		parallel->run(func, userData, count);
+		return;
+	}
+	for (int i = 0; i < count; ++i)
+		func(userData, i);
+}
+
+void dtNavMesh::connectTileTask(void* userData, int index)
+{
+	dtAddTilesContext* ctx = (dtAddTilesContext*)userData;
+	ctx->nav->connectTile(ctx->tiles[index]);
+}
+
+void dtNavMesh::connectExtLinksTask(void* userData, int index)
+{
+	dtAddTilesContext* ctx = (dtAddTilesContext*)userData;
+	dtNavMesh* nav = ctx->nav;
+	dtMeshTile* tile = ctx->tiles[index];
+	const bool isNew = ctx->marks[tile - nav->m_tiles] == DT_ADDTILES_NEW;
+	
+	// Only the links of the tile itself are written, so the tasks do not overlap.
+	static const int MAX_NEIS = 32;
+	dtMeshTile* neis[MAX_NEIS];
+	int nneis;
+	
+	nneis = nav->getTilesAt(tile->header->x, tile->header->y, neis, MAX_NEIS);
+	for (int j = 0; j < nneis; ++j)
+	{
+		if (neis[j] == tile)
+			continue;
+		if (isNew || ctx->marks[neis[j] - nav->m_tiles] == DT_ADDTILES_NEW)
+			nav->connectExtLinks(tile, neis[j], -1);
+	}
+	
+	for (int i = 0; i < 8; ++i)
+	{
+		nneis = nav->getNeighbourTilesAt(tile->header->x, tile->header->y, i, neis, MAX_NEIS);
+		for (int j = 0; j < nneis; ++j)
+		{
+			if (isNew || ctx->marks[neis[j] - nav->m_tiles] == DT_ADDTILES_NEW)
+				nav->connectExtLinks(tile, neis[j], i);
+		}
+	}
+}
+
+void dtNavMesh::connectExtOffMeshLinksTask(void* userData, int index)
+{
+	dtAddTilesContext* ctx = (dtAddTilesContext*)userData;
+	dtNavMesh* nav = ctx->nav;
+	dtMeshTile* tile = ctx->tiles[index];
+	const bool isNew = ctx->marks[tile - nav->m_tiles] == DT_ADDTILES_NEW;
+	
+	static const int MAX_NEIS = 32;
+	dtMeshTile* neis[MAX_NEIS];
+	int nneis;
+	
+	nneis = nav->getTilesAt(tile->header->x, tile->header->y, neis, MAX_NEIS);
+	for (int j = 0; j < nneis; ++j)
+	{
+		if (neis[j] == tile)
+			continue;
+		if (isNew || ctx->marks[neis[j] - nav->m_tiles] == DT_ADDTILES_NEW)
+			nav->connectExtOffMeshLinks(tile, neis[j], -1);
+	}
+	
+	for (int i = 0; i < 8; ++i)
+	{
+		nneis = nav->getNeighbourTilesAt(tile->header->x, tile->header->y, i, neis, MAX_NEIS);
+		for (int j = 0; j < nneis; ++j)
+		{
+			if (isNew || ctx->marks[neis[j] - nav->m_tiles] == DT_ADDTILES_NEW)
+				nav->connectExtOffMeshLinks(tile, neis[j], i);
+		}
+	}
+}
+
+void dtNavMesh::buildAdjacencyTask(void* userData, int index)
+{
+	dtAddTilesContext* ctx = (dtAddTilesContext*)userData;
+	dtMeshTile* tile = ctx->tiles[index];
+	ctx->nav->buildAdjacency(tile, tile->adjacency);
+}
+
+/// @par
+///
+/// Works like calling #addTile for each tile, but all the tiles are inserted
+/// before any of them is linked. The linking is then done in passes which can
+/// run in parallel through @p parallel:
+/// - The links and search data within each new tile.
+/// - The links from each new tile, and from each tile next to a new tile, towards
+///   its neighbours. Every task only writes the links of its own tile.
+/// - The polygon adjacency of the new tiles.
+///
+/// The off-mesh connections write to the tiles at both of their ends and are
+/// connected serially, like the adjacency of the tiles that were already in the mesh.
+///
+/// The tiles that cannot be added are skipped and get a zero reference in
+/// @p results. If some tiles were added the status has #DT_PARTIAL_RESULT set,
+/// along with the details of the failures.
+///
+/// @see #addTile
+dtStatus dtNavMesh::addTiles(unsigned char** data, const int* dataSize, int flags, const int count,
+							 dtTileRef* results, dtParallelFor* parallel)
+{
+	if (!data || !dataSize || count < 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	dtMeshTile** tiles = (dtMeshTile**)dtAlloc(sizeof(dtMeshTile*)*dtMax(m_maxTiles, 1), DT_ALLOC_TEMP);
+	unsigned char* marks = (unsigned char*)dtAlloc(sizeof(unsigned char)*dtMax(m_maxTiles, 1), DT_ALLOC_TEMP);
+	if (!tiles || !marks)
+	{
+		dtFree(tiles);
+		dtFree(marks);
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+	memset(marks, 0, sizeof(unsigned char)*m_maxTiles);
+	
+	// Insert all the tiles first, so that the linking passes see all of them.
+	dtStatus failures = 0;
+	int ntiles = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		if (results)
+			results[i] = 0;
+		dtMeshTile* tile = 0;
+		dtStatus status = insertTile(data[i], dataSize[i], flags, 0, &tile);
+		if (dtStatusFailed(status))
+		{
+			failures |= status;
+			continue;
+		}
+		marks[tile - m_tiles] = DT_ADDTILES_NEW;
+		tiles[ntiles++] = tile;
+		if (results)
+			results[i] = getTileRef(tile);
+	}
+	const int newCount = ntiles;
+	if (newCount > 0)
+		m_journal.version++;
+	for (int i = 0; i < newCount; ++i)
+	{
+		tiles[i]->stateVersion = m_journal.version;
+		tiles[i]->addVersion = m_journal.version;
 	}
 	
-	// Connect with neighbour tiles.
-	for (int i = 0; i < 8; ++i)
+	// Collect the tiles already in the mesh that will link to the new tiles.
+	static const int MAX_NEIS = 32;
+	dtMeshTile* neis[MAX_NEIS];
+	int nneis;
+	for (int i = 0; i < newCount; ++i)
 	{
-		nneis = getNeighbourTilesAt(header->x, header->y, i, neis, MAX_NEIS);
-		for (int j = 0; j < nneis; ++j)
+		const dtMeshHeader* header = tiles[i]->header;
+		for (int side = -1; side < 8; ++side)
 		{
-			connectExtLinks(tile, neis[j], i);
-			connectExtLinks(neis[j], tile, dtOppositeTile(i));
-			connectExtOffMeshLinks(tile, neis[j], i);
-			connectExtOffMeshLinks(neis[j], tile, dtOppositeTile(i));
+			if (side == -1)
+				nneis = getTilesAt(header->x, header->y, neis, MAX_NEIS);
+			else
+				nneis = getNeighbourTilesAt(header->x, header->y, side, neis, MAX_NEIS);
+			for (int j = 0; j < nneis; ++j)
+			{
+				const int idx = (int)(neis[j] - m_tiles);
+				if (marks[idx])
+					continue;
+				marks[idx] = DT_ADDTILES_NEIGHBOUR;
+				tiles[ntiles++] = neis[j];
+			}
 		}
 	}
 	
-	if (result)
-		*result = getTileRef(tile);
+	dtAddTilesContext ctx;
+	ctx.nav = this;
+	ctx.tiles = tiles;
+	ctx.marks = marks;
 	
-	return DT_SUCCESS;
+	runTasks(parallel, connectTileTask, &ctx, newCount);
+	runTasks(parallel, connectExtLinksTask, &ctx, ntiles);
+	for (int i = 0; i < ntiles; ++i)
+		connectExtOffMeshLinksTask(&ctx, i);
+	runTasks(parallel, buildAdjacencyTask, &ctx, newCount);
+	for (int i = newCount; i < ntiles; ++i)
+		rebuildAdjacency(tiles[i]);
+	
+	if (m_deferredReclaim && newCount > 0)
+		dtAtomicStoreRelease(&m_epoch, m_epoch+1);
+	
+	dtFree(tiles);
+	dtFree(marks);
+	
+	if (!failures)
+		return DT_SUCCESS;
+	if (!newCount)
+		return DT_FAILURE | (failures & DT_STATUS_DETAIL_MASK);
+	return DT_SUCCESS | DT_PARTIAL_RESULT | (failures & DT_STATUS_DETAIL_MASK);
 }
 
 const dtMeshTile* dtNavMesh::getTileAt(const int x, const int y, const int layer) const
 {
-	// Find tile based on hash.
-	int h = computeTileHash(x,y,m_tileLutMask);
-	dtMeshTile* tile = m_posLookup[h];
+	// Find tile based on hash, or on the grid location.
+	dtMeshTile** bucket = getTileBucket(x, y);
+	dtMeshTile* tile = bucket ? *bucket : 0;
 	while (tile)
 	{
 		if (tile->header &&
@@ -1031,9 +2008,9 @@ int dtNavMesh::getTilesAt(const int x, const int y, dtMeshTile** tiles, const in
 {
 	int n = 0;
 	
-	// Find tile based on hash.
-	int h = computeTileHash(x,y,m_tileLutMask);
-	dtMeshTile* tile = m_posLookup[h];
+	// Find tile based on hash, or on the grid location.
+	dtMeshTile** bucket = getTileBucket(x, y);
+	dtMeshTile* tile = bucket ? *bucket : 0;
 	while (tile)
 	{
 		if (tile->header &&
@@ -1057,9 +2034,9 @@ int dtNavMesh::getTilesAt(const int x, const int y, dtMeshTile const** tiles, co
 {
 	int n = 0;
 	
-	// Find tile based on hash.
-	int h = computeTileHash(x,y,m_tileLutMask);
-	dtMeshTile* tile = m_posLookup[h];
+	// Find tile based on hash, or on the grid location.
+	dtMeshTile** bucket = getTileBucket(x, y);
+	dtMeshTile* tile = bucket ? *bucket : 0;
 	while (tile)
 	{
 		if (tile->header &&
@@ -1078,9 +2055,9 @@ int dtNavMesh::getTilesAt(const int x, const int y, dtMeshTile const** tiles, co
 
 dtTileRef dtNavMesh::getTileRefAt(const int x, const int y, const int layer) const
 {
-	// Find tile based on hash.
-	int h = computeTileHash(x,y,m_tileLutMask);
-	dtMeshTile* tile = m_posLookup[h];
+	// Find tile based on hash, or on the grid location.
+	dtMeshTile** bucket = getTileBucket(x, y);
+	dtMeshTile* tile = bucket ? *bucket : 0;
 	while (tile)
 	{
 		if (tile->header &&
@@ -1132,12 +2109,21 @@ void dtNavMesh::calcTileLoc(const float* pos, int* tx, int* ty) const
 
 dtStatus dtNavMesh::getTileAndPolyByRef(const dtPolyRef ref, const dtMeshTile** tile, const dtPoly** poly) const
 {
-	if (!ref) return DT_FAILURE;
+	if (!ref) return DT_FAILURE | DT_INVALID_PARAM;
 	unsigned int salt, it, ip;
 	decodePolyId(ref, salt, it, ip);
 	if (it >= (unsigned int)m_maxTiles) return DT_FAILURE | DT_INVALID_PARAM;
-	if (m_tiles[it].salt != salt || m_tiles[it].header == 0) return DT_FAILURE | DT_INVALID_PARAM;
-	if (ip >= (unsigned int)m_tiles[it].header->polyCount) return DT_FAILURE | DT_INVALID_PARAM;
+	// The header is published last when a tile is added and cleared when it is removed,
+	// load it once before the salt so that a concurrent tile change is seen consistently.
+	const dtMeshHeader* header = dtAtomicLoadAcquire(&m_tiles[it].header);
+	if (!header)
+	{
+		if (dtAtomicLoadAcquire(&m_tiles[it].evictedSalt) == salt)
+			return DT_FAILURE | DT_TILE_NOT_RESIDENT;
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+	if (dtAtomicLoadAcquire(&m_tiles[it].salt) != salt) return DT_FAILURE | DT_INVALID_PARAM;
+	if (ip >= (unsigned int)header->polyCount) return DT_FAILURE | DT_INVALID_PARAM;
 	*tile = &m_tiles[it];
 	*poly = &m_tiles[it].polys[ip];
 	return DT_SUCCESS;
@@ -1162,11 +2148,20 @@ bool dtNavMesh::isValidPolyRef(dtPolyRef ref) const
 	unsigned int salt, it, ip;
 	decodePolyId(ref, salt, it, ip);
 	if (it >= (unsigned int)m_maxTiles) return false;
-	if (m_tiles[it].salt != salt || m_tiles[it].header == 0) return false;
-	if (ip >= (unsigned int)m_tiles[it].header->polyCount) return false;
+	const dtMeshHeader* header = dtAtomicLoadAcquire(&m_tiles[it].header);
+	if (!header) return false;
+	if (dtAtomicLoadAcquire(&m_tiles[it].salt) != salt) return false;
+	if (ip >= (unsigned int)header->polyCount) return false;
 	return true;
 }
 
+dtStatus dtNavMesh::getPolyRefStatus(dtPolyRef ref) const
+{
+	const dtMeshTile* tile = 0;
+	const dtPoly* poly = 0;
+	return getTileAndPolyByRef(ref, &tile, &poly);
+}
+
 /// @par
 ///
 /// This function returns the data for the tile so that, if desired,
@@ -1186,9 +2181,9 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 		return DT_FAILURE | DT_INVALID_PARAM;
 	
 	// Remove tile from hash lookup.
-	int h = computeTileHash(tile->header->x,tile->header->y,m_tileLutMask);
+	dtMeshTile** bucket = getTileBucket(tile->header->x, tile->header->y);
 	dtMeshTile* prev = 0;
-	dtMeshTile* cur = m_posLookup[h];
+	dtMeshTile* cur = *bucket;
 	while (cur)
 	{
 		if (cur == tile)
@@ -1196,7 +2191,7 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 			if (prev)
 				prev->next = cur->next;
 			else
-				m_posLookup[h] = cur->next;
+				*bucket = cur->next;
 			break;
 		}
 		prev = cur;
@@ -1223,14 +2218,18 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 		for (int j = 0; j < nneis; ++j)
 			unconnectLinks(neis[j], tile);
 	}
+
+	// The tile has already been removed from the lookup, so this only updates the neighbours.
+	m_journal.version++;
+	buildNeighbourAdjacency(tile);
+
+	// The journal entries of the tile are skipped once its reference changes.
+	dtFree(tile->polyStamps);
+	tile->polyStamps = 0;
 		
-	// Reset tile.
 	if (tile->flags & DT_TILE_FREE_DATA)
 	{
 		// Owns data
-		dtFree(tile->data);
-		tile->data = 0;
-		tile->dataSize = 0;
 		if (data) *data = 0;
 		if (dataSize) *dataSize = 0;
 	}
@@ -1240,6 +2239,61 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 		if (dataSize) *dataSize = tile->dataSize;
 	}
 
+	// Update salt, salt should never be zero.
+#ifdef DT_POLYREF64
+	unsigned int salt = (tile->salt+1) & ((1<<DT_SALT_BITS)-1);
+#else
+	unsigned int salt = (tile->salt+1) & ((1<<m_saltBits)-1);
+#endif
+	if (salt == 0)
+		salt++;
+	dtAtomicStoreRelease(&tile->salt, salt);
+
+	if (m_deferredReclaim)
+	{
+		// Hide the tile, but keep its data for the readers that may still be walking it.
+		dtTileMemoryStats tileStats;
+		getTileMemoryStats(tile, &tileStats);
+		dtAtomicStoreRelease(&tile->header, (dtMeshHeader*)0);
+		if (retire(tile, 0, 0, tileStats.totalSize))
+		{
+			dtAtomicStoreRelease(&m_epoch, m_epoch+1);
+			return DT_SUCCESS;
+		}
+	}
+
+	releaseTile(tile);
+
+	return DT_SUCCESS;
+}
+
+/// @par
+///
+/// The evicted tile is removed like with #removeTile, and its slot is returned to
+/// the free list. Adding the tile back with its reference as @p lastRef restores
+/// the polygon references into it. Until then, #getTileAndPolyByRef and the
+/// queries report #DT_TILE_NOT_RESIDENT for them, instead of #DT_INVALID_PARAM.
+///
+/// @see #addTile, dtTileStreamer
+dtStatus dtNavMesh::evictTile(dtTileRef ref, unsigned char** data, int* dataSize)
+{
+	dtStatus status = removeTile(ref, data, dataSize);
+	if (dtStatusSucceed(status))
+		dtAtomicStoreRelease(&m_tiles[decodePolyIdTile((dtPolyRef)ref)].evictedSalt, decodePolyIdSalt((dtPolyRef)ref));
+	return status;
+}
+
+void dtNavMesh::releaseTile(dtMeshTile* tile)
+{
+	// Reset tile.
+	if (tile->flags & DT_TILE_FREE_DATA)
+	{
+		// Owns data
+		dtFree(tile->data);
+		tile->data = 0;
+		tile->dataSize = 0;
+	}
+
 	tile->header = 0;
 	tile->flags = 0;
 	tile->linksFreeList = 0;
@@ -1248,24 +2302,196 @@ dtStatus dtNavMesh::removeTile(dtTileRef ref, unsigned char** data, int* dataSiz
 	tile->links = 0;
 	tile->detailMeshes = 0;
 	tile->detailVerts = 0;
+	tile->detailQuant = 0;
+	tile->detailQVerts = 0;
 	tile->detailTris = 0;
 	tile->bvTree = 0;
 	tile->offMeshCons = 0;
-
-	// Update salt, salt should never be zero.
-#ifdef DT_POLYREF64
-	tile->salt = (tile->salt+1) & ((1<<DT_SALT_BITS)-1);
-#else
-	tile->salt = (tile->salt+1) & ((1<<m_saltBits)-1);
-#endif
-	if (tile->salt == 0)
-		tile->salt++;
+	dtFree(tile->polySearch);
+	dtFree(tile->adjacency);
+	tile->polySearch = 0;
+	tile->adjacency = 0;
+	dtFree(tile->bvWideTree);
+	tile->bvWideTree = 0;
+	tile->bvWideNodeCount = 0;
+	dtFree(tile->detailGrids);
+	tile->detailGrids = 0;
+	tile->detailCells = 0;
+	tile->detailCellTris = 0;
 
 	// Add to free list.
 	tile->next = m_nextFree;
 	m_nextFree = tile;
+}
 
-	return DT_SUCCESS;
+bool dtNavMesh::retire(dtMeshTile* tile, void* mem0, void* mem1, int memSize)
+{
+	dtRetiredItem* item = (dtRetiredItem*)dtAlloc(sizeof(dtRetiredItem), DT_ALLOC_PERM_NAVMESH);
+	if (!item)
+		return false;
+	item->tile = tile;
+	item->mem[0] = mem0;
+	item->mem[1] = mem1;
+	item->memSize = memSize;
+	item->epoch = m_epoch;
+	item->next = m_retired;
+	m_retired = item;
+	return true;
+}
+
+/// @par
+///
+/// Deferred reclamation lets queries keep running on other threads while tiles are
+/// added and removed. A removed tile is hidden from lookups and its reference is
+/// invalidated immediately, but its data and the adjacency arrays replaced in its
+/// neighbours are kept alive until #reclaim is called with a later epoch. Tile data
+/// that is not owned by the navigation mesh must likewise be kept until then.
+///
+/// Each reader records #getEpoch before starting a batch of queries and the writer
+/// passes the oldest epoch still in use to #reclaim. The epoch is read with acquire and
+/// advanced with release semantics, publishing the epochs of the readers back to the
+/// writer is left to the application.
+///
+/// The graph searches only read the polygon adjacency and the polygon data of the
+/// tiles. The adjacency of a tile is a single allocation published with one atomic
+/// store, and the searches load it once per tile with #dtGetTileAdjacency. The tile
+/// header and salt checked by #getTileAndPolyByRef and #isValidPolyRef are published
+/// and loaded the same way, so the searches and the reference checks are safe to run
+/// during tile changes. The functions walking the polygon links still need
+/// the tile changes to be serialized with them.
+///
+/// A removed tile keeps its slot until it has been reclaimed, so restoring it with
+/// @p lastRef before that fails with #DT_ALREADY_OCCUPIED. (See: #addTile)
+void dtNavMesh::setDeferredReclaim(bool enabled)
+{
+	m_deferredReclaim = enabled;
+	if (!enabled)
+		reclaim(m_epoch+1);
+}
+
+void dtNavMesh::reclaim(unsigned int safeEpoch)
+{
+	// Collect the items to free, this also reverses them to oldest first
+	// so that the tiles return to the freelist in the order they were removed.
+	dtRetiredItem* expired = 0;
+	dtRetiredItem* prev = 0;
+	dtRetiredItem* item = m_retired;
+	while (item)
+	{
+		dtRetiredItem* next = item->next;
+		// Compare the epochs so that the counter can wrap around.
+		if ((int)(safeEpoch - item->epoch) > 0)
+		{
+			if (prev)
+				prev->next = next;
+			else
+				m_retired = next;
+			item->next = expired;
+			expired = item;
+		}
+		else
+		{
+			prev = item;
+		}
+		item = next;
+	}
+	
+	while (expired)
+	{
+		item = expired;
+		expired = item->next;
+		if (item->tile)
+			releaseTile(item->tile);
+		dtFree(item->mem[0]);
+		dtFree(item->mem[1]);
+		dtFree(item);
+	}
+}
+
+int dtNavMesh::getRetiredCount() const
+{
+	int n = 0;
+	for (const dtRetiredItem* item = m_retired; item; item = item->next)
+		n++;
+	return n;
+}
+
+/// @par
+///
+/// The sizes are computed from the tile contents and the navigation mesh parameters,
+/// and cover the memory allocated by the navigation mesh and the tile data. Tile data
+/// that is not owned by the navigation mesh is included too. The memory of the
+/// queries and crowds using the navigation mesh is reported by their own statistics.
+///
+/// @see getTileMemoryStats
+void dtNavMesh::getMemoryStats(dtNavMeshMemoryStats* stats) const
+{
+	if (!stats)
+		return;
+	memset(stats, 0, sizeof(dtNavMeshMemoryStats));
+	
+	stats->meshSize = sizeof(dtNavMesh) + sizeof(dtMeshTile)*m_maxTiles + sizeof(dtMeshTile*)*m_tileLutSize;
+	
+	for (int i = 0; i < m_maxTiles; ++i)
+	{
+		const dtMeshTile* tile = &m_tiles[i];
+		if (!tile->header)
+			continue;
+		dtTileMemoryStats tileStats;
+		getTileMemoryStats(tile, &tileStats);
+		stats->tileCount++;
+		stats->tileDataSize += tileStats.dataSize;
+		stats->linkSize += tileStats.linkSize;
+		stats->lookupSize += tileStats.searchSize + tileStats.bvTreeSize + tileStats.detailGridSize;
+		stats->stateSize += tileStats.stateSize;
+	}
+	stats->stateSize += sizeof(dtStateJournalEntry)*m_journal.capacity;
+	
+	for (const dtRetiredItem* item = m_retired; item; item = item->next)
+		stats->retiredSize += sizeof(dtRetiredItem) + item->memSize;
+	
+	stats->totalSize = stats->meshSize + stats->tileDataSize + stats->lookupSize +
+		stats->stateSize + stats->retiredSize;
+}
+
+void dtNavMesh::getTileMemoryStats(const dtMeshTile* tile, dtTileMemoryStats* stats) const
+{
+	if (!stats)
+		return;
+	memset(stats, 0, sizeof(dtTileMemoryStats));
+	if (!tile || !tile->header)
+		return;
+	
+	const dtMeshHeader* header = tile->header;
+	stats->dataSize = tile->dataSize;
+	stats->linkSize = (int)sizeof(dtLink)*header->maxLinkCount;
+	if (tile->polySearch)
+		stats->searchSize += (int)sizeof(dtPolySearchData)*dtMax(header->polyCount, 1);
+	if (tile->adjacency)
+		stats->searchSize += getAdjacencyMemUsed(header);
+	stats->bvTreeSize = (int)sizeof(dtWideBVNode)*tile->bvWideNodeCount;
+	if (tile->detailGrids)
+	{
+		// The grids, their cells and the cell triangles are stored in a single allocation.
+		int cellCount = 0;
+		int cellTriCount = 0;
+		for (int i = 0; i < header->polyCount; ++i)
+		{
+			const dtDetailTriGrid& grid = tile->detailGrids[i];
+			if (!grid.width)
+				continue;
+			const int end = (int)grid.cellBase + grid.width*grid.height;
+			cellCount = dtMax(cellCount, end + 1);
+			cellTriCount = dtMax(cellTriCount, (int)tile->detailCells[end]);
+		}
+		stats->detailGridSize = dtAlign4(sizeof(dtDetailTriGrid)*header->polyCount) +
+			dtAlign4(sizeof(unsigned int)*cellCount) + dtAlign4(sizeof(unsigned char)*cellTriCount);
+	}
+	if (tile->polyStamps)
+		stats->stateSize = (int)sizeof(unsigned int)*header->polyCount;
+	
+	stats->totalSize = stats->dataSize + stats->searchSize + stats->bvTreeSize +
+		stats->detailGridSize + stats->stateSize;
 }
 
 dtTileRef dtNavMesh::getTileRef(const dtMeshTile* tile) const
@@ -1374,17 +2600,265 @@ dtStatus dtNavMesh::restoreTileState(dtMeshTile* tile, const unsigned char* data
 		return DT_FAILURE | DT_INVALID_PARAM;
 	
 	// Restore per poly state.
+	const unsigned int version = ++m_journal.version;
 	for (int i = 0; i < tile->header->polyCount; ++i)
 	{
 		dtPoly* p = &tile->polys[i];
 		const dtPolyState* s = &polyStates[i];
+		if (p->flags != s->flags || p->getArea() != s->area)
+		{
+			if (!journalPolyState(tile, (unsigned int)i, version))
+				return DT_FAILURE | DT_OUT_OF_MEMORY;
+		}
 		p->flags = s->flags;
 		p->setArea(s->area);
+		updatePolySearchData(tile, i);
 	}
 	
 	return DT_SUCCESS;
 }
 
+/// @par
+///
+/// The journal records the polygons changed by #setPolyFlags, #setPolyArea, #restoreTileState
+/// and #restoreStateChanges, so that the state can be saved and restored in time proportional
+/// to the number of changes instead of the size of the navigation mesh.
+///
+/// The journal grows with each change. Use #discardStateChanges to drop the changes which are
+/// no longer needed.
+/// @see #storeStateChanges, #revertStateChanges
+void dtNavMesh::setStateJournal(bool enabled)
+{
+	if (!enabled)
+	{
+		dtFree(m_journal.entries);
+		m_journal.entries = 0;
+		m_journal.count = 0;
+		m_journal.capacity = 0;
+	}
+	else if (!m_journal.enabled)
+	{
+		m_journal.base = m_journal.version;
+	}
+	m_journal.enabled = enabled;
+}
+
+bool dtNavMesh::journalPolyState(dtMeshTile* tile, unsigned int ip, unsigned int version)
+{
+	tile->stateVersion = version;
+	if (!m_journal.enabled)
+		return true;
+
+	if (!tile->polyStamps)
+	{
+		tile->polyStamps = (unsigned int*)dtAlloc(sizeof(unsigned int)*tile->header->polyCount, DT_ALLOC_PERM_NAVMESH);
+		if (!tile->polyStamps)
+			return false;
+		memset(tile->polyStamps, 0, sizeof(unsigned int)*tile->header->polyCount);
+	}
+
+	// Each polygon is recorded once per version, with its state before the first change.
+	if (tile->polyStamps[ip] == version)
+		return true;
+
+	if (!reserveJournal(m_journal.count+1))
+		return false;
+
+	const dtPoly* poly = &tile->polys[ip];
+	dtStateJournalEntry* entry = &m_journal.entries[m_journal.count++];
+	entry->ref = encodePolyId(tile->salt, (unsigned int)(tile - m_tiles), ip);
+	entry->version = version;
+	entry->prevFlags = poly->flags;
+	entry->prevArea = poly->getArea();
+	tile->polyStamps[ip] = version;
+
+	return true;
+}
+
+bool dtNavMesh::reserveJournal(const int capacity)
+{
+	if (capacity <= m_journal.capacity)
+		return true;
+
+	int newCapacity = m_journal.capacity ? m_journal.capacity*2 : 256;
+	while (newCapacity < capacity)
+		newCapacity *= 2;
+	dtStateJournalEntry* entries = (dtStateJournalEntry*)dtAlloc(sizeof(dtStateJournalEntry)*newCapacity, DT_ALLOC_PERM_NAVMESH);
+	if (!entries)
+		return false;
+	if (m_journal.count)
+		memcpy(entries, m_journal.entries, sizeof(dtStateJournalEntry)*m_journal.count);
+	dtFree(m_journal.entries);
+	m_journal.entries = entries;
+	m_journal.capacity = newCapacity;
+	return true;
+}
+
+/// @par
+///
+/// Each changed polygon is stored once, with its current state, so the changes can be
+/// applied in any order. The polygons of the tiles removed since the change are skipped.
+///
+/// If there are more changes than fit into the array, the status has #DT_BUFFER_TOO_SMALL set.
+/// The storing fails if the journal is disabled, or the changes since the version have
+/// been discarded.
+/// @see #restoreStateChanges
+dtStatus dtNavMesh::storeStateChanges(unsigned int sinceVersion, dtPolyStateChange* changes, int* changeCount, const int maxChanges) const
+{
+	if (!changes || !changeCount || maxChanges < 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	*changeCount = 0;
+	if (!m_journal.enabled || sinceVersion < m_journal.base)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	dtStatus status = DT_SUCCESS;
+	int n = 0;
+	for (int i = m_journal.count-1; i >= 0; --i)
+	{
+		const dtStateJournalEntry* entry = &m_journal.entries[i];
+		if (entry->version <= sinceVersion)
+			break;
+
+		unsigned int salt, it, ip;
+		decodePolyId(entry->ref, salt, it, ip);
+		const dtMeshTile* tile = &m_tiles[it];
+		// Skip the removed polygons, and the changes followed by a later change.
+		if (tile->salt != salt || !tile->header || !tile->polyStamps || tile->polyStamps[ip] != entry->version)
+			continue;
+
+		if (n >= maxChanges)
+		{
+			status |= DT_BUFFER_TOO_SMALL;
+			break;
+		}
+
+		const dtPoly* poly = &tile->polys[ip];
+		dtPolyStateChange* change = &changes[n++];
+		change->ref = entry->ref;
+		change->flags = poly->flags;
+		change->area = poly->getArea();
+	}
+
+	*changeCount = n;
+
+	return status;
+}
+
+/// @par
+///
+/// The changes are applied as a single state version. If some of the polygon references
+/// are not valid, the status has #DT_INVALID_PARAM set.
+/// @see #storeStateChanges
+dtStatus dtNavMesh::restoreStateChanges(const dtPolyStateChange* changes, const int changeCount)
+{
+	if (!changes && changeCount > 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	const unsigned int version = ++m_journal.version;
+	dtStatus status = DT_SUCCESS;
+	for (int i = 0; i < changeCount; ++i)
+	{
+		const dtPolyStateChange* change = &changes[i];
+		if (!change->ref)
+		{
+			status |= DT_INVALID_PARAM;
+			continue;
+		}
+		unsigned int salt, it, ip;
+		decodePolyId(change->ref, salt, it, ip);
+		if (it >= (unsigned int)m_maxTiles || m_tiles[it].salt != salt || m_tiles[it].header == 0 ||
+			ip >= (unsigned int)m_tiles[it].header->polyCount)
+		{
+			status |= DT_INVALID_PARAM;
+			continue;
+		}
+		dtMeshTile* tile = &m_tiles[it];
+		dtPoly* poly = &tile->polys[ip];
+		if (poly->flags == change->flags && poly->getArea() == change->area)
+			continue;
+
+		if (!journalPolyState(tile, ip, version))
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		poly->flags = change->flags;
+		poly->setArea(change->area);
+		updatePolySearchData(tile, ip);
+	}
+
+	return status;
+}
+
+/// @par
+///
+/// The changes after the version are undone newest first, and the revert is recorded as
+/// a new state version, so #storeStateChanges reports it like any other change.
+/// The polygons of the tiles removed since the change are skipped, also when the tile
+/// has been added back with the same reference.
+///
+/// The revert fails if the journal is disabled, or the changes since the version have
+/// been discarded. If the journal cannot grow to record the revert, it fails with
+/// #DT_OUT_OF_MEMORY before any polygon is changed.
+dtStatus dtNavMesh::revertStateChanges(unsigned int version)
+{
+	if (!m_journal.enabled || version < m_journal.base)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	if (version >= m_journal.version)
+		return DT_SUCCESS;
+
+	// Each reverted entry records at most one new entry, make room for them up front
+	// so that running out of memory cannot leave the revert half applied.
+	int first = m_journal.count;
+	while (first > 0 && m_journal.entries[first-1].version > version)
+		first--;
+	if (!reserveJournal(m_journal.count + (m_journal.count - first)))
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+
+	const unsigned int revertVersion = ++m_journal.version;
+
+	// The revert entries are appended past the walked range.
+	for (int i = m_journal.count-1; i >= first; --i)
+	{
+		const dtPolyRef ref = m_journal.entries[i].ref;
+		const unsigned int entryVersion = m_journal.entries[i].version;
+		const unsigned short prevFlags = m_journal.entries[i].prevFlags;
+		const unsigned char prevArea = m_journal.entries[i].prevArea;
+
+		unsigned int salt, it, ip;
+		decodePolyId(ref, salt, it, ip);
+		dtMeshTile* tile = &m_tiles[it];
+		// Skip the removed polygons, and the changes made before the tile was added again.
+		if (tile->salt != salt || !tile->header || entryVersion < tile->addVersion || !tile->polyStamps)
+			continue;
+
+		// Cannot fail, the polygon stamps exist and the journal has room.
+		journalPolyState(tile, ip, revertVersion);
+		dtPoly* poly = &tile->polys[ip];
+		poly->flags = prevFlags;
+		poly->setArea(prevArea);
+		updatePolySearchData(tile, ip);
+	}
+
+	return DT_SUCCESS;
+}
+
+void dtNavMesh::discardStateChanges(unsigned int version)
+{
+	if (version > m_journal.version)
+		version = m_journal.version;
+	if (version <= m_journal.base)
+		return;
+
+	int n = 0;
+	while (n < m_journal.count && m_journal.entries[n].version <= version)
+		n++;
+	if (n > 0)
+	{
+		memmove(m_journal.entries, m_journal.entries + n, sizeof(dtStateJournalEntry)*(m_journal.count - n));
+		m_journal.count -= n;
+	}
+	m_journal.base = version;
+}
+
 /// @par
 ///
 /// Off-mesh connections are stored in the navigation mesh as special 2-vertex 
@@ -1472,7 +2946,13 @@ dtStatus dtNavMesh::setPolyFlags(dtPolyRef ref, unsigned short flags)
 	dtPoly* poly = &tile->polys[ip];
 	
 	// Change flags.
-	poly->flags = flags;
+	if (poly->flags != flags)
+	{
+		if (!journalPolyState(tile, ip, ++m_journal.version))
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		poly->flags = flags;
+	}
+	updatePolySearchData(tile, ip);
 	
 	return DT_SUCCESS;
 }
@@ -1504,7 +2984,13 @@ dtStatus dtNavMesh::setPolyArea(dtPolyRef ref, unsigned char area)
 	if (ip >= (unsigned int)tile->header->polyCount) return DT_FAILURE | DT_INVALID_PARAM;
 	dtPoly* poly = &tile->polys[ip];
 	
-	poly->setArea(area);
+	if (poly->getArea() != area)
+	{
+		if (!journalPolyState(tile, ip, ++m_journal.version))
+			return DT_FAILURE | DT_OUT_OF_MEMORY;
+		poly->setArea(area);
+	}
+	updatePolySearchData(tile, ip);
 	
 	return DT_SUCCESS;
 }
@@ -1525,3 +3011,35 @@ dtStatus dtNavMesh::getPolyArea(dtPolyRef ref, unsigned char* resultArea) const
 	return DT_SUCCESS;
 }
 
+/// @par
+///
+/// Uses SSE2 to test all the children at once when it is available.
+unsigned int dtOverlapWideBVNode(const dtWideBVNode* node, const short* bmin, const short* bmax)
+{
+#ifdef DT_WIDE_BVNODE_SSE2
+	__m128i fail = _mm_setzero_si128();
+	for (int j = 0; j < 3; ++j)
+	{
+		const __m128i nmin = _mm_loadu_si128((const __m128i*)node->bmin[j]);
+		const __m128i nmax = _mm_loadu_si128((const __m128i*)node->bmax[j]);
+		fail = _mm_or_si128(fail, _mm_cmpgt_epi16(nmin, _mm_set1_epi16(bmax[j])));
+		fail = _mm_or_si128(fail, _mm_cmpgt_epi16(_mm_set1_epi16(bmin[j]), nmax));
+	}
+	const unsigned int failMask = (unsigned int)_mm_movemask_epi8(_mm_packs_epi16(fail, _mm_setzero_si128()));
+	return ~failMask & ((1u << DT_WIDE_BVNODE_CHILDREN) - 1);
+#else
+	unsigned int mask = 0;
+	for (int k = 0; k < DT_WIDE_BVNODE_CHILDREN; ++k)
+	{
+		bool overlap = true;
+		for (int j = 0; j < 3; ++j)
+		{
+			if (node->bmin[j][k] > bmax[j] || node->bmax[j][k] < bmin[j])
+				overlap = false;
+		}
+		if (overlap)
+			mask |= 1u << k;
+	}
+	return mask;
+#endif
+}
@@ -168,11 +168,11 @@ static void subdivide(BVItem* items, int nitems, int imin, int imax, int& curNod
 	}
 }
 
-static int createBVTree(dtNavMeshCreateParams* params, dtBVNode* nodes, int /*nnodes*/)
+static int createBVTree(dtNavMeshCreateParams* params, dtBVNode* nodes, int /*nnodes*/, dtArena* arena)
 {
 	// Build tree
 	float quantFactor = 1 / params->cs;
-	BVItem* items = (BVItem*)dtAlloc(sizeof(BVItem)*params->polyCount, DT_ALLOC_TEMP);
+	BVItem* items = (BVItem*)dtAllocTemp(arena, sizeof(BVItem)*params->polyCount);
 	for (int i = 0; i < params->polyCount; i++)
 	{
 		BVItem& it = items[i];
@@ -235,7 +235,7 @@ static int createBVTree(dtNavMeshCreateParams* params, dtBVNode* nodes, int /*nn
 	int curNode = 0;
 	subdivide(items, params->polyCount, 0, params->polyCount, curNode, nodes);
 	
-	dtFree(items);
+	dtFreeTemp(arena, items);
 	
 	return curNode;
 }
@@ -277,8 +277,12 @@ static unsigned char classifyOffMeshPoint(const float* pt, const float* bmin, co
 /// used to free the memory will be determined by how the tile is added to the navigation
 /// mesh.
 ///
+/// The temporary memory of the build is taken from @p arena when it has room, so that
+/// a tile builder does not need to go through the allocator for every tile.
+///
 /// @see dtNavMesh, dtNavMesh::addTile()
-bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData, int* outDataSize)
+bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData, int* outDataSize,
+						 dtArena* arena)
 {
 	if (params->nvp > DT_VERTS_PER_POLYGON)
 		return false;
@@ -299,7 +303,7 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	
 	if (params->offMeshConCount > 0)
 	{
-		offMeshConClass = (unsigned char*)dtAlloc(sizeof(unsigned char)*params->offMeshConCount*2, DT_ALLOC_TEMP);
+		offMeshConClass = (unsigned char*)dtAllocTemp(arena, sizeof(unsigned char)*params->offMeshConCount*2);
 		if (!offMeshConClass)
 			return false;
 
@@ -433,7 +437,9 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	const int polysSize = dtAlign4(sizeof(dtPoly)*totPolyCount);
 	const int linksSize = dtAlign4(sizeof(dtLink)*maxLinkCount);
 	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*params->polyCount);
-	const int detailVertsSize = dtAlign4(sizeof(float)*3*uniqueDetailVertCount);
+	// Tiles without unique detail vertices have nothing to compact.
+	const bool compactDetail = params->compactDetailVerts && uniqueDetailVertCount > 0;
+	const int detailVertsSize = dtGetDetailVertsDataSize(uniqueDetailVertCount, compactDetail);
 	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*detailTriCount);
 	const int bvTreeSize = params->buildBvTree ? dtAlign4(sizeof(dtBVNode)*params->polyCount*2) : 0;
 	const int offMeshConsSize = dtAlign4(sizeof(dtOffMeshConnection)*storedOffMeshConCount);
@@ -442,10 +448,23 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 						 detailMeshesSize + detailVertsSize + detailTrisSize +
 						 bvTreeSize + offMeshConsSize;
 						 
-	unsigned char* data = (unsigned char*)dtAlloc(sizeof(unsigned char)*dataSize, DT_ALLOC_PERM);
+	// The compact detail vertices are quantized once all of them are known.
+	float* detailVertsTmp = 0;
+	if (compactDetail)
+	{
+		detailVertsTmp = (float*)dtAllocTemp(arena, sizeof(float)*3*uniqueDetailVertCount);
+		if (!detailVertsTmp)
+		{
+			dtFreeTemp(arena, offMeshConClass);
+			return false;
+		}
+	}
+	
+	unsigned char* data = (unsigned char*)dtAlloc(sizeof(unsigned char)*dataSize, DT_ALLOC_PERM_TILE_DATA);
 	if (!data)
 	{
-		dtFree(offMeshConClass);
+		dtFreeTemp(arena, detailVertsTmp);
+		dtFreeTemp(arena, offMeshConClass);
 		return false;
 	}
 	memset(data, 0, dataSize);
@@ -457,7 +476,8 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	dtPoly* navPolys = dtGetThenAdvanceBufferPointer<dtPoly>(d, polysSize);
 	d += linksSize; // Ignore links; just leave enough space for them. They'll be created on load.
 	dtPolyDetail* navDMeshes = dtGetThenAdvanceBufferPointer<dtPolyDetail>(d, detailMeshesSize);
-	float* navDVerts = dtGetThenAdvanceBufferPointer<float>(d, detailVertsSize);
+	unsigned char* navDVertsData = dtGetThenAdvanceBufferPointer<unsigned char>(d, detailVertsSize);
+	float* navDVerts = compactDetail ? detailVertsTmp : (float*)navDVertsData;
 	unsigned char* navDTris = dtGetThenAdvanceBufferPointer<unsigned char>(d, detailTrisSize);
 	dtBVNode* navBvtree = dtGetThenAdvanceBufferPointer<dtBVNode>(d, bvTreeSize);
 	dtOffMeshConnection* offMeshCons = dtGetThenAdvanceBufferPointer<dtOffMeshConnection>(d, offMeshConsSize);
@@ -466,6 +486,8 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	// Store header
 	header->magic = DT_NAVMESH_MAGIC;
 	header->version = DT_NAVMESH_VERSION;
+	if (compactDetail)
+		header->version |= DT_NAVMESH_COMPACT_DETAIL;
 	header->x = params->tileX;
 	header->y = params->tileY;
 	header->layer = params->tileLayer;
@@ -624,11 +646,17 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 			}
 		}
 	}
+	if (compactDetail)
+	{
+		dtQuantizeDetailVerts(navDVerts, uniqueDetailVertCount, (float*)navDVertsData,
+							  (unsigned short*)(navDVertsData + sizeof(float)*6));
+		dtFreeTemp(arena, detailVertsTmp);
+	}
 
 	// Store and create BVtree.
 	if (params->buildBvTree)
 	{
-		createBVTree(params, navBvtree, 2*params->polyCount);
+		createBVTree(params, navBvtree, 2*params->polyCount, arena);
 	}
 	
 	// Store Off-Mesh connections.
@@ -653,7 +681,7 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 		}
 	}
 		
-	dtFree(offMeshConClass);
+	dtFreeTemp(arena, offMeshConClass);
 	
 	*outData = data;
 	*outDataSize = dataSize;
@@ -661,17 +689,57 @@ bool dtCreateNavMeshData(dtNavMeshCreateParams* params, unsigned char** outData,
 	return true;
 }
 
+/// @par
+///
+/// The vertices are stored relative to the minimum of their bounds, in steps of
+/// 1/65535th of the size of the bounds on each axis.
+void dtQuantizeDetailVerts(const float* verts, const int nverts, float* quant, unsigned short* qverts)
+{
+	float bmin[3], bmax[3];
+	if (nverts > 0)
+	{
+		dtVcopy(bmin, verts);
+		dtVcopy(bmax, verts);
+		for (int i = 1; i < nverts; ++i)
+		{
+			dtVmin(bmin, &verts[i*3]);
+			dtVmax(bmax, &verts[i*3]);
+		}
+	}
+	else
+	{
+		dtVset(bmin, 0, 0, 0);
+		dtVset(bmax, 0, 0, 0);
+	}
+	
+	dtVcopy(quant, bmin);
+	for (int j = 0; j < 3; ++j)
+		quant[3+j] = (bmax[j] - bmin[j]) / 65535.0f;
+	
+	for (int i = 0; i < nverts; ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+		{
+			const float cell = quant[3+j];
+			const int q = cell > 0.0f ? (int)((verts[i*3+j] - bmin[j]) / cell + 0.5f) : 0;
+			qverts[i*3+j] = (unsigned short)dtClamp(q, 0, 0xffff);
+		}
+	}
+}
+
 bool dtNavMeshHeaderSwapEndian(unsigned char* data, const int /*dataSize*/)
 {
 	dtMeshHeader* header = (dtMeshHeader*)data;
 	
 	int swappedMagic = DT_NAVMESH_MAGIC;
 	int swappedVersion = DT_NAVMESH_VERSION;
+	int swappedVersionMask = DT_NAVMESH_VERSION_MASK;
 	dtSwapEndian(&swappedMagic);
 	dtSwapEndian(&swappedVersion);
+	dtSwapEndian(&swappedVersionMask);
 	
-	if ((header->magic != DT_NAVMESH_MAGIC || header->version != DT_NAVMESH_VERSION) &&
-		(header->magic != swappedMagic || header->version != swappedVersion))
+	if ((header->magic != DT_NAVMESH_MAGIC || (header->version & DT_NAVMESH_VERSION_MASK) != DT_NAVMESH_VERSION) &&
+		(header->magic != swappedMagic || (header->version & swappedVersionMask) != swappedVersion))
 	{
 		return false;
 	}
@@ -719,7 +787,7 @@ bool dtNavMeshDataSwapEndian(unsigned char* data, const int /*dataSize*/)
 	dtMeshHeader* header = (dtMeshHeader*)data;
 	if (header->magic != DT_NAVMESH_MAGIC)
 		return false;
-	if (header->version != DT_NAVMESH_VERSION)
+	if ((header->version & DT_NAVMESH_VERSION_MASK) != DT_NAVMESH_VERSION)
 		return false;
 	
 	// Patch header pointers.
@@ -728,7 +796,8 @@ bool dtNavMeshDataSwapEndian(unsigned char* data, const int /*dataSize*/)
 	const int polysSize = dtAlign4(sizeof(dtPoly)*header->polyCount);
 	const int linksSize = dtAlign4(sizeof(dtLink)*(header->maxLinkCount));
 	const int detailMeshesSize = dtAlign4(sizeof(dtPolyDetail)*header->detailMeshCount);
-	const int detailVertsSize = dtAlign4(sizeof(float)*3*header->detailVertCount);
+	const bool compactDetail = (header->version & DT_NAVMESH_COMPACT_DETAIL) != 0;
+	const int detailVertsSize = dtGetDetailVertsDataSize(header->detailVertCount, compactDetail);
 	const int detailTrisSize = dtAlign4(sizeof(unsigned char)*4*header->detailTriCount);
 	const int bvtreeSize = dtAlign4(sizeof(dtBVNode)*header->bvNodeCount);
 	const int offMeshLinksSize = dtAlign4(sizeof(dtOffMeshConnection)*header->offMeshConCount);
@@ -739,7 +808,7 @@ bool dtNavMeshDataSwapEndian(unsigned char* data, const int /*dataSize*/)
 	d += linksSize; // Ignore links; they technically should be endian-swapped but all their data is overwritten on load anyway.
 	//dtLink* links = dtGetThenAdvanceBufferPointer<dtLink>(d, linksSize);
 	dtPolyDetail* detailMeshes = dtGetThenAdvanceBufferPointer<dtPolyDetail>(d, detailMeshesSize);
-	float* detailVerts = dtGetThenAdvanceBufferPointer<float>(d, detailVertsSize);
+	unsigned char* detailVertsData = dtGetThenAdvanceBufferPointer<unsigned char>(d, detailVertsSize);
 	d += detailTrisSize; // Ignore detail tris; single bytes can't be endian-swapped.
 	//unsigned char* detailTris = dtGetThenAdvanceBufferPointer<unsigned char>(d, detailTrisSize);
 	dtBVNode* bvTree = dtGetThenAdvanceBufferPointer<dtBVNode>(d, bvtreeSize);
@@ -775,9 +844,26 @@ bool dtNavMeshDataSwapEndian(unsigned char* data, const int /*dataSize*/)
 	}
 	
 	// Detail verts
-	for (int i = 0; i < header->detailVertCount*3; ++i)
+	if (compactDetail)
 	{
-		dtSwapEndian(&detailVerts[i]);
+		float* quant = (float*)detailVertsData;
+		unsigned short* qverts = (unsigned short*)(detailVertsData + sizeof(float)*6);
+		for (int i = 0; i < 6; ++i)
+		{
+			dtSwapEndian(&quant[i]);
+		}
+		for (int i = 0; i < header->detailVertCount*3; ++i)
+		{
+			dtSwapEndian(&qverts[i]);
+		}
+	}
+	else
+	{
+		float* detailVerts = (float*)detailVertsData;
+		for (int i = 0; i < header->detailVertCount*3; ++i)
+		{
+			dtSwapEndian(&detailVerts[i]);
+		}
 	}
 
 	// BV-tree
@@ -18,7 +18,9 @@
 
 #include <float.h>
 #include <string.h>
+#include <stdlib.h>
 #include "DetourNavMeshQuery.h"
+#include "DetourFindPath.h"
 #include "DetourNavMesh.h"
 #include "DetourNode.h"
 #include "DetourCommon.h"
@@ -27,6 +29,21 @@
 #include "DetourAssert.h"
 #include <new>
 
+/// The state of a ray cast by dtNavMeshQuery::raycast.
+struct dtRaycastRay
+{
+	const float* startPos;
+	const float* endPos;
+	float dir[3];
+	float curPos[3];
+	dtPolyRef prevRef, curRef;
+	const dtMeshTile* prevTile, *tile;
+	const dtPoly* prevPoly, *poly;
+	dtRaycastHit* hit;
+	int n;
+	dtStatus status;
+};
+
 /// @class dtQueryFilter
 ///
 /// <b>The Default Implementation</b>
@@ -83,29 +100,77 @@ float dtQueryFilter::getCost(const float* pa, const float* pb,
 {
 	return dtVdist(pa, pb) * m_areaCost[curPoly->getArea()];
 }
-#else
-inline bool dtQueryFilter::passFilter(const dtPolyRef /*ref*/,
-									  const dtMeshTile* /*tile*/,
-									  const dtPoly* poly) const
+#endif
+
+/// Tests a neighbour polygon against the filter during a graph search.
+/// With the default filter only the polygon flags are needed, which are read from the dense
+/// search data of the tile instead of the polygon itself. A custom filter is always called
+/// with the polygon, as it may test anything.
+inline bool passSearchFilter(const dtQueryFilter* filter, const dtPolyRef ref,
+							 const dtMeshTile* tile, const dtPoly* poly)
 {
-	return (poly->flags & m_includeFlags) != 0 && (poly->flags & m_excludeFlags) == 0;
+#ifdef DT_VIRTUAL_QUERYFILTER
+	return filter->passFilter(ref, tile, poly);
+#else
+	dtIgnoreUnused(ref);
+	const unsigned short flags = tile->polySearch[poly - tile->polys].flags;
+	// The search data is stale if the flags were written without dtNavMesh::setPolyFlags().
+	dtAssert(flags == poly->flags);
+	return (flags & filter->getIncludeFlags()) != 0 && (flags & filter->getExcludeFlags()) == 0;
+#endif
 }
 
-inline float dtQueryFilter::getCost(const float* pa, const float* pb,
-									const dtPolyRef /*prevRef*/, const dtMeshTile* /*prevTile*/, const dtPoly* /*prevPoly*/,
-									const dtPolyRef /*curRef*/, const dtMeshTile* /*curTile*/, const dtPoly* curPoly,
-									const dtPolyRef /*nextRef*/, const dtMeshTile* /*nextTile*/, const dtPoly* /*nextPoly*/) const
+/// Returns the cost of a move through a polygon during a graph search.
+/// With the default filter the area of the polygon is read from the search data of the tile,
+/// like the flags in #passSearchFilter.
+inline float getSearchCost(const dtQueryFilter* filter, const float* pa, const float* pb,
+						   const dtPolyRef prevRef, const dtMeshTile* prevTile, const dtPoly* prevPoly,
+						   const dtPolyRef curRef, const dtMeshTile* curTile, const dtPoly* curPoly,
+						   const dtPolyRef nextRef, const dtMeshTile* nextTile, const dtPoly* nextPoly)
 {
-	return dtVdist(pa, pb) * m_areaCost[curPoly->getArea()];
+#ifdef DT_VIRTUAL_QUERYFILTER
+	return filter->getCost(pa, pb, prevRef, prevTile, prevPoly, curRef, curTile, curPoly, nextRef, nextTile, nextPoly);
+#else
+	dtIgnoreUnused(prevRef);
+	dtIgnoreUnused(prevTile);
+	dtIgnoreUnused(prevPoly);
+	dtIgnoreUnused(curRef);
+	dtIgnoreUnused(nextRef);
+	dtIgnoreUnused(nextTile);
+	dtIgnoreUnused(nextPoly);
+	const unsigned char area = curTile->polySearch[curPoly - curTile->polys].getArea();
+	// The search data is stale if the area was written without dtNavMesh::setPolyArea().
+	dtAssert(area == curPoly->getArea());
+	return dtVdist(pa, pb) * filter->getAreaCost(area);
+#endif
 }
-#endif	
+
+/// Runs #dtNavMeshQuery::findPathT with a #dtQueryFilter, testing and pricing the polygons
+/// with #passSearchFilter and #getSearchCost.
+struct dtSearchFilter
+{
+	const dtQueryFilter* filter;
+
+	inline bool passFilter(const dtPolyRef ref, const dtMeshTile* tile, const dtPoly* poly) const
+	{
+		return passSearchFilter(filter, ref, tile, poly);
+	}
+
+	inline float getCost(const float* pa, const float* pb,
+						 const dtPolyRef prevRef, const dtMeshTile* prevTile, const dtPoly* prevPoly,
+						 const dtPolyRef curRef, const dtMeshTile* curTile, const dtPoly* curPoly,
+						 const dtPolyRef nextRef, const dtMeshTile* nextTile, const dtPoly* nextPoly) const
+	{
+		return getSearchCost(filter, pa, pb, prevRef, prevTile, prevPoly, curRef, curTile, curPoly, nextRef, nextTile, nextPoly);
+	}
+};
 	
 static const float H_SCALE = 0.999f; // Search heuristic scale.
 
 
 dtNavMeshQuery* dtAllocNavMeshQuery()
 {
-	void* mem = dtAlloc(sizeof(dtNavMeshQuery), DT_ALLOC_PERM);
+	void* mem = dtAlloc(sizeof(dtNavMeshQuery), DT_ALLOC_PERM_NAVQUERY);
 	if (!mem) return 0;
 	return new(mem) dtNavMeshQuery;
 }
@@ -125,6 +190,10 @@ void dtFreeNavMeshQuery(dtNavMeshQuery* navmesh)
 /// to hold the entire result set the return status of the method will include 
 /// the #DT_BUFFER_TOO_SMALL flag.
 ///
+/// When a polygon reference passed to a method points into a tile evicted with
+/// dtNavMesh::evictTile, the method fails with the #DT_TILE_NOT_RESIDENT flag
+/// instead of #DT_INVALID_PARAM, so the caller can load the tile and retry.
+///
 /// Constant member functions can be used by multiple clients without side
 /// effects. (E.g. No change to the closed list. No impact on an in-progress
 /// sliced path query. Etc.)
@@ -137,24 +206,29 @@ void dtFreeNavMeshQuery(dtNavMeshQuery* navmesh)
 
 dtNavMeshQuery::dtNavMeshQuery() :
 	m_nav(0),
-	m_tinyNodePool(0),
+	m_raycastCache(0),
+	m_raycastCacheMask(0),
+	m_raycastCacheStamp(0),
+	m_scratch(0),
 	m_nodePool(0),
-	m_openList(0)
+	m_openList(0),
+	m_tempArena(0)
 {
 	memset(&m_query, 0, sizeof(dtQueryData));
 }
 
 dtNavMeshQuery::~dtNavMeshQuery()
 {
-	if (m_tinyNodePool)
-		m_tinyNodePool->~dtNodePool();
+	if (m_scratch)
+		m_scratch->~dtNodeScratch();
 	if (m_nodePool)
 		m_nodePool->~dtNodePool();
 	if (m_openList)
 		m_openList->~dtNodeQueue();
-	dtFree(m_tinyNodePool);
+	dtFree(m_scratch);
 	dtFree(m_nodePool);
 	dtFree(m_openList);
+	dtFree(m_raycastCache);
 }
 
 /// @par 
@@ -178,7 +252,7 @@ dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 			dtFree(m_nodePool);
 			m_nodePool = 0;
 		}
-		m_nodePool = new (dtAlloc(sizeof(dtNodePool), DT_ALLOC_PERM)) dtNodePool(maxNodes, dtNextPow2(maxNodes/4));
+		m_nodePool = new (dtAlloc(sizeof(dtNodePool), DT_ALLOC_PERM_NAVQUERY)) dtNodePool(maxNodes, dtNextPow2(maxNodes/4));
 		if (!m_nodePool)
 			return DT_FAILURE | DT_OUT_OF_MEMORY;
 	}
@@ -187,16 +261,14 @@ dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 		m_nodePool->clear();
 	}
 	
-	if (!m_tinyNodePool)
+	if (!m_scratch)
 	{
-		m_tinyNodePool = new (dtAlloc(sizeof(dtNodePool), DT_ALLOC_PERM)) dtNodePool(64, 32);
-		if (!m_tinyNodePool)
+		m_scratch = new (dtAlloc(sizeof(dtNodeScratch), DT_ALLOC_PERM_NAVQUERY)) dtNodeScratch;
+		if (!m_scratch)
 			return DT_FAILURE | DT_OUT_OF_MEMORY;
 	}
-	else
-	{
-		m_tinyNodePool->clear();
-	}
+	if (!m_scratch->init(64, maxNodes))
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
 	
 	if (!m_openList || m_openList->getCapacity() < maxNodes)
 	{
@@ -206,7 +278,7 @@ dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 			dtFree(m_openList);
 			m_openList = 0;
 		}
-		m_openList = new (dtAlloc(sizeof(dtNodeQueue), DT_ALLOC_PERM)) dtNodeQueue(maxNodes);
+		m_openList = new (dtAlloc(sizeof(dtNodeQueue), DT_ALLOC_PERM_NAVQUERY)) dtNodeQueue(maxNodes);
 		if (!m_openList)
 			return DT_FAILURE | DT_OUT_OF_MEMORY;
 	}
@@ -215,9 +287,38 @@ dtStatus dtNavMeshQuery::init(const dtNavMesh* nav, const int maxNodes)
 		m_openList->clear();
 	}
 	
+	// The line of sight cache is allocated by the first any-angle search, drop one too small for the new pool.
+	if (m_raycastCache && m_raycastCacheMask+1 < (int)dtNextPow2(m_nodePool->getMaxNodes()))
+	{
+		dtFree(m_raycastCache);
+		m_raycastCache = 0;
+		m_raycastCacheMask = 0;
+	}
+	m_raycastCacheStamp = 0;
+	
 	return DT_SUCCESS;
 }
 
+void dtNavMeshQuery::getMemoryStats(dtNavMeshQueryMemoryStats* stats) const
+{
+	if (!stats)
+		return;
+	memset(stats, 0, sizeof(dtNavMeshQueryMemoryStats));
+	
+	stats->querySize = (int)sizeof(dtNavMeshQuery);
+	if (m_nodePool)
+		stats->nodePoolSize = m_nodePool->getMemUsed();
+	if (m_openList)
+		stats->openListSize = m_openList->getMemUsed();
+	if (m_scratch)
+		stats->scratchSize = m_scratch->getMemUsed();
+	if (m_raycastCache)
+		stats->raycastCacheSize = (int)sizeof(dtRaycastCacheEntry)*(m_raycastCacheMask+1);
+	
+	stats->totalSize = stats->querySize + stats->nodePoolSize + stats->openListSize +
+		stats->scratchSize + stats->raycastCacheSize;
+}
+
 dtStatus dtNavMeshQuery::findRandomPoint(const dtQueryFilter* filter, float (*frand)(),
 										 dtPolyRef* randomRef, float* randomPt) const
 {
@@ -319,8 +420,9 @@ dtStatus dtNavMeshQuery::findRandomPointAroundCircle(dtPolyRef startRef, const f
 	dtAssert(m_openList);
 	
 	// Validate input
-	if (!startRef || !m_nav->isValidPolyRef(startRef))
-		return DT_FAILURE | DT_INVALID_PARAM;
+	const dtStatus refStatus = m_nav->getPolyRefStatus(startRef);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
 	
 	const dtMeshTile* startTile = 0;
 	const dtPoly* startPoly = 0;
@@ -395,10 +497,13 @@ dtStatus dtNavMeshQuery::findRandomPointAroundCircle(dtPolyRef startRef, const f
 		if (parentRef)
 			m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
 		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		const unsigned int bestIdx = (unsigned int)(bestPoly - bestTile->polys);
+		const dtTileAdjacency* bestAdj = dtGetTileAdjacency(bestTile);
+		const dtPolyPortal* portals = bestAdj->portals;
+		for (unsigned int i = bestAdj->base[bestIdx]; i < bestAdj->base[bestIdx+1]; ++i)
 		{
-			const dtLink* link = &bestTile->links[i];
-			dtPolyRef neighbourRef = link->ref;
+			const dtPolyAdjacency* nei = &bestAdj->entries[i];
+			dtPolyRef neighbourRef = nei->ref;
 			// Skip invalid neighbours and do not follow back to parent.
 			if (!neighbourRef || neighbourRef == parentRef)
 				continue;
@@ -409,13 +514,12 @@ dtStatus dtNavMeshQuery::findRandomPointAroundCircle(dtPolyRef startRef, const f
 			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
 			
 			// Do not advance if the polygon is excluded by the filter.
-			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+			if (!passSearchFilter(filter, neighbourRef, neighbourTile, neighbourPoly))
 				continue;
 			
-			// Find edge and calc distance to the edge.
-			float va[3], vb[3];
-			if (!getPortalPoints(bestRef, bestPoly, bestTile, neighbourRef, neighbourPoly, neighbourTile, va, vb))
-				continue;
+			// Get the portal to the neighbour.
+			const float* va = portals[i].left;
+			const float* vb = portals[i].right;
 			
 			// If the circle is not touching the next polygon, skip it.
 			float tseg;
@@ -508,8 +612,9 @@ dtStatus dtNavMeshQuery::closestPointOnPoly(dtPolyRef ref, const float* pos, flo
 	dtAssert(m_nav);
 	const dtMeshTile* tile = 0;
 	const dtPoly* poly = 0;
-	if (dtStatusFailed(m_nav->getTileAndPolyByRef(ref, &tile, &poly)))
-		return DT_FAILURE | DT_INVALID_PARAM;
+	const dtStatus refStatus = m_nav->getTileAndPolyByRef(ref, &tile, &poly);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
 	if (!tile)
 		return DT_FAILURE | DT_INVALID_PARAM;
 	
@@ -527,9 +632,6 @@ dtStatus dtNavMeshQuery::closestPointOnPoly(dtPolyRef ref, const float* pos, flo
 		return DT_SUCCESS;
 	}
 
-	const unsigned int ip = (unsigned int)(poly - tile->polys);
-	const dtPolyDetail* pd = &tile->detailMeshes[ip];
-
 	// Clamp point to be inside the polygon.
 	float verts[DT_VERTS_PER_POLYGON*3];	
 	float edged[DT_VERTS_PER_POLYGON];
@@ -566,24 +668,9 @@ dtStatus dtNavMeshQuery::closestPointOnPoly(dtPolyRef ref, const float* pos, flo
 	}
 
 	// Find height at the location.
-	for (int j = 0; j < pd->triCount; ++j)
-	{
-		const unsigned char* t = &tile->detailTris[(pd->triBase+j)*4];
-		const float* v[3];
-		for (int k = 0; k < 3; ++k)
-		{
-			if (t[k] < poly->vertCount)
-				v[k] = &tile->verts[poly->verts[t[k]]*3];
-			else
-				v[k] = &tile->detailVerts[(pd->vertBase+(t[k]-poly->vertCount))*3];
-		}
-		float h;
-		if (dtClosestHeightPointTriangle(closest, v[0], v[1], v[2], h))
-		{
-			closest[1] = h;
-			break;
-		}
-	}
+	float h;
+	if (dtGetPolyDetailHeight(tile, poly, closest, &h))
+		closest[1] = h;
 	
 	return DT_SUCCESS;
 }
@@ -605,8 +692,9 @@ dtStatus dtNavMeshQuery::closestPointOnPolyBoundary(dtPolyRef ref, const float*
 	
 	const dtMeshTile* tile = 0;
 	const dtPoly* poly = 0;
-	if (dtStatusFailed(m_nav->getTileAndPolyByRef(ref, &tile, &poly)))
-		return DT_FAILURE | DT_INVALID_PARAM;
+	const dtStatus refStatus = m_nav->getTileAndPolyByRef(ref, &tile, &poly);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
 	
 	// Collect vertices.
 	float verts[DT_VERTS_PER_POLYGON*3];	
@@ -657,8 +745,9 @@ dtStatus dtNavMeshQuery::getPolyHeight(dtPolyRef ref, const float* pos, float* h
 
 	const dtMeshTile* tile = 0;
 	const dtPoly* poly = 0;
-	if (dtStatusFailed(m_nav->getTileAndPolyByRef(ref, &tile, &poly)))
-		return DT_FAILURE | DT_INVALID_PARAM;
+	const dtStatus refStatus = m_nav->getTileAndPolyByRef(ref, &tile, &poly);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
 	
 	if (poly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
 	{
@@ -673,26 +762,12 @@ dtStatus dtNavMeshQuery::getPolyHeight(dtPolyRef ref, const float* pos, float* h
 	}
 	else
 	{
-		const unsigned int ip = (unsigned int)(poly - tile->polys);
-		const dtPolyDetail* pd = &tile->detailMeshes[ip];
-		for (int j = 0; j < pd->triCount; ++j)
+		float h;
+		if (dtGetPolyDetailHeight(tile, poly, pos, &h))
 		{
-			const unsigned char* t = &tile->detailTris[(pd->triBase+j)*4];
-			const float* v[3];
-			for (int k = 0; k < 3; ++k)
-			{
-				if (t[k] < poly->vertCount)
-					v[k] = &tile->verts[poly->verts[t[k]]*3];
-				else
-					v[k] = &tile->detailVerts[(pd->vertBase+(t[k]-poly->vertCount))*3];
-			}
-			float h;
-			if (dtClosestHeightPointTriangle(pos, v[0], v[1], v[2], h))
-			{
-				if (height)
-					*height = h;
-				return DT_SUCCESS;
-			}
+			if (height)
+				*height = h;
+			return DT_SUCCESS;
 		}
 	}
 	
@@ -817,39 +892,85 @@ void dtNavMeshQuery::queryPolygonsInTile(const dtMeshTile* tile, const float* qm
 		bmax[1] = (unsigned short)(qfac * maxy + 1) | 1;
 		bmax[2] = (unsigned short)(qfac * maxz + 1) | 1;
 
-		// Traverse tree
 		const dtPolyRef base = m_nav->getPolyRefBase(tile);
-		while (node < end)
-		{
-			const bool overlap = dtOverlapQuantBounds(bmin, bmax, node->bmin, node->bmax);
-			const bool isLeafNode = node->i >= 0;
 
-			if (isLeafNode && overlap)
+		if (tile->bvWideTree)
+		{
+			const short wmin[3] = { (short)(bmin[0] ^ 0x8000), (short)(bmin[1] ^ 0x8000), (short)(bmin[2] ^ 0x8000) };
+			const short wmax[3] = { (short)(bmax[0] ^ 0x8000), (short)(bmax[1] ^ 0x8000), (short)(bmax[2] ^ 0x8000) };
+			
+			// Traverse the wide tree, visiting the overlapping children in tree order.
+			int stack[DT_WIDE_BVTREE_STACK_SIZE];
+			int nstack = 0;
+			stack[nstack++] = 0;
+			while (nstack > 0)
 			{
-				dtPolyRef ref = base | (dtPolyRef)node->i;
-				if (filter->passFilter(ref, tile, &tile->polys[node->i]))
+				const int idx = stack[--nstack];
+				if (idx < 0)
 				{
-					polyRefs[n] = ref;
-					polys[n] = &tile->polys[node->i];
-
-					if (n == batchSize - 1)
+					const int ip = -idx-1;
+					const dtPolyRef ref = base | (dtPolyRef)ip;
+					if (filter->passFilter(ref, tile, &tile->polys[ip]))
 					{
-						query->process(tile, polys, polyRefs, batchSize);
-						n = 0;
+						polyRefs[n] = ref;
+						polys[n] = &tile->polys[ip];
+						
+						if (n == batchSize - 1)
+						{
+							query->process(tile, polys, polyRefs, batchSize);
+							n = 0;
+						}
+						else
+						{
+							n++;
+						}
 					}
-					else
+					continue;
+				}
+				const dtWideBVNode* wideNode = &tile->bvWideTree[idx];
+				const unsigned int mask = dtOverlapWideBVNode(wideNode, wmin, wmax);
+				for (int k = DT_WIDE_BVNODE_CHILDREN-1; k >= 0; --k)
+				{
+					if ((mask & (1u << k)) && wideNode->child[k] != 0)
+						stack[nstack++] = wideNode->child[k];
+				}
+			}
+		}
+		else
+		{
+			// Traverse tree
+			while (node < end)
+			{
+				const bool overlap = dtOverlapQuantBounds(bmin, bmax, node->bmin, node->bmax);
+				const bool isLeafNode = node->i >= 0;
+
+				if (isLeafNode && overlap)
+				{
+					dtPolyRef ref = base | (dtPolyRef)node->i;
+					if (filter->passFilter(ref, tile, &tile->polys[node->i]))
 					{
-						n++;
+						polyRefs[n] = ref;
+						polys[n] = &tile->polys[node->i];
+
+						if (n == batchSize - 1)
+						{
+							query->process(tile, polys, polyRefs, batchSize);
+							n = 0;
+						}
+						else
+						{
+							n++;
+						}
 					}
 				}
-			}
 
-			if (overlap || isLeafNode)
-				node++;
-			else
-			{
-				const int escapeIndex = -node->i;
-				node += escapeIndex;
+				if (overlap || isLeafNode)
+					node++;
+				else
+				{
+					const int escapeIndex = -node->i;
+					node += escapeIndex;
+				}
 			}
 		}
 	}
@@ -1002,6 +1123,199 @@ dtStatus dtNavMeshQuery::queryPolygons(const float* center, const float* halfExt
 	return DT_SUCCESS;
 }
 
+/// A point of dtNavMeshQuery::findNearestPolyBatch, sorted by its tile and cell along a Morton curve.
+struct dtNearestPolyPoint
+{
+	unsigned int tileKey;
+	unsigned int cellKey;
+	int index;
+};
+
+inline unsigned int spreadBits16(unsigned int v)
+{
+	v &= 0xffff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+inline unsigned int mortonKey(const int x, const int y)
+{
+	return spreadBits16((unsigned int)(x + 0x8000)) | (spreadBits16((unsigned int)(y + 0x8000)) << 1);
+}
+
+static int compareNearestPolyPoints(const void* va, const void* vb)
+{
+	const dtNearestPolyPoint* a = (const dtNearestPolyPoint*)va;
+	const dtNearestPolyPoint* b = (const dtNearestPolyPoint*)vb;
+	if (a->tileKey != b->tileKey)
+		return a->tileKey < b->tileKey ? -1 : 1;
+	if (a->cellKey != b->cellKey)
+		return a->cellKey < b->cellKey ? -1 : 1;
+	return a->index - b->index;
+}
+
+/// @par
+///
+/// Each point gets the same result as a call to #findNearestPoly, except that a hint
+/// is kept as the result when the point is over the hint polygon, and within the climb 
+/// height and the search box from it. The hints are typically the results of the 
+/// previous update, so that the entities which stay in their polygons are snapped 
+/// without searching.
+///
+/// The other points are sorted along a Morton curve, first by their tiles and then
+/// by their search boxes, so that nearby points are searched one after another
+/// and share the cached tile data. The sort buffer is taken
+/// from the temporary arena when one is set. (See: #setTempArena)
+///
+/// The nearest point is only written when a polygon is found.
+dtStatus dtNavMeshQuery::findNearestPolyBatch(const float* points, const int count, const float* halfExtents,
+											  const dtQueryFilter* filter,
+											  dtPolyRef* nearestRefs, float* nearestPts, const dtPolyRef* hints) const
+{
+	dtAssert(m_nav);
+	
+	if (!points || count < 0 || !halfExtents || !filter || !nearestRefs)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	if (count == 0)
+		return DT_SUCCESS;
+	
+	dtNearestPolyPoint* sorted = (dtNearestPolyPoint*)dtAllocTemp(m_tempArena, sizeof(dtNearestPolyPoint)*count);
+	if (!sorted)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	
+	const float* orig = m_nav->getParams()->orig;
+	const float cellSizeX = dtMax(halfExtents[0]*2.0f, 0.001f);
+	const float cellSizeZ = dtMax(halfExtents[2]*2.0f, 0.001f);
+	
+	int nsorted = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		const float* pt = &points[i*3];
+		const dtPolyRef hint = hints ? hints[i] : 0;
+		nearestRefs[i] = 0;
+		
+		// Keep the hint if the point has not left it.
+		if (hint && isNearestPolyHint(hint, pt, halfExtents, filter, nearestPts ? &nearestPts[i*3] : 0))
+		{
+			nearestRefs[i] = hint;
+			continue;
+		}
+		
+		int tx, ty;
+		m_nav->calcTileLoc(pt, &tx, &ty);
+		const int cx = (int)dtMathFloorf((pt[0] - orig[0]) / cellSizeX);
+		const int cz = (int)dtMathFloorf((pt[2] - orig[2]) / cellSizeZ);
+		dtNearestPolyPoint* sp = &sorted[nsorted++];
+		sp->tileKey = mortonKey(tx, ty);
+		sp->cellKey = mortonKey(cx, cz);
+		sp->index = i;
+	}
+	
+	qsort(sorted, nsorted, sizeof(dtNearestPolyPoint), compareNearestPolyPoints);
+	
+	for (int i = 0; i < nsorted; ++i)
+	{
+		const int idx = sorted[i].index;
+		const float* pt = &points[idx*3];
+		
+		// Search the tiles per cell like findNearestPoly, a cell may hold many layers.
+		dtFindNearestPolyQuery query(this, pt);
+		queryPolygons(pt, halfExtents, filter, &query);
+		
+		nearestRefs[idx] = query.nearestRef();
+		if (nearestPts && nearestRefs[idx])
+			dtVcopy(&nearestPts[idx*3], query.nearestPoint());
+	}
+	
+	dtFreeTemp(m_tempArena, sorted);
+	
+	return DT_SUCCESS;
+}
+
+/// @par
+///
+/// Most agents move only a little between updates, and are still over the polygon
+/// they were last found in, or over one of its neighbours. The hint polygon and then
+/// the polygons linked to it are tested first, and the tiles are only searched when
+/// the point is over none of them. A polygon is accepted when the point is over it,
+/// and within the climb height and the search box from it.
+///
+/// The hint may be a polygon the filter now excludes, in which case only its
+/// neighbours are tested. Use @p result to measure how often the hint is hit.
+///
+/// @see findNearestPoly
+dtStatus dtNavMeshQuery::findNearestPolyHinted(dtPolyRef hintRef, const float* center, const float* halfExtents,
+											   const dtQueryFilter* filter,
+											   dtPolyRef* nearestRef, float* nearestPt,
+											   dtNearestPolyHintResult* result) const
+{
+	dtAssert(m_nav);
+	
+	if (!nearestRef || !center || !halfExtents || !filter)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	*nearestRef = 0;
+	if (result)
+		*result = DT_NEAREST_NOT_FOUND;
+	
+	const dtMeshTile* tile = 0;
+	const dtPoly* poly = 0;
+	if (hintRef && dtStatusSucceed(m_nav->getTileAndPolyByRef(hintRef, &tile, &poly)))
+	{
+		if (isNearestPolyHint(hintRef, center, halfExtents, filter, nearestPt))
+		{
+			*nearestRef = hintRef;
+			if (result)
+				*result = DT_NEAREST_HINT_POLY;
+			return DT_SUCCESS;
+		}
+		
+		for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
+		{
+			const dtPolyRef neiRef = tile->links[i].ref;
+			if (neiRef && isNearestPolyHint(neiRef, center, halfExtents, filter, nearestPt))
+			{
+				*nearestRef = neiRef;
+				if (result)
+					*result = DT_NEAREST_HINT_NEIGHBOUR;
+				return DT_SUCCESS;
+			}
+		}
+	}
+	
+	dtStatus status = findNearestPoly(center, halfExtents, filter, nearestRef, nearestPt);
+	if (result)
+		*result = *nearestRef ? DT_NEAREST_SEARCH : DT_NEAREST_NOT_FOUND;
+	return status;
+}
+
+bool dtNavMeshQuery::isNearestPolyHint(dtPolyRef ref, const float* pos, const float* halfExtents,
+									   const dtQueryFilter* filter, float* nearestPt) const
+{
+	const dtMeshTile* tile = 0;
+	const dtPoly* poly = 0;
+	if (dtStatusFailed(m_nav->getTileAndPolyByRef(ref, &tile, &poly)))
+		return false;
+	if (poly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION || !filter->passFilter(ref, tile, poly))
+		return false;
+	
+	float closest[3];
+	bool posOverPoly = false;
+	closestPointOnPoly(ref, pos, closest, &posOverPoly);
+	if (!posOverPoly)
+		return false;
+	const float dy = dtAbs(pos[1] - closest[1]);
+	if (dy > tile->header->walkableClimb || dy > halfExtents[1])
+		return false;
+	
+	if (nearestPt)
+		dtVcopy(nearestPt, closest);
+	return true;
+}
+
 /// @par
 ///
 /// If the end polygon cannot be reached through the navigation graph,
@@ -1017,24 +1331,81 @@ dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
 								  const float* startPos, const float* endPos,
 								  const dtQueryFilter* filter,
 								  dtPolyRef* path, int* pathCount, const int maxPath) const
+{
+	const dtSearchFilter searchFilter = { filter };
+	return findPathT(startRef, endRef, startPos, endPos, filter ? &searchFilter : 0, path, pathCount, maxPath);
+}
+
+inline unsigned int hashTargetRef(dtPolyRef ref)
+{
+	// Mix the tile and salt bits into the low bits used as the bucket.
+	unsigned int a = (unsigned int)ref ^ (unsigned int)(ref >> 16 >> 16);
+	a ^= a >> 16;
+	a *= 0x85ebca6bu;
+	a ^= a >> 13;
+	return a;
+}
+
+/// @par
+///
+/// The search expands from the start polygon in order of cost, like #findPolysAroundCircle,
+/// and a target is reached when its polygon is removed from the open list. The cost of a
+/// reached target includes the cost from the polygon entry point to the target position.
+/// This replaces a #findPath call per target when choosing the best of several destinations.
+///
+/// Targets are reached in order of the cost to their polygon, so when the search stops early
+/// the reached targets are the nearest ones up to the final segment to the target position.
+/// All the targets located in the same polygon are reached at the same time.
+/// The targets are found from the polygon of a node through a hash table, which is allocated
+/// from the temporary arena (see #setTempArena).
+///
+/// The search stops when @p maxSettled targets have been reached, when all targets have
+/// been reached or when the graph has been exhausted. Targets that were not reached have
+/// a cost of FLT_MAX and an empty path. #DT_PARTIAL_RESULT is returned if fewer targets than
+/// requested were reached.
+///
+/// If a path array is to small to hold the full result, it will be filled as
+/// far as possible from the start polygon toward the target polygon.
+///
+dtStatus dtNavMeshQuery::findPathsToMany(dtPolyRef startRef, const float* startPos,
+										 const dtPolyRef* targetRefs, const float* targetPos, const int targetCount,
+										 const int maxSettled, const dtQueryFilter* filter,
+										 float* targetCosts, dtPolyRef* paths, int* pathCounts, const int maxPath) const
 {
 	dtAssert(m_nav);
 	dtAssert(m_nodePool);
 	dtAssert(m_openList);
 	
-	if (pathCount)
-		*pathCount = 0;
-	
 	// Validate input
-	if (!m_nav->isValidPolyRef(startRef) || !m_nav->isValidPolyRef(endRef) ||
-		!startPos || !endPos || !filter || maxPath <= 0 || !path || !pathCount)
+	if (!startPos || !targetRefs || !targetPos || targetCount <= 0 ||
+		maxSettled < 0 || !filter || !targetCosts || !paths || !pathCounts || maxPath <= 0)
 		return DT_FAILURE | DT_INVALID_PARAM;
-
-	if (startRef == endRef)
+	const dtStatus refStatus = m_nav->getPolyRefStatus(startRef);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
+	
+	for (int i = 0; i < targetCount; ++i)
 	{
-		path[0] = startRef;
-		*pathCount = 1;
-		return DT_SUCCESS;
+		targetCosts[i] = FLT_MAX;
+		pathCounts[i] = 0;
+	}
+	
+	const int wantSettled = (maxSettled > 0 && maxSettled < targetCount) ? maxSettled : targetCount;
+	int numSettled = 0;
+	
+	// Chain the targets by polygon in a hash table, so that finding the targets of a node
+	// does not depend on the number of targets.
+	const int bucketCount = (int)dtNextPow2((unsigned int)targetCount*2);
+	int* targetBuckets = (int*)dtAllocTemp(m_tempArena, sizeof(int)*(bucketCount + targetCount));
+	if (!targetBuckets)
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	int* nextTarget = targetBuckets + bucketCount;
+	memset(targetBuckets, 0xff, sizeof(int)*bucketCount);
+	for (int i = targetCount-1; i >= 0; --i)
+	{
+		const unsigned int bucket = hashTargetRef(targetRefs[i]) & (bucketCount-1);
+		nextTarget[i] = targetBuckets[bucket];
+		targetBuckets[bucket] = i;
 	}
 	
 	m_nodePool->clear();
@@ -1044,15 +1415,12 @@ dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
 	dtVcopy(startNode->pos, startPos);
 	startNode->pidx = 0;
 	startNode->cost = 0;
-	startNode->total = dtVdist(startPos, endPos) * H_SCALE;
+	startNode->total = 0;
 	startNode->id = startRef;
 	startNode->flags = DT_NODE_OPEN;
 	m_openList->push(startNode);
 	
-	dtNode* lastBestNode = startNode;
-	float lastBestNodeCost = startNode->total;
-	
-	bool outOfNodes = false;
+	dtStatus status = DT_SUCCESS;
 	
 	while (!m_openList->empty())
 	{
@@ -1061,22 +1429,12 @@ dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
 		bestNode->flags &= ~DT_NODE_OPEN;
 		bestNode->flags |= DT_NODE_CLOSED;
 		
-		// Reached the goal, stop searching.
-		if (bestNode->id == endRef)
-		{
-			lastBestNode = bestNode;
-			break;
-		}
-		
 		// Get current poly and tile.
 		// The API input has been cheked already, skip checking internal data.
 		const dtPolyRef bestRef = bestNode->id;
 		const dtMeshTile* bestTile = 0;
 		const dtPoly* bestPoly = 0;
 		m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
-		if (bestPoly->vertCount == 2) {
-			do {} while (0);
-		}
 		
 		// Get parent poly and tile.
 		dtPolyRef parentRef = 0;
@@ -1087,9 +1445,28 @@ dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
 		if (parentRef)
 			m_nav->getTileAndPolyByRefUnsafe(parentRef, &parentTile, &parentPoly);
 		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		// Settle the targets located in this polygon.
+		for (int i = targetBuckets[hashTargetRef(bestRef) & (bucketCount-1)]; i != -1; i = nextTarget[i])
+		{
+			if (targetRefs[i] != bestRef || pathCounts[i] > 0)
+				continue;
+			const float endCost = getSearchCost(filter, bestNode->pos, &targetPos[i*3],
+														parentRef, parentTile, parentPoly,
+														bestRef, bestTile, bestPoly,
+														0, 0, 0);
+			targetCosts[i] = bestNode->cost + endCost;
+			status |= getPathToNode(bestNode, &paths[i*maxPath], &pathCounts[i], maxPath) & DT_STATUS_DETAIL_MASK;
+			numSettled++;
+		}
+		if (numSettled >= wantSettled)
+			break;
+		
+		const unsigned int bestIdx = (unsigned int)(bestPoly - bestTile->polys);
+		const dtTileAdjacency* bestAdj = dtGetTileAdjacency(bestTile);
+		for (unsigned int i = bestAdj->base[bestIdx]; i < bestAdj->base[bestIdx+1]; ++i)
 		{
-			dtPolyRef neighbourRef = bestTile->links[i].ref;
+			const dtPolyAdjacency* nei = &bestAdj->entries[i];
+			dtPolyRef neighbourRef = nei->ref;
 			
 			// Skip invalid ids and do not expand back to where we came from.
 			if (!neighbourRef || neighbourRef == parentRef)
@@ -1099,70 +1476,37 @@ dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
 			// The API input has been cheked already, skip checking internal data.
 			const dtMeshTile* neighbourTile = 0;
 			const dtPoly* neighbourPoly = 0;
-			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);			
+			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
 			
-			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+			if (!passSearchFilter(filter, neighbourRef, neighbourTile, neighbourPoly))
 				continue;
-
+			
 			// deal explicitly with crossing tile boundaries
 			unsigned char crossSide = 0;
-			if (bestTile->links[i].side != 0xff)
-				crossSide = bestTile->links[i].side >> 1;
-
-			// get the node
+			if (nei->side != 0xff)
+				crossSide = nei->side >> 1;
+			
 			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef, crossSide);
 			if (!neighbourNode)
 			{
-				outOfNodes = true;
+				status |= DT_OUT_OF_NODES;
 				continue;
 			}
 			
 			// If the node is visited the first time, calculate node position.
 			if (neighbourNode->flags == 0)
-			{
-				getEdgeMidPoint(bestRef, bestPoly, bestTile,
-								neighbourRef, neighbourPoly, neighbourTile,
-								neighbourNode->pos);
-			}
-
-			// Calculate cost and heuristic.
-			float cost = 0;
-			float heuristic = 0;
+				dtVcopy(neighbourNode->pos, nei->mid);
 			
-			// Special case for last node.
-			if (neighbourRef == endRef)
-			{
-				// Cost
-				const float curCost = filter->getCost(bestNode->pos, neighbourNode->pos,
-													  parentRef, parentTile, parentPoly,
-													  bestRef, bestTile, bestPoly,
-													  neighbourRef, neighbourTile, neighbourPoly);
-				const float endCost = filter->getCost(neighbourNode->pos, endPos,
-													  bestRef, bestTile, bestPoly,
-													  neighbourRef, neighbourTile, neighbourPoly,
-													  0, 0, 0);
-				
-				cost = bestNode->cost + curCost + endCost;
-				heuristic = 0;
-			}
-			else
-			{
-				// Cost
-				const float curCost = filter->getCost(bestNode->pos, neighbourNode->pos,
-													  parentRef, parentTile, parentPoly,
-													  bestRef, bestTile, bestPoly,
-													  neighbourRef, neighbourTile, neighbourPoly);
-				cost = bestNode->cost + curCost;
-				heuristic = dtVdist(neighbourNode->pos, endPos)*H_SCALE;
-			}
-
-			const float total = cost + heuristic;
+			const float cost = bestNode->cost + getSearchCost(filter, bestNode->pos, neighbourNode->pos,
+																	  parentRef, parentTile, parentPoly,
+																	  bestRef, bestTile, bestPoly,
+																	  neighbourRef, neighbourTile, neighbourPoly);
 			
 			// The node is already in open list and the new result is worse, skip.
-			if ((neighbourNode->flags & DT_NODE_OPEN) && total >= neighbourNode->total)
+			if ((neighbourNode->flags & DT_NODE_OPEN) && cost >= neighbourNode->total)
 				continue;
 			// The node is already visited and process, and the new result is worse, skip.
-			if ((neighbourNode->flags & DT_NODE_CLOSED) && total >= neighbourNode->total)
+			if ((neighbourNode->flags & DT_NODE_CLOSED) && cost >= neighbourNode->total)
 				continue;
 			
 			// Add or update the node.
@@ -1170,7 +1514,7 @@ dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
 			neighbourNode->id = neighbourRef;
 			neighbourNode->flags = (neighbourNode->flags & ~DT_NODE_CLOSED);
 			neighbourNode->cost = cost;
-			neighbourNode->total = total;
+			neighbourNode->total = cost;
 			
 			if (neighbourNode->flags & DT_NODE_OPEN)
 			{
@@ -1183,23 +1527,13 @@ dtStatus dtNavMeshQuery::findPath(dtPolyRef startRef, dtPolyRef endRef,
 				neighbourNode->flags |= DT_NODE_OPEN;
 				m_openList->push(neighbourNode);
 			}
-			
-			// Update nearest node to target so far.
-			if (heuristic < lastBestNodeCost)
-			{
-				lastBestNodeCost = heuristic;
-				lastBestNode = neighbourNode;
-			}
 		}
 	}
-
-	dtStatus status = getPathToNode(lastBestNode, path, pathCount, maxPath);
-
-	if (lastBestNode->id != endRef)
+	
+	dtFreeTemp(m_tempArena, targetBuckets);
+	
+	if (numSettled < wantSettled)
 		status |= DT_PARTIAL_RESULT;
-
-	if (outOfNodes)
-		status |= DT_OUT_OF_NODES;
 	
 	return status;
 }
@@ -1276,8 +1610,11 @@ dtStatus dtNavMeshQuery::initSlicedFindPath(dtPolyRef startRef, dtPolyRef endRef
 		return DT_FAILURE | DT_INVALID_PARAM;
 	
 	// Validate input
-	if (!m_nav->isValidPolyRef(startRef) || !m_nav->isValidPolyRef(endRef))
-		return DT_FAILURE | DT_INVALID_PARAM;
+	dtStatus refStatus = m_nav->getPolyRefStatus(startRef);
+	if (dtStatusSucceed(refStatus))
+		refStatus = m_nav->getPolyRefStatus(endRef);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
 
 	// trade quality with performance?
 	if (options & DT_FINDPATH_ANY_ANGLE)
@@ -1287,6 +1624,25 @@ dtStatus dtNavMeshQuery::initSlicedFindPath(dtPolyRef startRef, dtPolyRef endRef
 		const dtMeshTile* tile = m_nav->getTileByRef(startRef);
 		float agentRadius = tile->header->walkableRadius;
 		m_query.raycastLimitSqr = dtSqr(agentRadius * DT_RAY_CAST_LIMIT_PROPORTIONS);
+		
+		if (!m_raycastCache)
+		{
+			const int raycastCacheSize = (int)dtNextPow2(m_nodePool->getMaxNodes());
+			m_raycastCache = (dtRaycastCacheEntry*)dtAlloc(sizeof(dtRaycastCacheEntry)*raycastCacheSize, DT_ALLOC_PERM_NAVQUERY);
+			if (!m_raycastCache)
+				return DT_FAILURE | DT_OUT_OF_MEMORY;
+			m_raycastCacheMask = raycastCacheSize-1;
+			m_raycastCacheStamp = 0;
+		}
+		
+		// Start a new generation of cached line of sight tests. The cache is cleared on
+		// the first search after init and when the stamp wraps around.
+		m_raycastCacheStamp++;
+		if (m_raycastCacheStamp <= 1)
+		{
+			memset(m_raycastCache, 0, sizeof(dtRaycastCacheEntry)*(m_raycastCacheMask+1));
+			m_raycastCacheStamp = 1;
+		}
 	}
 
 	if (startRef == endRef)
@@ -1316,22 +1672,59 @@ dtStatus dtNavMeshQuery::initSlicedFindPath(dtPolyRef startRef, dtPolyRef endRef
 	
 dtStatus dtNavMeshQuery::updateSlicedFindPath(const int maxIter, int* doneIters)
 {
-	if (!dtStatusInProgress(m_query.status))
-		return m_query.status;
+	return updateSlicedFindPathUntil(maxIter, 0, doneIters);
+}
 
-	// Make sure the request is still valid.
-	if (!m_nav->isValidPolyRef(m_query.startRef) || !m_nav->isValidPolyRef(m_query.endRef))
-	{
-		m_query.status = DT_FAILURE;
-		return DT_FAILURE;
-	}
+/// @par
+///
+/// The clock is read every few iterations, so the update can overrun the budget by the
+/// cost of a few iterations. At least one iteration is always performed.
+///
+/// The iteration rate can be used to convert a latency target into an iteration count
+/// for #updateSlicedFindPath, or to schedule the queries between frames.
+///
+/// @see dtTimeSetCustom
+dtStatus dtNavMeshQuery::updateSlicedFindPathTimed(const int maxIter, const uint64_t maxTimeNs, int* doneIters, float* itersPerUsec)
+{
+	const uint64_t start = dtGetTimeNs();
+	int iters = 0;
+	// A zero deadline would disable the time limit.
+	const dtStatus status = updateSlicedFindPathUntil(maxIter, dtMax(start + maxTimeNs, (uint64_t)1), &iters);
+	
+	if (doneIters)
+		*doneIters = iters;
+	if (itersPerUsec)
+	{
+		const uint64_t elapsed = dtGetTimeNs() - start;
+		*itersPerUsec = elapsed > 0 ? (float)iters * 1000.0f / (float)elapsed : 0.0f;
+	}
+	
+	return status;
+}
+
+dtStatus dtNavMeshQuery::updateSlicedFindPathUntil(const int maxIter, const uint64_t deadline, int* doneIters)
+{
+	// Number of iterations between the clock reads, must be power of two.
+	static const int TIME_CHECK_INTERVAL = 8;
+	
+	if (!dtStatusInProgress(m_query.status))
+		return m_query.status;
+
+	// Make sure the request is still valid.
+	if (!m_nav->isValidPolyRef(m_query.startRef) || !m_nav->isValidPolyRef(m_query.endRef))
+	{
+		// Tell apart an evicted start or end tile, the search can be retried once it is back.
+		const dtStatus refStatus = m_nav->getPolyRefStatus(m_query.startRef) | m_nav->getPolyRefStatus(m_query.endRef);
+		m_query.status = DT_FAILURE | (refStatus & DT_TILE_NOT_RESIDENT);
+		return m_query.status;
+	}
 
-	dtRaycastHit rayHit;
-	rayHit.maxPath = 0;
-		
 	int iter = 0;
 	while (iter < maxIter && !m_openList->empty())
 	{
+		if (deadline && iter > 0 && (iter & (TIME_CHECK_INTERVAL-1)) == 0 && dtGetTimeNs() >= deadline)
+			break;
+		
 		iter++;
 		
 		// Remove node from open list and put it in closed list.
@@ -1397,9 +1790,12 @@ dtStatus dtNavMeshQuery::updateSlicedFindPath(const int maxIter, int* doneIters)
 				tryLOS = true;
 		}
 		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		const unsigned int bestIdx = (unsigned int)(bestPoly - bestTile->polys);
+		const dtTileAdjacency* bestAdj = dtGetTileAdjacency(bestTile);
+		for (unsigned int i = bestAdj->base[bestIdx]; i < bestAdj->base[bestIdx+1]; ++i)
 		{
-			dtPolyRef neighbourRef = bestTile->links[i].ref;
+			const dtPolyAdjacency* nei = &bestAdj->entries[i];
+			dtPolyRef neighbourRef = nei->ref;
 			
 			// Skip invalid ids and do not expand back to where we came from.
 			if (!neighbourRef || neighbourRef == parentRef)
@@ -1411,7 +1807,7 @@ dtStatus dtNavMeshQuery::updateSlicedFindPath(const int maxIter, int* doneIters)
 			const dtPoly* neighbourPoly = 0;
 			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);			
 			
-			if (!m_query.filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+			if (!passSearchFilter(m_query.filter, neighbourRef, neighbourTile, neighbourPoly))
 				continue;
 			
 			// get the neighbor node
@@ -1428,57 +1824,50 @@ dtStatus dtNavMeshQuery::updateSlicedFindPath(const int maxIter, int* doneIters)
 
 			// If the node is visited the first time, calculate node position.
 			if (neighbourNode->flags == 0)
-			{
-				getEdgeMidPoint(bestRef, bestPoly, bestTile,
-								neighbourRef, neighbourPoly, neighbourTile,
-								neighbourNode->pos);
-			}
+				dtVcopy(neighbourNode->pos, nei->mid);
 			
 			// Calculate cost and heuristic.
-			float cost = 0;
+			float endCost = 0;
 			float heuristic = 0;
 			
-			// raycast parent
-			bool foundShortCut = false;
-			rayHit.pathCost = rayHit.t = 0;
-			if (tryLOS)
-			{
-				raycast(parentRef, parentNode->pos, neighbourNode->pos, m_query.filter, DT_RAYCAST_USE_COSTS, &rayHit, grandpaRef);
-				foundShortCut = rayHit.t >= 1.0f;
-			}
-
-			// update move cost
-			if (foundShortCut)
-			{
-				// shortcut found using raycast. Using shorter cost instead
-				cost = parentNode->cost + rayHit.pathCost;
-			}
-			else
-			{
-				// No shortcut found.
-				const float curCost = m_query.filter->getCost(bestNode->pos, neighbourNode->pos,
-															  parentRef, parentTile, parentPoly,
-															bestRef, bestTile, bestPoly,
-															neighbourRef, neighbourTile, neighbourPoly);
-				cost = bestNode->cost + curCost;
-			}
-
 			// Special case for last node.
 			if (neighbourRef == m_query.endRef)
 			{
-				const float endCost = m_query.filter->getCost(neighbourNode->pos, m_query.endPos,
-															  bestRef, bestTile, bestPoly,
-															  neighbourRef, neighbourTile, neighbourPoly,
-															  0, 0, 0);
-				
-				cost = cost + endCost;
-				heuristic = 0;
+				endCost = getSearchCost(m_query.filter, neighbourNode->pos, m_query.endPos,
+														bestRef, bestTile, bestPoly,
+														neighbourRef, neighbourTile, neighbourPoly,
+														0, 0, 0);
 			}
 			else
 			{
 				heuristic = dtVdist(neighbourNode->pos, m_query.endPos)*H_SCALE;
 			}
 			
+			const float curCost = getSearchCost(m_query.filter, bestNode->pos, neighbourNode->pos,
+																parentRef, parentTile, parentPoly,
+																bestRef, bestTile, bestPoly,
+																neighbourRef, neighbourTile, neighbourPoly);
+			float cost = bestNode->cost + curCost + endCost;
+			
+			// raycast parent
+			bool foundShortCut = false;
+			if (tryLOS)
+			{
+				// If the node has been reached at least as cheaply as through the current node,
+				// only a shortcut can improve it, so the ray can be abandoned once it costs too much.
+				float maxTotal = FLT_MAX;
+				if ((neighbourNode->flags & (DT_NODE_OPEN | DT_NODE_CLOSED)) && cost + heuristic >= neighbourNode->total)
+					maxTotal = neighbourNode->total;
+				
+				float rayCost = 0;
+				if (raycastShortcut(parentNode, grandpaRef, neighbourNode, endCost + heuristic, maxTotal, &rayCost))
+				{
+					// shortcut found using raycast. Using shorter cost instead
+					foundShortCut = true;
+					cost = parentNode->cost + rayCost + endCost;
+				}
+			}
+			
 			const float total = cost + heuristic;
 			
 			// The node is already in open list and the new result is worse, skip.
@@ -1531,6 +1920,71 @@ dtStatus dtNavMeshQuery::updateSlicedFindPath(const int maxIter, int* doneIters)
 	return m_query.status;
 }
 
+inline unsigned int hashRaycastPair(dtPolyRef fromRef, dtPolyRef toRef)
+{
+	const unsigned int a = (unsigned int)fromRef ^ (unsigned int)(fromRef >> 16 >> 16);
+	const unsigned int b = (unsigned int)toRef ^ (unsigned int)(toRef >> 16 >> 16);
+	return a*73856093u ^ b*19349663u;
+}
+
+/// @par
+///
+/// The node positions do not change during a query, so the tests are cached by the polygons
+/// of the nodes, and repeated when the parent or the neighbour is expanded again are free.
+///
+/// The cost of the ray is accumulated polygon by polygon, and the ray is abandoned as soon as
+/// the total cost through it reaches @p maxTotal. Abandoned rays are reported as blocked.
+/// The length of the ray is not a lower bound of its cost, since the area costs of the filter
+/// can be below one, so the ray is always cast.
+bool dtNavMeshQuery::raycastShortcut(const dtNode* parentNode, dtPolyRef grandpaRef, const dtNode* neighbourNode,
+									 const float costTail, const float maxTotal, float* cost)
+{
+	dtRaycastCacheEntry* entry = &m_raycastCache[hashRaycastPair(parentNode->id, neighbourNode->id) & m_raycastCacheMask];
+	if (entry->stamp == m_raycastCacheStamp && entry->fromRef == parentNode->id &&
+		entry->toRef == neighbourNode->id && entry->prevRef == grandpaRef)
+	{
+		*cost = entry->cost;
+		return entry->visible;
+	}
+	
+	dtRaycastHit hit;
+	hit.path = 0;
+	hit.maxPath = 0;
+	
+	dtRaycastRay ray;
+	if (dtStatusFailed(initRaycastRay(ray, parentNode->id, parentNode->pos, neighbourNode->pos, &hit, grandpaRef)))
+		return false;
+	
+	float verts[DT_VERTS_PER_POLYGON*3];
+	for (;;)
+	{
+		const dtPoly* poly = ray.poly;
+		const int nv = (int)poly->vertCount;
+		for (int i = 0; i < nv; ++i)
+			dtVcopy(&verts[i*3], &ray.tile->verts[poly->verts[i]*3]);
+		
+		float tmin, tmax;
+		int segMin, segMax;
+		const bool intersects = dtIntersectSegmentPoly2D(parentNode->pos, neighbourNode->pos, verts, nv, tmin, tmax, segMin, segMax);
+		if (!advanceRaycastRay(ray, verts, nv, intersects, tmax, segMax, m_query.filter, DT_RAYCAST_USE_COSTS))
+			break;
+		
+		// The shortcut cannot improve the neighbour anymore.
+		if (parentNode->cost + hit.pathCost + costTail >= maxTotal)
+			return false;
+	}
+	
+	entry->fromRef = parentNode->id;
+	entry->toRef = neighbourNode->id;
+	entry->prevRef = grandpaRef;
+	entry->cost = hit.pathCost;
+	entry->visible = hit.t >= 1.0f;
+	entry->stamp = m_raycastCacheStamp;
+	
+	*cost = hit.pathCost;
+	return entry->visible;
+}
+
 dtStatus dtNavMeshQuery::finalizeSlicedFindPath(dtPolyRef* path, int* pathCount, const int maxPath)
 {
 	*pathCount = 0;
@@ -1753,15 +2207,16 @@ dtStatus dtNavMeshQuery::appendVertex(const float* pos, const unsigned char flag
 	return DT_IN_PROGRESS;
 }
 
-dtStatus dtNavMeshQuery::appendPortals(const int startIdx, const int endIdx, const float* endPos, const dtPolyRef* path,
+dtStatus dtNavMeshQuery::appendPortals(dtStraightPathState* state, const dtPolyRef* path,
 									  float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
-									  int* straightPathCount, const int maxStraightPath, const int options) const
+									  int* straightPathCount, const int maxStraightPath) const
 {
-	const float* startPos = &straightPath[(*straightPathCount-1)*3];
 	// Append or update last vertex
 	dtStatus stat = 0;
-	for (int i = startIdx; i < endIdx; i++)
+	while (state->crossingIndex < state->crossingEndIndex)
 	{
+		const int i = state->crossingIndex++;
+		
 		// Calculate portal
 		const dtPolyRef from = path[i];
 		const dtMeshTile* fromTile = 0;
@@ -1779,7 +2234,7 @@ dtStatus dtNavMeshQuery::appendPortals(const int startIdx, const int endIdx, con
 		if (dtStatusFailed(getPortalPoints(from, fromPoly, fromTile, to, toPoly, toTile, left, right)))
 			break;
 	
-		if (options & DT_STRAIGHTPATH_AREA_CROSSINGS)
+		if (state->options & DT_STRAIGHTPATH_AREA_CROSSINGS)
 		{
 			// Skip intersection if only area crossings are requested.
 			if (fromPoly->getArea() == toPoly->getArea())
@@ -1788,7 +2243,7 @@ dtStatus dtNavMeshQuery::appendPortals(const int startIdx, const int endIdx, con
 		
 		// Append intersection
 		float s,t;
-		if (dtIntersectSegSeg2D(startPos, endPos, left, right, s, t))
+		if (dtIntersectSegSeg2D(state->crossingStart, state->crossingEnd, left, right, s, t))
 		{
 			float pt[3];
 			dtVlerp(pt, left,right, t);
@@ -1800,9 +2255,32 @@ dtStatus dtNavMeshQuery::appendPortals(const int startIdx, const int endIdx, con
 				return stat;
 		}
 	}
+	state->crossingIndex = state->crossingEndIndex;
 	return DT_IN_PROGRESS;
 }
 
+// Queues the portal crossings of the straight path segment from the last vertex to the end position.
+inline void queueStraightPathCrossings(dtStraightPathState* state, const int endIdx, const float* endPos)
+{
+	if (!(state->options & (DT_STRAIGHTPATH_AREA_CROSSINGS | DT_STRAIGHTPATH_ALL_CROSSINGS)))
+		return;
+	dtVcopy(state->crossingStart, state->lastPos);
+	dtVcopy(state->crossingEnd, endPos);
+	state->crossingIndex = state->apexIndex;
+	state->crossingEndIndex = endIdx;
+}
+
+// Queues a vertex of the straight path.
+inline void queueStraightPathVertex(dtStraightPathState* state, const float* pos, const unsigned char flags,
+									  const dtPolyRef ref, const bool last)
+{
+	dtVcopy(state->vertexPos, pos);
+	state->vertexFlags = flags;
+	state->vertexRef = ref;
+	state->hasVertex = true;
+	state->lastVertex = last;
+}
+
 /// @par
 /// 
 /// This method peforms what is often called 'string pulling'.
@@ -1820,6 +2298,7 @@ dtStatus dtNavMeshQuery::appendPortals(const int startIdx, const int endIdx, con
 /// they will be filled as far as possible from the start toward the end 
 /// position.
 ///
+/// @see initStraightPath
 dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* endPos,
 										  const dtPolyRef* path, const int pathSize,
 										  float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
@@ -1832,45 +2311,145 @@ dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* en
 	if (!maxStraightPath)
 		return DT_FAILURE | DT_INVALID_PARAM;
 	
-	if (!path[0])
+	dtStraightPathState state;
+	dtStatus stat = initStraightPath(startPos, endPos, path, pathSize, &state, options);
+	if (dtStatusFailed(stat))
+		return stat;
+	
+	stat = updateStraightPath(&state, path, pathSize, straightPath, straightPathFlags, straightPathRefs,
+							  straightPathCount, maxStraightPath);
+	if (dtStatusInProgress(stat))
+		return DT_SUCCESS | DT_BUFFER_TOO_SMALL | (stat & DT_STATUS_DETAIL_MASK);
+	if (dtStatusFailed(stat))
+		return stat;
+	
+	return stat | ((*straightPathCount >= maxStraightPath) ? DT_BUFFER_TOO_SMALL : 0);
+}
+
+/// @par
+///
+/// The straight path query keeps the funnel between calls, so that a consumer can
+/// advance along the straight path a few vertices at a time, without running the funnel
+/// over the whole corridor first and without a buffer for the whole straight path.
+/// The state is owned by the caller, and the same path must be passed to every call.
+///
+/// Common use case:
+///	-# Call initStraightPath() to start the query.
+///	-# Call updateStraightPath() to get the first vertices.
+///	-# While the status is #DT_IN_PROGRESS, consume the vertices, keep the last vertex 
+///	   in the arrays and call updateStraightPath() again.
+///
+/// The vertices are the same as returned by #findStraightPath. A vertex which is equal to 
+/// the last vertex in the arrays is merged with it, which is why the last vertex should 
+/// be kept. If the arrays are emptied, such a vertex is returned again.
+dtStatus dtNavMeshQuery::initStraightPath(const float* startPos, const float* endPos,
+										  const dtPolyRef* path, const int pathSize,
+										  dtStraightPathState* state, const int options) const
+{
+	dtAssert(m_nav);
+	
+	if (!state)
 		return DT_FAILURE | DT_INVALID_PARAM;
 	
-	dtStatus stat = 0;
+	memset(state, 0, sizeof(dtStraightPathState));
+	state->status = DT_FAILURE;
+	
+	if (!path || pathSize <= 0 || !path[0])
+		return DT_FAILURE | DT_INVALID_PARAM;
 	
 	// TODO: Should this be callers responsibility?
 	float closestStartPos[3];
 	if (dtStatusFailed(closestPointOnPolyBoundary(path[0], startPos, closestStartPos)))
 		return DT_FAILURE | DT_INVALID_PARAM;
 
-	float closestEndPos[3];
-	if (dtStatusFailed(closestPointOnPolyBoundary(path[pathSize-1], endPos, closestEndPos)))
+	dtVcopy(state->endPos, endPos);
+	if (dtStatusFailed(closestPointOnPolyBoundary(path[pathSize-1], endPos, state->closestEndPos)))
 		return DT_FAILURE | DT_INVALID_PARAM;
 	
+	dtVcopy(state->portalApex, closestStartPos);
+	dtVcopy(state->portalLeft, closestStartPos);
+	dtVcopy(state->portalRight, closestStartPos);
+	state->leftPolyRef = path[0];
+	state->rightPolyRef = path[0];
+	state->index = pathSize > 1 ? 0 : pathSize;
+	state->options = options;
+	
 	// Add start point.
-	stat = appendVertex(closestStartPos, DT_STRAIGHTPATH_START, path[0],
-						straightPath, straightPathFlags, straightPathRefs,
-						straightPathCount, maxStraightPath);
-	if (stat != DT_IN_PROGRESS)
-		return stat;
+	queueStraightPathVertex(state, closestStartPos, DT_STRAIGHTPATH_START, path[0], false);
+	
+	state->status = DT_IN_PROGRESS;
+	return DT_SUCCESS;
+}
+
+/// @par
+///
+/// The funnel stops as soon as the arrays are full, and continues from there on the next call.
+dtStatus dtNavMeshQuery::updateStraightPath(dtStraightPathState* state, const dtPolyRef* path, const int pathSize,
+											float* straightPath, unsigned char* straightPathFlags, dtPolyRef* straightPathRefs,
+											int* straightPathCount, const int maxStraightPath) const
+{
+	dtAssert(m_nav);
+	
+	if (!state || !path || !straightPath || !straightPathCount || maxStraightPath <= 0 ||
+		*straightPathCount < 0 || *straightPathCount > maxStraightPath)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	
+	if (!dtStatusInProgress(state->status))
+		return state->status;
 	
-	if (pathSize > 1)
+	const dtStatus details = state->partialEnd ? DT_PARTIAL_RESULT : 0;
+	if (*straightPathCount >= maxStraightPath)
+		return DT_IN_PROGRESS | details;
+	
+	dtStatus stat = 0;
+	
+	for (;;)
 	{
-		float portalApex[3], portalLeft[3], portalRight[3];
-		dtVcopy(portalApex, closestStartPos);
-		dtVcopy(portalLeft, portalApex);
-		dtVcopy(portalRight, portalApex);
-		int apexIndex = 0;
-		int leftIndex = 0;
-		int rightIndex = 0;
+		// Append portals along the current straight path segment.
+		if (state->crossingIndex < state->crossingEndIndex)
+		{
+			stat = appendPortals(state, path, straightPath, straightPathFlags, straightPathRefs,
+								 straightPathCount, maxStraightPath);
+			if (dtStatusFailed(stat) && !state->partialEnd)
+			{
+				state->status = stat;
+				return stat;
+			}
+			if (stat != DT_IN_PROGRESS && !dtStatusFailed(stat))
+				return DT_IN_PROGRESS | (state->partialEnd ? DT_PARTIAL_RESULT : 0);
+			state->crossingIndex = state->crossingEndIndex;
+		}
 		
-		unsigned char leftPolyType = 0;
-		unsigned char rightPolyType = 0;
+		// Append or update vertex
+		if (state->hasVertex)
+		{
+			state->hasVertex = false;
+			stat = appendVertex(state->vertexPos, state->vertexFlags, state->vertexRef,
+								straightPath, straightPathFlags, straightPathRefs,
+								straightPathCount, maxStraightPath);
+			// The vertex may have been merged, the next segment starts exactly at the last vertex.
+			// Keep it in the state as the caller may empty the arrays before the next call.
+			dtVcopy(state->lastPos, &straightPath[(*straightPathCount-1)*3]);
+			if (state->lastVertex ||
+				(stat != DT_IN_PROGRESS && state->vertexFlags == DT_STRAIGHTPATH_END))
+			{
+				state->status = DT_SUCCESS | (state->partialEnd ? DT_PARTIAL_RESULT : 0);
+				return state->status;
+			}
+			if (stat != DT_IN_PROGRESS)
+				return DT_IN_PROGRESS;
+		}
 		
-		dtPolyRef leftPolyRef = path[0];
-		dtPolyRef rightPolyRef = path[0];
+		if (state->endReached)
+		{
+			state->status = DT_SUCCESS;
+			return state->status;
+		}
 		
-		for (int i = 0; i < pathSize; ++i)
+		// Advance the funnel until it adds a vertex.
+		while (state->index < pathSize && !state->hasVertex)
 		{
+			const int i = state->index;
 			float left[3], right[3];
 			unsigned char toType;
 			
@@ -1884,173 +2463,137 @@ dtStatus dtNavMeshQuery::findStraightPath(const float* startPos, const float* en
 					// Failed to get portal points, in practice this means that path[i+1] is invalid polygon.
 					// Clamp the end point to path[i], and return the path so far.
 					
-					if (dtStatusFailed(closestPointOnPolyBoundary(path[i], endPos, closestEndPos)))
+					if (dtStatusFailed(closestPointOnPolyBoundary(path[i], state->endPos, state->closestEndPos)))
 					{
 						// This should only happen when the first polygon is invalid.
-						return DT_FAILURE | DT_INVALID_PARAM;
+						state->status = DT_FAILURE | DT_INVALID_PARAM;
+						return state->status;
 					}
 
-					// Apeend portals along the current straight path segment.
-					if (options & (DT_STRAIGHTPATH_AREA_CROSSINGS | DT_STRAIGHTPATH_ALL_CROSSINGS))
-					{
-						// Ignore status return value as we're just about to return anyway.
-						appendPortals(apexIndex, i, closestEndPos, path,
-											 straightPath, straightPathFlags, straightPathRefs,
-											 straightPathCount, maxStraightPath, options);
-					}
-
-					// Ignore status return value as we're just about to return anyway.
-					appendVertex(closestEndPos, 0, path[i],
-										straightPath, straightPathFlags, straightPathRefs,
-										straightPathCount, maxStraightPath);
-					
-					return DT_SUCCESS | DT_PARTIAL_RESULT | ((*straightPathCount >= maxStraightPath) ? DT_BUFFER_TOO_SMALL : 0);
+					// Apeend portals along the current straight path segment, and the clamped end point.
+					// Their status is ignored as the path ends there.
+					queueStraightPathCrossings(state, i, state->closestEndPos);
+					queueStraightPathVertex(state, state->closestEndPos, 0, path[i], true);
+					state->partialEnd = true;
+					state->index = pathSize;
+					state->endReached = true;
+					break;
 				}
 				
 				// If starting really close the portal, advance.
 				if (i == 0)
 				{
 					float t;
-					if (dtDistancePtSegSqr2D(portalApex, left, right, t) < dtSqr(0.001f))
+					if (dtDistancePtSegSqr2D(state->portalApex, left, right, t) < dtSqr(0.001f))
+					{
+						state->index++;
 						continue;
+					}
 				}
 			}
 			else
 			{
 				// End of the path.
-				dtVcopy(left, closestEndPos);
-				dtVcopy(right, closestEndPos);
+				dtVcopy(left, state->closestEndPos);
+				dtVcopy(right, state->closestEndPos);
 				
 				toType = DT_POLYTYPE_GROUND;
 			}
 			
 			// Right vertex.
-			if (dtTriArea2D(portalApex, portalRight, right) <= 0.0f)
+			if (dtTriArea2D(state->portalApex, state->portalRight, right) <= 0.0f)
 			{
-				if (dtVequal(portalApex, portalRight) || dtTriArea2D(portalApex, portalLeft, right) > 0.0f)
+				if (dtVequal(state->portalApex, state->portalRight) || dtTriArea2D(state->portalApex, state->portalLeft, right) > 0.0f)
 				{
-					dtVcopy(portalRight, right);
-					rightPolyRef = (i+1 < pathSize) ? path[i+1] : 0;
-					rightPolyType = toType;
-					rightIndex = i;
+					dtVcopy(state->portalRight, right);
+					state->rightPolyRef = (i+1 < pathSize) ? path[i+1] : 0;
+					state->rightPolyType = toType;
+					state->rightIndex = i;
 				}
 				else
 				{
 					// Append portals along the current straight path segment.
-					if (options & (DT_STRAIGHTPATH_AREA_CROSSINGS | DT_STRAIGHTPATH_ALL_CROSSINGS))
-					{
-						stat = appendPortals(apexIndex, leftIndex, portalLeft, path,
-											 straightPath, straightPathFlags, straightPathRefs,
-											 straightPathCount, maxStraightPath, options);
-						if (stat != DT_IN_PROGRESS)
-							return stat;					
-					}
+					queueStraightPathCrossings(state, state->leftIndex, state->portalLeft);
 				
-					dtVcopy(portalApex, portalLeft);
-					apexIndex = leftIndex;
+					dtVcopy(state->portalApex, state->portalLeft);
+					state->apexIndex = state->leftIndex;
 					
 					unsigned char flags = 0;
-					if (!leftPolyRef)
+					if (!state->leftPolyRef)
 						flags = DT_STRAIGHTPATH_END;
-					else if (leftPolyType == DT_POLYTYPE_OFFMESH_CONNECTION)
+					else if (state->leftPolyType == DT_POLYTYPE_OFFMESH_CONNECTION)
 						flags = DT_STRAIGHTPATH_OFFMESH_CONNECTION;
-					dtPolyRef ref = leftPolyRef;
-					
-					// Append or update vertex
-					stat = appendVertex(portalApex, flags, ref,
-										straightPath, straightPathFlags, straightPathRefs,
-										straightPathCount, maxStraightPath);
-					if (stat != DT_IN_PROGRESS)
-						return stat;
+					queueStraightPathVertex(state, state->portalApex, flags, state->leftPolyRef, false);
 					
-					dtVcopy(portalLeft, portalApex);
-					dtVcopy(portalRight, portalApex);
-					leftIndex = apexIndex;
-					rightIndex = apexIndex;
+					dtVcopy(state->portalLeft, state->portalApex);
+					dtVcopy(state->portalRight, state->portalApex);
+					state->leftIndex = state->apexIndex;
+					state->rightIndex = state->apexIndex;
 					
 					// Restart
-					i = apexIndex;
+					state->index = state->apexIndex+1;
 					
 					continue;
 				}
 			}
 			
 			// Left vertex.
-			if (dtTriArea2D(portalApex, portalLeft, left) >= 0.0f)
+			if (dtTriArea2D(state->portalApex, state->portalLeft, left) >= 0.0f)
 			{
-				if (dtVequal(portalApex, portalLeft) || dtTriArea2D(portalApex, portalRight, left) < 0.0f)
+				if (dtVequal(state->portalApex, state->portalLeft) || dtTriArea2D(state->portalApex, state->portalRight, left) < 0.0f)
 				{
-					dtVcopy(portalLeft, left);
-					leftPolyRef = (i+1 < pathSize) ? path[i+1] : 0;
-					leftPolyType = toType;
-					leftIndex = i;
+					dtVcopy(state->portalLeft, left);
+					state->leftPolyRef = (i+1 < pathSize) ? path[i+1] : 0;
+					state->leftPolyType = toType;
+					state->leftIndex = i;
 				}
 				else
 				{
 					// Append portals along the current straight path segment.
-					if (options & (DT_STRAIGHTPATH_AREA_CROSSINGS | DT_STRAIGHTPATH_ALL_CROSSINGS))
-					{
-						stat = appendPortals(apexIndex, rightIndex, portalRight, path,
-											 straightPath, straightPathFlags, straightPathRefs,
-											 straightPathCount, maxStraightPath, options);
-						if (stat != DT_IN_PROGRESS)
-							return stat;
-					}
+					queueStraightPathCrossings(state, state->rightIndex, state->portalRight);
 
-					dtVcopy(portalApex, portalRight);
-					apexIndex = rightIndex;
+					dtVcopy(state->portalApex, state->portalRight);
+					state->apexIndex = state->rightIndex;
 					
 					unsigned char flags = 0;
-					if (!rightPolyRef)
+					if (!state->rightPolyRef)
 						flags = DT_STRAIGHTPATH_END;
-					else if (rightPolyType == DT_POLYTYPE_OFFMESH_CONNECTION)
+					else if (state->rightPolyType == DT_POLYTYPE_OFFMESH_CONNECTION)
 						flags = DT_STRAIGHTPATH_OFFMESH_CONNECTION;
-					dtPolyRef ref = rightPolyRef;
-
-					// Append or update vertex
-					stat = appendVertex(portalApex, flags, ref,
-										straightPath, straightPathFlags, straightPathRefs,
-										straightPathCount, maxStraightPath);
-					if (stat != DT_IN_PROGRESS)
-						return stat;
+					queueStraightPathVertex(state, state->portalApex, flags, state->rightPolyRef, false);
 					
-					dtVcopy(portalLeft, portalApex);
-					dtVcopy(portalRight, portalApex);
-					leftIndex = apexIndex;
-					rightIndex = apexIndex;
+					dtVcopy(state->portalLeft, state->portalApex);
+					dtVcopy(state->portalRight, state->portalApex);
+					state->leftIndex = state->apexIndex;
+					state->rightIndex = state->apexIndex;
 					
 					// Restart
-					i = apexIndex;
+					state->index = state->apexIndex+1;
 					
 					continue;
 				}
 			}
+			
+			state->index++;
 		}
-
-		// Append portals along the current straight path segment.
-		if (options & (DT_STRAIGHTPATH_AREA_CROSSINGS | DT_STRAIGHTPATH_ALL_CROSSINGS))
+		
+		if (!state->hasVertex && !state->endReached)
 		{
-			stat = appendPortals(apexIndex, pathSize-1, closestEndPos, path,
-								 straightPath, straightPathFlags, straightPathRefs,
-								 straightPathCount, maxStraightPath, options);
-			if (stat != DT_IN_PROGRESS)
-				return stat;
+			// Append portals along the last straight path segment, and the end point.
+			queueStraightPathCrossings(state, pathSize-1, state->closestEndPos);
+			queueStraightPathVertex(state, state->closestEndPos, DT_STRAIGHTPATH_END, 0, true);
+			state->endReached = true;
 		}
 	}
-
-	// Ignore status return value as we're just about to return anyway.
-	appendVertex(closestEndPos, DT_STRAIGHTPATH_END, 0,
-						straightPath, straightPathFlags, straightPathRefs,
-						straightPathCount, maxStraightPath);
-	
-	return DT_SUCCESS | ((*straightPathCount >= maxStraightPath) ? DT_BUFFER_TOO_SMALL : 0);
 }
 
 /// @par
 ///
 /// This method is optimized for small delta movement and a small number of 
-/// polygons. If used for too great a distance, the result set will form an 
-/// incomplete path.
+/// polygons. The search starts with a small node pool, which grows when a move
+/// visits more polygons, up to the node count given to #init. If the pool cannot 
+/// grow anymore, the result set will form an incomplete path, and the status 
+/// has #DT_OUT_OF_NODES set.
 ///
 /// @p resultPos will equal the @p endPos if the end is reached. 
 /// Otherwise the closest reachable position will be returned.
@@ -2071,36 +2614,21 @@ dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* start
 										  float* resultPos, dtPolyRef* visited, int* visitedCount, const int maxVisitedSize) const
 {
 	dtAssert(m_nav);
-	dtAssert(m_tinyNodePool);
+	dtAssert(m_scratch);
 
 	*visitedCount = 0;
 	
 	// Validate input
 	if (!startRef)
 		return DT_FAILURE | DT_INVALID_PARAM;
-	if (!m_nav->isValidPolyRef(startRef))
-		return DT_FAILURE | DT_INVALID_PARAM;
+	const dtStatus refStatus = m_nav->getPolyRefStatus(startRef);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
 	
 	dtStatus status = DT_SUCCESS;
 	
-	static const int MAX_STACK = 48;
-	dtNode* stack[MAX_STACK];
-	int nstack = 0;
-	
-	m_tinyNodePool->clear();
-	
-	dtNode* startNode = m_tinyNodePool->getNode(startRef);
-	startNode->pidx = 0;
-	startNode->cost = 0;
-	startNode->total = 0;
-	startNode->id = startRef;
-	startNode->flags = DT_NODE_CLOSED;
-	stack[nstack++] = startNode;
-	
 	float bestPos[3];
-	float bestDist = FLT_MAX;
 	dtNode* bestNode = 0;
-	dtVcopy(bestPos, startPos);
 	
 	// Search constraints
 	float searchPos[3], searchRadSqr;
@@ -2109,121 +2637,156 @@ dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* start
 	
 	float verts[DT_VERTS_PER_POLYGON*3];
 	
-	while (nstack)
+	// Search again with a larger pool if the search runs out of nodes.
+	dtNodePool* nodePool = 0;
+	bool outOfNodes = true;
+	while (outOfNodes)
 	{
-		// Pop front.
-		dtNode* curNode = stack[0];
-		for (int i = 0; i < nstack-1; ++i)
-			stack[i] = stack[i+1];
-		nstack--;
+		outOfNodes = false;
+		bool reachedTarget = false;
 		
-		// Get poly and tile.
-		// The API input has been cheked already, skip checking internal data.
-		const dtPolyRef curRef = curNode->id;
-		const dtMeshTile* curTile = 0;
-		const dtPoly* curPoly = 0;
-		m_nav->getTileAndPolyByRefUnsafe(curRef, &curTile, &curPoly);			
+		m_scratch->clear();
+		nodePool = m_scratch->getNodePool();
 		
-		// Collect vertices.
-		const int nverts = curPoly->vertCount;
-		for (int i = 0; i < nverts; ++i)
-			dtVcopy(&verts[i*3], &curTile->verts[curPoly->verts[i]*3]);
+		dtNode* startNode = nodePool->getNode(startRef);
+		startNode->pidx = 0;
+		startNode->cost = 0;
+		startNode->total = 0;
+		startNode->id = startRef;
+		startNode->flags = DT_NODE_CLOSED;
+		m_scratch->push(startNode);
 		
-		// If target is inside the poly, stop search.
-		if (dtPointInPolygon(endPos, verts, nverts))
-		{
-			bestNode = curNode;
-			dtVcopy(bestPos, endPos);
-			break;
-		}
+		float bestDist = FLT_MAX;
+		bestNode = 0;
+		dtVcopy(bestPos, startPos);
 		
-		// Find wall edges and find nearest point inside the walls.
-		for (int i = 0, j = (int)curPoly->vertCount-1; i < (int)curPoly->vertCount; j = i++)
+		while (!m_scratch->empty())
 		{
-			// Find links to neighbours.
-			static const int MAX_NEIS = 8;
-			int nneis = 0;
-			dtPolyRef neis[MAX_NEIS];
+			// Pop front.
+			dtNode* curNode = m_scratch->pop();
+			
+			// Get poly and tile.
+			// The API input has been cheked already, skip checking internal data.
+			const dtPolyRef curRef = curNode->id;
+			const dtMeshTile* curTile = 0;
+			const dtPoly* curPoly = 0;
+			m_nav->getTileAndPolyByRefUnsafe(curRef, &curTile, &curPoly);			
+			
+			// Collect vertices.
+			const int nverts = curPoly->vertCount;
+			for (int i = 0; i < nverts; ++i)
+				dtVcopy(&verts[i*3], &curTile->verts[curPoly->verts[i]*3]);
 			
-			if (curPoly->neis[j] & DT_EXT_LINK)
+			// If target is inside the poly, stop search.
+			if (dtPointInPolygon(endPos, verts, nverts))
 			{
-				// Tile border.
-				for (unsigned int k = curPoly->firstLink; k != DT_NULL_LINK; k = curTile->links[k].next)
+				bestNode = curNode;
+				dtVcopy(bestPos, endPos);
+				reachedTarget = true;
+				break;
+			}
+			
+			// Find wall edges and find nearest point inside the walls.
+			for (int i = 0, j = (int)curPoly->vertCount-1; i < (int)curPoly->vertCount; j = i++)
+			{
+				// Find links to neighbours.
+				static const int MAX_NEIS = 8;
+				int nneis = 0;
+				dtPolyRef neis[MAX_NEIS];
+				
+				if (curPoly->neis[j] & DT_EXT_LINK)
 				{
-					const dtLink* link = &curTile->links[k];
-					if (link->edge == j)
+					// Tile border.
+					for (unsigned int k = curPoly->firstLink; k != DT_NULL_LINK; k = curTile->links[k].next)
 					{
-						if (link->ref != 0)
+						const dtLink* link = &curTile->links[k];
+						if (link->edge == j)
 						{
-							const dtMeshTile* neiTile = 0;
-							const dtPoly* neiPoly = 0;
-							m_nav->getTileAndPolyByRefUnsafe(link->ref, &neiTile, &neiPoly);
-							if (filter->passFilter(link->ref, neiTile, neiPoly))
+							if (link->ref != 0)
 							{
-								if (nneis < MAX_NEIS)
-									neis[nneis++] = link->ref;
+								const dtMeshTile* neiTile = 0;
+								const dtPoly* neiPoly = 0;
+								m_nav->getTileAndPolyByRefUnsafe(link->ref, &neiTile, &neiPoly);
+								if (filter->passFilter(link->ref, neiTile, neiPoly))
+								{
+									if (nneis < MAX_NEIS)
+										neis[nneis++] = link->ref;
+								}
 							}
 						}
 					}
 				}
-			}
-			else if (curPoly->neis[j])
-			{
-				const unsigned int idx = (unsigned int)(curPoly->neis[j]-1);
-				const dtPolyRef ref = m_nav->getPolyRefBase(curTile) | idx;
-				if (filter->passFilter(ref, curTile, &curTile->polys[idx]))
+				else if (curPoly->neis[j])
 				{
-					// Internal edge, encode id.
-					neis[nneis++] = ref;
-				}
-			}
-			
-			if (!nneis)
-			{
-				// Wall edge, calc distance.
-				const float* vj = &verts[j*3];
-				const float* vi = &verts[i*3];
-				float tseg;
-				const float distSqr = dtDistancePtSegSqr2D(endPos, vj, vi, tseg);
-				if (distSqr < bestDist)
-				{
-                    // Update nearest distance.
-					dtVlerp(bestPos, vj,vi, tseg);
-					bestDist = distSqr;
-					bestNode = curNode;
+					const unsigned int idx = (unsigned int)(curPoly->neis[j]-1);
+					const dtPolyRef ref = m_nav->getPolyRefBase(curTile) | idx;
+					if (filter->passFilter(ref, curTile, &curTile->polys[idx]))
+					{
+						// Internal edge, encode id.
+						neis[nneis++] = ref;
+					}
 				}
-			}
-			else
-			{
-				for (int k = 0; k < nneis; ++k)
+				
+				if (!nneis)
 				{
-					// Skip if no node can be allocated.
-					dtNode* neighbourNode = m_tinyNodePool->getNode(neis[k]);
-					if (!neighbourNode)
-						continue;
-					// Skip if already visited.
-					if (neighbourNode->flags & DT_NODE_CLOSED)
-						continue;
-					
-					// Skip the link if it is too far from search constraint.
-					// TODO: Maybe should use getPortalPoints(), but this one is way faster.
+					// Wall edge, calc distance.
 					const float* vj = &verts[j*3];
 					const float* vi = &verts[i*3];
 					float tseg;
-					float distSqr = dtDistancePtSegSqr2D(searchPos, vj, vi, tseg);
-					if (distSqr > searchRadSqr)
-						continue;
-					
-					// Mark as the node as visited and push to queue.
-					if (nstack < MAX_STACK)
+					const float distSqr = dtDistancePtSegSqr2D(endPos, vj, vi, tseg);
+					if (distSqr < bestDist)
+					{
+	                    // Update nearest distance.
+						dtVlerp(bestPos, vj,vi, tseg);
+						bestDist = distSqr;
+						bestNode = curNode;
+					}
+				}
+				else
+				{
+					for (int k = 0; k < nneis; ++k)
 					{
-						neighbourNode->pidx = m_tinyNodePool->getNodeIdx(curNode);
+						// Skip if no node can be allocated.
+						dtNode* neighbourNode = nodePool->getNode(neis[k]);
+						if (!neighbourNode)
+						{
+							outOfNodes = true;
+							continue;
+						}
+						// Skip if already visited.
+						if (neighbourNode->flags & DT_NODE_CLOSED)
+							continue;
+						
+						// Skip the link if it is too far from search constraint.
+						// TODO: Maybe should use getPortalPoints(), but this one is way faster.
+						const float* vj = &verts[j*3];
+						const float* vi = &verts[i*3];
+						float tseg;
+						float distSqr = dtDistancePtSegSqr2D(searchPos, vj, vi, tseg);
+						if (distSqr > searchRadSqr)
+							continue;
+						
+						// Mark as the node as visited and push to queue.
+						neighbourNode->pidx = nodePool->getNodeIdx(curNode);
 						neighbourNode->flags |= DT_NODE_CLOSED;
-						stack[nstack++] = neighbourNode;
+						m_scratch->push(neighbourNode);
 					}
 				}
 			}
 		}
+		
+		if (!outOfNodes)
+			break;
+		
+		// The target was reached, the nodes which did not fit are not needed.
+		if (reachedTarget)
+			break;
+		
+		if (!m_scratch->grow())
+		{
+			status |= DT_OUT_OF_NODES;
+			break;
+		}
 	}
 	
 	int n = 0;
@@ -2234,8 +2797,8 @@ dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* start
 		dtNode* node = bestNode;
 		do
 		{
-			dtNode* next = m_tinyNodePool->getNodeAtIdx(node->pidx);
-			node->pidx = m_tinyNodePool->getNodeIdx(prev);
+			dtNode* next = nodePool->getNodeAtIdx(node->pidx);
+			node->pidx = nodePool->getNodeIdx(prev);
 			prev = node;
 			node = next;
 		}
@@ -2251,7 +2814,7 @@ dtStatus dtNavMeshQuery::moveAlongSurface(dtPolyRef startRef, const float* start
 				status |= DT_BUFFER_TOO_SMALL;
 				break;
 			}
-			node = m_tinyNodePool->getNodeAtIdx(node->pidx);
+			node = nodePool->getNodeAtIdx(node->pidx);
 		}
 		while (node);
 	}
@@ -2488,216 +3051,249 @@ dtStatus dtNavMeshQuery::raycast(dtPolyRef startRef, const float* startPos, cons
 {
 	dtAssert(m_nav);
 	
+	dtRaycastRay ray;
+	dtStatus status = initRaycastRay(ray, startRef, startPos, endPos, hit, prevRef);
+	if (dtStatusFailed(status))
+		return status;
+	
+	float verts[DT_VERTS_PER_POLYGON*3+3];	
+	
+	while (ray.curRef)
+	{
+		// Cast ray against current polygon.
+		
+		// Collect vertices.
+		const dtPoly* poly = ray.poly;
+		int nv = 0;
+		for (int i = 0; i < (int)poly->vertCount; ++i)
+		{
+			dtVcopy(&verts[nv*3], &ray.tile->verts[poly->verts[i]*3]);
+			nv++;
+		}
+		
+		float tmin, tmax;
+		int segMin, segMax;
+		const bool intersects = dtIntersectSegmentPoly2D(startPos, endPos, verts, nv, tmin, tmax, segMin, segMax);
+		if (!advanceRaycastRay(ray, verts, nv, intersects, tmax, segMax, filter, options))
+			return ray.status;
+	}
+	
+	hit->pathCount = ray.n;
+	
+	return ray.status;
+}
+
+dtStatus dtNavMeshQuery::initRaycastRay(dtRaycastRay& ray, dtPolyRef startRef, const float* startPos, const float* endPos,
+										dtRaycastHit* hit, dtPolyRef prevRef) const
+{
 	hit->t = 0;
 	hit->pathCount = 0;
 	hit->pathCost = 0;
 
 	// Validate input
-	if (!startRef || !m_nav->isValidPolyRef(startRef))
-		return DT_FAILURE | DT_INVALID_PARAM;
+	const dtStatus refStatus = m_nav->getPolyRefStatus(startRef);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
 	if (prevRef && !m_nav->isValidPolyRef(prevRef))
 		return DT_FAILURE | DT_INVALID_PARAM;
 	
-	float dir[3], curPos[3], lastPos[3];
-	float verts[DT_VERTS_PER_POLYGON*3+3];	
-	int n = 0;
-
-	dtVcopy(curPos, startPos);
-	dtVsub(dir, endPos, startPos);
+	ray.startPos = startPos;
+	ray.endPos = endPos;
+	ray.hit = hit;
+	ray.n = 0;
+	ray.status = DT_SUCCESS;
+	
+	dtVcopy(ray.curPos, startPos);
+	dtVsub(ray.dir, endPos, startPos);
 	dtVset(hit->hitNormal, 0, 0, 0);
 
-	dtStatus status = DT_SUCCESS;
-
-	const dtMeshTile* prevTile, *tile, *nextTile;
-	const dtPoly* prevPoly, *poly, *nextPoly;
-	dtPolyRef curRef;
-
 	// The API input has been checked already, skip checking internal data.
-	curRef = startRef;
-	tile = 0;
-	poly = 0;
-	m_nav->getTileAndPolyByRefUnsafe(curRef, &tile, &poly);
-	nextTile = prevTile = tile;
-	nextPoly = prevPoly = poly;
+	ray.prevRef = prevRef;
+	ray.curRef = startRef;
+	ray.tile = 0;
+	ray.poly = 0;
+	m_nav->getTileAndPolyByRefUnsafe(ray.curRef, &ray.tile, &ray.poly);
+	ray.prevTile = ray.tile;
+	ray.prevPoly = ray.poly;
 	if (prevRef)
-		m_nav->getTileAndPolyByRefUnsafe(prevRef, &prevTile, &prevPoly);
+		m_nav->getTileAndPolyByRefUnsafe(prevRef, &ray.prevTile, &ray.prevPoly);
+	
+	return DT_SUCCESS;
+}
 
-	while (curRef)
+bool dtNavMeshQuery::advanceRaycastRay(dtRaycastRay& ray, const float* verts, const int nv,
+									   const bool intersects, const float tmax, const int segMax,
+									   const dtQueryFilter* filter, const unsigned int options) const
+{
+	dtRaycastHit* hit = ray.hit;
+	const float* startPos = ray.startPos;
+	const float* endPos = ray.endPos;
+	const dtPolyRef curRef = ray.curRef;
+	const dtMeshTile* tile = ray.tile;
+	const dtPoly* poly = ray.poly;
+	
+	if (!intersects)
 	{
-		// Cast ray against current polygon.
+		// Could not hit the polygon, keep the old t and report hit.
+		hit->pathCount = ray.n;
+		return false;
+	}
+
+	hit->hitEdgeIndex = segMax;
+
+	// Keep track of furthest t so far.
+	if (tmax > hit->t)
+		hit->t = tmax;
+	
+	// Store visited polygons.
+	if (ray.n < hit->maxPath)
+		hit->path[ray.n++] = curRef;
+	else
+		ray.status |= DT_BUFFER_TOO_SMALL;
+
+	// Ray end is completely inside the polygon.
+	if (segMax == -1)
+	{
+		hit->t = FLT_MAX;
+		hit->pathCount = ray.n;
 		
-		// Collect vertices.
-		int nv = 0;
-		for (int i = 0; i < (int)poly->vertCount; ++i)
-		{
-			dtVcopy(&verts[nv*3], &tile->verts[poly->verts[i]*3]);
-			nv++;
-		}
+		// add the cost
+		if (options & DT_RAYCAST_USE_COSTS)
+			hit->pathCost += filter->getCost(ray.curPos, endPos, ray.prevRef, ray.prevTile, ray.prevPoly, curRef, tile, poly, curRef, tile, poly);
+		return false;
+	}
+
+	// Follow neighbours.
+	dtPolyRef nextRef = 0;
+	const dtMeshTile* nextTile = tile;
+	const dtPoly* nextPoly = poly;
+	
+	for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
+	{
+		const dtLink* link = &tile->links[i];
 		
-		float tmin, tmax;
-		int segMin, segMax;
-		if (!dtIntersectSegmentPoly2D(startPos, endPos, verts, nv, tmin, tmax, segMin, segMax))
+		// Find link which contains this edge.
+		if ((int)link->edge != segMax)
+			continue;
+		
+		// Get pointer to the next polygon.
+		nextTile = 0;
+		nextPoly = 0;
+		m_nav->getTileAndPolyByRefUnsafe(link->ref, &nextTile, &nextPoly);
+		
+		// Skip off-mesh connections.
+		if (nextPoly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+			continue;
+		
+		// Skip links based on filter.
+		if (!filter->passFilter(link->ref, nextTile, nextPoly))
+			continue;
+		
+		// If the link is internal, just return the ref.
+		if (link->side == 0xff)
 		{
-			// Could not hit the polygon, keep the old t and report hit.
-			hit->pathCount = n;
-			return status;
+			nextRef = link->ref;
+			break;
 		}
-
-		hit->hitEdgeIndex = segMax;
-
-		// Keep track of furthest t so far.
-		if (tmax > hit->t)
-			hit->t = tmax;
 		
-		// Store visited polygons.
-		if (n < hit->maxPath)
-			hit->path[n++] = curRef;
-		else
-			status |= DT_BUFFER_TOO_SMALL;
-
-		// Ray end is completely inside the polygon.
-		if (segMax == -1)
+		// If the link is at tile boundary,
+		
+		// Check if the link spans the whole edge, and accept.
+		if (link->bmin == 0 && link->bmax == 255)
 		{
-			hit->t = FLT_MAX;
-			hit->pathCount = n;
-			
-			// add the cost
-			if (options & DT_RAYCAST_USE_COSTS)
-				hit->pathCost += filter->getCost(curPos, endPos, prevRef, prevTile, prevPoly, curRef, tile, poly, curRef, tile, poly);
-			return status;
+			nextRef = link->ref;
+			break;
 		}
-
-		// Follow neighbours.
-		dtPolyRef nextRef = 0;
 		
-		for (unsigned int i = poly->firstLink; i != DT_NULL_LINK; i = tile->links[i].next)
+		// Check for partial edge links.
+		const int v0 = poly->verts[link->edge];
+		const int v1 = poly->verts[(link->edge+1) % poly->vertCount];
+		const float* left = &tile->verts[v0*3];
+		const float* right = &tile->verts[v1*3];
+		
+		// Check that the intersection lies inside the link portal.
+		if (link->side == 0 || link->side == 4)
 		{
-			const dtLink* link = &tile->links[i];
-			
-			// Find link which contains this edge.
-			if ((int)link->edge != segMax)
-				continue;
-			
-			// Get pointer to the next polygon.
-			nextTile = 0;
-			nextPoly = 0;
-			m_nav->getTileAndPolyByRefUnsafe(link->ref, &nextTile, &nextPoly);
-			
-			// Skip off-mesh connections.
-			if (nextPoly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
-				continue;
-			
-			// Skip links based on filter.
-			if (!filter->passFilter(link->ref, nextTile, nextPoly))
-				continue;
+			// Calculate link size.
+			const float s = 1.0f/255.0f;
+			float lmin = left[2] + (right[2] - left[2])*(link->bmin*s);
+			float lmax = left[2] + (right[2] - left[2])*(link->bmax*s);
+			if (lmin > lmax) dtSwap(lmin, lmax);
 			
-			// If the link is internal, just return the ref.
-			if (link->side == 0xff)
+			// Find Z intersection.
+			float z = startPos[2] + (endPos[2]-startPos[2])*tmax;
+			if (z >= lmin && z <= lmax)
 			{
 				nextRef = link->ref;
 				break;
 			}
+		}
+		else if (link->side == 2 || link->side == 6)
+		{
+			// Calculate link size.
+			const float s = 1.0f/255.0f;
+			float lmin = left[0] + (right[0] - left[0])*(link->bmin*s);
+			float lmax = left[0] + (right[0] - left[0])*(link->bmax*s);
+			if (lmin > lmax) dtSwap(lmin, lmax);
 			
-			// If the link is at tile boundary,
-			
-			// Check if the link spans the whole edge, and accept.
-			if (link->bmin == 0 && link->bmax == 255)
+			// Find X intersection.
+			float x = startPos[0] + (endPos[0]-startPos[0])*tmax;
+			if (x >= lmin && x <= lmax)
 			{
 				nextRef = link->ref;
 				break;
 			}
-			
-			// Check for partial edge links.
-			const int v0 = poly->verts[link->edge];
-			const int v1 = poly->verts[(link->edge+1) % poly->vertCount];
-			const float* left = &tile->verts[v0*3];
-			const float* right = &tile->verts[v1*3];
-			
-			// Check that the intersection lies inside the link portal.
-			if (link->side == 0 || link->side == 4)
-			{
-				// Calculate link size.
-				const float s = 1.0f/255.0f;
-				float lmin = left[2] + (right[2] - left[2])*(link->bmin*s);
-				float lmax = left[2] + (right[2] - left[2])*(link->bmax*s);
-				if (lmin > lmax) dtSwap(lmin, lmax);
-				
-				// Find Z intersection.
-				float z = startPos[2] + (endPos[2]-startPos[2])*tmax;
-				if (z >= lmin && z <= lmax)
-				{
-					nextRef = link->ref;
-					break;
-				}
-			}
-			else if (link->side == 2 || link->side == 6)
-			{
-				// Calculate link size.
-				const float s = 1.0f/255.0f;
-				float lmin = left[0] + (right[0] - left[0])*(link->bmin*s);
-				float lmax = left[0] + (right[0] - left[0])*(link->bmax*s);
-				if (lmin > lmax) dtSwap(lmin, lmax);
-				
-				// Find X intersection.
-				float x = startPos[0] + (endPos[0]-startPos[0])*tmax;
-				if (x >= lmin && x <= lmax)
-				{
-					nextRef = link->ref;
-					break;
-				}
-			}
 		}
-		
-		// add the cost
-		if (options & DT_RAYCAST_USE_COSTS)
-		{
-			// compute the intersection point at the furthest end of the polygon
-			// and correct the height (since the raycast moves in 2d)
-			dtVcopy(lastPos, curPos);
-			dtVmad(curPos, startPos, dir, hit->t);
-			float* e1 = &verts[segMax*3];
-			float* e2 = &verts[((segMax+1)%nv)*3];
-			float eDir[3], diff[3];
-			dtVsub(eDir, e2, e1);
-			dtVsub(diff, curPos, e1);
-			float s = dtSqr(eDir[0]) > dtSqr(eDir[2]) ? diff[0] / eDir[0] : diff[2] / eDir[2];
-			curPos[1] = e1[1] + eDir[1] * s;
-
-			hit->pathCost += filter->getCost(lastPos, curPos, prevRef, prevTile, prevPoly, curRef, tile, poly, nextRef, nextTile, nextPoly);
-		}
-
-		if (!nextRef)
-		{
-			// No neighbour, we hit a wall.
-			
-			// Calculate hit normal.
-			const int a = segMax;
-			const int b = segMax+1 < nv ? segMax+1 : 0;
-			const float* va = &verts[a*3];
-			const float* vb = &verts[b*3];
-			const float dx = vb[0] - va[0];
-			const float dz = vb[2] - va[2];
-			hit->hitNormal[0] = dz;
-			hit->hitNormal[1] = 0;
-			hit->hitNormal[2] = -dx;
-			dtVnormalize(hit->hitNormal);
-			
-			hit->pathCount = n;
-			return status;
-		}
-
-		// No hit, advance to neighbour polygon.
-		prevRef = curRef;
-		curRef = nextRef;
-		prevTile = tile;
-		tile = nextTile;
-		prevPoly = poly;
-		poly = nextPoly;
 	}
 	
-	hit->pathCount = n;
+	// add the cost
+	if (options & DT_RAYCAST_USE_COSTS)
+	{
+		// compute the intersection point at the furthest end of the polygon
+		// and correct the height (since the raycast moves in 2d)
+		float lastPos[3];
+		dtVcopy(lastPos, ray.curPos);
+		dtVmad(ray.curPos, startPos, ray.dir, hit->t);
+		const float* e1 = &verts[segMax*3];
+		const float* e2 = &verts[((segMax+1)%nv)*3];
+		float eDir[3], diff[3];
+		dtVsub(eDir, e2, e1);
+		dtVsub(diff, ray.curPos, e1);
+		float s = dtSqr(eDir[0]) > dtSqr(eDir[2]) ? diff[0] / eDir[0] : diff[2] / eDir[2];
+		ray.curPos[1] = e1[1] + eDir[1] * s;
+
+		hit->pathCost += filter->getCost(lastPos, ray.curPos, ray.prevRef, ray.prevTile, ray.prevPoly, curRef, tile, poly, nextRef, nextTile, nextPoly);
+	}
+
+	if (!nextRef)
+	{
+		// No neighbour, we hit a wall.
+		
+		// Calculate hit normal.
+		const int a = segMax;
+		const int b = segMax+1 < nv ? segMax+1 : 0;
+		const float* va = &verts[a*3];
+		const float* vb = &verts[b*3];
+		const float dx = vb[0] - va[0];
+		const float dz = vb[2] - va[2];
+		hit->hitNormal[0] = dz;
+		hit->hitNormal[1] = 0;
+		hit->hitNormal[2] = -dx;
+		dtVnormalize(hit->hitNormal);
+		
+		hit->pathCount = ray.n;
+		return false;
+	}
+
+	// No hit, advance to neighbour polygon.
+	ray.prevRef = curRef;
+	ray.curRef = nextRef;
+	ray.prevTile = tile;
+	ray.tile = nextTile;
+	ray.prevPoly = poly;
+	ray.poly = nextPoly;
 	
-	return status;
+	return true;
 }
 
 /// @par
@@ -2741,8 +3337,9 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 	*resultCount = 0;
 	
 	// Validate input
-	if (!startRef || !m_nav->isValidPolyRef(startRef))
-		return DT_FAILURE | DT_INVALID_PARAM;
+	const dtStatus refStatus = m_nav->getPolyRefStatus(startRef);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
 	
 	m_nodePool->clear();
 	m_openList->clear();
@@ -2799,10 +3396,13 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 			status |= DT_BUFFER_TOO_SMALL;
 		}
 		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		const unsigned int bestIdx = (unsigned int)(bestPoly - bestTile->polys);
+		const dtTileAdjacency* bestAdj = dtGetTileAdjacency(bestTile);
+		const dtPolyPortal* portals = bestAdj->portals;
+		for (unsigned int i = bestAdj->base[bestIdx]; i < bestAdj->base[bestIdx+1]; ++i)
 		{
-			const dtLink* link = &bestTile->links[i];
-			dtPolyRef neighbourRef = link->ref;
+			const dtPolyAdjacency* nei = &bestAdj->entries[i];
+			dtPolyRef neighbourRef = nei->ref;
 			// Skip invalid neighbours and do not follow back to parent.
 			if (!neighbourRef || neighbourRef == parentRef)
 				continue;
@@ -2813,13 +3413,12 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
 		
 			// Do not advance if the polygon is excluded by the filter.
-			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+			if (!passSearchFilter(filter, neighbourRef, neighbourTile, neighbourPoly))
 				continue;
 			
-			// Find edge and calc distance to the edge.
-			float va[3], vb[3];
-			if (!getPortalPoints(bestRef, bestPoly, bestTile, neighbourRef, neighbourPoly, neighbourTile, va, vb))
-				continue;
+			// Get the portal to the neighbour.
+			const float* va = portals[i].left;
+			const float* vb = portals[i].right;
 			
 			// If the circle is not touching the next polygon, skip it.
 			float tseg;
@@ -2841,7 +3440,7 @@ dtStatus dtNavMeshQuery::findPolysAroundCircle(dtPolyRef startRef, const float*
 			if (neighbourNode->flags == 0)
 				dtVlerp(neighbourNode->pos, va, vb, 0.5f);
 			
-			float cost = filter->getCost(
+			float cost = getSearchCost(filter,
 				bestNode->pos, neighbourNode->pos,
 				parentRef, parentTile, parentPoly,
 				bestRef, bestTile, bestPoly,
@@ -2908,8 +3507,9 @@ dtStatus dtNavMeshQuery::findPolysAroundShape(dtPolyRef startRef, const float* v
 	*resultCount = 0;
 	
 	// Validate input
-	if (!startRef || !m_nav->isValidPolyRef(startRef))
-		return DT_FAILURE | DT_INVALID_PARAM;
+	const dtStatus refStatus = m_nav->getPolyRefStatus(startRef);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
 	
 	m_nodePool->clear();
 	m_openList->clear();
@@ -2970,10 +3570,13 @@ dtStatus dtNavMeshQuery::findPolysAroundShape(dtPolyRef startRef, const float* v
 			status |= DT_BUFFER_TOO_SMALL;
 		}
 		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		const unsigned int bestIdx = (unsigned int)(bestPoly - bestTile->polys);
+		const dtTileAdjacency* bestAdj = dtGetTileAdjacency(bestTile);
+		const dtPolyPortal* portals = bestAdj->portals;
+		for (unsigned int i = bestAdj->base[bestIdx]; i < bestAdj->base[bestIdx+1]; ++i)
 		{
-			const dtLink* link = &bestTile->links[i];
-			dtPolyRef neighbourRef = link->ref;
+			const dtPolyAdjacency* nei = &bestAdj->entries[i];
+			dtPolyRef neighbourRef = nei->ref;
 			// Skip invalid neighbours and do not follow back to parent.
 			if (!neighbourRef || neighbourRef == parentRef)
 				continue;
@@ -2984,13 +3587,12 @@ dtStatus dtNavMeshQuery::findPolysAroundShape(dtPolyRef startRef, const float* v
 			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
 			
 			// Do not advance if the polygon is excluded by the filter.
-			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+			if (!passSearchFilter(filter, neighbourRef, neighbourTile, neighbourPoly))
 				continue;
 			
-			// Find edge and calc distance to the edge.
-			float va[3], vb[3];
-			if (!getPortalPoints(bestRef, bestPoly, bestTile, neighbourRef, neighbourPoly, neighbourTile, va, vb))
-				continue;
+			// Get the portal to the neighbour.
+			const float* va = portals[i].left;
+			const float* vb = portals[i].right;
 			
 			// If the poly is not touching the edge to the next polygon, skip the connection it.
 			float tmin, tmax;
@@ -3014,7 +3616,7 @@ dtStatus dtNavMeshQuery::findPolysAroundShape(dtPolyRef startRef, const float* v
 			if (neighbourNode->flags == 0)
 				dtVlerp(neighbourNode->pos, va, vb, 0.5f);
 			
-			float cost = filter->getCost(
+			float cost = getSearchCost(filter,
 				bestNode->pos, neighbourNode->pos,
 				parentRef, parentTile, parentPoly,
 				bestRef, bestTile, bestPoly,
@@ -3049,8 +3651,11 @@ dtStatus dtNavMeshQuery::findPolysAroundShape(dtPolyRef startRef, const float* v
 
 dtStatus dtNavMeshQuery::getPathFromDijkstraSearch(dtPolyRef endRef, dtPolyRef* path, int* pathCount, int maxPath) const
 {
-	if (!m_nav->isValidPolyRef(endRef) || !path || !pathCount || maxPath < 0)
+	if (!path || !pathCount || maxPath < 0)
 		return DT_FAILURE | DT_INVALID_PARAM;
+	const dtStatus refStatus = m_nav->getPolyRefStatus(endRef);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
 
 	*pathCount = 0;
 
@@ -3067,6 +3672,9 @@ dtStatus dtNavMeshQuery::getPathFromDijkstraSearch(dtPolyRef endRef, dtPolyRef*
 /// This method is optimized for a small search radius and small number of result 
 /// polygons.
 ///
+/// The search uses the same growable node pool as #moveAlongSurface. If the pool
+/// cannot grow anymore, the status has #DT_OUT_OF_NODES set.
+///
 /// Candidate polygons are found by searching the navigation graph beginning at 
 /// the start polygon.
 ///
@@ -3090,167 +3698,178 @@ dtStatus dtNavMeshQuery::findLocalNeighbourhood(dtPolyRef startRef, const float*
 												int* resultCount, const int maxResult) const
 {
 	dtAssert(m_nav);
-	dtAssert(m_tinyNodePool);
+	dtAssert(m_scratch);
 	
 	*resultCount = 0;
 
 	// Validate input
-	if (!startRef || !m_nav->isValidPolyRef(startRef))
-		return DT_FAILURE | DT_INVALID_PARAM;
-	
-	static const int MAX_STACK = 48;
-	dtNode* stack[MAX_STACK];
-	int nstack = 0;
-	
-	m_tinyNodePool->clear();
-	
-	dtNode* startNode = m_tinyNodePool->getNode(startRef);
-	startNode->pidx = 0;
-	startNode->id = startRef;
-	startNode->flags = DT_NODE_CLOSED;
-	stack[nstack++] = startNode;
+	const dtStatus refStatus = m_nav->getPolyRefStatus(startRef);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
 	
 	const float radiusSqr = dtSqr(radius);
 	
 	float pa[DT_VERTS_PER_POLYGON*3];
 	float pb[DT_VERTS_PER_POLYGON*3];
 	
-	dtStatus status = DT_SUCCESS;
+	dtStatus status;
+	int n;
 	
-	int n = 0;
-	if (n < maxResult)
+	// Search again with a larger pool if the search runs out of nodes.
+	bool outOfNodes = true;
+	while (outOfNodes)
 	{
-		resultRef[n] = startNode->id;
-		if (resultParent)
-			resultParent[n] = 0;
-		++n;
-	}
-	else
-	{
-		status |= DT_BUFFER_TOO_SMALL;
-	}
-	
-	while (nstack)
-	{
-		// Pop front.
-		dtNode* curNode = stack[0];
-		for (int i = 0; i < nstack-1; ++i)
-			stack[i] = stack[i+1];
-		nstack--;
+		outOfNodes = false;
 		
-		// Get poly and tile.
-		// The API input has been cheked already, skip checking internal data.
-		const dtPolyRef curRef = curNode->id;
-		const dtMeshTile* curTile = 0;
-		const dtPoly* curPoly = 0;
-		m_nav->getTileAndPolyByRefUnsafe(curRef, &curTile, &curPoly);
+		m_scratch->clear();
+		dtNodePool* nodePool = m_scratch->getNodePool();
+		
+		dtNode* startNode = nodePool->getNode(startRef);
+		startNode->pidx = 0;
+		startNode->id = startRef;
+		startNode->flags = DT_NODE_CLOSED;
+		m_scratch->push(startNode);
 		
-		for (unsigned int i = curPoly->firstLink; i != DT_NULL_LINK; i = curTile->links[i].next)
+		status = DT_SUCCESS;
+		
+		n = 0;
+		if (n < maxResult)
 		{
-			const dtLink* link = &curTile->links[i];
-			dtPolyRef neighbourRef = link->ref;
-			// Skip invalid neighbours.
-			if (!neighbourRef)
-				continue;
-			
-			// Skip if cannot alloca more nodes.
-			dtNode* neighbourNode = m_tinyNodePool->getNode(neighbourRef);
-			if (!neighbourNode)
-				continue;
-			// Skip visited.
-			if (neighbourNode->flags & DT_NODE_CLOSED)
-				continue;
-			
-			// Expand to neighbour
-			const dtMeshTile* neighbourTile = 0;
-			const dtPoly* neighbourPoly = 0;
-			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
-			
-			// Skip off-mesh connections.
-			if (neighbourPoly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
-				continue;
-			
-			// Do not advance if the polygon is excluded by the filter.
-			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
-				continue;
-			
-			// Find edge and calc distance to the edge.
-			float va[3], vb[3];
-			if (!getPortalPoints(curRef, curPoly, curTile, neighbourRef, neighbourPoly, neighbourTile, va, vb))
-				continue;
-			
-			// If the circle is not touching the next polygon, skip it.
-			float tseg;
-			float distSqr = dtDistancePtSegSqr2D(centerPos, va, vb, tseg);
-			if (distSqr > radiusSqr)
-				continue;
-			
-			// Mark node visited, this is done before the overlap test so that
-			// we will not visit the poly again if the test fails.
-			neighbourNode->flags |= DT_NODE_CLOSED;
-			neighbourNode->pidx = m_tinyNodePool->getNodeIdx(curNode);
-			
-			// Check that the polygon does not collide with existing polygons.
+			resultRef[n] = startNode->id;
+			if (resultParent)
+				resultParent[n] = 0;
+			++n;
+		}
+		else
+		{
+			status |= DT_BUFFER_TOO_SMALL;
+		}
+		
+		while (!m_scratch->empty())
+		{
+			// Pop front.
+			dtNode* curNode = m_scratch->pop();
 			
-			// Collect vertices of the neighbour poly.
-			const int npa = neighbourPoly->vertCount;
-			for (int k = 0; k < npa; ++k)
-				dtVcopy(&pa[k*3], &neighbourTile->verts[neighbourPoly->verts[k]*3]);
+			// Get poly and tile.
+			// The API input has been cheked already, skip checking internal data.
+			const dtPolyRef curRef = curNode->id;
+			const dtMeshTile* curTile = 0;
+			const dtPoly* curPoly = 0;
+			m_nav->getTileAndPolyByRefUnsafe(curRef, &curTile, &curPoly);
 			
-			bool overlap = false;
-			for (int j = 0; j < n; ++j)
+			for (unsigned int i = curPoly->firstLink; i != DT_NULL_LINK; i = curTile->links[i].next)
 			{
-				dtPolyRef pastRef = resultRef[j];
+				const dtLink* link = &curTile->links[i];
+				dtPolyRef neighbourRef = link->ref;
+				// Skip invalid neighbours.
+				if (!neighbourRef)
+					continue;
 				
-				// Connected polys do not overlap.
-				bool connected = false;
-				for (unsigned int k = curPoly->firstLink; k != DT_NULL_LINK; k = curTile->links[k].next)
+				// Skip if cannot alloca more nodes.
+				dtNode* neighbourNode = nodePool->getNode(neighbourRef);
+				if (!neighbourNode)
 				{
-					if (curTile->links[k].ref == pastRef)
+					outOfNodes = true;
+					continue;
+				}
+				// Skip visited.
+				if (neighbourNode->flags & DT_NODE_CLOSED)
+					continue;
+				
+				// Expand to neighbour
+				const dtMeshTile* neighbourTile = 0;
+				const dtPoly* neighbourPoly = 0;
+				m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
+				
+				// Skip off-mesh connections.
+				if (neighbourPoly->getType() == DT_POLYTYPE_OFFMESH_CONNECTION)
+					continue;
+				
+				// Do not advance if the polygon is excluded by the filter.
+				if (!passSearchFilter(filter, neighbourRef, neighbourTile, neighbourPoly))
+					continue;
+				
+				// Find edge and calc distance to the edge.
+				float va[3], vb[3];
+				if (!getPortalPoints(curRef, curPoly, curTile, neighbourRef, neighbourPoly, neighbourTile, va, vb))
+					continue;
+				
+				// If the circle is not touching the next polygon, skip it.
+				float tseg;
+				float distSqr = dtDistancePtSegSqr2D(centerPos, va, vb, tseg);
+				if (distSqr > radiusSqr)
+					continue;
+				
+				// Mark node visited, this is done before the overlap test so that
+				// we will not visit the poly again if the test fails.
+				neighbourNode->flags |= DT_NODE_CLOSED;
+				neighbourNode->pidx = nodePool->getNodeIdx(curNode);
+				
+				// Check that the polygon does not collide with existing polygons.
+				
+				// Collect vertices of the neighbour poly.
+				const int npa = neighbourPoly->vertCount;
+				for (int k = 0; k < npa; ++k)
+					dtVcopy(&pa[k*3], &neighbourTile->verts[neighbourPoly->verts[k]*3]);
+				
+				bool overlap = false;
+				for (int j = 0; j < n; ++j)
+				{
+					dtPolyRef pastRef = resultRef[j];
+					
+					// Connected polys do not overlap.
+					bool connected = false;
+					for (unsigned int k = curPoly->firstLink; k != DT_NULL_LINK; k = curTile->links[k].next)
+					{
+						if (curTile->links[k].ref == pastRef)
+						{
+							connected = true;
+							break;
+						}
+					}
+					if (connected)
+						continue;
+					
+					// Potentially overlapping.
+					const dtMeshTile* pastTile = 0;
+					const dtPoly* pastPoly = 0;
+					m_nav->getTileAndPolyByRefUnsafe(pastRef, &pastTile, &pastPoly);
+					
+					// Get vertices and test overlap
+					const int npb = pastPoly->vertCount;
+					for (int k = 0; k < npb; ++k)
+						dtVcopy(&pb[k*3], &pastTile->verts[pastPoly->verts[k]*3]);
+					
+					if (dtOverlapPolyPoly2D(pa,npa, pb,npb))
 					{
-						connected = true;
+						overlap = true;
 						break;
 					}
 				}
-				if (connected)
+				if (overlap)
 					continue;
 				
-				// Potentially overlapping.
-				const dtMeshTile* pastTile = 0;
-				const dtPoly* pastPoly = 0;
-				m_nav->getTileAndPolyByRefUnsafe(pastRef, &pastTile, &pastPoly);
-				
-				// Get vertices and test overlap
-				const int npb = pastPoly->vertCount;
-				for (int k = 0; k < npb; ++k)
-					dtVcopy(&pb[k*3], &pastTile->verts[pastPoly->verts[k]*3]);
-				
-				if (dtOverlapPolyPoly2D(pa,npa, pb,npb))
+				// This poly is fine, store and advance to the poly.
+				if (n < maxResult)
 				{
-					overlap = true;
-					break;
+					resultRef[n] = neighbourRef;
+					if (resultParent)
+						resultParent[n] = curRef;
+					++n;
 				}
+				else
+				{
+					status |= DT_BUFFER_TOO_SMALL;
+				}
+				
+				m_scratch->push(neighbourNode);
 			}
-			if (overlap)
-				continue;
-			
-			// This poly is fine, store and advance to the poly.
-			if (n < maxResult)
-			{
-				resultRef[n] = neighbourRef;
-				if (resultParent)
-					resultParent[n] = curRef;
-				++n;
-			}
-			else
-			{
-				status |= DT_BUFFER_TOO_SMALL;
-			}
-			
-			if (nstack < MAX_STACK)
-			{
-				stack[nstack++] = neighbourNode;
-			}
+		}
+		
+		if (outOfNodes && !m_scratch->grow())
+		{
+			status |= DT_OUT_OF_NODES;
+			break;
 		}
 	}
 	
@@ -3309,8 +3928,9 @@ dtStatus dtNavMeshQuery::getPolyWallSegments(dtPolyRef ref, const dtQueryFilter*
 	
 	const dtMeshTile* tile = 0;
 	const dtPoly* poly = 0;
-	if (dtStatusFailed(m_nav->getTileAndPolyByRef(ref, &tile, &poly)))
-		return DT_FAILURE | DT_INVALID_PARAM;
+	const dtStatus refStatus = m_nav->getTileAndPolyByRef(ref, &tile, &poly);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
 	
 	int n = 0;
 	static const int MAX_INTERVAL = 16;
@@ -3458,8 +4078,9 @@ dtStatus dtNavMeshQuery::findDistanceToWall(dtPolyRef startRef, const float* cen
 	dtAssert(m_openList);
 	
 	// Validate input
-	if (!startRef || !m_nav->isValidPolyRef(startRef))
-		return DT_FAILURE | DT_INVALID_PARAM;
+	const dtStatus refStatus = m_nav->getPolyRefStatus(startRef);
+	if (dtStatusFailed(refStatus))
+		return refStatus;
 	
 	m_nodePool->clear();
 	m_openList->clear();
@@ -3552,10 +4173,12 @@ dtStatus dtNavMeshQuery::findDistanceToWall(dtPolyRef startRef, const float* cen
 			hitPos[2] = vj[2] + (vi[2] - vj[2])*tseg;
 		}
 		
-		for (unsigned int i = bestPoly->firstLink; i != DT_NULL_LINK; i = bestTile->links[i].next)
+		const unsigned int bestIdx = (unsigned int)(bestPoly - bestTile->polys);
+		const dtTileAdjacency* bestAdj = dtGetTileAdjacency(bestTile);
+		for (unsigned int i = bestAdj->base[bestIdx]; i < bestAdj->base[bestIdx+1]; ++i)
 		{
-			const dtLink* link = &bestTile->links[i];
-			dtPolyRef neighbourRef = link->ref;
+			const dtPolyAdjacency* nei = &bestAdj->entries[i];
+			dtPolyRef neighbourRef = nei->ref;
 			// Skip invalid neighbours and do not follow back to parent.
 			if (!neighbourRef || neighbourRef == parentRef)
 				continue;
@@ -3570,8 +4193,8 @@ dtStatus dtNavMeshQuery::findDistanceToWall(dtPolyRef startRef, const float* cen
 				continue;
 			
 			// Calc distance to the edge.
-			const float* va = &bestTile->verts[bestPoly->verts[link->edge]*3];
-			const float* vb = &bestTile->verts[bestPoly->verts[(link->edge+1) % bestPoly->vertCount]*3];
+			const float* va = &bestTile->verts[bestPoly->verts[nei->edge]*3];
+			const float* vb = &bestTile->verts[bestPoly->verts[(nei->edge+1) % bestPoly->vertCount]*3];
 			float tseg;
 			float distSqr = dtDistancePtSegSqr2D(centerPos, va, vb, tseg);
 			
@@ -3579,7 +4202,7 @@ dtStatus dtNavMeshQuery::findDistanceToWall(dtPolyRef startRef, const float* cen
 			if (distSqr > radiusSqr)
 				continue;
 			
-			if (!filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+			if (!passSearchFilter(filter, neighbourRef, neighbourTile, neighbourPoly))
 				continue;
 
 			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef);
@@ -3594,10 +4217,7 @@ dtStatus dtNavMeshQuery::findDistanceToWall(dtPolyRef startRef, const float* cen
 			
 			// Cost
 			if (neighbourNode->flags == 0)
-			{
-				getEdgeMidPoint(bestRef, bestPoly, bestTile,
-								neighbourRef, neighbourPoly, neighbourTile, neighbourNode->pos);
-			}
+				dtVcopy(neighbourNode->pos, nei->mid);
 			
 			const float total = bestNode->total + dtVdist(bestNode->pos, neighbourNode->pos);
 			
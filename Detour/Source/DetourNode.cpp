@@ -21,6 +21,7 @@
 #include "DetourAssert.h"
 #include "DetourCommon.h"
 #include <string.h>
+#include <new>
 
 #ifdef DT_POLYREF64
 // From Thomas Wang, https://gist.github.com/badboy/6267743
@@ -61,9 +62,9 @@ dtNodePool::dtNodePool(int maxNodes, int hashSize) :
 	// we have 1 fewer nodes available than the number of values it can contain.
 	dtAssert(m_maxNodes > 0 && m_maxNodes <= DT_NULL_IDX && m_maxNodes <= (1 << DT_NODE_PARENT_BITS) - 1);
 
-	m_nodes = (dtNode*)dtAlloc(sizeof(dtNode)*m_maxNodes, DT_ALLOC_PERM);
-	m_next = (dtNodeIndex*)dtAlloc(sizeof(dtNodeIndex)*m_maxNodes, DT_ALLOC_PERM);
-	m_first = (dtNodeIndex*)dtAlloc(sizeof(dtNodeIndex)*hashSize, DT_ALLOC_PERM);
+	m_nodes = (dtNode*)dtAlloc(sizeof(dtNode)*m_maxNodes, DT_ALLOC_PERM_NAVQUERY);
+	m_next = (dtNodeIndex*)dtAlloc(sizeof(dtNodeIndex)*m_maxNodes, DT_ALLOC_PERM_NAVQUERY);
+	m_first = (dtNodeIndex*)dtAlloc(sizeof(dtNodeIndex)*hashSize, DT_ALLOC_PERM_NAVQUERY);
 
 	dtAssert(m_nodes);
 	dtAssert(m_next);
@@ -144,6 +145,7 @@ dtNode* dtNodePool::getNode(dtPolyRef id, unsigned char state)
 	node->id = id;
 	node->state = state;
 	node->flags = 0;
+	node->heapIdx = -1;
 	
 	m_next[i] = m_first[bucket];
 	m_first[bucket] = i;
@@ -160,7 +162,7 @@ dtNodeQueue::dtNodeQueue(int n) :
 {
 	dtAssert(m_capacity > 0);
 	
-	m_heap = (dtNode**)dtAlloc(sizeof(dtNode*)*(m_capacity+1), DT_ALLOC_PERM);
+	m_heap = (dtNode**)dtAlloc(sizeof(dtNode*)*(m_capacity+1), DT_ALLOC_PERM_NAVQUERY);
 	dtAssert(m_heap);
 }
 
@@ -171,30 +173,117 @@ dtNodeQueue::~dtNodeQueue()
 
 void dtNodeQueue::bubbleUp(int i, dtNode* node)
 {
-	int parent = (i-1)/2;
+	int parent = (i-1)/DT_NODE_QUEUE_ARITY;
 	// note: (index > 0) means there is a parent
 	while ((i > 0) && (m_heap[parent]->total > node->total))
 	{
 		m_heap[i] = m_heap[parent];
+		m_heap[i]->heapIdx = i;
 		i = parent;
-		parent = (i-1)/2;
+		parent = (i-1)/DT_NODE_QUEUE_ARITY;
 	}
 	m_heap[i] = node;
+	node->heapIdx = i;
 }
 
 void dtNodeQueue::trickleDown(int i, dtNode* node)
 {
-	int child = (i*2)+1;
+	int child = (i*DT_NODE_QUEUE_ARITY)+1;
 	while (child < m_size)
 	{
-		if (((child+1) < m_size) && 
-			(m_heap[child]->total > m_heap[child+1]->total))
+		// Find the cheapest of the children.
+		const int lastChild = dtMin(child + DT_NODE_QUEUE_ARITY, m_size);
+		int best = child;
+		for (int j = child+1; j < lastChild; ++j)
 		{
-			child++;
+			if (m_heap[best]->total > m_heap[j]->total)
+				best = j;
 		}
-		m_heap[i] = m_heap[child];
-		i = child;
-		child = (i*2)+1;
+		m_heap[i] = m_heap[best];
+		m_heap[i]->heapIdx = i;
+		i = best;
+		child = (i*DT_NODE_QUEUE_ARITY)+1;
 	}
 	bubbleUp(i, node);
 }
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+dtNodeScratch::dtNodeScratch() :
+	m_pool(0),
+	m_queue(0),
+	m_head(0),
+	m_tail(0),
+	m_maxNodesLimit(0),
+	m_highWaterMark(0)
+{
+}
+
+dtNodeScratch::~dtNodeScratch()
+{
+	if (m_pool)
+		m_pool->~dtNodePool();
+	dtFree(m_pool);
+	dtFree(m_queue);
+}
+
+bool dtNodeScratch::init(int maxNodes, int maxNodesLimit)
+{
+	m_maxNodesLimit = dtMax(maxNodes, maxNodesLimit);
+	
+	if (!m_pool || m_pool->getMaxNodes() < maxNodes)
+	{
+		if (!allocate(maxNodes))
+			return false;
+	}
+	
+	clear();
+	m_highWaterMark = 0;
+	
+	return true;
+}
+
+bool dtNodeScratch::grow()
+{
+	if (!m_pool || m_pool->getMaxNodes() >= m_maxNodesLimit)
+		return false;
+	
+	return allocate(dtMin(m_pool->getMaxNodes()*2, m_maxNodesLimit));
+}
+
+void dtNodeScratch::clear()
+{
+	m_highWaterMark = getHighWaterMark();
+	m_pool->clear();
+	m_head = 0;
+	m_tail = 0;
+}
+
+bool dtNodeScratch::allocate(int maxNodes)
+{
+	// Keep the old pool if the new one cannot be allocated.
+	dtNodeIndex* queue = (dtNodeIndex*)dtAlloc(sizeof(dtNodeIndex)*maxNodes, DT_ALLOC_PERM_NAVQUERY);
+	if (!queue)
+		return false;
+	dtNodePool* pool = new (dtAlloc(sizeof(dtNodePool), DT_ALLOC_PERM_NAVQUERY)) dtNodePool(maxNodes, (int)dtNextPow2(maxNodes/2));
+	if (!pool)
+	{
+		dtFree(queue);
+		return false;
+	}
+	
+	if (m_pool)
+	{
+		m_highWaterMark = getHighWaterMark();
+		m_pool->~dtNodePool();
+		dtFree(m_pool);
+	}
+	dtFree(m_queue);
+	
+	m_pool = pool;
+	m_queue = queue;
+	m_head = 0;
+	m_tail = 0;
+	
+	return true;
+}
@@ -0,0 +1,538 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "DetourTileStreamer.h"
+#include "DetourNavMesh.h"
+#include "DetourCommon.h"
+#include "DetourAlloc.h"
+#include "DetourAssert.h"
+
+
+inline int computeStreamHash(int x, int y, const int mask)
+{
+	const unsigned int h1 = 0x8da6b343; // Large multiplicative constants;
+	const unsigned int h2 = 0xd8163841; // here arbitrarily chosen primes
+	unsigned int n = h1 * x + h2 * y;
+	return (int)(n & mask);
+}
+
+
+dtTileStreamFileLoader::dtTileStreamFileLoader() :
+	m_file(0),
+	m_entries(0)
+{
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+dtTileStreamFileLoader::~dtTileStreamFileLoader()
+{
+	close();
+}
+
+void dtTileStreamFileLoader::close()
+{
+	if (m_file)
+		fclose((FILE*)m_file);
+	m_file = 0;
+	dtFree(m_entries);
+	m_entries = 0;
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+dtStatus dtTileStreamFileLoader::open(const char* path)
+{
+	close();
+
+	FILE* fp = fopen(path, "rb");
+	if (!fp)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	dtTileStreamHeader header;
+	if (fread(&header, sizeof(header), 1, fp) != 1)
+	{
+		fclose(fp);
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+	if (header.magic != DT_TILESTREAM_MAGIC)
+	{
+		fclose(fp);
+		return DT_FAILURE | DT_WRONG_MAGIC;
+	}
+	if (header.version != DT_TILESTREAM_VERSION)
+	{
+		fclose(fp);
+		return DT_FAILURE | DT_WRONG_VERSION;
+	}
+	if (header.tileCount < 0)
+	{
+		fclose(fp);
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+
+	dtTileStreamEntry* entries = (dtTileStreamEntry*)dtAlloc(sizeof(dtTileStreamEntry)*dtMax(header.tileCount, 1), DT_ALLOC_PERM);
+	if (!entries)
+	{
+		fclose(fp);
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+	if (header.tileCount > 0 && fread(entries, sizeof(dtTileStreamEntry), header.tileCount, fp) != (size_t)header.tileCount)
+	{
+		dtFree(entries);
+		fclose(fp);
+		return DT_FAILURE | DT_INVALID_PARAM;
+	}
+
+	m_file = fp;
+	m_header = header;
+	m_entries = entries;
+
+	return DT_SUCCESS;
+}
+
+dtStatus dtTileStreamFileLoader::loadTile(const dtTileStreamEntry* entry, unsigned char* data)
+{
+	FILE* fp = (FILE*)m_file;
+	if (!fp)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	if (fseek(fp, (long)entry->offset, SEEK_SET) != 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	if (fread(data, entry->dataSize, 1, fp) != 1)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	return DT_SUCCESS;
+}
+
+/// @par
+///
+/// Each entry stores the tile reference of the tile, so the streamer can load the
+/// tile back with the same reference, and the polygon references saved along with
+/// the file stay valid.
+///
+/// @see dtTileStreamFileLoader, dtTileStreamer
+dtStatus dtSaveTileStream(const char* path, const dtNavMesh* mesh)
+{
+	if (!mesh)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	dtTileStreamHeader header;
+	header.magic = DT_TILESTREAM_MAGIC;
+	header.version = DT_TILESTREAM_VERSION;
+	memcpy(&header.params, mesh->getParams(), sizeof(dtNavMeshParams));
+	header.tileCount = 0;
+	for (int i = 0; i < mesh->getMaxTiles(); ++i)
+	{
+		const dtMeshTile* tile = mesh->getTile(i);
+		if (!tile || !tile->header || !tile->dataSize) continue;
+		header.tileCount++;
+	}
+
+	FILE* fp = fopen(path, "wb");
+	if (!fp)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+
+	// Store the index, the data follows it.
+	unsigned int offset = (unsigned int)(sizeof(dtTileStreamHeader) + sizeof(dtTileStreamEntry)*header.tileCount);
+	for (int i = 0; i < mesh->getMaxTiles() && ok; ++i)
+	{
+		const dtMeshTile* tile = mesh->getTile(i);
+		if (!tile || !tile->header || !tile->dataSize) continue;
+		dtTileStreamEntry entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.x = tile->header->x;
+		entry.y = tile->header->y;
+		entry.layer = tile->header->layer;
+		entry.dataSize = tile->dataSize;
+		entry.offset = offset;
+		entry.ref = mesh->getTileRef(tile);
+		ok = fwrite(&entry, sizeof(entry), 1, fp) == 1;
+		offset += tile->dataSize;
+	}
+
+	// Store the tiles.
+	for (int i = 0; i < mesh->getMaxTiles() && ok; ++i)
+	{
+		const dtMeshTile* tile = mesh->getTile(i);
+		if (!tile || !tile->header || !tile->dataSize) continue;
+		ok = fwrite(tile->data, tile->dataSize, 1, fp) == 1;
+	}
+
+	fclose(fp);
+
+	return ok ? DT_SUCCESS : DT_FAILURE;
+}
+
+
+dtTileStreamer::dtTileStreamer() :
+	m_nav(0),
+	m_loader(0),
+	m_entries(0),
+	m_items(0),
+	m_entryCount(0),
+	m_posLookup(0),
+	m_lookupMask(0),
+	m_tileEntries(0),
+	m_lruHead(-1),
+	m_lruTail(-1),
+	m_round(0),
+	m_residentCount(0),
+	m_residentBytes(0),
+	m_memoryBudget(0)
+{
+}
+
+dtTileStreamer::~dtTileStreamer()
+{
+	purge();
+}
+
+void dtTileStreamer::purge()
+{
+	// The resident tiles are owned by the navigation mesh, only the pending reads are freed.
+	for (int i = 0; i < m_entryCount; ++i)
+		dtFree(m_items[i].data);
+	dtFree(m_entries);
+	m_entries = 0;
+	dtFree(m_items);
+	m_items = 0;
+	dtFree(m_posLookup);
+	m_posLookup = 0;
+	dtFree(m_tileEntries);
+	m_tileEntries = 0;
+	m_entryCount = 0;
+	m_nav = 0;
+	m_loader = 0;
+	m_lruHead = -1;
+	m_lruTail = -1;
+	m_residentCount = 0;
+	m_residentBytes = 0;
+}
+
+/// @par
+///
+/// Each entry is loaded with its tile reference, or to the tile index of the same number
+/// if the reference is zero. The reference is kept while the tile is evicted with
+/// dtNavMesh::evictTile, the queries report #DT_TILE_NOT_RESIDENT for the polygon
+/// references into it until the tile is loaded back.
+///
+/// With deferred reclamation enabled, an evicted tile can only be loaded back once it
+/// has been reclaimed, until then the load fails with #DT_ALREADY_OCCUPIED.
+///
+/// The loader must outlive the streamer, and all the reads started with
+/// dtTileStreamLoader::requestTile must be finished before the streamer is destroyed.
+dtStatus dtTileStreamer::init(dtNavMesh* nav, const dtTileStreamEntry* entries, const int entryCount,
+							  dtTileStreamLoader* loader, const int memoryBudget)
+{
+	purge();
+
+	if (!nav || !loader || entryCount < 0 || entryCount > nav->getMaxTiles() || memoryBudget < 0)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	if (entryCount > 0 && !entries)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	m_nav = nav;
+	m_loader = loader;
+	m_memoryBudget = memoryBudget;
+	m_round = 0;
+
+	int lookupSize = dtNextPow2((unsigned int)(entryCount/4));
+	if (!lookupSize) lookupSize = 1;
+	m_lookupMask = lookupSize-1;
+
+	m_entries = (dtTileStreamEntry*)dtAlloc(sizeof(dtTileStreamEntry)*dtMax(entryCount, 1), DT_ALLOC_PERM);
+	m_items = (dtTileStreamItem*)dtAlloc(sizeof(dtTileStreamItem)*dtMax(entryCount, 1), DT_ALLOC_PERM);
+	m_posLookup = (int*)dtAlloc(sizeof(int)*lookupSize, DT_ALLOC_PERM);
+	m_tileEntries = (int*)dtAlloc(sizeof(int)*nav->getMaxTiles(), DT_ALLOC_PERM);
+	if (!m_entries || !m_items || !m_posLookup || !m_tileEntries)
+	{
+		purge();
+		return DT_FAILURE | DT_OUT_OF_MEMORY;
+	}
+
+	m_entryCount = entryCount;
+	if (entryCount > 0)
+		memcpy(m_entries, entries, sizeof(dtTileStreamEntry)*entryCount);
+	memset(m_items, 0, sizeof(dtTileStreamItem)*dtMax(entryCount, 1));
+	for (int i = 0; i < lookupSize; ++i)
+		m_posLookup[i] = -1;
+	for (int i = 0; i < nav->getMaxTiles(); ++i)
+		m_tileEntries[i] = -1;
+
+	for (int i = 0; i < entryCount; ++i)
+	{
+		dtTileStreamItem& item = m_items[i];
+		const dtTileRef ref = m_entries[i].ref;
+		const int tileIndex = ref ? (int)nav->decodePolyIdTile((dtPolyRef)ref) : i;
+		if (tileIndex >= nav->getMaxTiles() || m_tileEntries[tileIndex] != -1)
+		{
+			purge();
+			return DT_FAILURE | DT_INVALID_PARAM;
+		}
+		const dtMeshTile* tile = ((const dtNavMesh*)nav)->getTile(tileIndex);
+		if (tile->header)
+		{
+			purge();
+			return DT_FAILURE | DT_ALREADY_OCCUPIED;
+		}
+		m_tileEntries[tileIndex] = i;
+		item.ref = ref ? ref : (dtTileRef)nav->encodePolyId(tile->salt, (unsigned int)tileIndex, 0);
+		item.prev = -1;
+		item.next = -1;
+		item.state = DT_TILESTREAM_EVICTED;
+
+		const int h = computeStreamHash(m_entries[i].x, m_entries[i].y, m_lookupMask);
+		item.nextHash = m_posLookup[h];
+		m_posLookup[h] = i;
+	}
+
+	return DT_SUCCESS;
+}
+
+void dtTileStreamer::unlink(const int index)
+{
+	dtTileStreamItem& item = m_items[index];
+	if (item.prev != -1)
+		m_items[item.prev].next = item.next;
+	else
+		m_lruHead = item.next;
+	if (item.next != -1)
+		m_items[item.next].prev = item.prev;
+	else
+		m_lruTail = item.prev;
+	item.prev = -1;
+	item.next = -1;
+}
+
+void dtTileStreamer::linkFront(const int index)
+{
+	dtTileStreamItem& item = m_items[index];
+	item.prev = -1;
+	item.next = m_lruHead;
+	if (m_lruHead != -1)
+		m_items[m_lruHead].prev = index;
+	else
+		m_lruTail = index;
+	m_lruHead = index;
+}
+
+dtStatus dtTileStreamer::touchEntry(const int index)
+{
+	dtTileStreamItem& item = m_items[index];
+	item.lastUsed = m_round;
+
+	if (item.state == DT_TILESTREAM_RESIDENT)
+	{
+		if (m_lruHead != index)
+		{
+			unlink(index);
+			linkFront(index);
+		}
+		return DT_SUCCESS;
+	}
+	if (item.state == DT_TILESTREAM_LOADING)
+		return DT_IN_PROGRESS | DT_TILE_NOT_RESIDENT;
+
+	const dtTileStreamEntry* entry = &m_entries[index];
+	unsigned char* data = (unsigned char*)dtAlloc(sizeof(unsigned char)*dtMax(entry->dataSize, 1), DT_ALLOC_PERM_TILE_DATA);
+	if (!data)
+		return DT_FAILURE | DT_OUT_OF_MEMORY | DT_TILE_NOT_RESIDENT;
+
+	item.data = data;
+	item.state = DT_TILESTREAM_LOADING;
+	if (m_loader->requestTile(index, entry, data))
+		return DT_IN_PROGRESS | DT_TILE_NOT_RESIDENT;
+
+	return finishLoad(index, m_loader->loadTile(entry, data));
+}
+
+dtStatus dtTileStreamer::finishLoad(const int index, dtStatus status)
+{
+	if (index < 0 || index >= m_entryCount)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	dtTileStreamItem& item = m_items[index];
+	if (item.state != DT_TILESTREAM_LOADING)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	unsigned char* data = item.data;
+	item.data = 0;
+	item.state = DT_TILESTREAM_EVICTED;
+
+	if (dtStatusSucceed(status))
+	{
+		dtTileRef ref = 0;
+		status = m_nav->addTile(data, m_entries[index].dataSize, DT_TILE_FREE_DATA, item.ref, &ref);
+		if (dtStatusSucceed(status))
+		{
+			item.ref = ref;
+			dtTileMemoryStats stats;
+			m_nav->getTileMemoryStats(m_nav->getTileByRef(ref), &stats);
+			item.memSize = stats.totalSize;
+		}
+	}
+	if (dtStatusFailed(status))
+	{
+		dtFree(data);
+		return DT_FAILURE | DT_TILE_NOT_RESIDENT | (status & DT_STATUS_DETAIL_MASK);
+	}
+
+	item.state = DT_TILESTREAM_RESIDENT;
+	linkFront(index);
+	m_residentCount++;
+	m_residentBytes += item.memSize;
+
+	return DT_SUCCESS;
+}
+
+dtStatus dtTileStreamer::touchTile(const int x, const int y)
+{
+	if (!m_nav)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	dtStatus failures = 0;
+	bool pending = false;
+	for (int i = m_posLookup[computeStreamHash(x, y, m_lookupMask)]; i != -1; i = m_items[i].nextHash)
+	{
+		if (m_entries[i].x != x || m_entries[i].y != y)
+			continue;
+		const dtStatus status = touchEntry(i);
+		if (dtStatusFailed(status))
+			failures |= status;
+		else if (dtStatusInProgress(status))
+			pending = true;
+	}
+
+	if (failures)
+		return DT_FAILURE | (failures & DT_STATUS_DETAIL_MASK);
+	if (pending)
+		return DT_IN_PROGRESS | DT_TILE_NOT_RESIDENT;
+	return DT_SUCCESS;
+}
+
+/// @par
+///
+/// Call this with the area an agent or a query is about to use. The status has
+/// #DT_IN_PROGRESS set while some of the tiles are being read in the background.
+dtStatus dtTileStreamer::touchArea(const float* bmin, const float* bmax)
+{
+	if (!m_nav || !bmin || !bmax)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	int minx, miny, maxx, maxy;
+	m_nav->calcTileLoc(bmin, &minx, &miny);
+	m_nav->calcTileLoc(bmax, &maxx, &maxy);
+
+	dtStatus failures = 0;
+	bool pending = false;
+	for (int y = miny; y <= maxy; ++y)
+	{
+		for (int x = minx; x <= maxx; ++x)
+		{
+			const dtStatus status = touchTile(x, y);
+			if (dtStatusFailed(status))
+				failures |= status;
+			else if (dtStatusInProgress(status))
+				pending = true;
+		}
+	}
+
+	if (failures)
+		return DT_FAILURE | (failures & DT_STATUS_DETAIL_MASK);
+	if (pending)
+		return DT_IN_PROGRESS | DT_TILE_NOT_RESIDENT;
+	return DT_SUCCESS;
+}
+
+dtStatus dtTileStreamer::touchPolyRef(dtPolyRef ref)
+{
+	if (!m_nav || !ref)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	const int tileIndex = (int)m_nav->decodePolyIdTile(ref);
+	if (tileIndex >= m_nav->getMaxTiles() || m_tileEntries[tileIndex] == -1)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	const int index = m_tileEntries[tileIndex];
+	if (m_nav->decodePolyIdSalt(ref) != m_nav->decodePolyIdSalt((dtPolyRef)m_items[index].ref))
+		return DT_FAILURE | DT_INVALID_PARAM;
+	return touchEntry(index);
+}
+
+dtStatus dtTileStreamer::getPolyRefStatus(dtPolyRef ref) const
+{
+	if (!m_nav || !ref)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	const int tileIndex = (int)m_nav->decodePolyIdTile(ref);
+	if (tileIndex >= m_nav->getMaxTiles() || m_tileEntries[tileIndex] == -1)
+		return DT_FAILURE | DT_INVALID_PARAM;
+	const int index = m_tileEntries[tileIndex];
+	if (m_nav->decodePolyIdSalt(ref) != m_nav->decodePolyIdSalt((dtPolyRef)m_items[index].ref))
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	const dtTileStreamItem& item = m_items[index];
+	if (item.state == DT_TILESTREAM_LOADING)
+		return DT_IN_PROGRESS | DT_TILE_NOT_RESIDENT;
+	if (item.state != DT_TILESTREAM_RESIDENT)
+		return DT_FAILURE | DT_TILE_NOT_RESIDENT;
+	if (!m_nav->isValidPolyRef(ref))
+		return DT_FAILURE | DT_INVALID_PARAM;
+	return DT_SUCCESS;
+}
+
+dtStatus dtTileStreamer::evict(const int index)
+{
+	dtTileStreamItem& item = m_items[index];
+	dtAssert(item.state == DT_TILESTREAM_RESIDENT);
+
+	// The tile stays resident if the navigation mesh refuses to remove it.
+	const dtStatus status = m_nav->evictTile(item.ref, 0, 0);
+	if (dtStatusFailed(status))
+		return status;
+
+	unlink(index);
+	item.state = DT_TILESTREAM_EVICTED;
+	m_residentCount--;
+	m_residentBytes -= item.memSize;
+
+	return DT_SUCCESS;
+}
+
+/// @par
+///
+/// A tile the navigation mesh fails to evict stays resident in its place in the use order,
+/// and the eviction is tried again on the next update.
+void dtTileStreamer::update()
+{
+	if (!m_nav)
+		return;
+
+	if (m_memoryBudget > 0)
+	{
+		int index = m_lruTail;
+		while (m_residentBytes > m_memoryBudget && index != -1)
+		{
+			// The list is ordered by use, so the rest of the tiles are in use too.
+			if (m_items[index].lastUsed == m_round)
+				break;
+			const int prev = m_items[index].prev;
+			evict(index);
+			index = prev;
+		}
+	}
+
+	m_round++;
+}
@@ -0,0 +1,63 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include "DetourTime.h"
+
+#if defined(_WIN32)
+
+// Win32
+#include <windows.h>
+
+static uint64_t dtGetTimeDefault()
+{
+	static LARGE_INTEGER freq = { 0 };
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER count;
+	QueryPerformanceCounter(&count);
+	// Split the conversion to avoid overflowing the counter.
+	const uint64_t f = (uint64_t)freq.QuadPart;
+	const uint64_t c = (uint64_t)count.QuadPart;
+	return (c / f) * 1000000000ULL + (c % f) * 1000000000ULL / f;
+}
+
+#else
+
+// Linux, BSD, OSX
+#include <time.h>
+
+static uint64_t dtGetTimeDefault()
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+#endif
+
+static dtTimeFunc* sTimeFunc = dtGetTimeDefault;
+
+void dtTimeSetCustom(dtTimeFunc* timeFunc)
+{
+	sTimeFunc = timeFunc ? timeFunc : dtGetTimeDefault;
+}
+
+uint64_t dtGetTimeNs()
+{
+	return sTimeFunc();
+}
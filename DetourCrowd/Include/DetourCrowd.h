@@ -191,6 +191,20 @@ enum UpdateFlags
 	DT_CROWD_OPTIMIZE_TOPO = 16,		///< Use dtPathCorridor::optimizePathTopology() to optimize the agent path.
 };
 
+/// The memory used by a crowd, in bytes.
+/// @see dtCrowd::getMemoryStats()
+/// @ingroup crowd
+struct dtCrowdMemoryStats
+{
+	int crowdSize;					///< The crowd object, the agents and the agent arrays.
+	int corridorSize;				///< The paths of the agent corridors.
+	int gridSize;					///< The proximity grid.
+	int pathQueueSize;				///< The paths of the path queue and its query object.
+	int avoidanceSize;				///< The obstacle avoidance query.
+	int navQuerySize;				///< The query object of the crowd.
+	int totalSize;					///< The total memory used by the crowd.
+};
+
 struct dtCrowdAgentDebugInfo
 {
 	int idx;
@@ -348,6 +362,10 @@ public:
 	/// Gets the query object used by the crowd.
 	const dtNavMeshQuery* getNavMeshQuery() const { return m_navquery; }
 
+	/// Gets the memory used by the crowd, excluding the navigation mesh.
+	///  @param[out]	stats	The memory statistics.
+	void getMemoryStats(dtCrowdMemoryStats* stats) const;
+
 private:
 	// Explicitly disabled copy constructor and copy assignment operator.
 	dtCrowd(const dtCrowd&);
@@ -0,0 +1,153 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#ifndef DETOURFLOWFIELD_H
+#define DETOURFLOWFIELD_H
+
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+
+/// Stores the cost to go and the next portal towards a shared goal for the polygons around it.
+/// Used to steer many agents to the same location without a path search per agent.
+/// @ingroup crowd
+class dtFlowField
+{
+public:
+	dtFlowField();
+	~dtFlowField();
+
+	/// Allocates the flow field.
+	///  @param[in]		nav			The navigation mesh the field is computed on.
+	///  @param[in]		maxNodes	The maximum number of polygons the field can hold. [Limits: 0 < value <= 65535]
+	///  @param[in]		maxTiles	The maximum number of tiles the field can span. [Limit: > 0]
+	/// @return True if the initialization succeeded.
+	bool init(const dtNavMesh* nav, const int maxNodes, const int maxTiles);
+
+	/// Starts computing the field towards a new goal. Use #update to compute it.
+	///  @param[in]		goalRef		The reference id of the goal polygon.
+	///  @param[in]		goalPos		The goal location within the goal polygon. [(x, y, z)]
+	///  @param[in]		maxRadius	The maximum distance from the goal the field covers. [Limit: 0 = unlimited]
+	///  @param[in]		filter		The polygon filter applied while computing the field.
+	/// @returns The status flags for the operation.
+	dtStatus setGoal(dtPolyRef goalRef, const float* goalPos, const float maxRadius,
+					 const dtQueryFilter* filter);
+
+	/// Continues computing the field.
+	///  @param[in]		maxIter		The maximum number of polygons to settle.
+	///  @param[out]	doneIters	The number of polygons settled. [opt]
+	/// @returns The status flags for the operation.
+	dtStatus update(const int maxIter, int* doneIters);
+
+	/// Returns true if none of the tiles the field spans has been removed, replaced or changed
+	/// since the goal was set. (See: #dtMeshTile::stateVersion)
+	bool isValid() const;
+
+	/// Gets the next location towards the goal from the specified polygon.
+	///  @param[in]		ref			The reference id of a polygon in the field.
+	///  @param[out]	target		The midpoint of the exit portal, or the goal location in the goal polygon. [(x, y, z)]
+	///  @param[out]	nextRef		The reference id of the next polygon towards the goal. [opt]
+	///  @param[out]	cost		The cost to go from the target to the goal. [opt]
+	/// @returns The status flags for the query. Fails if the field is not valid.
+	dtStatus getFlowTarget(dtPolyRef ref, float* target, dtPolyRef* nextRef, float* cost) const;
+
+	/// Gets the normalized steering direction on the xz-plane towards the goal.
+	///  @param[in]		ref			The reference id of the polygon containing @p pos.
+	///  @param[in]		pos			The current location. [(x, y, z)]
+	///  @param[out]	dir			The steering direction. [(x, y, z)]
+	/// @returns The status flags for the query. Fails if the field is not valid.
+	dtStatus getFlowDirection(dtPolyRef ref, const float* pos, float* dir) const;
+
+	inline dtStatus getStatus() const { return m_status; }
+	inline dtPolyRef getGoalRef() const { return m_goalRef; }
+	inline const float* getGoalPos() const { return m_goalPos; }
+	inline float getMaxRadius() const { return m_maxRadius; }
+	inline const dtQueryFilter* getFilter() const { return m_filter; }
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtFlowField(const dtFlowField&);
+	dtFlowField& operator=(const dtFlowField&);
+
+	void purge();
+	bool addTile(const dtMeshTile* tile);
+
+	const dtNavMesh* m_nav;
+	class dtNodePool* m_nodePool;
+	class dtNodeQueue* m_openList;
+
+	dtTileRef* m_tiles;
+	int m_ntiles;
+	int m_maxTiles;
+	unsigned int m_stateVersion;
+
+	dtPolyRef m_goalRef;
+	float m_goalPos[3];
+	float m_maxRadius;
+	const dtQueryFilter* m_filter;
+	dtStatus m_status;
+};
+
+/// Keeps the flow fields of the most recently used goals.
+/// @ingroup crowd
+class dtFlowFieldCache
+{
+	struct Entry
+	{
+		dtFlowField* field;
+		unsigned int lastUsed;
+	};
+
+	Entry* m_entries;
+	int m_maxFields;
+	unsigned int m_tick;
+
+	void purge();
+
+public:
+	dtFlowFieldCache();
+	~dtFlowFieldCache();
+
+	/// Allocates the cache.
+	///  @param[in]		maxFields	The maximum number of goals kept in the cache. [Limit: > 0]
+	///  @param[in]		maxNodes	The maximum number of polygons per field. [Limits: 0 < value <= 65535]
+	///  @param[in]		maxTiles	The maximum number of tiles per field. [Limit: > 0]
+	///  @param[in]		nav			The navigation mesh the fields are computed on.
+	/// @return True if the initialization succeeded.
+	bool init(const int maxFields, const int maxNodes, const int maxTiles, const dtNavMesh* nav);
+
+	/// Returns the field towards the goal polygon, starting a new one if the goal is not cached.
+	/// The least recently used field is replaced when the cache is full.
+	///  @param[in]		goalRef		The reference id of the goal polygon.
+	///  @param[in]		goalPos		The goal location within the goal polygon. [(x, y, z)]
+	///  @param[in]		maxRadius	The maximum distance from the goal the field covers. [Limit: 0 = unlimited]
+	///  @param[in]		filter		The polygon filter applied while computing the field.
+	/// @return The field, or null if the goal is not valid.
+	dtFlowField* request(dtPolyRef goalRef, const float* goalPos, const float maxRadius,
+						 const dtQueryFilter* filter);
+
+	/// Continues computing the fields in progress, and restarts the fields whose tiles have changed.
+	///  @param[in]		maxIters	The maximum number of polygons to settle in total.
+	void update(const int maxIters);
+
+private:
+	// Explicitly disabled copy constructor and copy assignment operator.
+	dtFlowFieldCache(const dtFlowFieldCache&);
+	dtFlowFieldCache& operator=(const dtFlowFieldCache&);
+};
+
+#endif // DETOURFLOWFIELD_H
@@ -124,6 +124,13 @@ public:
 
 	inline int getObstacleSegmentCount() const { return m_nsegments; }
 	const dtObstacleSegment* getObstacleSegment(const int i) { return &m_segments[i]; }
+	
+	inline int getMemUsed() const
+	{
+		return sizeof(*this) +
+			sizeof(dtObstacleCircle)*m_maxCircles +
+			sizeof(dtObstacleSegment)*m_maxSegments;
+	}
 
 private:
 	// Explicitly disabled copy constructor and copy assignment operator.
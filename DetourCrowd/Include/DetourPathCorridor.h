@@ -87,6 +87,12 @@ public:
 	///  @param[in]		filter			The filter to apply to the operation.	
 	bool isValid(const int maxLookAhead, dtNavMeshQuery* navquery, const dtQueryFilter* filter);
 	
+	/// Repairs the first invalid section of the corridor with a short local search, keeping the rest of the path.
+	///  @param[in]		navquery		The query object used to build the corridor.
+	///  @param[in]		filter			The filter to apply to the operation.
+	/// @return True if the path was valid or has been repaired, false if the path has to be replanned.
+	bool repairPath(dtNavMeshQuery* navquery, const dtQueryFilter* filter);
+	
 	/// Moves the position from the current location to the desired location, adjusting the corridor 
 	/// as needed to reflect the change.
 	///  @param[in]		npos		The desired new position. [(x, y, z)]
@@ -132,6 +138,10 @@ public:
 	/// The number of polygons in the current corridor path.
 	/// @return The number of polygons in the current corridor path.
 	inline int getPathCount() const { return m_npath; }
+	
+	/// The memory allocated for the corridor's path, in bytes.
+	/// @return The memory allocated for the corridor's path.
+	inline int getMemUsed() const { return (int)sizeof(dtPolyRef)*m_maxPath; }
 
 private:
 	// Explicitly disabled copy constructor and copy assignment operator.
@@ -148,4 +158,7 @@ int dtMergeCorridorEndMoved(dtPolyRef* path, const int npath, const int maxPath,
 int dtMergeCorridorStartShortcut(dtPolyRef* path, const int npath, const int maxPath,
 								 const dtPolyRef* visited, const int nvisited);
 
+int dtMergeCorridorDetour(dtPolyRef* path, const int npath, const int maxPath, const int first,
+						  const dtPolyRef* detour, const int ndetour);
+
 #endif // DETOUTPATHCORRIDOR_H
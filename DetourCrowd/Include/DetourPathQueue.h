@@ -49,8 +49,10 @@ class dtPathQueue
 	int m_maxPathSize;
 	int m_queueHead;
 	dtNavMeshQuery* m_navquery;
+	float m_itersPerUsec;
 	
 	void purge();
+	void updateQueue(const int maxIters, const uint64_t deadline);
 	
 public:
 	dtPathQueue();
@@ -59,6 +61,11 @@ public:
 	bool init(const int maxPathSize, const int maxSearchNodeCount, dtNavMesh* nav);
 	
 	void update(const int maxIters);
+
+	/// Updates the path requests until the time budget is used. The request at the head of
+	/// the queue is always advanced, even when the budget is already used.
+	///  @param[in]		maxTimeNs	The time budget in nanoseconds.
+	void updateTimed(const uint64_t maxTimeNs);
 	
 	dtPathQueueRef request(dtPolyRef startRef, dtPolyRef endRef,
 						   const float* startPos, const float* endPos, 
@@ -70,6 +77,12 @@ public:
 	
 	inline const dtNavMeshQuery* getNavQuery() const { return m_navquery; }
 
+	/// The number of pathfinder iterations per microsecond achieved by the last timed update.
+	inline float getItersPerUsec() const { return m_itersPerUsec; }
+
+	/// The memory allocated by the queue for the paths and its query object, in bytes.
+	int getMemUsed() const;
+
 private:
 	// Explicitly disabled copy constructor and copy assignment operator.
 	dtPathQueue(const dtPathQueue&);
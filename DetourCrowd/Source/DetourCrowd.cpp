@@ -33,7 +33,7 @@
 
 dtCrowd* dtAllocCrowd()
 {
-	void* mem = dtAlloc(sizeof(dtCrowd), DT_ALLOC_PERM);
+	void* mem = dtAlloc(sizeof(dtCrowd), DT_ALLOC_PERM_CROWD);
 	if (!mem) return 0;
 	return new(mem) dtCrowd;
 }
@@ -47,6 +47,7 @@ void dtFreeCrowd(dtCrowd* ptr)
 
 
 static const int MAX_ITERS_PER_UPDATE = 100;
+static const int MAX_REPAIRS_PER_UPDATE = 8;
 
 static const int MAX_PATHQUEUE_NODES = 4096;
 static const int MAX_COMMON_NODES = 512;
@@ -420,22 +421,22 @@ bool dtCrowd::init(const int maxAgents, const float maxAgentRadius, dtNavMesh* n
 	
 	// Allocate temp buffer for merging paths.
 	m_maxPathResult = 256;
-	m_pathResult = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*m_maxPathResult, DT_ALLOC_PERM);
+	m_pathResult = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*m_maxPathResult, DT_ALLOC_PERM_CROWD);
 	if (!m_pathResult)
 		return false;
 	
 	if (!m_pathq.init(m_maxPathResult, MAX_PATHQUEUE_NODES, nav))
 		return false;
 	
-	m_agents = (dtCrowdAgent*)dtAlloc(sizeof(dtCrowdAgent)*m_maxAgents, DT_ALLOC_PERM);
+	m_agents = (dtCrowdAgent*)dtAlloc(sizeof(dtCrowdAgent)*m_maxAgents, DT_ALLOC_PERM_CROWD);
 	if (!m_agents)
 		return false;
 	
-	m_activeAgents = (dtCrowdAgent**)dtAlloc(sizeof(dtCrowdAgent*)*m_maxAgents, DT_ALLOC_PERM);
+	m_activeAgents = (dtCrowdAgent**)dtAlloc(sizeof(dtCrowdAgent*)*m_maxAgents, DT_ALLOC_PERM_CROWD);
 	if (!m_activeAgents)
 		return false;
 
-	m_agentAnims = (dtCrowdAgentAnimation*)dtAlloc(sizeof(dtCrowdAgentAnimation)*m_maxAgents, DT_ALLOC_PERM);
+	m_agentAnims = (dtCrowdAgentAnimation*)dtAlloc(sizeof(dtCrowdAgentAnimation)*m_maxAgents, DT_ALLOC_PERM_CROWD);
 	if (!m_agentAnims)
 		return false;
 	
@@ -462,6 +463,35 @@ bool dtCrowd::init(const int maxAgents, const float maxAgentRadius, dtNavMesh* n
 	return true;
 }
 
+void dtCrowd::getMemoryStats(dtCrowdMemoryStats* stats) const
+{
+	if (!stats)
+		return;
+	memset(stats, 0, sizeof(dtCrowdMemoryStats));
+	
+	stats->crowdSize = (int)sizeof(dtCrowd) + (int)sizeof(dtPolyRef)*m_maxPathResult;
+	if (m_agents)
+	{
+		stats->crowdSize += (int)(sizeof(dtCrowdAgent) + sizeof(dtCrowdAgent*) + sizeof(dtCrowdAgentAnimation))*m_maxAgents;
+		for (int i = 0; i < m_maxAgents; ++i)
+			stats->corridorSize += m_agents[i].corridor.getMemUsed();
+	}
+	if (m_grid)
+		stats->gridSize = m_grid->getMemUsed();
+	stats->pathQueueSize = m_pathq.getMemUsed();
+	if (m_obstacleQuery)
+		stats->avoidanceSize = m_obstacleQuery->getMemUsed();
+	if (m_navquery)
+	{
+		dtNavMeshQueryMemoryStats queryStats;
+		m_navquery->getMemoryStats(&queryStats);
+		stats->navQuerySize = queryStats.totalSize;
+	}
+	
+	stats->totalSize = stats->crowdSize + stats->corridorSize + stats->gridSize +
+		stats->pathQueueSize + stats->avoidanceSize + stats->navQuerySize;
+}
+
 void dtCrowd::setObstacleAvoidanceParams(const int idx, const dtObstacleAvoidanceParams* params)
 {
 	if (idx >= 0 && idx < DT_CROWD_MAX_OBSTAVOIDANCE_PARAMS)
@@ -943,6 +973,9 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 	static const int CHECK_LOOKAHEAD = 10;
 	static const float TARGET_REPLAN_DELAY = 1.0; // seconds
 	
+	// Each repair runs a short search right away, the agents past the budget replan through the path queue.
+	int nrepairs = 0;
+	
 	for (int i = 0; i < nagents; ++i)
 	{
 		dtCrowdAgent* ag = agents[i];
@@ -963,10 +996,12 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 		{
 			// Current location is not valid, try to reposition.
 			// TODO: this can snap agents, how to handle that?
+			// The previous polygon may only have been excluded by the filter, start from its neighbours.
 			float nearest[3];
 			dtVcopy(nearest, agentPos);
+			const dtPolyRef prevRef = agentRef;
 			agentRef = 0;
-			m_navquery->findNearestPoly(ag->npos, m_agentPlacementHalfExtents, &m_filters[ag->params.queryFilterType], &agentRef, nearest);
+			m_navquery->findNearestPolyHinted(prevRef, ag->npos, m_agentPlacementHalfExtents, &m_filters[ag->params.queryFilterType], &agentRef, nearest);
 			dtVcopy(agentPos, nearest);
 
 			if (!agentRef)
@@ -1001,8 +1036,9 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 				// Current target is not valid, try to reposition.
 				float nearest[3];
 				dtVcopy(nearest, ag->targetPos);
+				const dtPolyRef prevRef = ag->targetRef;
 				ag->targetRef = 0;
-				m_navquery->findNearestPoly(ag->targetPos, m_agentPlacementHalfExtents, &m_filters[ag->params.queryFilterType], &ag->targetRef, nearest);
+				m_navquery->findNearestPolyHinted(prevRef, ag->targetPos, m_agentPlacementHalfExtents, &m_filters[ag->params.queryFilterType], &ag->targetRef, nearest);
 				dtVcopy(ag->targetPos, nearest);
 				replan = true;
 			}
@@ -1015,13 +1051,21 @@ void dtCrowd::checkPathValidity(dtCrowdAgent** agents, const int nagents, const
 			}
 		}
 
-		// If nearby corridor is not valid, replan.
+		// If nearby corridor is not valid, try to repair it locally, and replan if that fails.
 		if (!ag->corridor.isValid(CHECK_LOOKAHEAD, m_navquery, &m_filters[ag->params.queryFilterType]))
 		{
 			// Fix current path.
 //			ag->corridor.trimInvalidPath(agentRef, agentPos, m_navquery, &m_filter);
-//			ag->boundary.reset();
-			replan = true;
+			if (!replan && nrepairs++ < MAX_REPAIRS_PER_UPDATE &&
+				ag->corridor.repairPath(m_navquery, &m_filters[ag->params.queryFilterType]) &&
+				ag->corridor.isValid(CHECK_LOOKAHEAD, m_navquery, &m_filters[ag->params.queryFilterType]))
+			{
+				ag->boundary.reset();
+			}
+			else
+			{
+				replan = true;
+			}
 		}
 		
 		// If the end of the path is near and it is not the requested location, replan.
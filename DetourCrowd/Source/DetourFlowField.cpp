@@ -0,0 +1,507 @@
+//
+// Copyright (c) 2009-2010 Mikko Mononen memon@inside.org
+//
+// This software is provided 'as-is', without any express or implied
+// warranty.  In no event will the authors be held liable for any damages
+// arising from the use of this software.
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would be
+//    appreciated but is not required.
+// 2. Altered source versions must be plainly marked as such, and must not be
+//    misrepresented as being the original software.
+// 3. This notice may not be removed or altered from any source distribution.
+//
+
+#include <string.h>
+#include <new>
+#include "DetourFlowField.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshQuery.h"
+#include "DetourFindPath.h"
+#include "DetourNode.h"
+#include "DetourCommon.h"
+#include "DetourMath.h"
+#include "DetourAlloc.h"
+#include "DetourAssert.h"
+
+
+// Finds the adjacency entry of the polygon leading to the specified neighbour.
+static const dtPolyAdjacency* findAdjacency(const dtMeshTile* tile, const dtPoly* poly, dtPolyRef ref)
+{
+	const dtTileAdjacency* adjacency = dtGetTileAdjacency(tile);
+	const unsigned int ip = (unsigned int)(poly - tile->polys);
+	for (unsigned int i = adjacency->base[ip]; i < adjacency->base[ip+1]; ++i)
+	{
+		if (adjacency->entries[i].ref == ref)
+			return &adjacency->entries[i];
+	}
+	return 0;
+}
+
+
+dtFlowField::dtFlowField() :
+	m_nav(0),
+	m_nodePool(0),
+	m_openList(0),
+	m_tiles(0),
+	m_ntiles(0),
+	m_maxTiles(0),
+	m_stateVersion(0),
+	m_goalRef(0),
+	m_maxRadius(0),
+	m_filter(0),
+	m_status(0)
+{
+	dtVset(m_goalPos, 0,0,0);
+}
+
+dtFlowField::~dtFlowField()
+{
+	purge();
+}
+
+void dtFlowField::purge()
+{
+	if (m_nodePool)
+		m_nodePool->~dtNodePool();
+	if (m_openList)
+		m_openList->~dtNodeQueue();
+	dtFree(m_nodePool);
+	dtFree(m_openList);
+	dtFree(m_tiles);
+	m_nodePool = 0;
+	m_openList = 0;
+	m_tiles = 0;
+	m_ntiles = 0;
+	m_maxTiles = 0;
+	m_goalRef = 0;
+	m_status = 0;
+}
+
+bool dtFlowField::init(const dtNavMesh* nav, const int maxNodes, const int maxTiles)
+{
+	purge();
+
+	if (!nav || maxNodes <= 0 || maxNodes > DT_NULL_IDX || maxTiles <= 0)
+		return false;
+
+	m_nav = nav;
+
+	m_nodePool = new (dtAlloc(sizeof(dtNodePool), DT_ALLOC_PERM_CROWD)) dtNodePool(maxNodes, dtNextPow2(maxNodes/4));
+	if (!m_nodePool)
+		return false;
+
+	m_openList = new (dtAlloc(sizeof(dtNodeQueue), DT_ALLOC_PERM_CROWD)) dtNodeQueue(maxNodes);
+	if (!m_openList)
+		return false;
+
+	m_tiles = (dtTileRef*)dtAlloc(sizeof(dtTileRef)*maxTiles, DT_ALLOC_PERM_CROWD);
+	if (!m_tiles)
+		return false;
+	m_maxTiles = maxTiles;
+
+	return true;
+}
+
+bool dtFlowField::addTile(const dtMeshTile* tile)
+{
+	const dtTileRef ref = m_nav->getTileRef(tile);
+	for (int i = 0; i < m_ntiles; ++i)
+	{
+		if (m_tiles[i] == ref)
+			return true;
+	}
+	if (m_ntiles >= m_maxTiles)
+		return false;
+	m_tiles[m_ntiles++] = ref;
+	return true;
+}
+
+/// @par
+///
+/// The field is computed by a Dijkstra search running backwards from the goal, so
+/// each polygon stores the cost to reach the goal and the portal to leave through.
+/// A polygon is only added if it can move into its successor, so one-way off-mesh
+/// connections are followed in the correct direction.
+///
+/// The filter is stored and used by the following calls to #update, so it must
+/// stay valid until the field is complete.
+dtStatus dtFlowField::setGoal(dtPolyRef goalRef, const float* goalPos, const float maxRadius,
+							  const dtQueryFilter* filter)
+{
+	dtAssert(m_nav);
+	dtAssert(m_nodePool);
+	dtAssert(m_openList);
+
+	m_goalRef = 0;
+	m_status = DT_FAILURE;
+
+	// Validate input
+	if (!m_nav->isValidPolyRef(goalRef) || !goalPos ||
+		!(maxRadius >= 0.0f) || !filter)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	const dtMeshTile* goalTile = 0;
+	const dtPoly* goalPoly = 0;
+	m_nav->getTileAndPolyByRefUnsafe(goalRef, &goalTile, &goalPoly);
+
+	m_goalRef = goalRef;
+	dtVcopy(m_goalPos, goalPos);
+	m_maxRadius = maxRadius;
+	m_filter = filter;
+
+	m_nodePool->clear();
+	m_openList->clear();
+	m_ntiles = 0;
+	m_stateVersion = m_nav->getStateVersion();
+	addTile(goalTile);
+
+	dtNode* goalNode = m_nodePool->getNode(goalRef);
+	dtVcopy(goalNode->pos, goalPos);
+	goalNode->pidx = 0;
+	goalNode->cost = 0;
+	goalNode->total = 0;
+	goalNode->id = goalRef;
+	goalNode->flags = DT_NODE_OPEN;
+	m_openList->push(goalNode);
+
+	m_status = DT_IN_PROGRESS;
+
+	return m_status;
+}
+
+dtStatus dtFlowField::update(const int maxIter, int* doneIters)
+{
+	if (!dtStatusInProgress(m_status))
+		return m_status;
+
+	// Make sure the data we are visiting is still valid.
+	if (!isValid())
+	{
+		m_status = DT_FAILURE;
+		return DT_FAILURE;
+	}
+
+	const float radiusSqr = dtSqr(m_maxRadius);
+
+	int iter = 0;
+	while (iter < maxIter && !m_openList->empty())
+	{
+		iter++;
+
+		// Remove node from open list and put it in closed list.
+		dtNode* bestNode = m_openList->pop();
+		bestNode->flags &= ~DT_NODE_OPEN;
+		bestNode->flags |= DT_NODE_CLOSED;
+
+		// Get current poly and tile.
+		// The tiles have been validated above, skip checking internal data.
+		const dtPolyRef bestRef = bestNode->id;
+		const dtMeshTile* bestTile = 0;
+		const dtPoly* bestPoly = 0;
+		m_nav->getTileAndPolyByRefUnsafe(bestRef, &bestTile, &bestPoly);
+
+		// Get the next poly and tile towards the goal.
+		dtPolyRef nextRef = 0;
+		const dtMeshTile* nextTile = 0;
+		const dtPoly* nextPoly = 0;
+		if (bestNode->pidx)
+			nextRef = m_nodePool->getNodeAtIdx(bestNode->pidx)->id;
+		if (nextRef)
+			m_nav->getTileAndPolyByRefUnsafe(nextRef, &nextTile, &nextPoly);
+
+		const unsigned int bestIdx = (unsigned int)(bestPoly - bestTile->polys);
+		const dtTileAdjacency* bestAdj = dtGetTileAdjacency(bestTile);
+		for (unsigned int i = bestAdj->base[bestIdx]; i < bestAdj->base[bestIdx+1]; ++i)
+		{
+			const dtPolyRef neighbourRef = bestAdj->entries[i].ref;
+
+			// Skip invalid neighbours and do not follow back to the next polygon.
+			if (!neighbourRef || neighbourRef == nextRef)
+				continue;
+
+			const dtMeshTile* neighbourTile = 0;
+			const dtPoly* neighbourPoly = 0;
+			m_nav->getTileAndPolyByRefUnsafe(neighbourRef, &neighbourTile, &neighbourPoly);
+
+			// Track the tile even if the polygon is filtered out, so that opening it invalidates the field.
+			if (neighbourTile != bestTile && !addTile(neighbourTile))
+			{
+				m_status |= DT_BUFFER_TOO_SMALL;
+				continue;
+			}
+
+			if (!m_filter->passFilter(neighbourRef, neighbourTile, neighbourPoly))
+				continue;
+
+			// The search runs backwards, the neighbour must be able to move into the current polygon.
+			const dtPolyAdjacency* back = findAdjacency(neighbourTile, neighbourPoly, bestRef);
+			if (!back)
+				continue;
+
+			// Do not grow past the radius.
+			if (m_maxRadius > 0.0f && dtVdistSqr(back->mid, m_goalPos) > radiusSqr)
+				continue;
+
+			dtNode* neighbourNode = m_nodePool->getNode(neighbourRef);
+			if (!neighbourNode)
+			{
+				m_status |= DT_OUT_OF_NODES;
+				continue;
+			}
+
+			// Settled nodes already have their final cost.
+			if (neighbourNode->flags & DT_NODE_CLOSED)
+				continue;
+
+			// Cost to cross the current polygon from the shared portal towards the goal.
+			const float cost = bestNode->cost + m_filter->getCost(back->mid, bestNode->pos,
+																  neighbourRef, neighbourTile, neighbourPoly,
+																  bestRef, bestTile, bestPoly,
+																  nextRef, nextTile, nextPoly);
+
+			// The node is already in open list and the new result is worse, skip.
+			if ((neighbourNode->flags & DT_NODE_OPEN) && cost >= neighbourNode->total)
+				continue;
+
+			// Add or update the node.
+			dtVcopy(neighbourNode->pos, back->mid);
+			neighbourNode->pidx = m_nodePool->getNodeIdx(bestNode);
+			neighbourNode->id = neighbourRef;
+			neighbourNode->cost = cost;
+			neighbourNode->total = cost;
+
+			if (neighbourNode->flags & DT_NODE_OPEN)
+			{
+				// Already in open, update node location.
+				m_openList->modify(neighbourNode);
+			}
+			else
+			{
+				// Put the node in open list.
+				neighbourNode->flags |= DT_NODE_OPEN;
+				m_openList->push(neighbourNode);
+			}
+		}
+	}
+
+	// Exhausted all nodes, the field is complete.
+	if (m_openList->empty())
+		m_status = DT_SUCCESS | (m_status & DT_STATUS_DETAIL_MASK);
+
+	if (doneIters)
+		*doneIters = iter;
+
+	return m_status;
+}
+
+/// @par
+///
+/// The field spans the tiles of its polygons and of the filtered out polygons next to them.
+/// Adding or removing a tile changes the tiles linked to it, so a new tile next to the
+/// field invalidates it as well as a change of the polygon flags or areas in the field.
+bool dtFlowField::isValid() const
+{
+	if (!m_goalRef)
+		return false;
+	for (int i = 0; i < m_ntiles; ++i)
+	{
+		const dtMeshTile* tile = m_nav->getTileByRef(m_tiles[i]);
+		if (!tile || tile->stateVersion > m_stateVersion)
+			return false;
+	}
+	return true;
+}
+
+/// @par
+///
+/// Only the polygons whose cost is final can be queried, while the field is in progress
+/// the polygons closest to the goal become available first.
+dtStatus dtFlowField::getFlowTarget(dtPolyRef ref, float* target, dtPolyRef* nextRef, float* cost) const
+{
+	dtAssert(m_nodePool);
+
+	if (!ref || !target || !m_goalRef)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	// The costs and portals are stale once the tiles have changed.
+	if (!isValid())
+		return DT_FAILURE;
+
+	const dtNode* node = m_nodePool->findNode(ref, 0);
+	if (!node || !(node->flags & DT_NODE_CLOSED))
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	dtVcopy(target, node->pos);
+	if (nextRef)
+		*nextRef = node->pidx ? m_nodePool->getNodeAtIdx(node->pidx)->id : 0;
+	if (cost)
+		*cost = node->cost;
+
+	return DT_SUCCESS;
+}
+
+dtStatus dtFlowField::getFlowDirection(dtPolyRef ref, const float* pos, float* dir) const
+{
+	static const float MIN_TARGET_DIST = 0.01f;
+
+	if (!pos || !dir)
+		return DT_FAILURE | DT_INVALID_PARAM;
+
+	float target[3];
+	dtPolyRef nextRef = 0;
+	dtStatus status = getFlowTarget(ref, target, &nextRef, 0);
+	if (dtStatusFailed(status))
+		return status;
+
+	// When standing on the exit portal, steer towards the one after it.
+	if (nextRef && dtVdist2DSqr(pos, target) < dtSqr(MIN_TARGET_DIST))
+		getFlowTarget(nextRef, target, 0, 0);
+
+	dtVsub(dir, target, pos);
+	dir[1] = 0;
+	const float d = dtMathSqrtf(dtSqr(dir[0]) + dtSqr(dir[2]));
+	if (d > MIN_TARGET_DIST)
+		dtVscale(dir, dir, 1.0f / d);
+	else
+		dtVset(dir, 0,0,0);
+
+	return DT_SUCCESS;
+}
+
+
+dtFlowFieldCache::dtFlowFieldCache() :
+	m_entries(0),
+	m_maxFields(0),
+	m_tick(0)
+{
+}
+
+dtFlowFieldCache::~dtFlowFieldCache()
+{
+	purge();
+}
+
+void dtFlowFieldCache::purge()
+{
+	for (int i = 0; i < m_maxFields; ++i)
+	{
+		if (m_entries[i].field)
+		{
+			m_entries[i].field->~dtFlowField();
+			dtFree(m_entries[i].field);
+		}
+	}
+	dtFree(m_entries);
+	m_entries = 0;
+	m_maxFields = 0;
+}
+
+bool dtFlowFieldCache::init(const int maxFields, const int maxNodes, const int maxTiles, const dtNavMesh* nav)
+{
+	purge();
+
+	if (maxFields <= 0)
+		return false;
+
+	m_entries = (Entry*)dtAlloc(sizeof(Entry)*maxFields, DT_ALLOC_PERM_CROWD);
+	if (!m_entries)
+		return false;
+	memset(m_entries, 0, sizeof(Entry)*maxFields);
+	m_maxFields = maxFields;
+
+	for (int i = 0; i < m_maxFields; ++i)
+	{
+		void* mem = dtAlloc(sizeof(dtFlowField), DT_ALLOC_PERM_CROWD);
+		if (!mem)
+			return false;
+		m_entries[i].field = new(mem) dtFlowField;
+		if (!m_entries[i].field->init(nav, maxNodes, maxTiles))
+			return false;
+	}
+
+	m_tick = 0;
+
+	return true;
+}
+
+/// @par
+///
+/// The requests towards the same goal polygon share the field. The goal location of
+/// the request that started the field is used, and the field is restarted if it was
+/// computed with a different radius or filter.
+dtFlowField* dtFlowFieldCache::request(dtPolyRef goalRef, const float* goalPos, const float maxRadius,
+									   const dtQueryFilter* filter)
+{
+	m_tick++;
+
+	Entry* entry = 0;
+	for (int i = 0; i < m_maxFields; ++i)
+	{
+		if (m_entries[i].field->getGoalRef() == goalRef)
+		{
+			entry = &m_entries[i];
+			break;
+		}
+	}
+
+	if (entry && entry->field->isValid() &&
+		entry->field->getMaxRadius() == maxRadius && entry->field->getFilter() == filter)
+	{
+		entry->lastUsed = m_tick;
+		return entry->field;
+	}
+
+	// Replace the least recently used field.
+	if (!entry)
+	{
+		entry = &m_entries[0];
+		for (int i = 1; i < m_maxFields; ++i)
+		{
+			if (m_entries[i].lastUsed < entry->lastUsed)
+				entry = &m_entries[i];
+		}
+	}
+
+	if (dtStatusFailed(entry->field->setGoal(goalRef, goalPos, maxRadius, filter)))
+		return 0;
+	entry->lastUsed = m_tick;
+
+	return entry->field;
+}
+
+void dtFlowFieldCache::update(const int maxIters)
+{
+	int iterCount = maxIters;
+
+	for (int i = 0; i < m_maxFields; ++i)
+	{
+		dtFlowField* field = m_entries[i].field;
+		if (!field->getGoalRef())
+			continue;
+
+		// Restart the fields whose tiles have changed, or drop them if the goal is gone.
+		if (!field->isValid())
+		{
+			float goalPos[3];
+			dtVcopy(goalPos, field->getGoalPos());
+			field->setGoal(field->getGoalRef(), goalPos, field->getMaxRadius(), field->getFilter());
+			if (!field->getGoalRef())
+			{
+				m_entries[i].lastUsed = 0;
+				continue;
+			}
+		}
+
+		if (iterCount > 0 && dtStatusInProgress(field->getStatus()))
+		{
+			int iters = 0;
+			field->update(iterCount, &iters);
+			iterCount -= iters;
+		}
+	}
+}
@@ -71,7 +71,7 @@ static int isectRaySeg(const float* ap, const float* u,
 
 dtObstacleAvoidanceDebugData* dtAllocObstacleAvoidanceDebugData()
 {
-	void* mem = dtAlloc(sizeof(dtObstacleAvoidanceDebugData), DT_ALLOC_PERM);
+	void* mem = dtAlloc(sizeof(dtObstacleAvoidanceDebugData), DT_ALLOC_PERM_CROWD);
 	if (!mem) return 0;
 	return new(mem) dtObstacleAvoidanceDebugData;
 }
@@ -113,25 +113,25 @@ bool dtObstacleAvoidanceDebugData::init(const int maxSamples)
 	dtAssert(maxSamples);
 	m_maxSamples = maxSamples;
 
-	m_vel = (float*)dtAlloc(sizeof(float)*3*m_maxSamples, DT_ALLOC_PERM);
+	m_vel = (float*)dtAlloc(sizeof(float)*3*m_maxSamples, DT_ALLOC_PERM_CROWD);
 	if (!m_vel)
 		return false;
-	m_pen = (float*)dtAlloc(sizeof(float)*m_maxSamples, DT_ALLOC_PERM);
+	m_pen = (float*)dtAlloc(sizeof(float)*m_maxSamples, DT_ALLOC_PERM_CROWD);
 	if (!m_pen)
 		return false;
-	m_ssize = (float*)dtAlloc(sizeof(float)*m_maxSamples, DT_ALLOC_PERM);
+	m_ssize = (float*)dtAlloc(sizeof(float)*m_maxSamples, DT_ALLOC_PERM_CROWD);
 	if (!m_ssize)
 		return false;
-	m_vpen = (float*)dtAlloc(sizeof(float)*m_maxSamples, DT_ALLOC_PERM);
+	m_vpen = (float*)dtAlloc(sizeof(float)*m_maxSamples, DT_ALLOC_PERM_CROWD);
 	if (!m_vpen)
 		return false;
-	m_vcpen = (float*)dtAlloc(sizeof(float)*m_maxSamples, DT_ALLOC_PERM);
+	m_vcpen = (float*)dtAlloc(sizeof(float)*m_maxSamples, DT_ALLOC_PERM_CROWD);
 	if (!m_vcpen)
 		return false;
-	m_spen = (float*)dtAlloc(sizeof(float)*m_maxSamples, DT_ALLOC_PERM);
+	m_spen = (float*)dtAlloc(sizeof(float)*m_maxSamples, DT_ALLOC_PERM_CROWD);
 	if (!m_spen)
 		return false;
-	m_tpen = (float*)dtAlloc(sizeof(float)*m_maxSamples, DT_ALLOC_PERM);
+	m_tpen = (float*)dtAlloc(sizeof(float)*m_maxSamples, DT_ALLOC_PERM_CROWD);
 	if (!m_tpen)
 		return false;
 	
@@ -193,7 +193,7 @@ void dtObstacleAvoidanceDebugData::normalizeSamples()
 
 dtObstacleAvoidanceQuery* dtAllocObstacleAvoidanceQuery()
 {
-	void* mem = dtAlloc(sizeof(dtObstacleAvoidanceQuery), DT_ALLOC_PERM);
+	void* mem = dtAlloc(sizeof(dtObstacleAvoidanceQuery), DT_ALLOC_PERM_CROWD);
 	if (!mem) return 0;
 	return new(mem) dtObstacleAvoidanceQuery;
 }
@@ -229,14 +229,14 @@ bool dtObstacleAvoidanceQuery::init(const int maxCircles, const int maxSegments)
 {
 	m_maxCircles = maxCircles;
 	m_ncircles = 0;
-	m_circles = (dtObstacleCircle*)dtAlloc(sizeof(dtObstacleCircle)*m_maxCircles, DT_ALLOC_PERM);
+	m_circles = (dtObstacleCircle*)dtAlloc(sizeof(dtObstacleCircle)*m_maxCircles, DT_ALLOC_PERM_CROWD);
 	if (!m_circles)
 		return false;
 	memset(m_circles, 0, sizeof(dtObstacleCircle)*m_maxCircles);
 
 	m_maxSegments = maxSegments;
 	m_nsegments = 0;
-	m_segments = (dtObstacleSegment*)dtAlloc(sizeof(dtObstacleSegment)*m_maxSegments, DT_ALLOC_PERM);
+	m_segments = (dtObstacleSegment*)dtAlloc(sizeof(dtObstacleSegment)*m_maxSegments, DT_ALLOC_PERM_CROWD);
 	if (!m_segments)
 		return false;
 	memset(m_segments, 0, sizeof(dtObstacleSegment)*m_maxSegments);
@@ -155,6 +155,63 @@ int dtMergeCorridorStartShortcut(dtPolyRef* path, const int npath, const int max
 	return req+size;
 }
 
+int dtMergeCorridorDetour(dtPolyRef* path, const int npath, const int maxPath, const int first,
+						  const dtPolyRef* detour, const int ndetour)
+{
+	// Find the first detour polygon which rejoins the path after the start of the detour.
+	int joinPath = -1;
+	int joinDetour = -1;
+	for (int j = 1; j < ndetour && joinPath == -1; ++j)
+	{
+		for (int i = npath-1; i > first; --i)
+		{
+			if (path[i] == detour[j])
+			{
+				joinPath = i;
+				joinDetour = j;
+				break;
+			}
+		}
+	}
+	
+	// If the detour does not rejoin the path, return current path.
+	if (joinPath == -1 || joinDetour == -1)
+		return npath;
+	
+	// Find the last detour polygon which leaves the path at or before the start of the detour,
+	// so that the detour does not walk back and forth along the path.
+	int leavePath = first;
+	int leaveDetour = 0;
+	for (int j = joinDetour-1; j > 0 && leaveDetour == 0; --j)
+	{
+		for (int i = 0; i < first; ++i)
+		{
+			if (path[i] == detour[j])
+			{
+				leavePath = i;
+				leaveDetour = j;
+				break;
+			}
+		}
+	}
+	
+	// Concatenate paths, the polygon leaving the path is already in place.
+	const int req = dtMin(joinDetour - leaveDetour, maxPath - (leavePath+1));
+	const int orig = joinPath+1;
+	const int dest = leavePath+1 + req;
+	int size = dtMax(0, npath-orig);
+	if (dest+size > maxPath)
+		size = maxPath-dest;
+	if (size)
+		memmove(path+dest, path+orig, size*sizeof(dtPolyRef));
+	
+	// Store detour
+	for (int i = 0; i < req; ++i)
+		path[leavePath+1+i] = detour[leaveDetour+1+i];
+	
+	return dest+size;
+}
+
 /**
 @class dtPathCorridor
 @par
@@ -215,7 +272,7 @@ dtPathCorridor::~dtPathCorridor()
 bool dtPathCorridor::init(const int maxPath)
 {
 	dtAssert(!m_path);
-	m_path = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*maxPath, DT_ALLOC_PERM);
+	m_path = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*maxPath, DT_ALLOC_PERM_CROWD);
 	if (!m_path)
 		return false;
 	m_npath = 0;
@@ -579,6 +636,68 @@ bool dtPathCorridor::trimInvalidPath(dtPolyRef safeRef, const float* safePos,
 	return true;
 }
 
+/// @par
+///
+/// Only the first invalid section of the path is repaired: a search limited to a few
+/// iterations connects the last valid polygon before the section to the furthest valid
+/// polygon after it that it can reach, and the result is spliced into the path. The cost of the repair
+/// depends on the size of the change, not on the length of the path, so a closed door
+/// or a rebuilt tile does not cause a full replan for every agent going through it.
+///
+/// The repair fails if the first polygon or the last polygon of the path is invalid, 
+/// or if the search does not reach the rest of the path, in which case the path should 
+/// be replanned.
+bool dtPathCorridor::repairPath(dtNavMeshQuery* navquery, const dtQueryFilter* filter)
+{
+	dtAssert(navquery);
+	dtAssert(filter);
+	dtAssert(m_path);
+	
+	static const int MAX_ITER = 64;
+	static const int MAX_RES = 32;
+	
+	// Find the invalid section.
+	int first = 0;
+	while (first < m_npath && navquery->isValidPolyRef(m_path[first], filter))
+		first++;
+	if (first == m_npath)
+		return true;
+	if (first == 0)
+		return false;
+	int next = first+1;
+	while (next < m_npath && !navquery->isValidPolyRef(m_path[next], filter))
+		next++;
+	if (next == m_npath)
+		return false;
+	
+	// Search towards the target, the detour can rejoin the path anywhere after the invalid section.
+	// The detour leaves the path where the path entered the invalid section, use the middle of that
+	// portal as the start, or the closest point to the agent if the section is no longer linked.
+	const dtPolyRef startRef = m_path[first-1];
+	float startPos[3];
+	if (dtStatusFailed(navquery->getEdgeMidPoint(startRef, m_path[first], startPos)) &&
+		dtStatusFailed(navquery->closestPointOnPoly(startRef, m_pos, startPos, 0)))
+		return false;
+	
+	dtPolyRef res[MAX_RES];
+	int nres = 0;
+	navquery->initSlicedFindPath(startRef, m_path[m_npath-1], startPos, m_target, filter);
+	navquery->updateSlicedFindPath(MAX_ITER, 0);
+	dtStatus status = navquery->finalizeSlicedFindPathPartial(m_path+next, m_npath-next, res, &nres, MAX_RES);
+	if (dtStatusFailed(status) || nres < 2)
+		return false;
+	
+	bool rejoined = false;
+	for (int i = next; i < m_npath && !rejoined; ++i)
+		rejoined = m_path[i] == res[nres-1];
+	if (!rejoined)
+		return false;
+	
+	m_npath = dtMergeCorridorDetour(m_path, m_npath, m_maxPath, first-1, res, nres);
+	
+	return true;
+}
+
 /// @par
 ///
 /// The path can be invalidated if there are structural changes to the underlying navigation mesh, or the state of 
@@ -22,13 +22,15 @@
 #include "DetourNavMeshQuery.h"
 #include "DetourAlloc.h"
 #include "DetourCommon.h"
+#include "DetourTime.h"
 
 
 dtPathQueue::dtPathQueue() :
 	m_nextHandle(1),
 	m_maxPathSize(0),
 	m_queueHead(0),
-	m_navquery(0)
+	m_navquery(0),
+	m_itersPerUsec(0)
 {
 	for (int i = 0; i < MAX_QUEUE; ++i)
 		m_queue[i].path = 0;
@@ -64,7 +66,7 @@ bool dtPathQueue::init(const int maxPathSize, const int maxSearchNodeCount, dtNa
 	for (int i = 0; i < MAX_QUEUE; ++i)
 	{
 		m_queue[i].ref = DT_PATHQ_INVALID;
-		m_queue[i].path = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*m_maxPathSize, DT_ALLOC_PERM);
+		m_queue[i].path = (dtPolyRef*)dtAlloc(sizeof(dtPolyRef)*m_maxPathSize, DT_ALLOC_PERM_CROWD);
 		if (!m_queue[i].path)
 			return false;
 	}
@@ -74,13 +76,46 @@ bool dtPathQueue::init(const int maxPathSize, const int maxSearchNodeCount, dtNa
 	return true;
 }
 
+int dtPathQueue::getMemUsed() const
+{
+	int size = 0;
+	for (int i = 0; i < MAX_QUEUE; ++i)
+	{
+		if (m_queue[i].path)
+			size += (int)sizeof(dtPolyRef)*m_maxPathSize;
+	}
+	if (m_navquery)
+	{
+		dtNavMeshQueryMemoryStats stats;
+		m_navquery->getMemoryStats(&stats);
+		size += stats.totalSize;
+	}
+	return size;
+}
+
 void dtPathQueue::update(const int maxIters)
+{
+	updateQueue(maxIters, 0);
+}
+
+void dtPathQueue::updateTimed(const uint64_t maxTimeNs)
+{
+	static const int MAX_ITERS = 0x7fffffff;
+
+	// A zero deadline would disable the time limit.
+	const uint64_t deadline = dtMax(dtGetTimeNs() + maxTimeNs, (uint64_t)1);
+	updateQueue(MAX_ITERS, deadline);
+}
+
+void dtPathQueue::updateQueue(const int maxIters, const uint64_t deadline)
 {
 	static const int MAX_KEEP_ALIVE = 2; // in update ticks.
 
 	// Update path request until there is nothing to update
-	// or upto maxIters pathfinder iterations has been consumed.
+	// or upto maxIters pathfinder iterations has been consumed,
+	// or the clock has reached the deadline.
 	int iterCount = maxIters;
+	const uint64_t start = deadline ? dtGetTimeNs() : 0;
 	
 	for (int i = 0; i < MAX_QUEUE; ++i)
 	{
@@ -117,7 +152,17 @@ void dtPathQueue::update(const int maxIters)
 		if (dtStatusInProgress(q.status))
 		{
 			int iters = 0;
-			q.status = m_navquery->updateSlicedFindPath(iterCount, &iters);
+			if (deadline)
+			{
+				// The first search of the update always runs, so that a small budget still makes progress.
+				const uint64_t now = dtGetTimeNs();
+				if (now < deadline || iterCount == maxIters)
+					q.status = m_navquery->updateSlicedFindPathTimed(iterCount, now < deadline ? deadline - now : 0, &iters, 0);
+			}
+			else
+			{
+				q.status = m_navquery->updateSlicedFindPath(iterCount, &iters);
+			}
 			iterCount -= iters;
 		}
 		if (dtStatusSucceed(q.status))
@@ -125,11 +170,20 @@ void dtPathQueue::update(const int maxIters)
 			q.status = m_navquery->finalizeSlicedFindPath(q.path, &q.npath, m_maxPathSize);
 		}
 
-		if (iterCount <= 0)
+		if (iterCount <= 0 || (deadline && dtStatusInProgress(q.status)))
 			break;
 
 		m_queueHead++;
 	}
+
+	// Keep the previous rate when there was nothing to search.
+	const int iters = maxIters - iterCount;
+	if (deadline && iters > 0)
+	{
+		const uint64_t elapsed = dtGetTimeNs() - start;
+		if (elapsed > 0)
+			m_itersPerUsec = (float)iters * 1000.0f / (float)elapsed;
+	}
 }
 
 dtPathQueueRef dtPathQueue::request(dtPolyRef startRef, dtPolyRef endRef,
@@ -27,7 +27,7 @@
 
 dtProximityGrid* dtAllocProximityGrid()
 {
-	void* mem = dtAlloc(sizeof(dtProximityGrid), DT_ALLOC_PERM);
+	void* mem = dtAlloc(sizeof(dtProximityGrid), DT_ALLOC_PERM_CROWD);
 	if (!mem) return 0;
 	return new(mem) dtProximityGrid;
 }
@@ -73,14 +73,14 @@ bool dtProximityGrid::init(const int poolSize, const float cellSize)
 	
 	// Allocate hashs buckets
 	m_bucketsSize = dtNextPow2(poolSize);
-	m_buckets = (unsigned short*)dtAlloc(sizeof(unsigned short)*m_bucketsSize, DT_ALLOC_PERM);
+	m_buckets = (unsigned short*)dtAlloc(sizeof(unsigned short)*m_bucketsSize, DT_ALLOC_PERM_CROWD);
 	if (!m_buckets)
 		return false;
 	
 	// Allocate pool of items.
 	m_poolSize = poolSize;
 	m_poolHead = 0;
-	m_pool = (Item*)dtAlloc(sizeof(Item)*m_poolSize, DT_ALLOC_PERM);
+	m_pool = (Item*)dtAlloc(sizeof(Item)*m_poolSize, DT_ALLOC_PERM_CROWD);
 	if (!m_pool)
 		return false;
 	
@@ -1,6 +1,18 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "catch.hpp"
 
 #include "DetourCommon.h"
+#include "DetourMath.h"
+#include "DetourNode.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshBuilder.h"
+#include "DetourNavMeshQuery.h"
+#include "DetourFindPath.h"
+
+#include "Tests_DetourGrid.h"
+#include "Tests_DetourClock.h"
 
 TEST_CASE("dtRandomPointInConvexPoly")
 {
@@ -31,3 +43,1814 @@ TEST_CASE("dtRandomPointInConvexPoly")
 		REQUIRE(out[2] == Approx(0));
 	}
 }
+
+TEST_CASE("dtNodeQueue")
+{
+	SECTION("Pops nodes in order of total cost after modify")
+	{
+		dtNodePool pool(16, 8);
+		dtNodeQueue queue(16);
+
+		const float totals[] = { 5, 3, 8, 1, 9, 7, 2, 6 };
+		const int ntotals = sizeof(totals) / sizeof(totals[0]);
+		dtNode* nodes[ntotals];
+		for (int i = 0; i < ntotals; ++i)
+		{
+			nodes[i] = pool.getNode((dtPolyRef)(i + 1));
+			nodes[i]->total = totals[i];
+			queue.push(nodes[i]);
+		}
+
+		// Decrease the cost of a couple of nodes that are deep in the heap.
+		nodes[4]->total = 0.5f;
+		queue.modify(nodes[4]);
+		nodes[2]->total = 2.5f;
+		queue.modify(nodes[2]);
+
+		const float expected[] = { 0.5f, 1, 2, 2.5f, 3, 5, 6, 7 };
+		for (int i = 0; i < ntotals; ++i)
+		{
+			REQUIRE(!queue.empty());
+			dtNode* node = queue.pop();
+			REQUIRE(node->total == Approx(expected[i]));
+		}
+		REQUIRE(queue.empty());
+	}
+}
+
+TEST_CASE("dtNodeScratch")
+{
+	SECTION("Grows up to the limit and keeps the size")
+	{
+		dtNodeScratch scratch;
+		REQUIRE(scratch.init(4, 10));
+		dtNodePool* pool = scratch.getNodePool();
+		for (int i = 0; i < 4; ++i)
+			REQUIRE(pool->getNode((dtPolyRef)(i + 1)) != 0);
+		REQUIRE(pool->getNode(5) == 0);
+
+		REQUIRE(scratch.grow());
+		REQUIRE(scratch.getMaxNodes() == 8);
+		REQUIRE(scratch.grow());
+		REQUIRE(scratch.getMaxNodes() == 10);
+		REQUIRE(!scratch.grow());
+		REQUIRE(scratch.getHighWaterMark() == 4);
+
+		REQUIRE(scratch.init(4, 10));
+		REQUIRE(scratch.getMaxNodes() == 10);
+		REQUIRE(scratch.getHighWaterMark() == 0);
+	}
+
+	SECTION("Pops nodes in the order they were pushed")
+	{
+		dtNodeScratch scratch;
+		REQUIRE(scratch.init(8, 8));
+		scratch.clear();
+		dtNodePool* pool = scratch.getNodePool();
+
+		const dtPolyRef refs[] = { 7, 3, 5, 1 };
+		for (int i = 0; i < 4; ++i)
+			scratch.push(pool->getNode(refs[i]));
+		for (int i = 0; i < 4; ++i)
+		{
+			REQUIRE(!scratch.empty());
+			REQUIRE(scratch.pop()->id == refs[i]);
+		}
+		REQUIRE(scratch.empty());
+	}
+}
+
+TEST_CASE("dtArena")
+{
+	SECTION("Returns memory in reverse order and overflows to the allocator")
+	{
+		dtArena arena;
+		REQUIRE(arena.init(256));
+
+		void* a = dtAllocTemp(&arena, 40);
+		void* b = dtAllocTemp(&arena, 40);
+		REQUIRE(arena.owns(a));
+		REQUIRE(arena.owns(b));
+		REQUIRE(((size_t)b & 15) == 0);
+		const size_t used = arena.getUsed();
+
+		void* c = dtAllocTemp(&arena, 1024);
+		REQUIRE(c != 0);
+		REQUIRE(!arena.owns(c));
+		REQUIRE(arena.getOverflowCount() == 1);
+		dtFreeTemp(&arena, c);
+		REQUIRE(arena.getUsed() == used);
+
+		// Out of order free is released by reset.
+		dtFreeTemp(&arena, a);
+		REQUIRE(arena.getUsed() == used);
+		dtFreeTemp(&arena, b);
+		dtFreeTemp(&arena, a);
+		REQUIRE(arena.getUsed() == 0);
+		REQUIRE(arena.getHighWaterMark() == used);
+
+		dtAllocTemp(&arena, 16);
+		arena.reset();
+		REQUIRE(arena.getUsed() == 0);
+	}
+}
+
+/// A filter type for findPathT that passes the same polygons and costs as a dtQueryFilter.
+struct TestPathFilter
+{
+	float waterCost;
+
+	bool passFilter(const dtPolyRef /*ref*/, const dtMeshTile* /*tile*/, const dtPoly* poly) const
+	{
+		return (poly->flags & 1) != 0;
+	}
+
+	float getCost(const float* pa, const float* pb,
+				  const dtPolyRef /*prevRef*/, const dtMeshTile* /*prevTile*/, const dtPoly* /*prevPoly*/,
+				  const dtPolyRef /*curRef*/, const dtMeshTile* /*curTile*/, const dtPoly* curPoly,
+				  const dtPolyRef /*nextRef*/, const dtMeshTile* /*nextTile*/, const dtPoly* /*nextPoly*/) const
+	{
+		return dtVdist(pa, pb) * (curPoly->getArea() == 1 ? waterCost : 1.0f);
+	}
+};
+
+TEST_CASE("dtNavMeshQuery::findPathT")
+{
+	dtNavMesh* nav = createGridNavMesh(GRID_LAYOUT, GRID_SIZE);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+	dtQueryFilter filter;
+	filter.setAreaCost(1, 4.0f);
+	TestPathFilter testFilter;
+	testFilter.waterCost = 4.0f;
+
+	SECTION("Finds the same paths as findPath")
+	{
+		const int maxPath = 64;
+		dtPolyRef path[maxPath];
+		dtPolyRef pathT[maxPath];
+		for (int i = 0; i < GRID_SIZE*GRID_SIZE; ++i)
+		{
+			float startPos[3];
+			const dtPolyRef startRef = getGridCell(nav, i % GRID_SIZE, i / GRID_SIZE, startPos);
+			if (!startRef)
+				continue;
+			for (int j = 0; j < GRID_SIZE*GRID_SIZE; j += 3)
+			{
+				float endPos[3];
+				const dtPolyRef endRef = getGridCell(nav, j % GRID_SIZE, j / GRID_SIZE, endPos);
+				if (!endRef)
+					continue;
+
+				int npath = 0;
+				const dtStatus status = query->findPath(startRef, endRef, startPos, endPos, &filter, path, &npath, maxPath);
+				REQUIRE(dtStatusSucceed(status));
+
+				int npathT = 0;
+				REQUIRE(query->findPathT(startRef, endRef, startPos, endPos, &testFilter, pathT, &npathT, maxPath) == status);
+				REQUIRE(npathT == npath);
+				REQUIRE(memcmp(path, pathT, sizeof(dtPolyRef)*npath) == 0);
+				REQUIRE(path[npath-1] == endRef);
+			}
+		}
+	}
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+/// Runs a straight path query in chunks of a few vertices, consuming them like a caller of
+/// updateStraightPath would. Returns the status of the last update.
+static dtStatus streamStraightPath(const dtNavMeshQuery* query, const float* startPos, const float* endPos,
+								   const dtPolyRef* path, const int npath, const int options, const int chunkSize,
+								   float* straight, unsigned char* straightFlags, dtPolyRef* straightRefs,
+								   int* straightCount, const int maxStraight)
+{
+	*straightCount = 0;
+	dtStraightPathState state;
+	dtStatus status = query->initStraightPath(startPos, endPos, path, npath, &state, options);
+	if (dtStatusFailed(status))
+		return status;
+
+	float chunk[4*3];
+	unsigned char chunkFlags[4];
+	dtPolyRef chunkRefs[4];
+	int nchunk = 0;
+	int kept = 0;
+	for (int iter = 0; iter < maxStraight*4; ++iter)
+	{
+		status = query->updateStraightPath(&state, path, npath, chunk, chunkFlags, chunkRefs, &nchunk, chunkSize);
+		if (dtStatusFailed(status))
+			return status;
+
+		// The kept vertex may have been updated by a merged vertex.
+		int base = *straightCount - kept;
+		for (int i = 0; i < nchunk; ++i)
+		{
+			if (i == 0 && !kept && base > 0 && dtVequal(&chunk[0], &straight[(base-1)*3]))
+			{
+				// The arrays were emptied, merge a vertex equal to the last one like the query does.
+				base--;
+			}
+			REQUIRE(base + i < maxStraight);
+			dtVcopy(&straight[(base+i)*3], &chunk[i*3]);
+			straightFlags[base+i] = chunkFlags[i];
+			straightRefs[base+i] = chunkRefs[i];
+		}
+		*straightCount = base + nchunk;
+
+		if (!dtStatusInProgress(status))
+			return status;
+
+		// Keep the last vertex when there is room for more.
+		if (chunkSize > 1 && nchunk > 0)
+		{
+			dtVcopy(&chunk[0], &chunk[(nchunk-1)*3]);
+			chunkFlags[0] = chunkFlags[nchunk-1];
+			chunkRefs[0] = chunkRefs[nchunk-1];
+			nchunk = 1;
+			kept = 1;
+		}
+		else
+		{
+			nchunk = 0;
+			kept = 0;
+		}
+	}
+	FAIL("The straight path query did not finish.");
+	return DT_FAILURE;
+}
+
+TEST_CASE("dtNavMeshQuery::updateStraightPath")
+{
+	dtNavMesh* nav = createGridNavMesh(GRID_LAYOUT, GRID_SIZE);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+	dtQueryFilter filter;
+
+	const int maxPath = 64;
+	const int maxStraight = 64;
+	dtPolyRef path[maxPath];
+	float straight[maxStraight*3];
+	unsigned char straightFlags[maxStraight];
+	dtPolyRef straightRefs[maxStraight];
+	float streamed[maxStraight*3];
+	unsigned char streamedFlags[maxStraight];
+	dtPolyRef streamedRefs[maxStraight];
+	const int options[3] = { 0, DT_STRAIGHTPATH_AREA_CROSSINGS, DT_STRAIGHTPATH_ALL_CROSSINGS };
+
+	SECTION("Returns the same vertices in chunks as findStraightPath")
+	{
+		int nqueries = 0;
+		for (int i = 0; i < GRID_SIZE*GRID_SIZE; i += 3)
+		{
+			float startPos[3];
+			const dtPolyRef startRef = getGridCell(nav, i % GRID_SIZE, i / GRID_SIZE, startPos);
+			if (!startRef)
+				continue;
+			startPos[0] += 0.3f;
+			for (int j = 1; j < GRID_SIZE*GRID_SIZE; j += 5)
+			{
+				float endPos[3];
+				const dtPolyRef endRef = getGridCell(nav, j % GRID_SIZE, j / GRID_SIZE, endPos);
+				if (!endRef)
+					continue;
+				endPos[2] -= 0.2f;
+				int npath = 0;
+				REQUIRE(query->findPath(startRef, endRef, startPos, endPos, &filter, path, &npath, maxPath) == DT_SUCCESS);
+
+				for (int o = 0; o < 3; ++o)
+				{
+					int nstraight = 0;
+					const dtStatus status = query->findStraightPath(startPos, endPos, path, npath, straight, straightFlags, straightRefs,
+																	&nstraight, maxStraight, options[o]);
+					REQUIRE(status == DT_SUCCESS);
+					REQUIRE(straightFlags[nstraight-1] == DT_STRAIGHTPATH_END);
+
+					for (int chunkSize = 1; chunkSize <= 3; ++chunkSize)
+					{
+						int nstreamed = 0;
+						REQUIRE(streamStraightPath(query, startPos, endPos, path, npath, options[o], chunkSize,
+												   streamed, streamedFlags, streamedRefs, &nstreamed, maxStraight) == status);
+						REQUIRE(nstreamed == nstraight);
+						REQUIRE(memcmp(streamed, straight, sizeof(float)*3*nstraight) == 0);
+						REQUIRE(memcmp(streamedFlags, straightFlags, nstraight) == 0);
+						REQUIRE(memcmp(streamedRefs, straightRefs, sizeof(dtPolyRef)*nstraight) == 0);
+					}
+					nqueries++;
+				}
+			}
+		}
+		REQUIRE(nqueries > 100);
+	}
+
+	SECTION("Fills a full buffer without overflowing on a partial path")
+	{
+		// Water to water, the path crosses a few polygons.
+		float startPos[3];
+		float endPos[3];
+		const dtPolyRef startRef = getGridCell(nav, 0, 6, startPos);
+		const dtPolyRef endRef = getGridCell(nav, 6, 2, endPos);
+		int npath = 0;
+		REQUIRE(query->findPath(startRef, endRef, startPos, endPos, &filter, path, &npath, maxPath) == DT_SUCCESS);
+		REQUIRE(npath > 6);
+
+		// Cut the corridor with a polygon that is not valid, the path ends before it.
+		dtPolyRef cutPath[maxPath];
+		memcpy(cutPath, path, sizeof(dtPolyRef)*npath);
+		cutPath[npath-2] = 0;
+
+		for (int o = 0; o < 3; ++o)
+		{
+			int nfull = 0;
+			const dtStatus fullStatus = query->findStraightPath(startPos, endPos, cutPath, npath, straight, straightFlags, straightRefs,
+																&nfull, maxStraight, options[o]);
+			REQUIRE(fullStatus == (DT_SUCCESS | DT_PARTIAL_RESULT));
+			REQUIRE(nfull > 1);
+
+			for (int maxCount = 1; maxCount <= nfull+1; ++maxCount)
+			{
+				// Guard the vertex past the end of the buffer.
+				for (int i = 0; i < maxStraight*3; ++i)
+					streamed[i] = -1.0f;
+				memset(streamedFlags, 0xff, sizeof(streamedFlags));
+				memset(streamedRefs, 0xff, sizeof(streamedRefs));
+
+				int n = 0;
+				const dtStatus status = query->findStraightPath(startPos, endPos, cutPath, npath, streamed, streamedFlags, streamedRefs,
+																&n, maxCount, options[o]);
+				REQUIRE(dtStatusSucceed(status));
+				REQUIRE(n == dtMin(maxCount, nfull));
+				REQUIRE(dtStatusDetail(status, DT_BUFFER_TOO_SMALL) == (maxCount <= nfull));
+				// The path is only known to be partial once the funnel reaches the cut.
+				if (maxCount >= nfull)
+					REQUIRE(dtStatusDetail(status, DT_PARTIAL_RESULT));
+				REQUIRE(streamed[maxCount*3] == -1.0f);
+				REQUIRE(streamedFlags[maxCount] == 0xff);
+				REQUIRE(streamedRefs[maxCount] == (dtPolyRef)-1);
+				REQUIRE(memcmp(streamed, straight, sizeof(float)*3*n) == 0);
+				REQUIRE(memcmp(streamedRefs, straightRefs, sizeof(dtPolyRef)*(n-1)) == 0);
+			}
+		}
+	}
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+/// A test layout where the cells form a tree, so there is a single path between two cells.
+static const char* GRID_TREE_LAYOUT =
+	"..~....."
+	".#.#.#.#"
+	".#~#.#.#"
+	"~#.#~#.#"
+	".#.#.#.#"
+	".#.#~#.#"
+	".#~#.#.#"
+	".#.#.#.#";
+
+/// Returns the cost of a path through the portal mid points of its polygons.
+static float getPathCost(const dtNavMesh* nav, const dtQueryFilter* filter,
+						 const dtPolyRef* path, const int npath, const float* startPos, const float* endPos)
+{
+	float pos[3];
+	dtVcopy(pos, startPos);
+	float cost = 0.0f;
+	for (int i = 0; i < npath; ++i)
+	{
+		float next[3];
+		if (i+1 < npath)
+		{
+			// The portal is the edge shared by the two quads.
+			const dtMeshTile* tile = 0;
+			const dtPoly* poly = 0;
+			const dtPoly* nextPoly = 0;
+			nav->getTileAndPolyByRefUnsafe(path[i], &tile, &poly);
+			nav->getTileAndPolyByRefUnsafe(path[i+1], &tile, &nextPoly);
+			dtVset(next, 0.0f, 0.0f, 0.0f);
+			for (int j = 0; j < poly->vertCount; ++j)
+			{
+				for (int k = 0; k < nextPoly->vertCount; ++k)
+				{
+					if (poly->verts[j] == nextPoly->verts[k])
+						dtVmad(next, next, &tile->verts[poly->verts[j]*3], 0.5f);
+				}
+			}
+		}
+		else
+		{
+			dtVcopy(next, endPos);
+		}
+		unsigned char area = 0;
+		nav->getPolyArea(path[i], &area);
+		cost += dtVdist(pos, next) * filter->getAreaCost(area);
+		dtVcopy(pos, next);
+	}
+	return cost;
+}
+
+TEST_CASE("dtNavMeshQuery::findPathsToMany")
+{
+	dtNavMesh* nav = createGridNavMesh(GRID_TREE_LAYOUT, GRID_SIZE);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+	dtQueryFilter filter;
+	filter.setAreaCost(1, 4.0f);
+
+	const int maxTargets = GRID_SIZE*GRID_SIZE;
+	const int maxPath = 32;
+	dtPolyRef targetRefs[maxTargets];
+	float targetPos[maxTargets*3];
+	int ntargets = 0;
+	for (int i = 0; i < GRID_SIZE*GRID_SIZE; ++i)
+	{
+		targetRefs[ntargets] = getGridCell(nav, i % GRID_SIZE, i / GRID_SIZE, &targetPos[ntargets*3]);
+		if (targetRefs[ntargets])
+			ntargets++;
+	}
+
+	float costs[maxTargets];
+	int pathCounts[maxTargets];
+	static dtPolyRef paths[maxTargets*maxPath];
+	dtPolyRef path[maxPath];
+
+	SECTION("Finds the same paths as findPath")
+	{
+		for (int s = 0; s < ntargets; s += 5)
+		{
+			const float* startPos = &targetPos[s*3];
+			const dtStatus status = query->findPathsToMany(targetRefs[s], startPos, targetRefs, targetPos, ntargets, 0,
+														   &filter, costs, paths, pathCounts, maxPath);
+			REQUIRE(status == DT_SUCCESS);
+			for (int i = 0; i < ntargets; ++i)
+			{
+				const dtPolyRef* manyPath = &paths[i*maxPath];
+				REQUIRE(pathCounts[i] > 0);
+				REQUIRE(manyPath[0] == targetRefs[s]);
+				REQUIRE(manyPath[pathCounts[i]-1] == targetRefs[i]);
+				REQUIRE(costs[i] == Approx(getPathCost(nav, &filter, manyPath, pathCounts[i], startPos, &targetPos[i*3])));
+
+				int npath = 0;
+				REQUIRE(query->findPath(targetRefs[s], targetRefs[i], startPos, &targetPos[i*3], &filter, path, &npath, maxPath) == DT_SUCCESS);
+				REQUIRE(npath == pathCounts[i]);
+				REQUIRE(memcmp(path, manyPath, sizeof(dtPolyRef)*npath) == 0);
+			}
+		}
+	}
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+/// Runs an any-angle search to completion with the sliced path query.
+static dtStatus findAnyAnglePath(dtNavMeshQuery* query, const dtPolyRef startRef, const dtPolyRef endRef,
+								 const float* startPos, const float* endPos, const dtQueryFilter* filter,
+								 dtPolyRef* path, int* npath, const int maxPath)
+{
+	dtStatus status = query->initSlicedFindPath(startRef, endRef, startPos, endPos, filter, DT_FINDPATH_ANY_ANGLE);
+	while (dtStatusInProgress(status))
+		status = query->updateSlicedFindPath(16, 0);
+	if (dtStatusFailed(status))
+		return status;
+	return query->finalizeSlicedFindPath(path, npath, maxPath);
+}
+
+TEST_CASE("dtNavMeshQuery::initSlicedFindPath")
+{
+	dtQueryFilter filter;
+	filter.setAreaCost(1, 4.0f);
+	const int maxPath = 64;
+	dtPolyRef path[maxPath];
+
+	SECTION("Allocates the line of sight cache on the first any-angle search")
+	{
+		dtNavMesh* nav = createGridNavMesh(GRID_LAYOUT, GRID_SIZE);
+		dtNavMeshQuery* query = dtAllocNavMeshQuery();
+		REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+		float startPos[3];
+		float endPos[3];
+		const dtPolyRef startRef = getGridCell(nav, 0, 0, startPos);
+		const dtPolyRef endRef = getGridCell(nav, 7, 7, endPos);
+
+		dtNavMeshQueryMemoryStats stats;
+		query->getMemoryStats(&stats);
+		REQUIRE(stats.raycastCacheSize == 0);
+
+		int npath = 0;
+		dtStatus status = query->initSlicedFindPath(startRef, endRef, startPos, endPos, &filter, 0);
+		while (dtStatusInProgress(status))
+			status = query->updateSlicedFindPath(16, 0);
+		REQUIRE(query->finalizeSlicedFindPath(path, &npath, maxPath) == DT_SUCCESS);
+		query->getMemoryStats(&stats);
+		REQUIRE(stats.raycastCacheSize == 0);
+
+		REQUIRE(findAnyAnglePath(query, startRef, endRef, startPos, endPos, &filter, path, &npath, maxPath) == DT_SUCCESS);
+		query->getMemoryStats(&stats);
+		const int cacheSize = stats.raycastCacheSize;
+		REQUIRE(cacheSize > 0);
+
+		// The cache is kept while it fits the node pool.
+		REQUIRE(dtStatusSucceed(query->init(nav, 128)));
+		query->getMemoryStats(&stats);
+		REQUIRE(stats.raycastCacheSize == cacheSize);
+		REQUIRE(dtStatusSucceed(query->init(nav, 1024)));
+		query->getMemoryStats(&stats);
+		REQUIRE(stats.raycastCacheSize == 0);
+		REQUIRE(findAnyAnglePath(query, startRef, endRef, startPos, endPos, &filter, path, &npath, maxPath) == DT_SUCCESS);
+		query->getMemoryStats(&stats);
+		REQUIRE(stats.raycastCacheSize > cacheSize);
+
+		dtFreeNavMeshQuery(query);
+		dtFreeNavMesh(nav);
+	}
+
+	SECTION("Finds the same any-angle paths as the search without the cache")
+	{
+		// The cells of the paths found before the line of sight tests were cached.
+		struct ExpectedPath
+		{
+			int layout;
+			int cells[GRID_SIZE*GRID_SIZE];
+			int ncells;
+		};
+		const char* const layouts[2] = { GRID_LAYOUT, GRID_TREE_LAYOUT };
+		const ExpectedPath expected[] =
+		{
+			{ 0, { 0, 8, 16, 17, 25, 33, 41, 49, 50, 51, 52, 60, 61, 62, 63 }, 15 },
+			{ 0, { 16, 17, 18, 19, 27, 35, 36, 37, 29, 30, 31, 39, 47 }, 13 },
+			{ 0, { 63, 55, 47, 39, 31, 23, 15, 14, 13, 5, 4, 3, 2, 1, 0 }, 15 },
+			{ 1, { 0, 1, 2, 3, 4, 5, 6, 14, 22, 30, 38, 46, 54, 62 }, 14 },
+			{ 1, { 2, 3, 4, 12, 20, 28, 36, 44, 52, 60 }, 10 },
+			{ 1, { 7, 6, 5, 4, 3, 2, 1, 0, 8, 16, 24, 32, 40, 48, 56 }, 15 },
+		};
+
+		for (int l = 0; l < 2; ++l)
+		{
+			dtNavMesh* nav = createGridNavMesh(layouts[l], GRID_SIZE);
+			dtNavMeshQuery* query = dtAllocNavMeshQuery();
+			REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+			// A small node pool gets a small cache, where the tests of a search collide more often.
+			dtNavMeshQuery* smallQuery = dtAllocNavMeshQuery();
+			REQUIRE(dtStatusSucceed(smallQuery->init(nav, GRID_SIZE*GRID_SIZE)));
+
+			for (int i = 0; i < (int)(sizeof(expected)/sizeof(expected[0])); ++i)
+			{
+				const ExpectedPath& exp = expected[i];
+				if (exp.layout != l)
+					continue;
+				float startPos[3];
+				float endPos[3];
+				const int start = exp.cells[0];
+				const int end = exp.cells[exp.ncells-1];
+				const dtPolyRef startRef = getGridCell(nav, start % GRID_SIZE, start / GRID_SIZE, startPos);
+				const dtPolyRef endRef = getGridCell(nav, end % GRID_SIZE, end / GRID_SIZE, endPos);
+				int npath = 0;
+				REQUIRE(findAnyAnglePath(query, startRef, endRef, startPos, endPos, &filter, path, &npath, maxPath) == DT_SUCCESS);
+				REQUIRE(npath == exp.ncells);
+				for (int j = 0; j < npath; ++j)
+				{
+					float pos[3];
+					REQUIRE(path[j] == getGridCell(nav, exp.cells[j] % GRID_SIZE, exp.cells[j] / GRID_SIZE, pos));
+				}
+			}
+
+			// The cached tests of a search do not leak into the next one.
+			dtPolyRef smallPath[maxPath];
+			for (int i = 0; i < GRID_SIZE*GRID_SIZE; ++i)
+			{
+				float startPos[3];
+				const dtPolyRef startRef = getGridCell(nav, i % GRID_SIZE, i / GRID_SIZE, startPos);
+				if (!startRef)
+					continue;
+				for (int j = 0; j < GRID_SIZE*GRID_SIZE; j += 3)
+				{
+					float endPos[3];
+					const dtPolyRef endRef = getGridCell(nav, j % GRID_SIZE, j / GRID_SIZE, endPos);
+					if (!endRef)
+						continue;
+
+					int npath = 0;
+					const dtStatus status = findAnyAnglePath(query, startRef, endRef, startPos, endPos, &filter, path, &npath, maxPath);
+					REQUIRE(dtStatusSucceed(status));
+					int nsmallPath = 0;
+					REQUIRE(findAnyAnglePath(smallQuery, startRef, endRef, startPos, endPos, &filter, smallPath, &nsmallPath, maxPath) == status);
+					REQUIRE(nsmallPath == npath);
+					REQUIRE(memcmp(path, smallPath, sizeof(dtPolyRef)*npath) == 0);
+				}
+			}
+
+			dtFreeNavMeshQuery(smallQuery);
+			dtFreeNavMeshQuery(query);
+			dtFreeNavMesh(nav);
+		}
+	}
+}
+
+TEST_CASE("dtNavMeshQuery::findNearestPolyBatch")
+{
+	// 2x2 tiles of layers stacked 2 units apart, more tiles than a single cell can hold.
+	const int tilesPerSide = 2;
+	const int layers = 10;
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	params.tileWidth = (float)GRID_SIZE;
+	params.tileHeight = (float)GRID_SIZE;
+	params.maxTiles = tilesPerSide*tilesPerSide*layers;
+	params.maxPolys = GRID_SIZE*GRID_SIZE;
+	dtNavMesh* nav = dtAllocNavMesh();
+	REQUIRE(dtStatusSucceed(nav->init(&params)));
+	for (int ty = 0; ty < tilesPerSide; ++ty)
+	{
+		for (int tx = 0; tx < tilesPerSide; ++tx)
+		{
+			for (int layer = 0; layer < layers; ++layer)
+			{
+				unsigned char* data = 0;
+				int dataSize = 0;
+				createGridTileData(GRID_LAYOUT, GRID_SIZE, tx, ty, layer, layer*2.0f, &data, &dataSize);
+				REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+			}
+		}
+	}
+
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+	dtQueryFilter filter;
+
+	// Points around the corner shared by the tiles, so each search box touches all of them.
+	const int maxPoints = 128;
+	const float halfExtents[3] = { 1.5f, (float)(layers*2), 1.5f };
+	float points[maxPoints*3];
+	int npoints = 0;
+	for (int i = 0; i < maxPoints; ++i)
+	{
+		const float x = GRID_SIZE - 1.5f + (i % 4) + 0.25f;
+		const float z = GRID_SIZE - 1.5f + ((i / 4) % 4) + 0.25f;
+		const float y = (i / 16) * 2.5f - 0.2f;
+		dtVset(&points[npoints*3], x, y, z);
+		npoints++;
+	}
+
+	dtPolyRef refs[maxPoints];
+	float nearest[maxPoints*3];
+	dtPolyRef batchRefs[maxPoints];
+	float batchNearest[maxPoints*3];
+	int nfound = 0;
+	for (int i = 0; i < npoints; ++i)
+	{
+		dtVset(&nearest[i*3], 0.0f, 0.0f, 0.0f);
+		REQUIRE(dtStatusSucceed(query->findNearestPoly(&points[i*3], halfExtents, &filter, &refs[i], &nearest[i*3])));
+		if (refs[i])
+			nfound++;
+	}
+	REQUIRE(nfound > npoints/2);
+	memset(batchNearest, 0, sizeof(batchNearest));
+
+	SECTION("Finds the same polygons as findNearestPoly")
+	{
+		REQUIRE(dtStatusSucceed(query->findNearestPolyBatch(points, npoints, halfExtents, &filter, batchRefs, batchNearest)));
+		for (int i = 0; i < npoints; ++i)
+		{
+			REQUIRE(batchRefs[i] == refs[i]);
+			REQUIRE(memcmp(&batchNearest[i*3], &nearest[i*3], sizeof(float)*3) == 0);
+		}
+	}
+
+	SECTION("Keeps the hints the points are still over")
+	{
+		dtPolyRef hints[maxPoints];
+		for (int i = 0; i < npoints; ++i)
+		{
+			// Give the other half of the points the polygon of another point as hint.
+			hints[i] = (i & 1) ? refs[(i + 17) % npoints] : refs[i];
+		}
+
+		dtArena arena;
+		REQUIRE(arena.init(4096));
+		query->setTempArena(&arena);
+		REQUIRE(dtStatusSucceed(query->findNearestPolyBatch(points, npoints, halfExtents, &filter, batchRefs, batchNearest, hints)));
+		query->setTempArena(0);
+		REQUIRE(arena.getUsed() == 0);
+
+		for (int i = 0; i < npoints; ++i)
+		{
+			if (hints[i] && hints[i] == refs[i])
+			{
+				// The fast path returns the closest point on the hint.
+				float closest[3];
+				REQUIRE(dtStatusSucceed(query->closestPointOnPoly(hints[i], &points[i*3], closest, 0)));
+				REQUIRE(batchRefs[i] == hints[i]);
+				REQUIRE(dtVdist(&batchNearest[i*3], closest) == Approx(0.0f));
+			}
+			else
+			{
+				REQUIRE(batchRefs[i] == refs[i]);
+				if (refs[i])
+					REQUIRE(dtVdist(&batchNearest[i*3], &nearest[i*3]) == Approx(0.0f));
+			}
+		}
+	}
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+/// Builds a tile of DETAIL_CELLS x DETAIL_CELLS quads at zero height, with a detail mesh that
+/// raises the center of each quad to a different height.
+static const int DETAIL_CELLS = 4;
+
+static void createDetailTileData(const bool compact, unsigned char** data, int* dataSize)
+{
+	const int nvp = 4;
+	const int vertsPerRow = DETAIL_CELLS + 1;
+	const int npolys = DETAIL_CELLS*DETAIL_CELLS;
+	unsigned short verts[vertsPerRow*vertsPerRow*3];
+	unsigned short polys[npolys*nvp*2];
+	unsigned short polyFlags[npolys];
+	unsigned char polyAreas[npolys];
+	unsigned int detailMeshes[npolys*4];
+	float detailVerts[npolys*(nvp+1)*3];
+	unsigned char detailTris[npolys*4*4];
+
+	for (int z = 0; z <= DETAIL_CELLS; ++z)
+	{
+		for (int x = 0; x <= DETAIL_CELLS; ++x)
+		{
+			unsigned short* v = &verts[(z*vertsPerRow + x)*3];
+			v[0] = (unsigned short)x;
+			v[1] = 0;
+			v[2] = (unsigned short)z;
+		}
+	}
+
+	for (int z = 0; z < DETAIL_CELLS; ++z)
+	{
+		for (int x = 0; x < DETAIL_CELLS; ++x)
+		{
+			const int ip = z*DETAIL_CELLS + x;
+			unsigned short* p = &polys[ip*nvp*2];
+			p[0] = (unsigned short)(z*vertsPerRow + x);
+			p[1] = (unsigned short)((z+1)*vertsPerRow + x);
+			p[2] = (unsigned short)((z+1)*vertsPerRow + x+1);
+			p[3] = (unsigned short)(z*vertsPerRow + x+1);
+			p[nvp+0] = x > 0 ? (unsigned short)(ip-1) : 0xffff;
+			p[nvp+1] = z+1 < DETAIL_CELLS ? (unsigned short)(ip+DETAIL_CELLS) : 0xffff;
+			p[nvp+2] = x+1 < DETAIL_CELLS ? (unsigned short)(ip+1) : 0xffff;
+			p[nvp+3] = z > 0 ? (unsigned short)(ip-DETAIL_CELLS) : 0xffff;
+			polyFlags[ip] = 1;
+			polyAreas[ip] = 0;
+
+			// The detail vertices start with the polygon vertices, the center vertex is the only unique one.
+			float* dv = &detailVerts[ip*(nvp+1)*3];
+			for (int j = 0; j < nvp; ++j)
+			{
+				const unsigned short* v = &verts[p[j]*3];
+				dtVset(&dv[j*3], (float)v[0], 0.0f, (float)v[2]);
+			}
+			dtVset(&dv[nvp*3], x + 0.5f, 0.15f*(ip % 5) + 0.05f*(ip / 3), z + 0.5f);
+
+			unsigned char* t = &detailTris[ip*4*4];
+			for (int j = 0; j < nvp; ++j)
+			{
+				t[j*4+0] = (unsigned char)j;
+				t[j*4+1] = (unsigned char)((j+1) % nvp);
+				t[j*4+2] = (unsigned char)nvp;
+				t[j*4+3] = 0;
+			}
+
+			detailMeshes[ip*4+0] = (unsigned int)(ip*(nvp+1));
+			detailMeshes[ip*4+1] = (unsigned int)(nvp+1);
+			detailMeshes[ip*4+2] = (unsigned int)(ip*4);
+			detailMeshes[ip*4+3] = 4;
+		}
+	}
+
+	dtNavMeshCreateParams params;
+	memset(&params, 0, sizeof(params));
+	params.verts = verts;
+	params.vertCount = vertsPerRow*vertsPerRow;
+	params.polys = polys;
+	params.polyFlags = polyFlags;
+	params.polyAreas = polyAreas;
+	params.polyCount = npolys;
+	params.nvp = nvp;
+	params.detailMeshes = detailMeshes;
+	params.detailVerts = detailVerts;
+	params.detailVertsCount = npolys*(nvp+1);
+	params.detailTris = detailTris;
+	params.detailTriCount = npolys*4;
+	params.walkableHeight = 2.0f;
+	params.walkableRadius = 0.5f;
+	params.walkableClimb = 0.5f;
+	params.bmax[0] = (float)DETAIL_CELLS;
+	params.bmax[1] = 3.0f;
+	params.bmax[2] = (float)DETAIL_CELLS;
+	params.cs = 1.0f;
+	params.ch = 1.0f;
+	params.buildBvTree = true;
+	params.compactDetailVerts = compact;
+
+	REQUIRE(dtCreateNavMeshData(&params, data, dataSize));
+}
+
+TEST_CASE("dtNavMeshCreateParams::compactDetailVerts")
+{
+	unsigned char* data = 0;
+	int dataSize = 0;
+	unsigned char* compactData = 0;
+	int compactDataSize = 0;
+	createDetailTileData(false, &data, &dataSize);
+	createDetailTileData(true, &compactData, &compactDataSize);
+	REQUIRE(compactDataSize < dataSize);
+	REQUIRE((((const dtMeshHeader*)compactData)->version & DT_NAVMESH_COMPACT_DETAIL) != 0);
+	REQUIRE((((const dtMeshHeader*)data)->version & DT_NAVMESH_COMPACT_DETAIL) == 0);
+
+	SECTION("Swaps the endianess of the compact tile data back and forth")
+	{
+		unsigned char* copy = (unsigned char*)dtAlloc(compactDataSize, DT_ALLOC_PERM);
+		REQUIRE(copy != 0);
+		memcpy(copy, compactData, compactDataSize);
+		// The header is swapped last to the other endianess, and first back from it.
+		REQUIRE(dtNavMeshDataSwapEndian(copy, compactDataSize));
+		REQUIRE(dtNavMeshHeaderSwapEndian(copy, compactDataSize));
+		REQUIRE(memcmp(copy, compactData, compactDataSize) != 0);
+		REQUIRE(dtNavMeshHeaderSwapEndian(copy, compactDataSize));
+		REQUIRE(dtNavMeshDataSwapEndian(copy, compactDataSize));
+		REQUIRE(memcmp(copy, compactData, compactDataSize) == 0);
+		dtFree(copy);
+	}
+
+	SECTION("Finds the heights and closest points of the float tile within the quantization error")
+	{
+		dtNavMesh* nav = dtAllocNavMesh();
+		dtNavMesh* compactNav = dtAllocNavMesh();
+		REQUIRE(dtStatusSucceed(nav->init(data, dataSize, DT_TILE_FREE_DATA)));
+		REQUIRE(dtStatusSucceed(compactNav->init(compactData, compactDataSize, DT_TILE_FREE_DATA)));
+		data = 0;
+		compactData = 0;
+
+		const dtMeshTile* tile = ((const dtNavMesh*)compactNav)->getTile(0);
+		REQUIRE(tile->detailQVerts != 0);
+		REQUIRE(tile->detailVerts == 0);
+		REQUIRE(((const dtNavMesh*)nav)->getTile(0)->detailQVerts == 0);
+
+		// The vertices are off by half a quantization step at most, the slopes of the
+		// detail triangles are below 2, so the heights are off by at most twice as much more.
+		const float* quant = tile->detailQuant;
+		const float eps = 0.5f*(quant[4] + 2.0f*dtMax(quant[3], quant[5])) + 1e-5f;
+		REQUIRE(eps < 1e-3f);
+
+		dtNavMeshQuery* query = dtAllocNavMeshQuery();
+		dtNavMeshQuery* compactQuery = dtAllocNavMeshQuery();
+		REQUIRE(dtStatusSucceed(query->init(nav, 64)));
+		REQUIRE(dtStatusSucceed(compactQuery->init(compactNav, 64)));
+		dtQueryFilter filter;
+		const float halfExtents[3] = { 0.1f, 5.0f, 0.1f };
+
+		float maxHeight = 0.0f;
+		const int steps = DETAIL_CELLS*8;
+		for (int i = 0; i <= steps; ++i)
+		{
+			for (int j = 0; j <= steps; ++j)
+			{
+				// Sample the interior and the edges of the polygons, and points just outside the tile.
+				const float pos[3] = { -0.2f + i*(DETAIL_CELLS + 0.4f)/steps, 4.0f, -0.2f + j*(DETAIL_CELLS + 0.4f)/steps };
+				const float center[3] = { dtClamp(pos[0], 0.01f, DETAIL_CELLS - 0.01f), 0.0f, dtClamp(pos[2], 0.01f, DETAIL_CELLS - 0.01f) };
+				dtPolyRef ref = 0;
+				dtPolyRef compactRef = 0;
+				REQUIRE(dtStatusSucceed(query->findNearestPoly(center, halfExtents, &filter, &ref, 0)));
+				REQUIRE(dtStatusSucceed(compactQuery->findNearestPoly(center, halfExtents, &filter, &compactRef, 0)));
+				REQUIRE(ref != 0);
+				REQUIRE(ref == compactRef);
+
+				float height = 0.0f;
+				float compactHeight = 0.0f;
+				const dtStatus status = query->getPolyHeight(ref, pos, &height);
+				REQUIRE(compactQuery->getPolyHeight(ref, pos, &compactHeight) == status);
+				if (dtStatusSucceed(status))
+				{
+					REQUIRE(dtAbs(height - compactHeight) <= eps);
+					maxHeight = dtMax(maxHeight, height);
+				}
+
+				float closest[3];
+				float compactClosest[3];
+				bool overPoly = false;
+				bool compactOverPoly = false;
+				REQUIRE(query->closestPointOnPoly(ref, pos, closest, &overPoly) == DT_SUCCESS);
+				REQUIRE(compactQuery->closestPointOnPoly(ref, pos, compactClosest, &compactOverPoly) == DT_SUCCESS);
+				REQUIRE(overPoly == compactOverPoly);
+				REQUIRE(dtAbs(closest[0] - compactClosest[0]) <= eps);
+				REQUIRE(dtAbs(closest[1] - compactClosest[1]) <= eps);
+				REQUIRE(dtAbs(closest[2] - compactClosest[2]) <= eps);
+			}
+		}
+		// The heights come from the detail meshes.
+		REQUIRE(maxHeight > 0.5f);
+
+		dtFreeNavMeshQuery(compactQuery);
+		dtFreeNavMeshQuery(query);
+		dtFreeNavMesh(compactNav);
+		dtFreeNavMesh(nav);
+	}
+
+	dtFree(compactData);
+	dtFree(data);
+}
+
+/// Builds a tile of two 4x4 quads side by side. The detail mesh of each quad is a lattice of
+/// divs[i] x divs[i] cells split into triangles, at varying heights inside the quad.
+static void createLatticeDetailTileData(const int* divs, const bool compact, unsigned char** data, int* dataSize)
+{
+	static const int MAX_DIV = 8;
+	const int nvp = 4;
+	const int npolys = 2;
+	const unsigned short verts[6*3] = { 0,0,0, 0,0,4, 4,0,4, 4,0,0, 8,0,4, 8,0,0 };
+	const unsigned short polys[npolys*nvp*2] =
+	{
+		0, 1, 2, 3, 0xffff, 0xffff, 1, 0xffff,
+		3, 2, 4, 5, 0, 0xffff, 0xffff, 0xffff,
+	};
+	const unsigned short polyFlags[npolys] = { 1, 1 };
+	const unsigned char polyAreas[npolys] = { 0, 0 };
+	unsigned int detailMeshes[npolys*4];
+	static float detailVerts[npolys*(MAX_DIV+1)*(MAX_DIV+1)*3];
+	static unsigned char detailTris[npolys*MAX_DIV*MAX_DIV*2*4];
+
+	int nverts = 0;
+	int ntris = 0;
+	for (int ip = 0; ip < npolys; ++ip)
+	{
+		const int div = divs[ip];
+		REQUIRE(div <= MAX_DIV);
+		const float ox = ip * 4.0f;
+		detailMeshes[ip*4+0] = (unsigned int)nverts;
+		detailMeshes[ip*4+1] = (unsigned int)((div+1)*(div+1));
+		detailMeshes[ip*4+2] = (unsigned int)ntris;
+		detailMeshes[ip*4+3] = (unsigned int)(div*div*2);
+
+		// The corners are the polygon vertices, in the order of the polygon.
+		int index[MAX_DIV+1][MAX_DIV+1];
+		index[0][0] = 0;
+		index[0][div] = 1;
+		index[div][div] = 2;
+		index[div][0] = 3;
+		for (int k = 0; k < nvp; ++k)
+			dtVset(&detailVerts[(nverts+k)*3], ox + (k < 2 ? 0.0f : 4.0f), 0.0f, (k == 1 || k == 2) ? 4.0f : 0.0f);
+		int n = nvp;
+		for (int i = 0; i <= div; ++i)
+		{
+			for (int k = 0; k <= div; ++k)
+			{
+				if ((i == 0 || i == div) && (k == 0 || k == div))
+					continue;
+				const float x = ox + i*4.0f/div;
+				const float z = k*4.0f/div;
+				dtVset(&detailVerts[(nverts+n)*3], x, 0.5f + 0.4f*dtMathSqrtf((float)((i*7 + k*3) % 5)), z);
+				index[i][k] = n++;
+			}
+		}
+		nverts += n;
+
+		// Alternate the diagonal of the cells.
+		for (int i = 0; i < div; ++i)
+		{
+			for (int k = 0; k < div; ++k)
+			{
+				unsigned char* t = &detailTris[ntris*4];
+				const int a = index[i][k], b = index[i][k+1], c = index[i+1][k+1], d = index[i+1][k];
+				const int tris[2][2][3] = { { {a,b,c}, {a,c,d} }, { {a,b,d}, {b,c,d} } };
+				for (int j = 0; j < 2; ++j)
+				{
+					for (int m = 0; m < 3; ++m)
+						t[j*4+m] = (unsigned char)tris[(i+k) & 1][j][m];
+					t[j*4+3] = 0;
+				}
+				ntris += 2;
+			}
+		}
+	}
+
+	dtNavMeshCreateParams params;
+	memset(&params, 0, sizeof(params));
+	params.verts = verts;
+	params.vertCount = 6;
+	params.polys = polys;
+	params.polyFlags = polyFlags;
+	params.polyAreas = polyAreas;
+	params.polyCount = npolys;
+	params.nvp = nvp;
+	params.detailMeshes = detailMeshes;
+	params.detailVerts = detailVerts;
+	params.detailVertsCount = nverts;
+	params.detailTris = detailTris;
+	params.detailTriCount = ntris;
+	params.walkableHeight = 2.0f;
+	params.walkableRadius = 0.5f;
+	params.walkableClimb = 0.5f;
+	params.bmax[0] = 8.0f;
+	params.bmax[1] = 3.0f;
+	params.bmax[2] = 4.0f;
+	params.cs = 1.0f;
+	params.ch = 1.0f;
+	params.buildBvTree = true;
+	params.compactDetailVerts = compact;
+
+	REQUIRE(dtCreateNavMeshData(&params, data, dataSize));
+}
+
+/// Finds the height of the detail mesh by testing all the triangles of the polygon in order.
+static bool getDetailHeightLinear(const dtMeshTile* tile, const dtPoly* poly, const float* pos, float* height)
+{
+	const dtPolyDetail* pd = &tile->detailMeshes[poly - tile->polys];
+	for (int j = 0; j < pd->triCount; ++j)
+	{
+		const unsigned char* t = &tile->detailTris[(pd->triBase+j)*4];
+		const float* v[3];
+		float dv[3][3];
+		for (int k = 0; k < 3; ++k)
+		{
+			if (t[k] < poly->vertCount)
+				v[k] = &tile->verts[poly->verts[t[k]]*3];
+			else
+				v[k] = dtGetDetailVert(tile, pd->vertBase + (t[k] - poly->vertCount), dv[k]);
+		}
+		float h;
+		if (dtClosestHeightPointTriangle(pos, v[0], v[1], v[2], h))
+		{
+			*height = h;
+			return true;
+		}
+	}
+	return false;
+}
+
+TEST_CASE("dtGetPolyDetailHeight")
+{
+	// The first polygon has enough triangles for a grid, the second does not.
+	const int divs[2] = { 7, 2 };
+	REQUIRE(divs[0]*divs[0]*2 >= DT_DETAIL_GRID_MIN_TRIS);
+	REQUIRE(divs[1]*divs[1]*2 < DT_DETAIL_GRID_MIN_TRIS);
+
+	for (int compact = 0; compact < 2; ++compact)
+	{
+		unsigned char* data = 0;
+		int dataSize = 0;
+		createLatticeDetailTileData(divs, compact != 0, &data, &dataSize);
+		dtNavMesh* nav = dtAllocNavMesh();
+		REQUIRE(dtStatusSucceed(nav->init(data, dataSize, DT_TILE_FREE_DATA)));
+		const dtMeshTile* tile = ((const dtNavMesh*)nav)->getTile(0);
+		REQUIRE(tile->detailGrids != 0);
+		const dtDetailTriGrid& grid = tile->detailGrids[0];
+		REQUIRE(grid.width > 1);
+		REQUIRE(grid.height > 1);
+		REQUIRE(tile->detailGrids[1].width == 0);
+
+		// Sample the polygons and around them, the cell boundaries of the grid and points next to them.
+		const int maxSamples = 4096;
+		static float samples[maxSamples*2];
+		int nsamples = 0;
+		for (int i = 0; i <= 60; ++i)
+		{
+			for (int k = 0; k <= 36; ++k)
+			{
+				samples[nsamples*2+0] = -1.0f + i*10.0f/60;
+				samples[nsamples*2+1] = -1.0f + k*6.0f/36;
+				nsamples++;
+			}
+		}
+		for (int i = 0; i <= grid.width; ++i)
+		{
+			for (int k = 0; k <= grid.height; ++k)
+			{
+				const float x = grid.bmin[0] + i/grid.cellScale[0];
+				const float z = grid.bmin[1] + k/grid.cellScale[1];
+				const float offsets[3] = { -1e-4f, 0.0f, 1e-4f };
+				for (int j = 0; j < 9; ++j)
+				{
+					REQUIRE(nsamples < maxSamples);
+					samples[nsamples*2+0] = x + offsets[j % 3];
+					samples[nsamples*2+1] = z + offsets[j / 3];
+					nsamples++;
+				}
+			}
+		}
+
+		int nfound = 0;
+		int nmissed = 0;
+		for (int ip = 0; ip < 2; ++ip)
+		{
+			const dtPoly* poly = &tile->polys[ip];
+			for (int i = 0; i < nsamples; ++i)
+			{
+				const float pos[3] = { samples[i*2+0], 1.0f, samples[i*2+1] };
+				float height = 0.0f;
+				float expectedHeight = 0.0f;
+				const bool found = dtGetPolyDetailHeight(tile, poly, pos, &height);
+				REQUIRE(getDetailHeightLinear(tile, poly, pos, &expectedHeight) == found);
+				if (found)
+				{
+					REQUIRE(height == expectedHeight);
+					nfound++;
+				}
+				else
+				{
+					nmissed++;
+				}
+			}
+		}
+		REQUIRE(nfound > 0);
+		REQUIRE(nmissed > 0);
+
+		dtFreeNavMesh(nav);
+	}
+}
+
+/// Builds a navigation mesh of tilesPerSide x tilesPerSide grid tiles of the same layout.
+static dtNavMesh* createTiledGridNavMesh(const char* layout, const int tilesPerSide)
+{
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	params.tileWidth = (float)GRID_SIZE;
+	params.tileHeight = (float)GRID_SIZE;
+	params.maxTiles = tilesPerSide*tilesPerSide;
+	params.maxPolys = GRID_SIZE*GRID_SIZE;
+	dtNavMesh* nav = dtAllocNavMesh();
+	REQUIRE(nav != 0);
+	REQUIRE(dtStatusSucceed(nav->init(&params)));
+	for (int ty = 0; ty < tilesPerSide; ++ty)
+	{
+		for (int tx = 0; tx < tilesPerSide; ++tx)
+		{
+			unsigned char* data = 0;
+			int dataSize = 0;
+			createGridTileData(layout, GRID_SIZE, tx, ty, 0, 0.0f, &data, &dataSize);
+			REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+		}
+	}
+	return nav;
+}
+
+static const char* const GRID_OPEN_LAYOUT =
+	"........"
+	"........"
+	"........"
+	"........"
+	"........"
+	"........"
+	"........"
+	"........";
+
+TEST_CASE("dtNavMeshQuery::moveAlongSurface")
+{
+	const int tilesPerSide = 3;
+	const int cellsPerSide = GRID_SIZE*tilesPerSide;
+	dtQueryFilter filter;
+
+	// The node scratch starts at 64 nodes, the pool size of the searches before it could grow.
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	dtNavMeshQuery* smallQuery = dtAllocNavMeshQuery();
+	dtNavMeshQuery* limitQuery = dtAllocNavMeshQuery();
+
+	const int maxVisited = 64;
+	dtPolyRef visited[maxVisited];
+	dtPolyRef smallVisited[maxVisited];
+
+	SECTION("Finds the same moves as the small pool when they fit in it")
+	{
+		dtNavMesh* nav = createTiledGridNavMesh(GRID_LAYOUT, tilesPerSide);
+		REQUIRE(dtStatusSucceed(query->init(nav, 1024)));
+		REQUIRE(dtStatusSucceed(smallQuery->init(nav, 64)));
+
+		for (int i = 0; i < cellsPerSide*cellsPerSide; i += 5)
+		{
+			float startPos[3];
+			const dtPolyRef startRef = getGridCell(nav, i % cellsPerSide, i / cellsPerSide, startPos);
+			if (!startRef)
+				continue;
+			static const float dirs[8][2] = { {1,0}, {0.7f,0.7f}, {0,1}, {-0.7f,0.7f}, {-1,0}, {-0.7f,-0.7f}, {0,-1}, {0.7f,-0.7f} };
+			for (int dir = 0; dir < 8; ++dir)
+			{
+				const float endPos[3] = { startPos[0] + dirs[dir][0]*2.5f + 0.1f, 0.0f, startPos[2] + dirs[dir][1]*2.5f + 0.15f };
+
+				float resultPos[3];
+				float smallResultPos[3];
+				int nvisited = 0;
+				int nsmallVisited = 0;
+				const dtStatus status = query->moveAlongSurface(startRef, startPos, endPos, &filter, resultPos, visited, &nvisited, maxVisited);
+				REQUIRE(smallQuery->moveAlongSurface(startRef, startPos, endPos, &filter, smallResultPos, smallVisited, &nsmallVisited, maxVisited) == status);
+				REQUIRE(status == DT_SUCCESS);
+				REQUIRE(dtVequal(resultPos, smallResultPos));
+				REQUIRE(nvisited == nsmallVisited);
+				REQUIRE(memcmp(visited, smallVisited, sizeof(dtPolyRef)*nvisited) == 0);
+			}
+		}
+
+		dtFreeNavMesh(nav);
+	}
+
+	SECTION("Grows the pool for a move which does not fit, up to the node limit")
+	{
+		dtNavMesh* nav = createTiledGridNavMesh(GRID_OPEN_LAYOUT, tilesPerSide);
+		REQUIRE(dtStatusSucceed(query->init(nav, 1024)));
+		REQUIRE(dtStatusSucceed(smallQuery->init(nav, 64)));
+		REQUIRE(dtStatusSucceed(limitQuery->init(nav, 100)));
+
+		dtNavMeshQueryMemoryStats stats;
+		query->getMemoryStats(&stats);
+		const int initialScratchSize = stats.scratchSize;
+
+		// The search visits every polygon of the circle through the start and the end.
+		float startPos[3];
+		float endPos[3];
+		const dtPolyRef startRef = getGridCell(nav, 0, 0, startPos);
+		const dtPolyRef endRef = getGridCell(nav, cellsPerSide-1, cellsPerSide-1, endPos);
+
+		float resultPos[3];
+		int nvisited = 0;
+		REQUIRE(query->moveAlongSurface(startRef, startPos, endPos, &filter, resultPos, visited, &nvisited, maxVisited) == DT_SUCCESS);
+		REQUIRE(dtVequal(resultPos, endPos));
+		REQUIRE(visited[0] == startRef);
+		REQUIRE(visited[nvisited-1] == endRef);
+		query->getMemoryStats(&stats);
+		REQUIRE(stats.scratchSize > initialScratchSize);
+
+		for (int i = 0; i < 2; ++i)
+		{
+			dtNavMeshQuery* limited = i == 0 ? smallQuery : limitQuery;
+			const dtStatus status = limited->moveAlongSurface(startRef, startPos, endPos, &filter, resultPos, visited, &nvisited, maxVisited);
+			REQUIRE(status == (DT_SUCCESS | DT_OUT_OF_NODES));
+			REQUIRE(!dtVequal(resultPos, endPos));
+			REQUIRE(nvisited > 0);
+			REQUIRE(visited[0] == startRef);
+		}
+
+		// The grown pool is kept, a move in the opposite direction needs no growing.
+		query->getMemoryStats(&stats);
+		const int grownScratchSize = stats.scratchSize;
+		REQUIRE(query->moveAlongSurface(endRef, endPos, startPos, &filter, resultPos, visited, &nvisited, maxVisited) == DT_SUCCESS);
+		REQUIRE(dtVequal(resultPos, startPos));
+		query->getMemoryStats(&stats);
+		REQUIRE(stats.scratchSize == grownScratchSize);
+
+		dtFreeNavMesh(nav);
+	}
+
+	dtFreeNavMeshQuery(limitQuery);
+	dtFreeNavMeshQuery(smallQuery);
+	dtFreeNavMeshQuery(query);
+}
+
+TEST_CASE("dtNavMeshQuery::findLocalNeighbourhood")
+{
+	const int tilesPerSide = 3;
+	const int cellsPerSide = GRID_SIZE*tilesPerSide;
+	dtQueryFilter filter;
+
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	dtNavMeshQuery* smallQuery = dtAllocNavMeshQuery();
+
+	const int maxResult = 1024;
+	static dtPolyRef refs[maxResult];
+	static dtPolyRef parents[maxResult];
+	static dtPolyRef smallRefs[maxResult];
+	static dtPolyRef smallParents[maxResult];
+
+	SECTION("Finds the same polygons as the small pool when they fit in it")
+	{
+		dtNavMesh* nav = createTiledGridNavMesh(GRID_LAYOUT, tilesPerSide);
+		REQUIRE(dtStatusSucceed(query->init(nav, 1024)));
+		REQUIRE(dtStatusSucceed(smallQuery->init(nav, 64)));
+
+		for (int i = 0; i < cellsPerSide*cellsPerSide; i += 3)
+		{
+			float centerPos[3];
+			const dtPolyRef startRef = getGridCell(nav, i % cellsPerSide, i / cellsPerSide, centerPos);
+			if (!startRef)
+				continue;
+			int n = 0;
+			int nsmall = 0;
+			const dtStatus status = query->findLocalNeighbourhood(startRef, centerPos, 2.0f, &filter, refs, parents, &n, maxResult);
+			REQUIRE(smallQuery->findLocalNeighbourhood(startRef, centerPos, 2.0f, &filter, smallRefs, smallParents, &nsmall, maxResult) == status);
+			REQUIRE(status == DT_SUCCESS);
+			REQUIRE(n == nsmall);
+			REQUIRE(memcmp(refs, smallRefs, sizeof(dtPolyRef)*n) == 0);
+			REQUIRE(memcmp(parents, smallParents, sizeof(dtPolyRef)*n) == 0);
+		}
+
+		dtFreeNavMesh(nav);
+	}
+
+	SECTION("Grows the pool for a neighbourhood which does not fit, up to the node limit")
+	{
+		dtNavMesh* nav = createTiledGridNavMesh(GRID_OPEN_LAYOUT, tilesPerSide);
+		REQUIRE(dtStatusSucceed(query->init(nav, 1024)));
+		REQUIRE(dtStatusSucceed(smallQuery->init(nav, 64)));
+
+		float centerPos[3];
+		const dtPolyRef startRef = getGridCell(nav, cellsPerSide/2, cellsPerSide/2, centerPos);
+		const float radius = 7.0f;
+		int n = 0;
+		REQUIRE(query->findLocalNeighbourhood(startRef, centerPos, radius, &filter, refs, parents, &n, maxResult) == DT_SUCCESS);
+		REQUIRE(n > 64);
+
+		// Every cell inside the circle is found, and no cell outside it.
+		for (int i = 0; i < cellsPerSide*cellsPerSide; ++i)
+		{
+			float pos[3];
+			const dtPolyRef ref = getGridCell(nav, i % cellsPerSide, i / cellsPerSide, pos);
+			bool found = false;
+			for (int j = 0; j < n && !found; ++j)
+				found = refs[j] == ref;
+			const float dx = dtMax(dtAbs(pos[0] - centerPos[0]) - 0.5f, 0.0f);
+			const float dz = dtMax(dtAbs(pos[2] - centerPos[2]) - 0.5f, 0.0f);
+			const float dist = dtMathSqrtf(dx*dx + dz*dz);
+			if (dist < radius - 0.5f)
+				REQUIRE(found);
+			if (dist > radius)
+				REQUIRE(!found);
+		}
+
+		int nsmall = 0;
+		REQUIRE(smallQuery->findLocalNeighbourhood(startRef, centerPos, radius, &filter, smallRefs, smallParents, &nsmall, maxResult) == (DT_SUCCESS | DT_OUT_OF_NODES));
+		REQUIRE(nsmall < n);
+
+		dtFreeNavMesh(nav);
+	}
+
+	dtFreeNavMeshQuery(smallQuery);
+	dtFreeNavMeshQuery(query);
+}
+
+TEST_CASE("dtNavMeshQuery::updateSlicedFindPathTimed")
+{
+	const int tilesPerSide = 3;
+	const int cellsPerSide = GRID_SIZE*tilesPerSide;
+	dtQueryFilter filter;
+	const int maxPath = 256;
+	dtPolyRef path[maxPath];
+	dtPolyRef expectedPath[maxPath];
+
+	dtNavMesh* nav = createTiledGridNavMesh(GRID_OPEN_LAYOUT, tilesPerSide);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 1024)));
+
+	float startPos[3];
+	float endPos[3];
+	const dtPolyRef startRef = getGridCell(nav, 0, 0, startPos);
+	const dtPolyRef endRef = getGridCell(nav, cellsPerSide-1, cellsPerSide-1, endPos);
+	int nexpected = 0;
+	REQUIRE(query->findPath(startRef, endRef, startPos, endPos, &filter, expectedPath, &nexpected, maxPath) == DT_SUCCESS);
+
+	REQUIRE(query->initSlicedFindPath(startRef, endRef, startPos, endPos, &filter) == DT_IN_PROGRESS);
+	int iters = 0;
+	float itersPerUsec = -1.0f;
+
+	SECTION("Stops at the deadline and reports the iteration rate")
+	{
+		// The clock is read at the start, every 8 iterations and at the end. The read after
+		// 24 iterations is the first past the deadline, and the update took 4 reads.
+		setFakeClock(1000, 1000);
+		REQUIRE(query->updateSlicedFindPathTimed(100000, 2500, &iters, &itersPerUsec) == DT_IN_PROGRESS);
+		REQUIRE(iters == 24);
+		REQUIRE(itersPerUsec == Approx(6.0f));
+
+		// The updates resume the search where the previous one stopped.
+		dtStatus status = DT_IN_PROGRESS;
+		for (int i = 0; i < 100 && dtStatusInProgress(status); ++i)
+		{
+			status = query->updateSlicedFindPathTimed(100000, 2500, &iters, 0);
+			REQUIRE(iters > 0);
+			REQUIRE(iters <= 24);
+		}
+		REQUIRE(status == DT_SUCCESS);
+		int npath = 0;
+		REQUIRE(query->finalizeSlicedFindPath(path, &npath, maxPath) == DT_SUCCESS);
+		REQUIRE(npath == nexpected);
+		REQUIRE(memcmp(path, expectedPath, sizeof(dtPolyRef)*npath) == 0);
+	}
+
+	SECTION("Performs at least one iteration when the budget is used")
+	{
+		// A clock starting at zero does not disable the deadline.
+		setFakeClock(0, 1000);
+		REQUIRE(query->updateSlicedFindPathTimed(100000, 0, &iters, &itersPerUsec) == DT_IN_PROGRESS);
+		REQUIRE(iters == 8);
+		REQUIRE(itersPerUsec == Approx(4.0f));
+
+		// A clock which does not advance reports no rate.
+		setFakeClock(5000, 0);
+		REQUIRE(query->updateSlicedFindPathTimed(100000, 0, &iters, &itersPerUsec) == DT_IN_PROGRESS);
+		REQUIRE(iters == 8);
+		REQUIRE(itersPerUsec == 0.0f);
+
+		REQUIRE(query->updateSlicedFindPathTimed(1, 0, &iters, 0) == DT_IN_PROGRESS);
+		REQUIRE(iters == 1);
+	}
+
+	dtTimeSetCustom(0);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+/// Runs the tasks serially in reverse order, to check that addTiles does not depend on the order.
+struct ReverseParallelFor : public dtParallelFor
+{
+	int runs;
+	ReverseParallelFor() : runs(0) {}
+	virtual void run(dtParallelTaskFunc func, void* userData, int count)
+	{
+		runs++;
+		for (int i = count-1; i >= 0; --i)
+			func(userData, i);
+	}
+};
+
+static const int LINK_ROW_SIZE = 15;
+
+static int compareLinkRows(const void* va, const void* vb)
+{
+	const float* a = (const float*)va;
+	const float* b = (const float*)vb;
+	for (int i = 0; i < LINK_ROW_SIZE; ++i)
+	{
+		if (a[i] != b[i])
+			return a[i] < b[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+/// Writes the location of the polygon, so that it can be compared between meshes
+/// that placed the tiles at different indices.
+static void setLinkRowTarget(const dtNavMesh* nav, const dtPolyRef ref, float* row)
+{
+	const dtMeshTile* tile = 0;
+	const dtPoly* poly = 0;
+	nav->getTileAndPolyByRefUnsafe(ref, &tile, &poly);
+	row[0] = (float)tile->header->x;
+	row[1] = (float)tile->header->y;
+	row[2] = (float)tile->header->layer;
+	row[3] = (float)(poly - tile->polys);
+}
+
+/// Collects the links and the adjacency of a polygon in sorted order. Returns the number of rows.
+static int getPolyLinkRows(const dtNavMesh* nav, const dtMeshTile* tile, const int ip, float* links, float* adjacency)
+{
+	const dtPoly* poly = &tile->polys[ip];
+	int nlinks = 0;
+	for (unsigned int k = poly->firstLink; k != DT_NULL_LINK; k = tile->links[k].next)
+	{
+		const dtLink& link = tile->links[k];
+		float* row = &links[nlinks*LINK_ROW_SIZE];
+		memset(row, 0, sizeof(float)*LINK_ROW_SIZE);
+		setLinkRowTarget(nav, link.ref, row);
+		row[4] = link.edge;
+		row[5] = link.side;
+		row[6] = link.bmin;
+		row[7] = link.bmax;
+		nlinks++;
+	}
+	qsort(links, nlinks, sizeof(float)*LINK_ROW_SIZE, compareLinkRows);
+
+	const dtTileAdjacency* adj = dtGetTileAdjacency(tile);
+	REQUIRE((int)(adj->base[ip+1] - adj->base[ip]) == nlinks);
+	for (unsigned int k = adj->base[ip]; k < adj->base[ip+1]; ++k)
+	{
+		float* row = &adjacency[(k - adj->base[ip])*LINK_ROW_SIZE];
+		setLinkRowTarget(nav, adj->entries[k].ref, row);
+		row[4] = adj->entries[k].edge;
+		row[5] = adj->entries[k].side;
+		dtVcopy(&row[6], adj->entries[k].mid);
+		dtVcopy(&row[9], adj->portals[k].left);
+		dtVcopy(&row[12], adj->portals[k].right);
+	}
+	qsort(adjacency, nlinks, sizeof(float)*LINK_ROW_SIZE, compareLinkRows);
+
+	return nlinks;
+}
+
+/// Checks that the tiles of two meshes have the same links, adjacency and off-mesh connections.
+/// Returns the number of links leaving the tiles through off-mesh connections.
+static int compareTileLinks(const dtNavMesh* expected, const dtNavMesh* nav)
+{
+	static const int MAX_ROWS = 64;
+	float expectedLinks[MAX_ROWS*LINK_ROW_SIZE];
+	float expectedAdjacency[MAX_ROWS*LINK_ROW_SIZE];
+	float links[MAX_ROWS*LINK_ROW_SIZE];
+	float adjacency[MAX_ROWS*LINK_ROW_SIZE];
+	int offMeshLinks = 0;
+	for (int i = 0; i < expected->getMaxTiles(); ++i)
+	{
+		const dtMeshTile* expectedTile = expected->getTile(i);
+		if (!expectedTile->header)
+			continue;
+		const dtMeshHeader* header = expectedTile->header;
+		const dtMeshTile* tile = nav->getTileAt(header->x, header->y, header->layer);
+		REQUIRE(tile != 0);
+		REQUIRE(tile->header->polyCount == header->polyCount);
+
+		// The off-mesh connections snap their end points to the polygons they link to.
+		REQUIRE(memcmp(tile->verts, expectedTile->verts, sizeof(float)*3*header->vertCount) == 0);
+		REQUIRE(memcmp(tile->offMeshCons, expectedTile->offMeshCons, sizeof(dtOffMeshConnection)*header->offMeshConCount) == 0);
+
+		for (int ip = 0; ip < header->polyCount; ++ip)
+		{
+			const int nexpected = getPolyLinkRows(expected, expectedTile, ip, expectedLinks, expectedAdjacency);
+			REQUIRE(getPolyLinkRows(nav, tile, ip, links, adjacency) == nexpected);
+			REQUIRE(memcmp(links, expectedLinks, sizeof(float)*LINK_ROW_SIZE*nexpected) == 0);
+			REQUIRE(memcmp(adjacency, expectedAdjacency, sizeof(float)*LINK_ROW_SIZE*nexpected) == 0);
+
+			if (expectedTile->polys[ip].getType() != DT_POLYTYPE_OFFMESH_CONNECTION)
+				continue;
+			for (int k = 0; k < nexpected; ++k)
+			{
+				const float* row = &expectedLinks[k*LINK_ROW_SIZE];
+				if (row[0] != header->x || row[1] != header->y || row[2] != header->layer)
+					offMeshLinks++;
+			}
+		}
+	}
+	return offMeshLinks;
+}
+
+TEST_CASE("dtNavMesh::addTiles")
+{
+	// A 3x3 grid of tiles, and a second layer above the middle tile. Off-mesh connections
+	// lead to the next tile along the x-axis, and between the layers of the middle tile.
+	// None lands on the middle tile from the side, since it would link to both layers and
+	// its end point would be moved by whichever layer is linked last.
+	static const int TILE_COUNT = 10;
+	unsigned char* datas[TILE_COUNT];
+	int dataSizes[TILE_COUNT];
+	for (int i = 0; i < TILE_COUNT; ++i)
+	{
+		const int tx = i < 9 ? i % 3 : 1;
+		const int ty = i < 9 ? i / 3 : 1;
+		const int layer = i < 9 ? 0 : 1;
+		const float x = (float)(tx*GRID_SIZE);
+		const float z = (float)(ty*GRID_SIZE);
+		float offMeshConVerts[GRID_MAX_OFFMESH*6];
+		int offMeshConCount = 0;
+		if (layer == 0 && tx < 2 && !(tx == 0 && ty == 1))
+		{
+			const float verts[6] = { x + 6.5f, 0.0f, z + 6.5f, x + 9.5f, 0.0f, z + 6.5f };
+			memcpy(&offMeshConVerts[offMeshConCount++*6], verts, sizeof(verts));
+		}
+		if (layer == 0 && tx == 1 && ty == 1)
+		{
+			const float verts[6] = { x + 0.5f, 0.0f, z + 0.5f, x + 0.5f, 3.0f, z + 0.5f };
+			memcpy(&offMeshConVerts[offMeshConCount++*6], verts, sizeof(verts));
+		}
+		if (layer == 1)
+		{
+			const float verts[6] = { x + 3.5f, 3.0f, z + 0.5f, x + 3.5f, 0.0f, z - 1.5f };
+			memcpy(&offMeshConVerts[offMeshConCount++*6], verts, sizeof(verts));
+		}
+		createGridTileData(GRID_LAYOUT, GRID_SIZE, tx, ty, layer, layer ? 3.0f : 0.0f, &datas[i], &dataSizes[i],
+						   offMeshConVerts, offMeshConCount);
+	}
+
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	params.tileWidth = (float)GRID_SIZE;
+	params.tileHeight = (float)GRID_SIZE;
+	params.maxTiles = 16;
+	params.maxPolys = GRID_SIZE*GRID_SIZE;
+
+	// The tiles added one by one, to copies of the data since the links are stored in it.
+	dtNavMesh* expected = dtAllocNavMesh();
+	REQUIRE(dtStatusSucceed(expected->init(&params)));
+	for (int i = 0; i < TILE_COUNT; ++i)
+	{
+		unsigned char* data = (unsigned char*)dtAlloc(dataSizes[i], DT_ALLOC_PERM);
+		REQUIRE(data != 0);
+		memcpy(data, datas[i], dataSizes[i]);
+		REQUIRE(dtStatusSucceed(expected->addTile(data, dataSizes[i], DT_TILE_FREE_DATA, 0, 0)));
+	}
+
+	dtNavMesh* nav = dtAllocNavMesh();
+	REQUIRE(dtStatusSucceed(nav->init(&params)));
+	dtTileRef results[TILE_COUNT];
+
+	SECTION("Links the tiles added together like addTile")
+	{
+		REQUIRE(nav->addTiles(datas, dataSizes, 0, TILE_COUNT, results, 0) == DT_SUCCESS);
+		for (int i = 0; i < TILE_COUNT; ++i)
+			REQUIRE(nav->getTileByRef(results[i])->data == datas[i]);
+		REQUIRE(compareTileLinks(expected, nav) > 0);
+	}
+
+	SECTION("Links the tiles added next to the tiles already in the mesh like addTile")
+	{
+		// Every other tile is already in the mesh, so each new tile borders old ones on all sides.
+		unsigned char* newDatas[TILE_COUNT];
+		int newSizes[TILE_COUNT];
+		int nnew = 0;
+		for (int i = 0; i < TILE_COUNT; ++i)
+		{
+			if (i % 2 == 0)
+			{
+				REQUIRE(dtStatusSucceed(nav->addTile(datas[i], dataSizes[i], 0, 0, 0)));
+				continue;
+			}
+			newDatas[nnew] = datas[i];
+			newSizes[nnew] = dataSizes[i];
+			nnew++;
+		}
+		ReverseParallelFor parallel;
+		REQUIRE(nav->addTiles(newDatas, newSizes, 0, nnew, results, &parallel) == DT_SUCCESS);
+		REQUIRE(parallel.runs > 0);
+		REQUIRE(compareTileLinks(expected, nav) > 0);
+	}
+
+	dtFreeNavMesh(nav);
+	dtFreeNavMesh(expected);
+	for (int i = 0; i < TILE_COUNT; ++i)
+		dtFree(datas[i]);
+}
+
+TEST_CASE("dtNavMesh::evictTile")
+{
+	dtNavMesh* nav = createGridNavMesh(GRID_LAYOUT, GRID_SIZE);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+	dtQueryFilter filter;
+	float startPos[3];
+	float endPos[3];
+	const dtPolyRef startRef = getGridCell(nav, 0, 0, startPos);
+	const dtPolyRef endRef = getGridCell(nav, GRID_SIZE-1, GRID_SIZE-1, endPos);
+	REQUIRE(startRef != 0);
+	REQUIRE(endRef != 0);
+
+	const dtMeshTile* tile = ((const dtNavMesh*)nav)->getTile(0);
+	const dtTileRef tileRef = nav->getTileRef(tile);
+	const int dataSize = tile->dataSize;
+	unsigned char* data = (unsigned char*)dtAlloc(dataSize, DT_ALLOC_PERM);
+	memcpy(data, tile->data, dataSize);
+
+	SECTION("Queries report the polygons of an evicted tile as not resident until it is added back")
+	{
+		REQUIRE(dtStatusSucceed(nav->evictTile(tileRef, 0, 0)));
+		REQUIRE(!nav->isValidPolyRef(startRef));
+		REQUIRE(nav->getPolyRefStatus(startRef) == (DT_FAILURE | DT_TILE_NOT_RESIDENT));
+
+		const int maxPath = 64;
+		dtPolyRef path[maxPath];
+		int npath = 0;
+		float closest[3];
+		REQUIRE(query->findPath(startRef, endRef, startPos, endPos, &filter, path, &npath, maxPath) == (DT_FAILURE | DT_TILE_NOT_RESIDENT));
+		REQUIRE(query->closestPointOnPoly(startRef, startPos, closest, 0) == (DT_FAILURE | DT_TILE_NOT_RESIDENT));
+
+		dtTileRef result = 0;
+		REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, tileRef, &result)));
+		data = 0;
+		REQUIRE(result == tileRef);
+		REQUIRE(nav->getPolyRefStatus(startRef) == DT_SUCCESS);
+		REQUIRE(query->findPath(startRef, endRef, startPos, endPos, &filter, path, &npath, maxPath) == DT_SUCCESS);
+	}
+
+	SECTION("Removed tiles stay invalid")
+	{
+		REQUIRE(dtStatusSucceed(nav->removeTile(tileRef, 0, 0)));
+		REQUIRE(nav->getPolyRefStatus(startRef) == (DT_FAILURE | DT_INVALID_PARAM));
+	}
+
+	dtFree(data);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtNavMesh::setDeferredReclaim")
+{
+	dtNavMesh* nav = createGridNavMesh(GRID_LAYOUT, GRID_SIZE);
+	nav->setDeferredReclaim(true);
+
+	float pos[3];
+	const dtPolyRef ref = getGridCell(nav, 0, 0, pos);
+	REQUIRE(ref != 0);
+
+	const dtMeshTile* tile = ((const dtNavMesh*)nav)->getTile(0);
+	const dtTileRef tileRef = nav->getTileRef(tile);
+	const int dataSize = tile->dataSize;
+	unsigned char* data = (unsigned char*)dtAlloc(dataSize, DT_ALLOC_PERM);
+	memcpy(data, tile->data, dataSize);
+
+	// A reader looked up the tile before it was removed.
+	const unsigned int readerEpoch = nav->getEpoch();
+	const dtMeshTile* readerTile = 0;
+	const dtPoly* readerPoly = 0;
+	REQUIRE(nav->getTileAndPolyByRef(ref, &readerTile, &readerPoly) == DT_SUCCESS);
+	const unsigned short polyFlags = readerPoly->flags;
+
+	REQUIRE(dtStatusSucceed(nav->removeTile(tileRef, 0, 0)));
+	REQUIRE(!nav->isValidPolyRef(ref));
+	REQUIRE(nav->getPolyRefStatus(ref) == (DT_FAILURE | DT_INVALID_PARAM));
+	REQUIRE(nav->getEpoch() != readerEpoch);
+	REQUIRE(nav->getRetiredCount() == 1);
+
+	SECTION("Keeps the removed tile readable until it is reclaimed")
+	{
+		REQUIRE(readerTile->data != 0);
+		REQUIRE(readerTile->polys == readerPoly);
+		REQUIRE(readerPoly->flags == polyFlags);
+		REQUIRE(dtGetTileAdjacency(readerTile) != 0);
+
+		nav->reclaim(readerEpoch);
+		REQUIRE(nav->getRetiredCount() == 1);
+		REQUIRE(readerTile->data != 0);
+		REQUIRE(dtGetTileAdjacency(readerTile) != 0);
+
+		nav->reclaim(nav->getEpoch());
+		REQUIRE(nav->getRetiredCount() == 0);
+		REQUIRE(readerTile->data == 0);
+		REQUIRE(dtGetTileAdjacency(readerTile) == 0);
+	}
+
+	SECTION("Restores the tile reference only after the tile is reclaimed")
+	{
+		dtTileRef result = 0;
+		REQUIRE(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, tileRef, &result) == (DT_FAILURE | DT_ALREADY_OCCUPIED));
+		REQUIRE(result == 0);
+
+		nav->reclaim(nav->getEpoch());
+		REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, tileRef, &result)));
+		data = 0;
+		REQUIRE(result == tileRef);
+		REQUIRE(nav->isValidPolyRef(ref));
+	}
+
+	dtFree(data);
+	dtFreeNavMesh(nav);
+}
+
+static void* failingAlloc(size_t /*size*/, dtAllocHint /*hint*/)
+{
+	return 0;
+}
+
+TEST_CASE("dtNavMesh::revertStateChanges")
+{
+	dtNavMesh* nav = createGridNavMesh(GRID_LAYOUT, GRID_SIZE);
+	nav->setStateJournal(true);
+
+	float pos[3];
+	const dtPolyRef ref = getGridCell(nav, 0, 0, pos);
+	REQUIRE(ref != 0);
+	unsigned short flags = 0;
+
+	SECTION("Skips the changes made before the tile was added back with the same reference")
+	{
+		const unsigned int version = nav->getStateVersion();
+		REQUIRE(nav->setPolyFlags(ref, 2) == DT_SUCCESS);
+
+		const dtMeshTile* tile = ((const dtNavMesh*)nav)->getTile(0);
+		const dtTileRef tileRef = nav->getTileRef(tile);
+		const int dataSize = tile->dataSize;
+		unsigned char* data = (unsigned char*)dtAlloc(dataSize, DT_ALLOC_PERM);
+		memcpy(data, tile->data, dataSize);
+		REQUIRE(dtStatusSucceed(nav->removeTile(tileRef, 0, 0)));
+		REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, tileRef, 0)));
+
+		REQUIRE(nav->setPolyFlags(ref, 4) == DT_SUCCESS);
+		REQUIRE(nav->revertStateChanges(version) == DT_SUCCESS);
+		REQUIRE(nav->getPolyFlags(ref, &flags) == DT_SUCCESS);
+		REQUIRE(flags == 2);
+	}
+
+	SECTION("Leaves the state unchanged when the journal cannot grow")
+	{
+		float otherPos[3];
+		const dtPolyRef otherRef = getGridCell(nav, 1, 0, otherPos);
+		REQUIRE(otherRef != 0);
+
+		const unsigned int version = nav->getStateVersion();
+		// Leave room in the journal for a single entry, one entry is recorded per change.
+		for (int i = 0; i < 255; ++i)
+			REQUIRE(nav->setPolyFlags((i & 1) ? otherRef : ref, (unsigned short)(2 + ((i >> 1) & 1))) == DT_SUCCESS);
+		unsigned short otherFlags = 0;
+		REQUIRE(nav->getPolyFlags(ref, &flags) == DT_SUCCESS);
+		REQUIRE(nav->getPolyFlags(otherRef, &otherFlags) == DT_SUCCESS);
+
+		dtAllocSetCustom(failingAlloc, 0);
+		const dtStatus status = nav->revertStateChanges(version);
+		dtAllocSetCustom(0, 0);
+		REQUIRE(status == (DT_FAILURE | DT_OUT_OF_MEMORY));
+		unsigned short newFlags = 0;
+		REQUIRE(nav->getPolyFlags(ref, &newFlags) == DT_SUCCESS);
+		REQUIRE(newFlags == flags);
+		REQUIRE(nav->getPolyFlags(otherRef, &newFlags) == DT_SUCCESS);
+		REQUIRE(newFlags == otherFlags);
+
+		REQUIRE(nav->revertStateChanges(version) == DT_SUCCESS);
+		REQUIRE(nav->getPolyFlags(ref, &newFlags) == DT_SUCCESS);
+		REQUIRE(newFlags == 1);
+		REQUIRE(nav->getPolyFlags(otherRef, &newFlags) == DT_SUCCESS);
+		REQUIRE(newFlags == 1);
+	}
+
+	dtFreeNavMesh(nav);
+}
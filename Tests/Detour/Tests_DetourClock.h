@@ -0,0 +1,25 @@
+#ifndef TESTS_DETOURCLOCK_H
+#define TESTS_DETOURCLOCK_H
+
+#include "DetourTime.h"
+
+/// A clock for dtTimeSetCustom which advances by a fixed step on every read.
+static uint64_t s_fakeClockTime = 0;
+static uint64_t s_fakeClockStep = 0;
+
+inline uint64_t readFakeClock()
+{
+	const uint64_t now = s_fakeClockTime;
+	s_fakeClockTime += s_fakeClockStep;
+	return now;
+}
+
+/// Installs the fake clock, the first read returns @p time.
+inline void setFakeClock(const uint64_t time, const uint64_t step)
+{
+	s_fakeClockTime = time;
+	s_fakeClockStep = step;
+	dtTimeSetCustom(readFakeClock);
+}
+
+#endif // TESTS_DETOURCLOCK_H
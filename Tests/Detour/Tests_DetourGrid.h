@@ -0,0 +1,169 @@
+#ifndef TESTS_DETOURGRID_H
+#define TESTS_DETOURGRID_H
+
+#include <string.h>
+
+#include "catch.hpp"
+
+#include "DetourCommon.h"
+#include "DetourNavMesh.h"
+#include "DetourNavMeshBuilder.h"
+#include "DetourNavMeshQuery.h"
+
+/// A test layout of unit cells. '#' is not walkable, '~' is walkable water.
+static const int GRID_SIZE = 8;
+static const char* const GRID_LAYOUT =
+	"........"
+	".####..."
+	"....#~~."
+	"..#.#~~."
+	"..#...#."
+	"..####.."
+	"~~~....."
+	"........";
+
+/// The most off-mesh connections a grid tile can have.
+static const int GRID_MAX_OFFMESH = 4;
+
+/// Builds the tile data of a quad polygon for each walkable cell of the layout. The tile
+/// covers the cells from (tx*size, ty*size) with its polygons at the height y, and has the
+/// bidirectional off-mesh connections of the specified end points.
+inline void createGridTileData(const char* layout, const int size, const int tx, const int ty, const int layer,
+							   const float y, unsigned char** data, int* dataSize,
+							   const float* offMeshConVerts = 0, const int offMeshConCount = 0)
+{
+	const int nvp = 4;
+	const int vertsPerRow = size + 1;
+	unsigned short verts[(GRID_SIZE+1)*(GRID_SIZE+1)*3];
+	unsigned short polys[GRID_SIZE*GRID_SIZE*nvp*2];
+	unsigned short polyFlags[GRID_SIZE*GRID_SIZE];
+	unsigned char polyAreas[GRID_SIZE*GRID_SIZE];
+	int polyIndex[GRID_SIZE*GRID_SIZE];
+	float offMeshConRad[GRID_MAX_OFFMESH];
+	unsigned short offMeshConFlags[GRID_MAX_OFFMESH];
+	unsigned char offMeshConAreas[GRID_MAX_OFFMESH];
+	unsigned char offMeshConDir[GRID_MAX_OFFMESH];
+	unsigned int offMeshConUserID[GRID_MAX_OFFMESH];
+	REQUIRE(size <= GRID_SIZE);
+	REQUIRE(offMeshConCount <= GRID_MAX_OFFMESH);
+
+	for (int z = 0; z <= size; ++z)
+	{
+		for (int x = 0; x <= size; ++x)
+		{
+			unsigned short* v = &verts[(z*vertsPerRow + x)*3];
+			v[0] = (unsigned short)x;
+			v[1] = 0;
+			v[2] = (unsigned short)z;
+		}
+	}
+
+	int npolys = 0;
+	for (int i = 0; i < size*size; ++i)
+		polyIndex[i] = layout[i] == '#' ? -1 : npolys++;
+
+	// The edges of a cell in order are x-, z+, x+, z-.
+	const int dx[4] = { -1, 0, 1, 0 };
+	const int dz[4] = { 0, 1, 0, -1 };
+	for (int z = 0; z < size; ++z)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			const int ip = polyIndex[z*size + x];
+			if (ip < 0)
+				continue;
+			unsigned short* p = &polys[ip*nvp*2];
+			p[0] = (unsigned short)(z*vertsPerRow + x);
+			p[1] = (unsigned short)((z+1)*vertsPerRow + x);
+			p[2] = (unsigned short)((z+1)*vertsPerRow + x+1);
+			p[3] = (unsigned short)(z*vertsPerRow + x+1);
+			for (int j = 0; j < 4; ++j)
+			{
+				const int nx = x + dx[j];
+				const int nz = z + dz[j];
+				if (nx < 0 || nz < 0 || nx >= size || nz >= size)
+				{
+					// The edges on the tile border are portals to the neighbour tiles.
+					p[nvp+j] = (unsigned short)(0x8000 | j);
+					continue;
+				}
+				const int nei = polyIndex[nz*size + nx];
+				p[nvp+j] = nei >= 0 ? (unsigned short)nei : 0xffff;
+			}
+			polyFlags[ip] = 1;
+			polyAreas[ip] = layout[z*size + x] == '~' ? 1 : 0;
+		}
+	}
+
+	for (int i = 0; i < offMeshConCount; ++i)
+	{
+		offMeshConRad[i] = 0.5f;
+		offMeshConFlags[i] = 1;
+		offMeshConAreas[i] = 0;
+		offMeshConDir[i] = DT_OFFMESH_CON_BIDIR;
+		offMeshConUserID[i] = (unsigned int)i;
+	}
+
+	dtNavMeshCreateParams params;
+	memset(&params, 0, sizeof(params));
+	params.verts = verts;
+	params.vertCount = vertsPerRow*vertsPerRow;
+	params.polys = polys;
+	params.polyFlags = polyFlags;
+	params.polyAreas = polyAreas;
+	params.polyCount = npolys;
+	params.nvp = nvp;
+	params.offMeshConVerts = offMeshConVerts;
+	params.offMeshConRad = offMeshConRad;
+	params.offMeshConFlags = offMeshConFlags;
+	params.offMeshConAreas = offMeshConAreas;
+	params.offMeshConDir = offMeshConDir;
+	params.offMeshConUserID = offMeshConUserID;
+	params.offMeshConCount = offMeshConCount;
+	params.walkableHeight = 2.0f;
+	params.walkableRadius = 0.5f;
+	params.walkableClimb = 0.5f;
+	params.tileX = tx;
+	params.tileY = ty;
+	params.tileLayer = layer;
+	params.bmin[0] = (float)(tx*size);
+	params.bmin[1] = y;
+	params.bmin[2] = (float)(ty*size);
+	params.bmax[0] = params.bmin[0] + size;
+	params.bmax[1] = y + 1.0f;
+	params.bmax[2] = params.bmin[2] + size;
+	params.cs = 1.0f;
+	params.ch = 1.0f;
+	params.buildBvTree = true;
+
+	REQUIRE(dtCreateNavMeshData(&params, data, dataSize));
+}
+
+/// Builds a single tile navigation mesh with a quad polygon for each walkable cell of the layout.
+inline dtNavMesh* createGridNavMesh(const char* layout, const int size)
+{
+	unsigned char* data = 0;
+	int dataSize = 0;
+	createGridTileData(layout, size, 0, 0, 0, 0.0f, &data, &dataSize);
+
+	dtNavMesh* nav = dtAllocNavMesh();
+	REQUIRE(nav != 0);
+	REQUIRE(dtStatusSucceed(nav->init(data, dataSize, DT_TILE_FREE_DATA)));
+	return nav;
+}
+
+/// Returns the reference of the polygon of a cell and its center point.
+inline dtPolyRef getGridCell(const dtNavMesh* nav, const int x, const int z, float* pos)
+{
+	const float halfExtents[3] = { 0.1f, 1.0f, 0.1f };
+	dtVset(pos, x + 0.5f, 0.0f, z + 0.5f);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	query->init(nav, 16);
+	dtQueryFilter filter;
+	dtPolyRef ref = 0;
+	query->findNearestPoly(pos, halfExtents, &filter, &ref, 0);
+	dtFreeNavMeshQuery(query);
+	return ref;
+}
+
+#endif // TESTS_DETOURGRID_H
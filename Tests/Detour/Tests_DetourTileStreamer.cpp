@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "catch.hpp"
+
+#include "DetourAlloc.h"
+#include "DetourNavMesh.h"
+#include "DetourTileStreamer.h"
+
+#include "Tests_DetourGrid.h"
+
+static const int STREAM_TILES = 4;
+
+/// Reads the tiles from memory, the offset of an entry is the offset of the tile data in the blob.
+/// With async set, the reads are left pending until the test finishes them.
+struct MemoryTileLoader : public dtTileStreamLoader
+{
+	unsigned char* blob;
+	bool async;
+	int requests;
+	int pending;
+	unsigned char* pendingData;
+
+	MemoryTileLoader() : blob(0), async(false), requests(0), pending(-1), pendingData(0) {}
+	virtual ~MemoryTileLoader() { dtFree(blob); }
+
+	virtual dtStatus loadTile(const dtTileStreamEntry* entry, unsigned char* data)
+	{
+		memcpy(data, blob + entry->offset, entry->dataSize);
+		return DT_SUCCESS;
+	}
+
+	virtual bool requestTile(const int index, const dtTileStreamEntry* /*entry*/, unsigned char* data)
+	{
+		if (!async)
+			return false;
+		requests++;
+		pending = index;
+		pendingData = data;
+		return true;
+	}
+};
+
+static dtNavMesh* createStreamNavMesh()
+{
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	params.tileWidth = (float)GRID_SIZE;
+	params.tileHeight = (float)GRID_SIZE;
+	params.maxTiles = 8;
+	params.maxPolys = GRID_SIZE*GRID_SIZE;
+	dtNavMesh* nav = dtAllocNavMesh();
+	REQUIRE(nav != 0);
+	REQUIRE(dtStatusSucceed(nav->init(&params)));
+	return nav;
+}
+
+/// Builds a row of grid tiles along the x-axis into the loader, and their index entries.
+static void createStreamEntries(MemoryTileLoader* loader, dtTileStreamEntry* entries)
+{
+	unsigned char* datas[STREAM_TILES];
+	int totalSize = 0;
+	for (int i = 0; i < STREAM_TILES; ++i)
+	{
+		memset(&entries[i], 0, sizeof(dtTileStreamEntry));
+		createGridTileData(GRID_LAYOUT, GRID_SIZE, i, 0, 0, 0.0f, &datas[i], &entries[i].dataSize);
+		entries[i].x = i;
+		entries[i].offset = (unsigned int)totalSize;
+		totalSize += entries[i].dataSize;
+	}
+	loader->blob = (unsigned char*)dtAlloc(totalSize, DT_ALLOC_PERM);
+	REQUIRE(loader->blob != 0);
+	for (int i = 0; i < STREAM_TILES; ++i)
+	{
+		memcpy(loader->blob + entries[i].offset, datas[i], entries[i].dataSize);
+		dtFree(datas[i]);
+	}
+}
+
+/// Returns the reference of a polygon in the middle of the tile at x.
+static dtPolyRef getStreamPoly(const dtNavMesh* nav, const int x)
+{
+	float pos[3];
+	return getGridCell(nav, x*GRID_SIZE + 5, 4, pos);
+}
+
+TEST_CASE("dtTileStreamer")
+{
+	dtNavMesh* nav = createStreamNavMesh();
+	MemoryTileLoader loader;
+	dtTileStreamEntry entries[STREAM_TILES];
+	createStreamEntries(&loader, entries);
+
+	SECTION("Loads the touched tiles")
+	{
+		dtTileStreamer streamer;
+		REQUIRE(streamer.init(nav, entries, STREAM_TILES, &loader, 0) == DT_SUCCESS);
+		REQUIRE(streamer.getResidentCount() == 0);
+
+		const float bmin[3] = { 1.0f, 0.0f, 1.0f };
+		const float bmax[3] = { GRID_SIZE + 1.0f, 1.0f, 1.0f };
+		REQUIRE(streamer.touchArea(bmin, bmax) == DT_SUCCESS);
+		REQUIRE(streamer.getResidentCount() == 2);
+		REQUIRE(streamer.isResident(0));
+		REQUIRE(streamer.isResident(1));
+		REQUIRE(!streamer.isResident(2));
+		REQUIRE(streamer.getResidentBytes() > 0);
+
+		const dtPolyRef ref = getStreamPoly(nav, 1);
+		REQUIRE(ref != 0);
+		REQUIRE(streamer.getPolyRefStatus(ref) == DT_SUCCESS);
+
+		// Without a budget nothing is evicted.
+		streamer.update();
+		streamer.update();
+		REQUIRE(streamer.getResidentCount() == 2);
+	}
+
+	SECTION("Evicts the least recently used tiles over the budget and reloads them under the saved reference")
+	{
+		// Room for two tiles.
+		int twoTiles = 0;
+		{
+			dtNavMesh* measureNav = createStreamNavMesh();
+			dtTileStreamer measure;
+			REQUIRE(measure.init(measureNav, entries, STREAM_TILES, &loader, 0) == DT_SUCCESS);
+			REQUIRE(measure.touchTile(0, 0) == DT_SUCCESS);
+			REQUIRE(measure.touchTile(1, 0) == DT_SUCCESS);
+			twoTiles = measure.getResidentBytes();
+			dtFreeNavMesh(measureNav);
+		}
+		dtTileStreamer streamer;
+		REQUIRE(streamer.init(nav, entries, STREAM_TILES, &loader, twoTiles + twoTiles/4) == DT_SUCCESS);
+
+		REQUIRE(streamer.touchTile(0, 0) == DT_SUCCESS);
+		streamer.update();
+		REQUIRE(streamer.touchTile(1, 0) == DT_SUCCESS);
+		streamer.update();
+		REQUIRE(streamer.touchTile(2, 0) == DT_SUCCESS);
+		const dtPolyRef savedRef = getStreamPoly(nav, 0);
+		REQUIRE(nav->isValidPolyRef(savedRef));
+		streamer.update();
+
+		REQUIRE(streamer.getResidentCount() == 2);
+		REQUIRE(!streamer.isResident(0));
+		REQUIRE(streamer.isResident(1));
+		REQUIRE(streamer.isResident(2));
+		REQUIRE(streamer.getResidentBytes() <= streamer.getMemoryBudget());
+		REQUIRE(streamer.getPolyRefStatus(savedRef) == (DT_FAILURE | DT_TILE_NOT_RESIDENT));
+		const dtMeshTile* tile = 0;
+		const dtPoly* poly = 0;
+		REQUIRE(nav->getTileAndPolyByRef(savedRef, &tile, &poly) == (DT_FAILURE | DT_TILE_NOT_RESIDENT));
+
+		// The reload comes back with the same reference, and evicts the tile used least recently.
+		REQUIRE(streamer.touchPolyRef(savedRef) == DT_SUCCESS);
+		REQUIRE(nav->isValidPolyRef(savedRef));
+		REQUIRE(getStreamPoly(nav, 0) == savedRef);
+		REQUIRE(streamer.getPolyRefStatus(savedRef) == DT_SUCCESS);
+		streamer.update();
+		REQUIRE(streamer.isResident(0));
+		REQUIRE(!streamer.isResident(1));
+		REQUIRE(streamer.isResident(2));
+	}
+
+	SECTION("Does not evict the tiles used in the round")
+	{
+		dtTileStreamer streamer;
+		REQUIRE(streamer.init(nav, entries, STREAM_TILES, &loader, 1) == DT_SUCCESS);
+		for (int i = 0; i < STREAM_TILES; ++i)
+			REQUIRE(streamer.touchTile(i, 0) == DT_SUCCESS);
+		streamer.update();
+		REQUIRE(streamer.getResidentCount() == STREAM_TILES);
+
+		// Only the tile used in the next round stays, even though it alone is over the budget.
+		REQUIRE(streamer.touchTile(2, 0) == DT_SUCCESS);
+		streamer.update();
+		REQUIRE(streamer.getResidentCount() == 1);
+		REQUIRE(streamer.isResident(2));
+		REQUIRE(streamer.getResidentBytes() > streamer.getMemoryBudget());
+
+		streamer.update();
+		REQUIRE(streamer.getResidentCount() == 0);
+		REQUIRE(streamer.getResidentBytes() == 0);
+	}
+
+	SECTION("Keeps a tile resident when the navigation mesh fails to evict it")
+	{
+		dtTileStreamer streamer;
+		REQUIRE(streamer.init(nav, entries, STREAM_TILES, &loader, 1) == DT_SUCCESS);
+		REQUIRE(streamer.touchTile(0, 0) == DT_SUCCESS);
+		REQUIRE(streamer.touchTile(1, 0) == DT_SUCCESS);
+		const int residentBytes = streamer.getResidentBytes();
+
+		// The tile removed behind the back of the streamer cannot be evicted, the next one still is.
+		REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(0, 0, 0), 0, 0)));
+		streamer.update();
+		streamer.update();
+		REQUIRE(streamer.isResident(0));
+		REQUIRE(!streamer.isResident(1));
+		REQUIRE(streamer.getResidentCount() == 1);
+		REQUIRE(streamer.getResidentBytes() < residentBytes);
+		REQUIRE(streamer.getResidentBytes() > 0);
+	}
+
+	SECTION("Finishes the reads started in the background")
+	{
+		loader.async = true;
+		dtTileStreamer streamer;
+		REQUIRE(streamer.init(nav, entries, STREAM_TILES, &loader, 0) == DT_SUCCESS);
+
+		REQUIRE(streamer.touchTile(1, 0) == (DT_IN_PROGRESS | DT_TILE_NOT_RESIDENT));
+		REQUIRE(loader.requests == 1);
+		REQUIRE(loader.pending == 1);
+		REQUIRE(!streamer.isResident(1));
+		REQUIRE(nav->getTileAt(1, 0, 0) == 0);
+
+		// The pending read is not started again.
+		REQUIRE(streamer.touchTile(1, 0) == (DT_IN_PROGRESS | DT_TILE_NOT_RESIDENT));
+		REQUIRE(loader.requests == 1);
+
+		// A failed read leaves the tile evicted, and the next touch starts a new read.
+		REQUIRE(streamer.finishLoad(1, DT_FAILURE) == (DT_FAILURE | DT_TILE_NOT_RESIDENT));
+		REQUIRE(!streamer.isResident(1));
+		REQUIRE(streamer.touchTile(1, 0) == (DT_IN_PROGRESS | DT_TILE_NOT_RESIDENT));
+		REQUIRE(loader.requests == 2);
+
+		REQUIRE(loader.loadTile(streamer.getEntry(1), loader.pendingData) == DT_SUCCESS);
+		REQUIRE(streamer.finishLoad(1, DT_SUCCESS) == DT_SUCCESS);
+		REQUIRE(streamer.isResident(1));
+		REQUIRE(streamer.getResidentCount() == 1);
+		REQUIRE(nav->getTileAt(1, 0, 0) != 0);
+		REQUIRE(streamer.getPolyRefStatus(getStreamPoly(nav, 1)) == DT_SUCCESS);
+
+		REQUIRE(streamer.finishLoad(1, DT_SUCCESS) == (DT_FAILURE | DT_INVALID_PARAM));
+		REQUIRE(streamer.finishLoad(STREAM_TILES, DT_SUCCESS) == (DT_FAILURE | DT_INVALID_PARAM));
+	}
+
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtSaveTileStream")
+{
+	// Add the first tile twice, so that its reference is not the one of a new tile.
+	dtNavMesh* nav = createStreamNavMesh();
+	for (int i = 0; i < 3; ++i)
+	{
+		unsigned char* data = 0;
+		int dataSize = 0;
+		createGridTileData(GRID_LAYOUT, GRID_SIZE, i == 2 ? 1 : 0, 0, 0, 0.0f, &data, &dataSize);
+		REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, 0)));
+		if (i == 0)
+			REQUIRE(dtStatusSucceed(nav->removeTile(nav->getTileRefAt(0, 0, 0), 0, 0)));
+	}
+	const dtPolyRef refs[2] = { getStreamPoly(nav, 0), getStreamPoly(nav, 1) };
+	REQUIRE(nav->decodePolyIdSalt(refs[0]) != 1);
+
+	const char* path = "Tests_DetourTileStreamer.bin";
+	REQUIRE(dtSaveTileStream(path, nav) == DT_SUCCESS);
+
+	dtTileStreamFileLoader loader;
+	REQUIRE(loader.open(path) == DT_SUCCESS);
+	const dtTileStreamHeader* header = loader.getHeader();
+	REQUIRE(header->tileCount == 2);
+	REQUIRE(memcmp(&header->params, nav->getParams(), sizeof(dtNavMeshParams)) == 0);
+
+	dtNavMesh* loaded = dtAllocNavMesh();
+	REQUIRE(dtStatusSucceed(loaded->init(&header->params)));
+	dtTileStreamer streamer;
+	REQUIRE(streamer.init(loaded, loader.getEntries(), header->tileCount, &loader, 0) == DT_SUCCESS);
+	const float bmin[3] = { 0.0f, 0.0f, 0.0f };
+	const float bmax[3] = { 2.0f*GRID_SIZE - 1.0f, 1.0f, GRID_SIZE - 1.0f };
+	REQUIRE(streamer.touchArea(bmin, bmax) == DT_SUCCESS);
+	REQUIRE(streamer.getResidentCount() == 2);
+
+	// The tiles come back with the data and references they were saved with.
+	for (int i = 0; i < 2; ++i)
+	{
+		REQUIRE(loaded->isValidPolyRef(refs[i]));
+		REQUIRE(getStreamPoly(loaded, i) == refs[i]);
+		const dtMeshTile* tile = nav->getTileAt(i, 0, 0);
+		const dtMeshTile* loadedTile = loaded->getTileAt(i, 0, 0);
+		REQUIRE(loadedTile->dataSize == tile->dataSize);
+		REQUIRE(memcmp(loadedTile->data, tile->data, tile->dataSize) == 0);
+	}
+
+	loader.close();
+	remove(path);
+	dtFreeNavMesh(loaded);
+	dtFreeNavMesh(nav);
+}
@@ -0,0 +1,120 @@
+#include <string.h>
+
+#include "catch.hpp"
+
+#include "DetourCrowd.h"
+
+#include "Detour/Tests_DetourGrid.h"
+
+/// An open layout, the agents walk along the middle row and can go around any single cell.
+static const char* const CROWD_LAYOUT =
+	"........"
+	"........"
+	"........"
+	"........"
+	"........"
+	"........"
+	"........"
+	"........";
+
+static void initAgentParams(dtCrowdAgentParams* params)
+{
+	memset(params, 0, sizeof(dtCrowdAgentParams));
+	params->radius = 0.3f;
+	params->height = 2.0f;
+	params->maxAcceleration = 8.0f;
+	params->maxSpeed = 1.0f;
+	params->collisionQueryRange = params->radius * 12.0f;
+	params->pathOptimizationRange = params->radius * 30.0f;
+}
+
+static bool corridorContains(const dtCrowdAgent* ag, const dtPolyRef ref)
+{
+	for (int i = 0; i < ag->corridor.getPathCount(); ++i)
+	{
+		if (ag->corridor.getPath()[i] == ref)
+			return true;
+	}
+	return false;
+}
+
+TEST_CASE("dtCrowd::checkPathValidity")
+{
+	dtNavMesh* nav = createGridNavMesh(CROWD_LAYOUT, GRID_SIZE);
+	dtCrowd* crowd = dtAllocCrowd();
+	const int maxAgents = 16;
+	REQUIRE(crowd->init(maxAgents, 0.3f, nav));
+
+	float targetPos[3];
+	const dtPolyRef targetRef = getGridCell(nav, GRID_SIZE-1, 4, targetPos);
+	float closedPos[3];
+	const dtPolyRef closedRef = getGridCell(nav, 4, 4, closedPos);
+	REQUIRE(targetRef != 0);
+	REQUIRE(closedRef != 0);
+
+	dtCrowdAgentParams params;
+	initAgentParams(&params);
+	const float dt = 0.1f;
+
+	SECTION("Repairs the corridor of an agent when a polygon on its path is closed")
+	{
+		float pos[3];
+		getGridCell(nav, 0, 4, pos);
+		const int idx = crowd->addAgent(pos, &params);
+		REQUIRE(idx >= 0);
+		REQUIRE(crowd->requestMoveTarget(idx, targetRef, targetPos));
+		crowd->update(dt, 0);
+		crowd->update(dt, 0);
+
+		const dtCrowdAgent* ag = crowd->getAgent(idx);
+		REQUIRE(ag->targetState == DT_CROWDAGENT_TARGET_VALID);
+		REQUIRE(corridorContains(ag, closedRef));
+		const float replanTime = ag->targetReplanTime;
+		REQUIRE(replanTime > 0.0f);
+
+		REQUIRE(nav->setPolyFlags(closedRef, 0) == DT_SUCCESS);
+		crowd->update(dt, 0);
+
+		// A replan would have reset the replan time.
+		REQUIRE(ag->targetState == DT_CROWDAGENT_TARGET_VALID);
+		REQUIRE(ag->targetReplanTime > replanTime);
+		REQUIRE(!corridorContains(ag, closedRef));
+		REQUIRE(ag->corridor.getLastPoly() == targetRef);
+	}
+
+	SECTION("Replans the agents past the repair budget of an update")
+	{
+		for (int i = 0; i < maxAgents; ++i)
+		{
+			float pos[3];
+			getGridCell(nav, i % 3, 4, pos);
+			const int idx = crowd->addAgent(pos, &params);
+			REQUIRE(idx >= 0);
+			REQUIRE(crowd->requestMoveTarget(idx, targetRef, targetPos));
+		}
+		crowd->update(dt, 0);
+		crowd->update(dt, 0);
+		for (int i = 0; i < maxAgents; ++i)
+		{
+			REQUIRE(crowd->getAgent(i)->targetState == DT_CROWDAGENT_TARGET_VALID);
+			REQUIRE(corridorContains(crowd->getAgent(i), closedRef));
+		}
+
+		REQUIRE(nav->setPolyFlags(closedRef, 0) == DT_SUCCESS);
+		crowd->update(dt, 0);
+
+		int nrepaired = 0;
+		for (int i = 0; i < maxAgents; ++i)
+		{
+			const dtCrowdAgent* ag = crowd->getAgent(i);
+			REQUIRE(!corridorContains(ag, closedRef));
+			if (ag->targetState == DT_CROWDAGENT_TARGET_VALID && ag->targetReplanTime > 0.0f)
+				nrepaired++;
+		}
+		REQUIRE(nrepaired > 0);
+		REQUIRE(nrepaired < maxAgents);
+	}
+
+	dtFreeCrowd(crowd);
+	dtFreeNavMesh(nav);
+}
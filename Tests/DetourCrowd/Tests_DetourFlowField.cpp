@@ -0,0 +1,250 @@
+#include <string.h>
+
+#include "catch.hpp"
+
+#include "DetourFlowField.h"
+
+#include "Detour/Tests_DetourGrid.h"
+
+/// Builds a navigation mesh of two grid tiles side by side along the x-axis.
+static dtNavMesh* createTwoTileNavMesh(dtTileRef* tileRefs)
+{
+	dtNavMeshParams params;
+	memset(&params, 0, sizeof(params));
+	params.tileWidth = (float)GRID_SIZE;
+	params.tileHeight = (float)GRID_SIZE;
+	params.maxTiles = 4;
+	params.maxPolys = GRID_SIZE*GRID_SIZE;
+	dtNavMesh* nav = dtAllocNavMesh();
+	REQUIRE(nav != 0);
+	REQUIRE(dtStatusSucceed(nav->init(&params)));
+	for (int tx = 0; tx < 2; ++tx)
+	{
+		unsigned char* data = 0;
+		int dataSize = 0;
+		createGridTileData(GRID_LAYOUT, GRID_SIZE, tx, 0, 0, 0.0f, &data, &dataSize);
+		REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, &tileRefs[tx])));
+	}
+	return nav;
+}
+
+TEST_CASE("dtFlowField")
+{
+	dtNavMesh* nav = createGridNavMesh(GRID_LAYOUT, GRID_SIZE);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+
+	dtQueryFilter filter;
+	filter.setAreaCost(1, 4.0f);
+
+	float goalPos[3];
+	const dtPolyRef goalRef = getGridCell(nav, 5, 4, goalPos);
+	REQUIRE(goalRef != 0);
+
+	dtFlowField field;
+	REQUIRE(field.init(nav, 256, 4));
+	REQUIRE(field.setGoal(goalRef, goalPos, 0.0f, &filter) == DT_IN_PROGRESS);
+
+	// Settle a few polygons at a time, the ones nearest the goal are available first.
+	int iters = 0;
+	while (dtStatusInProgress(field.update(4, &iters)))
+		REQUIRE(iters == 4);
+	REQUIRE(field.getStatus() == DT_SUCCESS);
+	REQUIRE(field.isValid());
+
+	SECTION("Stores the cost to go and the next polygon towards the goal")
+	{
+		const int maxPath = 64;
+		dtPolyRef path[maxPath];
+		for (int i = 0; i < GRID_SIZE*GRID_SIZE; ++i)
+		{
+			float pos[3];
+			const dtPolyRef ref = getGridCell(nav, i % GRID_SIZE, i / GRID_SIZE, pos);
+			if (!ref)
+				continue;
+
+			float target[3];
+			dtPolyRef nextRef = 0;
+			float cost = 0.0f;
+			REQUIRE(field.getFlowTarget(ref, target, &nextRef, &cost) == DT_SUCCESS);
+
+			// Every polygon of the layout can reach the goal.
+			int npath = 0;
+			REQUIRE(query->findPath(ref, goalRef, target, goalPos, &filter, path, &npath, maxPath) == DT_SUCCESS);
+			REQUIRE(path[npath-1] == goalRef);
+
+			if (ref == goalRef)
+			{
+				REQUIRE(nextRef == 0);
+				REQUIRE(cost == 0.0f);
+				REQUIRE(dtVdist(target, goalPos) == Approx(0.0f));
+				continue;
+			}
+
+			// The cost is the cost of the next polygon plus crossing it.
+			float nextTarget[3];
+			float nextCost = 0.0f;
+			REQUIRE(field.getFlowTarget(nextRef, nextTarget, 0, &nextCost) == DT_SUCCESS);
+			unsigned char area = 0;
+			REQUIRE(nav->getPolyArea(nextRef, &area) == DT_SUCCESS);
+			REQUIRE(cost == Approx(nextCost + dtVdist(target, nextTarget) * filter.getAreaCost(area)));
+			REQUIRE(nextCost < cost);
+		}
+	}
+
+	SECTION("Steers towards the goal")
+	{
+		const int maxVisited = 16;
+		dtPolyRef visited[maxVisited];
+		for (int i = 0; i < GRID_SIZE*GRID_SIZE; ++i)
+		{
+			float pos[3];
+			dtPolyRef ref = getGridCell(nav, i % GRID_SIZE, i / GRID_SIZE, pos);
+			if (!ref)
+				continue;
+
+			bool reached = ref == goalRef;
+			for (int step = 0; step < 200 && !reached; ++step)
+			{
+				float dir[3];
+				REQUIRE(field.getFlowDirection(ref, pos, dir) == DT_SUCCESS);
+				REQUIRE(dir[1] == 0.0f);
+				if (dtVlenSqr(dir) == 0.0f)
+					break;
+				REQUIRE(dtVlen(dir) == Approx(1.0f));
+
+				float target[3];
+				REQUIRE(field.getFlowTarget(ref, target, 0, 0) == DT_SUCCESS);
+				float toTarget[3];
+				dtVsub(toTarget, target, pos);
+				toTarget[1] = 0.0f;
+				if (dtVlen(toTarget) > 0.01f)
+					REQUIRE(dtVdot(dir, toTarget) > 0.0f);
+
+				float end[3];
+				dtVmad(end, pos, dir, 0.25f);
+				int nvisited = 0;
+				REQUIRE(dtStatusSucceed(query->moveAlongSurface(ref, pos, end, &filter, pos, visited, &nvisited, maxVisited)));
+				REQUIRE(nvisited > 0);
+				ref = visited[nvisited-1];
+				reached = ref == goalRef && dtVdist2D(pos, goalPos) < 0.3f;
+			}
+			REQUIRE(reached);
+		}
+	}
+
+	SECTION("Fails once a polygon in the field changes")
+	{
+		float pos[3];
+		const dtPolyRef ref = getGridCell(nav, 0, 0, pos);
+		float target[3];
+		REQUIRE(nav->setPolyFlags(ref, 0) == DT_SUCCESS);
+		REQUIRE(!field.isValid());
+		REQUIRE(dtStatusFailed(field.getFlowTarget(ref, target, 0, 0)));
+		REQUIRE(dtStatusFailed(field.getFlowDirection(goalRef, pos, target)));
+	}
+
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}
+
+TEST_CASE("dtFlowFieldCache")
+{
+	dtTileRef tileRefs[2];
+	dtNavMesh* nav = createTwoTileNavMesh(tileRefs);
+	dtQueryFilter filter;
+
+	float goalPos[3];
+	const dtPolyRef goalRef = getGridCell(nav, 5, 4, goalPos);
+	REQUIRE(goalRef != 0);
+	// A polygon of the second tile, reached through the tile border.
+	float farPos[3];
+	const dtPolyRef farRef = getGridCell(nav, GRID_SIZE + 2, 4, farPos);
+	REQUIRE(farRef != 0);
+
+	dtFlowFieldCache cache;
+	REQUIRE(cache.init(2, 256, 4, nav));
+	dtFlowField* field = cache.request(goalRef, goalPos, 0.0f, &filter);
+	REQUIRE(field != 0);
+	cache.update(1000);
+	REQUIRE(field->getStatus() == DT_SUCCESS);
+
+	float target[3];
+	REQUIRE(field->getFlowTarget(farRef, target, 0, 0) == DT_SUCCESS);
+
+	SECTION("Shares the field of a goal and replaces the least recently used field")
+	{
+		REQUIRE(cache.request(goalRef, goalPos, 0.0f, &filter) == field);
+
+		float otherPos[3];
+		const dtPolyRef otherRef = getGridCell(nav, 0, 0, otherPos);
+		float thirdPos[3];
+		const dtPolyRef thirdRef = getGridCell(nav, 7, 7, thirdPos);
+		dtFlowField* other = cache.request(otherRef, otherPos, 0.0f, &filter);
+		REQUIRE(other != 0);
+		REQUIRE(other != field);
+		REQUIRE(cache.request(goalRef, goalPos, 0.0f, &filter) == field);
+
+		REQUIRE(cache.request(thirdRef, thirdPos, 0.0f, &filter) == other);
+		REQUIRE(other->getGoalRef() == thirdRef);
+		REQUIRE(field->getGoalRef() == goalRef);
+	}
+
+	SECTION("Restarts the field when a polygon flag changes")
+	{
+		// Close the polygon the far polygon flows through.
+		dtPolyRef nextRef = 0;
+		REQUIRE(field->getFlowTarget(farRef, target, &nextRef, 0) == DT_SUCCESS);
+		REQUIRE(nextRef != 0);
+		REQUIRE(nav->setPolyFlags(nextRef, 0) == DT_SUCCESS);
+		REQUIRE(!field->isValid());
+		REQUIRE(dtStatusFailed(field->getFlowTarget(farRef, target, 0, 0)));
+
+		cache.update(1000);
+		REQUIRE(field->isValid());
+		REQUIRE(field->getStatus() == DT_SUCCESS);
+		REQUIRE(field->getGoalRef() == goalRef);
+		REQUIRE(field->getFlowTarget(nextRef, target, 0, 0) == (DT_FAILURE | DT_INVALID_PARAM));
+		dtPolyRef newNextRef = 0;
+		REQUIRE(field->getFlowTarget(farRef, target, &newNextRef, 0) == DT_SUCCESS);
+		REQUIRE(newNextRef != nextRef);
+	}
+
+	SECTION("Restarts the field when a tile is removed or added")
+	{
+		unsigned char* data = 0;
+		int dataSize = 0;
+		REQUIRE(dtStatusSucceed(nav->removeTile(tileRefs[1], &data, &dataSize)));
+		REQUIRE(!field->isValid());
+
+		// The field now only covers the first tile.
+		cache.update(1000);
+		REQUIRE(field->isValid());
+		REQUIRE(field->getStatus() == DT_SUCCESS);
+		REQUIRE(dtStatusFailed(field->getFlowTarget(farRef, target, 0, 0)));
+
+		// A tile added next to the field links to it, and opens new polygons to the field.
+		createGridTileData(GRID_LAYOUT, GRID_SIZE, 1, 0, 0, 0.0f, &data, &dataSize);
+		dtTileRef newRef = 0;
+		REQUIRE(dtStatusSucceed(nav->addTile(data, dataSize, DT_TILE_FREE_DATA, 0, &newRef)));
+		REQUIRE(!field->isValid());
+
+		cache.update(1000);
+		REQUIRE(field->isValid());
+		float newFarPos[3];
+		const dtPolyRef newFarRef = getGridCell(nav, GRID_SIZE + 2, 4, newFarPos);
+		REQUIRE(field->getFlowTarget(newFarRef, target, 0, 0) == DT_SUCCESS);
+	}
+
+	SECTION("Drops the field when the goal is removed")
+	{
+		unsigned char* data = 0;
+		int dataSize = 0;
+		REQUIRE(dtStatusSucceed(nav->removeTile(tileRefs[0], &data, &dataSize)));
+		cache.update(1000);
+		REQUIRE(field->getGoalRef() == 0);
+		REQUIRE(dtStatusFailed(field->getFlowTarget(farRef, target, 0, 0)));
+	}
+
+	dtFreeNavMesh(nav);
+}
@@ -0,0 +1,68 @@
+#include <string.h>
+
+#include "catch.hpp"
+
+#include "DetourPathCorridor.h"
+
+TEST_CASE("dtMergeCorridorDetour")
+{
+	// Polygon 3 at index 2 is invalid, the detour leaves from polygon 2 at index 1.
+	dtPolyRef path[8] = { 1, 2, 3, 4, 5, 6 };
+	const int npath = 6;
+
+	SECTION("Splices a detour which rejoins the path after the invalid section")
+	{
+		const dtPolyRef detour[] = { 2, 10, 11, 5 };
+		const dtPolyRef expected[] = { 1, 2, 10, 11, 5, 6 };
+		const int n = dtMergeCorridorDetour(path, npath, 8, 1, detour, 4);
+		REQUIRE(n == 6);
+		REQUIRE(memcmp(path, expected, sizeof(expected)) == 0);
+	}
+
+	SECTION("Rejoins the path at the first detour polygon found on it")
+	{
+		// The detour passes polygon 4 right after the invalid polygon, then wanders past 6.
+		const dtPolyRef detour[] = { 2, 10, 4, 11, 6 };
+		const dtPolyRef expected[] = { 1, 2, 10, 4, 5, 6 };
+		const int n = dtMergeCorridorDetour(path, npath, 8, 1, detour, 5);
+		REQUIRE(n == 6);
+		REQUIRE(memcmp(path, expected, sizeof(expected)) == 0);
+	}
+
+	SECTION("Removes the polygons the detour backtracks through")
+	{
+		// Polygon 4 is invalid, the detour leaves from polygon 3 but walks back to polygon 2.
+		const dtPolyRef detour[] = { 3, 2, 20, 5 };
+		const dtPolyRef expected[] = { 1, 2, 20, 5, 6 };
+		const int n = dtMergeCorridorDetour(path, npath, 8, 2, detour, 4);
+		REQUIRE(n == 5);
+		REQUIRE(memcmp(path, expected, sizeof(expected)) == 0);
+	}
+
+	SECTION("Truncates the path to maxPath")
+	{
+		const dtPolyRef detour[] = { 2, 10, 11, 12, 13, 4 };
+		const dtPolyRef expected[] = { 1, 2, 10, 11, 12, 13, 4, 5 };
+		const int n = dtMergeCorridorDetour(path, npath, 8, 1, detour, 6);
+		REQUIRE(n == 8);
+		REQUIRE(memcmp(path, expected, sizeof(expected)) == 0);
+	}
+
+	SECTION("Truncates the detour to maxPath")
+	{
+		const dtPolyRef detour[] = { 2, 10, 11, 12, 13, 14, 15, 16, 4 };
+		const dtPolyRef expected[] = { 1, 2, 10, 11, 12, 13, 14, 15 };
+		const int n = dtMergeCorridorDetour(path, npath, 8, 1, detour, 9);
+		REQUIRE(n == 8);
+		REQUIRE(memcmp(path, expected, sizeof(expected)) == 0);
+	}
+
+	SECTION("Keeps the path if the detour does not rejoin it")
+	{
+		const dtPolyRef detour[] = { 2, 10, 11 };
+		const dtPolyRef expected[] = { 1, 2, 3, 4, 5, 6 };
+		const int n = dtMergeCorridorDetour(path, npath, 8, 1, detour, 3);
+		REQUIRE(n == npath);
+		REQUIRE(memcmp(path, expected, sizeof(expected)) == 0);
+	}
+}
@@ -0,0 +1,67 @@
+#include <string.h>
+
+#include "catch.hpp"
+
+#include "DetourPathQueue.h"
+
+#include "Detour/Tests_DetourGrid.h"
+#include "Detour/Tests_DetourClock.h"
+
+TEST_CASE("dtPathQueue::updateTimed")
+{
+	dtNavMesh* nav = createGridNavMesh(GRID_LAYOUT, GRID_SIZE);
+	dtNavMeshQuery* query = dtAllocNavMeshQuery();
+	REQUIRE(dtStatusSucceed(query->init(nav, 256)));
+	dtQueryFilter filter;
+	const int maxPath = 64;
+	dtPolyRef path[maxPath];
+	dtPolyRef expectedPath[maxPath];
+
+	float startPos[3];
+	float endPos[3];
+	const dtPolyRef startRef = getGridCell(nav, 0, 0, startPos);
+	const dtPolyRef endRef = getGridCell(nav, 7, 7, endPos);
+	int nexpected = 0;
+	REQUIRE(query->findPath(startRef, endRef, startPos, endPos, &filter, expectedPath, &nexpected, maxPath) == DT_SUCCESS);
+
+	dtPathQueue queue;
+	REQUIRE(queue.init(maxPath, 256, nav));
+	const dtPathQueueRef ref = queue.request(startRef, endRef, startPos, endPos, &filter);
+	REQUIRE(ref != DT_PATHQ_INVALID);
+	REQUIRE(queue.getItersPerUsec() == 0.0f);
+
+	SECTION("Stops at the deadline and reports the iteration rate")
+	{
+		// The clock is read for the deadline, at the start, before the search and every 8
+		// iterations of it, and at the end. The read after 8 iterations is past the deadline,
+		// and the update took 4 reads from its start.
+		setFakeClock(1000, 1000);
+		queue.updateTimed(2500);
+		REQUIRE(queue.getRequestStatus(ref) == DT_IN_PROGRESS);
+		REQUIRE(queue.getItersPerUsec() == Approx(2.0f));
+
+		for (int i = 0; i < 100 && dtStatusInProgress(queue.getRequestStatus(ref)); ++i)
+			queue.updateTimed(2500);
+	}
+
+	SECTION("Advances the head request when the budget is used")
+	{
+		setFakeClock(1000, 1000);
+		queue.updateTimed(0);
+		REQUIRE(queue.getRequestStatus(ref) == DT_IN_PROGRESS);
+		REQUIRE(queue.getItersPerUsec() == Approx(2.0f));
+
+		for (int i = 0; i < 100 && dtStatusInProgress(queue.getRequestStatus(ref)); ++i)
+			queue.updateTimed(0);
+	}
+
+	REQUIRE(queue.getRequestStatus(ref) == DT_SUCCESS);
+	int npath = 0;
+	REQUIRE(queue.getPathResult(ref, path, &npath, maxPath) == DT_SUCCESS);
+	REQUIRE(npath == nexpected);
+	REQUIRE(memcmp(path, expectedPath, sizeof(dtPolyRef)*npath) == 0);
+
+	dtTimeSetCustom(0);
+	dtFreeNavMeshQuery(query);
+	dtFreeNavMesh(nav);
+}